@@ -683,22 +683,19 @@ static NSString* _StringFromRepositoryState(GCRepositoryState state) {
           if ([localTip isEqualToCommit:upstreamTip]) {
             _infoTextField2.stringValue = NSLocalizedString(@"Up-to-date", nil);
           } else {
-            GCCommit* commit = [_repository findMergeBaseForCommits:@[ localTip, upstreamTip ] error:NULL];
-            GCHistoryCommit* ancestor = commit ? [_repository.history historyCommitForCommit:commit] : nil;
-            if (ancestor) {
-              if ([ancestor isEqualToCommit:localTip]) {
-                NSUInteger count = [_repository.history countAncestorCommitsFromCommit:upstreamTip toCommit:localTip];
-                _infoTextField2.stringValue = [NSString stringWithFormat:NSLocalizedString(@" %@ behind", nil), _FormatCommitCount(_numberFormatter, count)];
-                isBehind = YES;
-              } else if ([ancestor isEqualToCommit:upstreamTip]) {
-                NSUInteger count = [_repository.history countAncestorCommitsFromCommit:localTip toCommit:upstreamTip];
-                _infoTextField2.stringValue = [NSString stringWithFormat:NSLocalizedString(@" %@ ahead", nil), _FormatCommitCount(_numberFormatter, count)];
-              } else {
-                NSUInteger count1 = [_repository.history countAncestorCommitsFromCommit:localTip toCommit:ancestor];
-                NSUInteger count2 = [_repository.history countAncestorCommitsFromCommit:upstreamTip toCommit:ancestor];
-                _infoTextField2.stringValue = [NSString stringWithFormat:NSLocalizedString(@" %@ ahead, %@ behind", nil), _FormatCommitCount(_numberFormatter, count1), _FormatCommitCount(_numberFormatter, count2)];
-                isBehind = YES;
-              }
+            NSUInteger ahead;
+            NSUInteger behind;
+            [_repository.history countAheadCommits:&ahead behindCommits:&behind forLocalBranch:branch];
+            if ((ahead == NSNotFound) || (behind == NSNotFound)) {
+              _infoTextField2.stringValue = @"";
+            } else if (ahead && behind) {
+              _infoTextField2.stringValue = [NSString stringWithFormat:NSLocalizedString(@" %@ ahead, %@ behind", nil), _FormatCommitCount(_numberFormatter, ahead), _FormatCommitCount(_numberFormatter, behind)];
+              isBehind = YES;
+            } else if (behind) {
+              _infoTextField2.stringValue = [NSString stringWithFormat:NSLocalizedString(@" %@ behind", nil), _FormatCommitCount(_numberFormatter, behind)];
+              isBehind = YES;
+            } else if (ahead) {
+              _infoTextField2.stringValue = [NSString stringWithFormat:NSLocalizedString(@" %@ ahead", nil), _FormatCommitCount(_numberFormatter, ahead)];
             } else {
               _infoTextField2.stringValue = @"";
               XLOG_DEBUG_UNREACHABLE();
@@ -41,6 +41,7 @@ extern NSString* const GIDiffContentsViewControllerUserDefaultKey_DiffViewMode;
 @property(nonatomic, readonly) NSArray* deltas;
 @property(nonatomic, readonly) NSDictionary* conflicts;
 - (void)setDeltas:(NSArray*)deltas usingConflicts:(NSDictionary*)conflicts;
+- (void)setDeltas:(NSArray*)deltas usingConflicts:(NSDictionary*)conflicts changes:(GCDiffChangeSet*)changes;  // Pass the changes from the current deltas to only regenerate the patches and update the rows that changed
 
 - (GCDiffDelta*)topVisibleDelta:(CGFloat*)offset;
 - (void)setTopVisibleDelta:(GCDiffDelta*)delta offset:(CGFloat)offset;
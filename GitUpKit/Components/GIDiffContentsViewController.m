@@ -307,15 +307,37 @@ static NSImage* _untrackedImage = nil;
 }
 
 - (void)setDeltas:(NSArray*)deltas usingConflicts:(NSDictionary*)conflicts {
+  [self setDeltas:deltas usingConflicts:conflicts changes:nil];
+}
+
+- (void)setDeltas:(NSArray*)deltas usingConflicts:(NSDictionary*)conflicts changes:(GCDiffChangeSet*)changes {
   if ((deltas != _deltas) || (conflicts != _conflicts)) {
+    if (conflicts.count || _conflicts.count) {  // Patches are never reused for conflicts
+      changes = nil;
+    }
     _deltas = deltas;
     _conflicts = conflicts;
-    [self _reloadDeltas];
+    [self _reloadDeltasWithChanges:changes];
   }
 }
 
-- (void)_reloadDeltas {
+static NSIndexSet* _RowsForDeltaIndexes(NSIndexSet* indexes, NSUInteger firstRow) {
+  NSMutableIndexSet* rows = [[NSMutableIndexSet alloc] init];
+  [indexes enumerateIndexesUsingBlock:^(NSUInteger index, BOOL* stop) {
+    [rows addIndexesInRange:NSMakeRange(firstRow + 2 * index, 2)];
+  }];
+  return rows;
+}
+
+// Changes let unchanged deltas reuse their patches without comparing them and let the table view only update the rows that changed
+- (void)_reloadDeltasWithChanges:(GCDiffChangeSet*)changes {
   BOOL flashScrollers = NO;
+  NSIndexSet* removedIndexes;
+  NSIndexSet* insertedIndexes;
+  NSIndexSet* modifiedIndexes;
+  if (changes && !(_data.count && _deltas.count && [changes getRemovedIndexes:&removedIndexes insertedIndexes:&insertedIndexes modifiedIndexes:&modifiedIndexes fromDeltas:[_data valueForKey:@"delta"] toDeltas:_deltas])) {
+    changes = nil;  // Changes are not from the current deltas
+  }
 
   if (_deltas.count) {
     CFMutableDictionaryRef cache = NULL;
@@ -334,11 +356,18 @@ static NSImage* _untrackedImage = nil;
       GCIndexConflict* conflict = [_conflicts objectForKey:delta.canonicalPath];
       GIDiffContentData* data = nil;
       if (cache) {
-        GIDiffContentData* oldData = CFDictionaryGetValue(cache, (__bridge const void*)delta.canonicalPath);
-        if (!conflict && !oldData.conflict && [oldData.delta isEqualToDelta:delta]) {  // Ignore cache for conflicts
-          data = oldData;
+        GIDiffContentData* cachedData = CFDictionaryGetValue(cache, (__bridge const void*)delta.canonicalPath);
+        if (!conflict && !cachedData.conflict) {  // Ignore cache for conflicts
+          if (changes) {
+            NSString* path = delta.canonicalPath;
+            if (cachedData && !changes.modifiedDeltas[path] && !changes.insertedDeltas[path]) {
+              data = cachedData;
+            }
+          } else if ([cachedData.delta isEqualToDelta:delta]) {
+            data = cachedData;
+          }
         }
-        if (!oldData) {
+        if (!cachedData) {
           flashScrollers = YES;
         }
       }
@@ -385,7 +414,18 @@ static NSImage* _untrackedImage = nil;
   } else {
     _data = nil;
   }
-  [_tableView reloadData];
+  if (changes) {
+    NSUInteger firstRow = _headerView ? 1 : 0;
+    NSIndexSet* modifiedRows = _RowsForDeltaIndexes(modifiedIndexes, firstRow);
+    [_tableView beginUpdates];
+    [_tableView removeRowsAtIndexes:_RowsForDeltaIndexes(removedIndexes, firstRow) withAnimation:NSTableViewAnimationEffectNone];
+    [_tableView insertRowsAtIndexes:_RowsForDeltaIndexes(insertedIndexes, firstRow) withAnimation:NSTableViewAnimationEffectNone];
+    [_tableView endUpdates];
+    [_tableView reloadDataForRowIndexes:modifiedRows columnIndexes:[NSIndexSet indexSetWithIndexesInRange:NSMakeRange(0, _tableView.numberOfColumns)]];
+    [_tableView noteHeightOfRowsWithIndexesChanged:modifiedRows];
+  } else {
+    [_tableView reloadData];
+  }
 
   _emptyTextField.hidden = _data.count ? YES : NO;
 
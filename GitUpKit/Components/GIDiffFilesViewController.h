@@ -39,6 +39,7 @@
 @property(nonatomic, readonly) NSArray* deltas;
 @property(nonatomic, readonly) NSDictionary* conflicts;
 - (void)setDeltas:(NSArray*)deltas usingConflicts:(NSDictionary*)conflicts;
+- (void)setDeltas:(NSArray*)deltas usingConflicts:(NSDictionary*)conflicts changes:(GCDiffChangeSet*)changes;  // Pass the changes from the current deltas to only update the rows that changed
 
 @property(nonatomic, weak) GCDiffDelta* selectedDelta;
 @property(nonatomic, weak) NSArray* selectedDeltas;
@@ -104,7 +104,13 @@ static NSImage* _untrackedImage = nil;
 }
 
 - (void)setDeltas:(NSArray*)deltas usingConflicts:(NSDictionary*)conflicts {
+  [self setDeltas:deltas usingConflicts:conflicts changes:nil];
+}
+
+- (void)setDeltas:(NSArray*)deltas usingConflicts:(NSDictionary*)conflicts changes:(GCDiffChangeSet*)changes {
   if ((deltas != _deltas) || (conflicts != _conflicts)) {
+    NSArray* oldDeltas = _deltas;
+    BOOL conflictsChanged = (conflicts.count || _conflicts.count) && ![conflicts isEqualToDictionary:_conflicts];  // Conflicts affect the sorting and the icons of all rows
     _conflicts = [conflicts copy];
     // Sort deltas with conflicts first
     if (deltas && conflicts.count) {
@@ -121,10 +127,28 @@ static NSImage* _untrackedImage = nil;
     } else {
       _deltas = [deltas copy];
     }
-    [self _reloadDeltas];
+    NSIndexSet* removedIndexes;
+    NSIndexSet* insertedIndexes;
+    NSIndexSet* modifiedIndexes;
+    if (changes && oldDeltas.count && !conflictsChanged && [changes getRemovedIndexes:&removedIndexes insertedIndexes:&insertedIndexes modifiedIndexes:&modifiedIndexes fromDeltas:oldDeltas toDeltas:_deltas]) {
+      [self _updateDeltasRemovingRows:removedIndexes insertingRows:insertedIndexes reloadingRows:modifiedIndexes];
+    } else {
+      [self _reloadDeltas];
+    }
   }
 }
 
+// Unlike -reloadData, this preserves the selection and the scrolling position of the rows that did not change
+- (void)_updateDeltasRemovingRows:(NSIndexSet*)removedRows insertingRows:(NSIndexSet*)insertedRows reloadingRows:(NSIndexSet*)modifiedRows {
+  [_tableView beginUpdates];
+  [_tableView removeRowsAtIndexes:removedRows withAnimation:NSTableViewAnimationEffectNone];
+  [_tableView insertRowsAtIndexes:insertedRows withAnimation:NSTableViewAnimationEffectNone];
+  [_tableView endUpdates];
+  [_tableView reloadDataForRowIndexes:modifiedRows columnIndexes:[NSIndexSet indexSetWithIndexesInRange:NSMakeRange(0, _tableView.numberOfColumns)]];
+
+  _emptyTextField.hidden = self.deltas.count ? YES : NO;
+}
+
 - (void)_reloadDeltas {
   [_tableView reloadData];
 
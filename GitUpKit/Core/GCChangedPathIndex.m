@@ -0,0 +1,391 @@
+//  Copyright (C) 2015-2019 Pierre-Olivier Latour <info@pol-online.net>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#if !__has_feature(objc_arc)
+#error This file requires ARC
+#endif
+
+#import "GCPrivate.h"
+
+// Filters follow the parameters used by Git for its changed-path Bloom filters
+#define kMagic 0x49504347  // "GCPI"
+#define kVersion 2
+#define kHashCount 7
+#define kBitsPerEntry 10
+#define kMaxChangedPaths 512  // Commits with more changed paths get an empty filter which always matches
+#define kMaxTips 16
+#define kHashSeed1 0x293ae76f
+#define kHashSeed2 0x7e646e2c
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t count;
+  uint32_t tipCount;
+} Header;
+
+// Layout: header, filter words, filter offsets (in words), OIDs sorted for binary search and tips (all their ancestors are in the index)
+static BOOL _ParseIndex(NSData* data, uint32_t* count, const uint64_t** words, const uint32_t** offsets, const git_oid** oids, uint32_t* tipCount, const git_oid** tips) {
+  const unsigned char* bytes = data.bytes;
+  NSUInteger length = data.length;
+  if (length < sizeof(Header)) {
+    return NO;
+  }
+  const Header* header = (const Header*)bytes;
+  if ((header->magic != kMagic) || (header->version != kVersion)) {
+    return NO;
+  }
+  uint64_t tailLength = ((uint64_t)header->count + 1) * sizeof(uint32_t) + ((uint64_t)header->count + header->tipCount) * sizeof(git_oid);
+  if ((length < sizeof(Header) + tailLength) || ((length - sizeof(Header) - tailLength) % sizeof(uint64_t))) {
+    return NO;
+  }
+  uint64_t wordCount = (length - sizeof(Header) - tailLength) / sizeof(uint64_t);
+  *count = header->count;
+  *words = (const uint64_t*)(bytes + sizeof(Header));
+  *offsets = (const uint32_t*)(*words + wordCount);
+  *oids = (const git_oid*)(*offsets + header->count + 1);
+  *tipCount = header->tipCount;
+  *tips = *oids + header->count;
+  if (((*offsets)[0] != 0) || ((*offsets)[header->count] != wordCount)) {
+    return NO;
+  }
+  for (uint32_t i = 0; i < header->count; ++i) {
+    if (((*offsets)[i] > (*offsets)[i + 1]) || (i && (git_oid_cmp(&(*oids)[i - 1], &(*oids)[i]) >= 0))) {
+      return NO;
+    }
+  }
+  return YES;
+}
+
+// MurmurHash3 (x86 32 bits variant)
+static uint32_t _Hash(uint32_t seed, const char* data, size_t length) {
+  const uint32_t c1 = 0xcc9e2d51;
+  const uint32_t c2 = 0x1b873593;
+  uint32_t hash = seed;
+  size_t blockCount = length / 4;
+  for (size_t i = 0; i < blockCount; ++i) {
+    uint32_t k;
+    memcpy(&k, data + i * 4, sizeof(uint32_t));
+    k *= c1;
+    k = (k << 15) | (k >> 17);
+    k *= c2;
+    hash ^= k;
+    hash = (hash << 13) | (hash >> 19);
+    hash = hash * 5 + 0xe6546b64;
+  }
+  const unsigned char* tail = (const unsigned char*)data + blockCount * 4;
+  uint32_t k = 0;
+  switch (length & 3) {
+    case 3:
+      k ^= tail[2] << 16;
+      __attribute__((fallthrough));
+    case 2:
+      k ^= tail[1] << 8;
+      __attribute__((fallthrough));
+    case 1:
+      k ^= tail[0];
+      k *= c1;
+      k = (k << 15) | (k >> 17);
+      k *= c2;
+      hash ^= k;
+  }
+  hash ^= (uint32_t)length;
+  hash ^= hash >> 16;
+  hash *= 0x85ebca6b;
+  hash ^= hash >> 13;
+  hash *= 0xc2b2ae35;
+  hash ^= hash >> 16;
+  return hash;
+}
+
+static inline void _ComputeHashes(const char* path, uint32_t* hashes) {
+  size_t length = strlen(path);
+  uint32_t hash1 = _Hash(kHashSeed1, path, length);
+  uint32_t hash2 = _Hash(kHashSeed2, path, length);
+  for (NSUInteger i = 0; i < kHashCount; ++i) {
+    hashes[i] = hash1 + (uint32_t)i * hash2;
+  }
+}
+
+static BOOL _FilterContainsPath(const uint64_t* words, NSUInteger wordCount, const char* path) {
+  if (wordCount == 0) {
+    return YES;
+  }
+  uint32_t hashes[kHashCount];
+  _ComputeHashes(path, hashes);
+  uint64_t bitCount = (uint64_t)wordCount * 64;
+  for (NSUInteger i = 0; i < kHashCount; ++i) {
+    uint64_t bit = hashes[i] % bitCount;
+    if (!(words[bit / 64] & ((uint64_t)1 << (bit % 64)))) {
+      return NO;
+    }
+  }
+  return YES;
+}
+
+// Paths changed compared to any of the parents since file history matches commits that differ from any of their parents
+static NSData* _ComputeFilter(git_commit* commit) {
+  git_repository* repository = git_commit_owner(commit);
+  NSMutableSet* paths = [[NSMutableSet alloc] init];
+  git_tree* tree = NULL;
+  int status = git_commit_tree(&tree, commit);
+  unsigned int parentCount = git_commit_parentcount(commit);
+  for (unsigned int i = 0; (status == GIT_OK) && (i < MAX(parentCount, 1)) && (paths.count <= kMaxChangedPaths); ++i) {
+    git_commit* parentCommit = NULL;
+    git_tree* parentTree = NULL;  // Root commits are compared to the empty tree
+    git_diff* diff = NULL;
+    if (parentCount) {
+      status = git_commit_parent(&parentCommit, commit, i);
+      if (status == GIT_OK) {
+        status = git_commit_tree(&parentTree, parentCommit);
+      }
+    }
+    if (status == GIT_OK) {
+      status = git_diff_tree_to_tree(&diff, repository, parentTree, tree, NULL);
+    }
+    if (status == GIT_OK) {
+      for (size_t j = 0, count = git_diff_num_deltas(diff); (j < count) && (paths.count <= kMaxChangedPaths); ++j) {
+        const git_diff_delta* delta = git_diff_get_delta(diff, j);
+        [paths addObject:[NSString stringWithUTF8String:delta->new_file.path]];
+        [paths addObject:[NSString stringWithUTF8String:delta->old_file.path]];
+      }
+    }
+    git_diff_free(diff);
+    git_tree_free(parentTree);
+    git_commit_free(parentCommit);
+  }
+  git_tree_free(tree);
+  if (status != GIT_OK) {
+    LOG_LIBGIT2_ERROR(status);
+    return nil;
+  }
+  if (paths.count > kMaxChangedPaths) {
+    return [NSData data];
+  }
+
+  NSUInteger wordCount = MAX((paths.count * kBitsPerEntry + 63) / 64, 1);
+  NSMutableData* data = [NSMutableData dataWithLength:(wordCount * sizeof(uint64_t))];
+  uint64_t* words = data.mutableBytes;
+  uint64_t bitCount = (uint64_t)wordCount * 64;
+  for (NSString* path in paths) {
+    uint32_t hashes[kHashCount];
+    _ComputeHashes(path.UTF8String, hashes);
+    for (NSUInteger i = 0; i < kHashCount; ++i) {
+      uint64_t bit = hashes[i] % bitCount;
+      words[bit / 64] |= (uint64_t)1 << (bit % 64);
+    }
+  }
+  return data;
+}
+
+@implementation GCChangedPathIndex {
+  NSString* _path;
+  NSData* _data;
+  uint32_t _fileCount;
+  const uint64_t* _words;
+  const uint32_t* _offsets;
+  const git_oid* _oids;
+  NSMutableDictionary* _pendingFilters;  // Filters computed since the index was last written keyed by OID
+  NSMutableArray* _tips;  // Most recent first
+  BOOL _tipsChanged;
+}
+
+- (instancetype)initWithPath:(NSString*)path {
+  if ((self = [super init])) {
+    _path = [path copy];
+    _pendingFilters = [[NSMutableDictionary alloc] init];
+    [self _loadData:(path ? [NSData dataWithContentsOfFile:path options:NSDataReadingMappedIfSafe error:NULL] : nil)];
+  }
+  return self;
+}
+
+- (void)_loadData:(NSData*)data {
+  _data = nil;
+  _fileCount = 0;
+  _tips = [[NSMutableArray alloc] init];
+  _tipsChanged = NO;
+  if (data) {
+    uint32_t tipCount;
+    const git_oid* tips;
+    if (_ParseIndex(data, &_fileCount, &_words, &_offsets, &_oids, &tipCount, &tips)) {
+      _data = data;
+      for (uint32_t i = 0; i < tipCount; ++i) {
+        [_tips addObject:[NSData dataWithBytes:&tips[i] length:sizeof(git_oid)]];
+      }
+    } else {
+      XLOG_WARNING(@"Ignoring invalid changed-path index at \"%@\"", _path);
+      _fileCount = 0;
+    }
+  }
+}
+
+- (NSUInteger)count {
+  return _fileCount + _pendingFilters.count;
+}
+
+- (BOOL)_findOID:(const git_oid*)oid index:(uint32_t*)index {
+  uint32_t low = 0;
+  uint32_t high = _fileCount;
+  while (low < high) {
+    uint32_t middle = low + (high - low) / 2;
+    int result = git_oid_cmp(oid, &_oids[middle]);
+    if (result == 0) {
+      *index = middle;
+      return YES;
+    }
+    if (result < 0) {
+      high = middle;
+    } else {
+      low = middle + 1;
+    }
+  }
+  return NO;
+}
+
+// Ancestors of the tips from previous updates are already indexed so they are hidden from the walk which then only visits new commits
+- (BOOL)updateWithRepository:(GCRepository*)repository error:(NSError**)error {
+  BOOL success = NO;
+  git_revwalk* walker = NULL;
+  git_oid headOID;
+  git_oid oid;
+
+  CALL_LIBGIT2_FUNCTION_GOTO(cleanup, git_revwalk_new, &walker, repository.private);
+  int status = git_reference_name_to_id(&headOID, repository.private, "HEAD");
+  if ((status == GIT_EUNBORNBRANCH) || (status == GIT_ENOTFOUND)) {  // Nothing to index in empty repositories
+    success = YES;
+    goto cleanup;
+  }
+  CHECK_LIBGIT2_FUNCTION_CALL(goto cleanup, status, == GIT_OK);
+  CALL_LIBGIT2_FUNCTION_GOTO(cleanup, git_revwalk_push, walker, &headOID);
+  for (NSData* tip in _tips) {
+    status = git_revwalk_hide(walker, tip.bytes);
+    if (status != GIT_OK) {  // Tip may have been garbage collected since
+      XLOG_VERBOSE(@"Not hiding missing tip %s from changed-path index update", git_oid_tostr_s(tip.bytes));
+    }
+  }
+  while (1) {
+    status = git_revwalk_next(&oid, walker);
+    if (status == GIT_ITEROVER) {
+      break;
+    }
+    CHECK_LIBGIT2_FUNCTION_CALL(goto cleanup, status, == GIT_OK);
+    uint32_t index;
+    if ([self _findOID:&oid index:&index]) {
+      continue;
+    }
+    NSData* key = [[NSData alloc] initWithBytes:&oid length:sizeof(git_oid)];
+    if (_pendingFilters[key] == nil) {
+      git_commit* commit;
+      CALL_LIBGIT2_FUNCTION_GOTO(cleanup, git_commit_lookup, &commit, repository.private, &oid);
+      NSData* filter = _ComputeFilter(commit);
+      if (filter) {  // Commits without filters are checked directly by callers
+        _pendingFilters[key] = filter;
+      }
+      git_commit_free(commit);
+    }
+  }
+  NSData* headTip = [[NSData alloc] initWithBytes:&headOID length:sizeof(git_oid)];
+  if (![_tips.firstObject isEqualToData:headTip]) {
+    [_tips removeObject:headTip];
+    [_tips insertObject:headTip atIndex:0];
+    if (_tips.count > kMaxTips) {
+      [_tips removeObjectsInRange:NSMakeRange(kMaxTips, _tips.count - kMaxTips)];
+    }
+    _tipsChanged = YES;
+  }
+  success = YES;
+
+cleanup:
+  git_revwalk_free(walker);
+  return success;
+}
+
+- (BOOL)commit:(git_commit*)commit mayHaveChangedPath:(const char*)path {
+  const git_oid* oid = git_commit_id(commit);
+  uint32_t index;
+  if ([self _findOID:oid index:&index]) {
+    return _FilterContainsPath(_words + _offsets[index], _offsets[index + 1] - _offsets[index], path);
+  }
+  NSData* filter = _pendingFilters[[NSData dataWithBytes:oid length:sizeof(git_oid)]];
+  return filter ? _FilterContainsPath(filter.bytes, filter.length / sizeof(uint64_t), path) : YES;  // Let caller check the commit directly
+}
+
+- (BOOL)writeIfNeeded:(NSError**)error {
+  if ((_path == nil) || ((_pendingFilters.count == 0) && !_tipsChanged)) {
+    return YES;
+  }
+  if (self.count >= UINT32_MAX) {
+    GC_SET_GENERIC_ERROR(@"Too many commits in changed-path index");
+    return NO;
+  }
+
+  // Merge sorted pending filters with the ones already in the file
+  NSArray* keys = [_pendingFilters.allKeys sortedArrayUsingComparator:^NSComparisonResult(NSData* key1, NSData* key2) {
+    return git_oid_cmp(key1.bytes, key2.bytes);
+  }];
+  NSUInteger count = self.count;
+  uint64_t wordCount = _fileCount ? _offsets[_fileCount] : 0;
+  for (NSData* key in keys) {
+    wordCount += [_pendingFilters[key] length] / sizeof(uint64_t);
+  }
+  if (wordCount >= UINT32_MAX) {
+    GC_SET_GENERIC_ERROR(@"Changed-path index is too large");
+    return NO;
+  }
+  NSUInteger tipCount = _tips.count;
+  NSMutableData* data = [NSMutableData dataWithLength:(sizeof(Header) + wordCount * sizeof(uint64_t) + (count + 1) * sizeof(uint32_t) + (count + tipCount) * sizeof(git_oid))];
+  Header* header = data.mutableBytes;
+  header->magic = kMagic;
+  header->version = kVersion;
+  header->count = (uint32_t)count;
+  header->tipCount = (uint32_t)tipCount;
+  uint64_t* words = (uint64_t*)(header + 1);
+  uint32_t* offsets = (uint32_t*)(words + wordCount);
+  git_oid* oids = (git_oid*)(offsets + count + 1);
+  uint32_t offset = 0;
+  for (NSUInteger i = 0, fileIndex = 0, keyIndex = 0; i < count; ++i) {
+    NSData* key = keyIndex < keys.count ? keys[keyIndex] : nil;
+    const void* filterWords;
+    uint32_t filterWordCount;
+    if (key && ((fileIndex == _fileCount) || (git_oid_cmp(key.bytes, &_oids[fileIndex]) < 0))) {
+      NSData* filter = _pendingFilters[key];
+      git_oid_cpy(&oids[i], key.bytes);
+      filterWords = filter.bytes;
+      filterWordCount = (uint32_t)(filter.length / sizeof(uint64_t));
+      ++keyIndex;
+    } else {
+      git_oid_cpy(&oids[i], &_oids[fileIndex]);
+      filterWords = _words + _offsets[fileIndex];
+      filterWordCount = _offsets[fileIndex + 1] - _offsets[fileIndex];
+      ++fileIndex;
+    }
+    offsets[i] = offset;
+    memcpy(words + offset, filterWords, filterWordCount * sizeof(uint64_t));
+    offset += filterWordCount;
+  }
+  offsets[count] = offset;
+  for (NSUInteger i = 0; i < tipCount; ++i) {
+    git_oid_cpy(&oids[count + i], [_tips[i] bytes]);
+  }
+
+  if (![data writeToFile:_path options:NSDataWritingAtomic error:error]) {
+    return NO;
+  }
+  [_pendingFilters removeAllObjects];
+  [self _loadData:data];
+  return YES;
+}
+
+@end
@@ -25,6 +25,20 @@
 
 @dynamic private;
 
+// Commits from a history load their git_commit lazily which fails if the object has gone missing from the repository since the history was loaded,
+// so accessors must handle a NULL git_commit and return placeholder values instead
+static git_signature _missingSignature = {(char*)"", (char*)"", {0, 0, '+'}};
+
+static inline const git_signature* _Author(GCCommit* commit) {
+  git_commit* gitCommit = commit.private;
+  return gitCommit ? git_commit_author(gitCommit) : &_missingSignature;
+}
+
+static inline const git_signature* _Committer(GCCommit* commit) {
+  git_commit* gitCommit = commit.private;
+  return gitCommit ? git_commit_committer(gitCommit) : &_missingSignature;
+}
+
 - (instancetype)initWithRepository:(GCRepository*)repository commit:(git_commit*)commit {
   return [self initWithRepository:repository object:(git_object*)commit];
 }
@@ -46,21 +60,29 @@ static inline NSString* _ConvertMessage(GCCommit* commit, const char* message, s
 }
 
 - (NSString*)message {
-  const char* message = git_commit_message((git_commit*)_private);  // This already trims leading newlines
+  git_commit* commit = self.private;
+  if (commit == NULL) {
+    return @"";
+  }
+  const char* message = git_commit_message(commit);  // This already trims leading newlines
   size_t length = strlen(message);
   if (length) {
     while (message[length - 1] == '\n') {  // Trim trailing newlines
       --length;
     }
   } else {
-    XLOG_WARNING(@"Empty message for commit %s", git_oid_tostr_s(git_commit_id((git_commit*)_private)));
+    XLOG_WARNING(@"Empty message for commit %s", git_oid_tostr_s(git_commit_id(commit)));
   }
-  return _ConvertMessage(self, message, length, git_commit_message_encoding((git_commit*)_private));
+  return _ConvertMessage(self, message, length, git_commit_message_encoding(commit));
 }
 
 - (NSString*)summary {
-  const char* summary = git_commit_summary((git_commit*)_private);
-  return _ConvertMessage(self, summary, strlen(summary), git_commit_message_encoding((git_commit*)_private));
+  git_commit* commit = self.private;
+  if (commit == NULL) {
+    return @"";
+  }
+  const char* summary = git_commit_summary(commit);
+  return _ConvertMessage(self, summary, strlen(summary), git_commit_message_encoding(commit));
 }
 
 - (NSDate*)date {
@@ -69,43 +91,44 @@ static inline NSString* _ConvertMessage(GCCommit* commit, const char* message, s
 
 // Reimplementation of git_commit_time_offset()
 - (NSTimeZone*)timeZone {
-  const git_signature* signature = git_commit_committer((git_commit*)_private);
+  const git_signature* signature = _Committer(self);
   return [NSTimeZone timeZoneForSecondsFromGMT:(signature->when.offset * 60)];
 }
 
 - (NSString*)authorName {
-  const git_signature* signature = git_commit_author((git_commit*)_private);
+  const git_signature* signature = _Author(self);
   return [NSString stringWithUTF8String:signature->name];
 }
 
 - (NSString*)authorEmail {
-  const git_signature* signature = git_commit_author((git_commit*)_private);
+  const git_signature* signature = _Author(self);
   return [NSString stringWithUTF8String:signature->email];
 }
 
 - (NSDate*)authorDate {
-  const git_signature* signature = git_commit_author((git_commit*)_private);
+  const git_signature* signature = _Author(self);
   return [NSDate dateWithTimeIntervalSince1970:signature->when.time];
 }
 
 - (NSString*)committerName {
-  const git_signature* signature = git_commit_committer((git_commit*)_private);
+  const git_signature* signature = _Committer(self);
   return [NSString stringWithUTF8String:signature->name];
 }
 
 - (NSString*)committerEmail {
-  const git_signature* signature = git_commit_committer((git_commit*)_private);
+  const git_signature* signature = _Committer(self);
   return [NSString stringWithUTF8String:signature->email];
 }
 
 // Reimplementation of git_commit_time()
 - (NSDate*)committerDate {
-  const git_signature* signature = git_commit_committer((git_commit*)_private);
+  const git_signature* signature = _Committer(self);
   return [NSDate dateWithTimeIntervalSince1970:signature->when.time];
 }
 
 - (NSString*)treeSHA1 {
-  return GCGitOIDToSHA1(git_commit_tree_id((git_commit*)_private));
+  git_commit* commit = self.private;
+  return commit ? GCGitOIDToSHA1(git_commit_tree_id(commit)) : nil;
 }
 
 - (NSString*)description {
@@ -123,15 +146,15 @@ static inline NSString* _ConvertMessage(GCCommit* commit, const char* message, s
 @implementation GCCommit (Extensions)
 
 - (NSString*)author {
-  return GCUserFromSignature(git_commit_author((git_commit*)_private));
+  return GCUserFromSignature(_Author(self));
 }
 
 - (NSString*)committer {
-  return GCUserFromSignature(git_commit_committer((git_commit*)_private));
+  return GCUserFromSignature(_Committer(self));
 }
 
 - (NSTimeInterval)timeIntervalSinceReferenceDate {
-  const git_signature* signature = git_commit_committer((git_commit*)_private);
+  const git_signature* signature = _Committer(self);
   return signature->when.time - NSTimeIntervalSince1970;
 }
 
@@ -141,16 +164,14 @@ static inline NSString* _ConvertMessage(GCCommit* commit, const char* message, s
 
 static inline NSComparisonResult _TimeCompare(GCCommit* commit1, GCCommit* commit2) {
   XLOG_DEBUG_CHECK(commit1 != commit2);
-  git_time_t time1 = git_commit_time((git_commit*)commit1->_private);
-  git_time_t time2 = git_commit_time((git_commit*)commit2->_private);
+  git_time_t time1 = _Committer(commit1)->when.time;  // Same as git_commit_time()
+  git_time_t time2 = _Committer(commit2)->when.time;
   if (time1 < time2) {
     return NSOrderedAscending;
   } else if (time1 > time2) {
     return NSOrderedDescending;
   }
-  const git_oid* oid1 = git_commit_id((git_commit*)commit1->_private);
-  const git_oid* oid2 = git_commit_id((git_commit*)commit2->_private);
-  return git_oid_cmp(oid1, oid2);  // Ensure stable ordering
+  return git_oid_cmp(commit1.OID, commit2.OID);  // Ensure stable ordering
 }
 
 - (NSComparisonResult)timeCompare:(GCCommit*)commit {
@@ -165,8 +186,17 @@ static inline NSComparisonResult _TimeCompare(GCCommit* commit1, GCCommit* commi
 
 @implementation GCRepository (GCCommit)
 
+static git_commit* _LoadCommit(GCCommit* commit, NSError** error) {
+  git_commit* gitCommit = commit.private;
+  if (gitCommit == NULL) {
+    GC_SET_GENERIC_ERROR(@"Missing commit %@", commit.SHA1);
+  }
+  return gitCommit;
+}
+
 - (NSString*)computeUniqueShortSHA1ForCommit:(GCCommit*)commit error:(NSError**)error {
-  return [self computeUniqueOIDForCommit:commit.private error:error];
+  git_commit* gitCommit = _LoadCommit(commit, error);
+  return gitCommit ? [self computeUniqueOIDForCommit:gitCommit error:error] : nil;
 }
 
 - (GCCommit*)findCommitWithSHA1:(NSString*)sha1 error:(NSError**)error {
@@ -192,10 +222,14 @@ static inline NSComparisonResult _TimeCompare(GCCommit* commit1, GCCommit* commi
 }
 
 - (NSArray*)lookupParentsForCommit:(GCCommit*)commit error:(NSError**)error {
+  git_commit* childCommit = _LoadCommit(commit, error);
+  if (childCommit == NULL) {
+    return nil;
+  }
   NSMutableArray* array = [[NSMutableArray alloc] init];
-  for (unsigned int i = 0, count = git_commit_parentcount(commit.private); i < count; ++i) {
+  for (unsigned int i = 0, count = git_commit_parentcount(childCommit); i < count; ++i) {
     git_commit* gitCommit;
-    CALL_LIBGIT2_FUNCTION_RETURN(nil, git_commit_parent, &gitCommit, commit.private, i);
+    CALL_LIBGIT2_FUNCTION_RETURN(nil, git_commit_parent, &gitCommit, childCommit, i);
     GCCommit* parentCommit = [[GCCommit alloc] initWithRepository:self commit:gitCommit];
     [array addObject:parentCommit];
   }
@@ -206,8 +240,12 @@ static inline NSComparisonResult _TimeCompare(GCCommit* commit1, GCCommit* commi
   NSString* sha1 = nil;
   git_tree* tree = NULL;
   git_tree_entry* entry = NULL;
+  git_commit* gitCommit = _LoadCommit(commit, error);
+  if (gitCommit == NULL) {
+    goto cleanup;
+  }
 
-  CALL_LIBGIT2_FUNCTION_GOTO(cleanup, git_commit_tree, &tree, commit.private);
+  CALL_LIBGIT2_FUNCTION_GOTO(cleanup, git_commit_tree, &tree, gitCommit);
   CALL_LIBGIT2_FUNCTION_GOTO(cleanup, git_tree_entry_bypath, &entry, tree, GCGitPathFromFileSystemPath(path));
   sha1 = GCGitOIDToSHA1(git_tree_entry_id(entry));
 
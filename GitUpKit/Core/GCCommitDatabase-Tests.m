@@ -140,6 +140,71 @@
   XCTAssertTrue([[NSFileManager defaultManager] removeItemAtPath:path error:NULL]);
 }
 
+- (void)testCommitDatabase_Shared {
+  NSString* path = [NSTemporaryDirectory() stringByAppendingPathComponent:[[[NSProcessInfo processInfo] globallyUniqueString] stringByAppendingPathExtension:@"db"]];
+
+  // Clone repository
+  NSString* clonePath = [NSTemporaryDirectory() stringByAppendingPathComponent:[[NSProcessInfo processInfo] globallyUniqueString]];
+  GCRepository* clone = [[GCRepository alloc] initWithClonedRepositoryFromURL:[NSURL fileURLWithPath:self.repository.workingDirectoryPath] toPath:clonePath usingDelegate:nil recursive:NO error:NULL];
+  XCTAssertNotNil(clone);
+
+  // Populate shared database from repository
+  GCCommitDatabase* database = [[GCCommitDatabase alloc] initWithRepository:self.repository databasePath:path options:kGCCommitDatabaseOptions_Shared error:NULL];
+  XCTAssertNotNil(database);
+  XCTAssertTrue([database updateWithProgressHandler:NULL error:NULL]);
+  XCTAssertEqual([database countTips], 2);
+  XCTAssertEqual([database countCommits], 5);
+  XCTAssertEqual([database countRelations], 4);
+  XCTAssertEqual([database totalCommitRetainCount], 4 + 2);
+
+  // Populate shared database from clone (commits are shared and only the tips of the clone are added)
+  GCCommitDatabase* cloneDatabase = [[GCCommitDatabase alloc] initWithRepository:clone databasePath:path options:kGCCommitDatabaseOptions_Shared error:NULL];
+  XCTAssertNotNil(cloneDatabase);
+  __block NSUInteger addedCount = 0;
+  XCTAssertTrue([cloneDatabase updateWithProgressHandler:^BOOL(BOOL firstUpdate, NSUInteger addedCommits, NSUInteger removedCommits) {
+    XCTAssertFalse(firstUpdate);
+    addedCount = addedCommits;
+    return YES;
+  }
+                                                   error:NULL]);
+  XCTAssertEqual(addedCount, 0);
+  XCTAssertEqual([cloneDatabase countTips], 2 + 2);
+  XCTAssertEqual([cloneDatabase countCommits], 5);
+  XCTAssertEqual([cloneDatabase countRelations], 4);
+  XCTAssertEqual([cloneDatabase totalCommitRetainCount], 4 + 2 + 2);
+  XCTAssertEqual([[cloneDatabase findCommitsMatching:@"2" error:NULL] count], 1);
+
+  // Delete topic branch from repository (its commits are still retained by the clone)
+  XCTAssertTrue([self.repository deleteLocalBranch:self.topicBranch error:NULL]);
+  XCTAssertTrue([database updateWithProgressHandler:NULL error:NULL]);
+  XCTAssertEqual([database countTips], 1 + 2);
+  XCTAssertEqual([database countCommits], 5);
+  XCTAssertEqual([database countRelations], 4);
+  XCTAssertEqual([database totalCommitRetainCount], 4 + 1 + 2);
+
+  // Re-populate shared database from clone (should be no-op)
+  XCTAssertTrue([cloneDatabase updateWithProgressHandler:NULL error:NULL]);
+  XCTAssertEqual([cloneDatabase countTips], 1 + 2);
+  XCTAssertEqual([cloneDatabase countCommits], 5);
+
+  // Check shared database is not regenerated when opened with different options
+  XCTAssertNil([[GCCommitDatabase alloc] initWithRepository:clone databasePath:path options:(kGCCommitDatabaseOptions_Shared | kGCCommitDatabaseOptions_IndexDiffs) error:NULL]);
+  XCTAssertEqual([cloneDatabase countCommits], 5);
+
+  // Delete clone (its tips are pruned by the next update of the repository)
+  cloneDatabase = nil;
+  [self destroyLocalRepository:clone];
+  XCTAssertTrue([database updateWithProgressHandler:NULL error:NULL]);
+  XCTAssertEqual([database countTips], 1);
+  XCTAssertEqual([database countCommits], 5);
+  XCTAssertEqual([database countRelations], 4);
+  XCTAssertEqual([database totalCommitRetainCount], 4 + 1);
+
+  // Delete database
+  database = nil;
+  XCTAssertTrue([[NSFileManager defaultManager] removeItemAtPath:path error:NULL]);
+}
+
 @end
 
 @implementation GCEmptyRepositoryTests (GCCommitDatabase)
@@ -170,6 +235,94 @@
   XCTAssertTrue([[NSFileManager defaultManager] removeItemAtPath:path error:NULL]);
 }
 
+static NSString* _ExtractUniqueWords(NSString* lines) {
+  NSData* words = [GCCommitDatabase extractUniqueWordsFromLines:[lines dataUsingEncoding:NSUTF8StringEncoding]];
+  return [[NSString alloc] initWithData:words encoding:NSUTF8StringEncoding];
+}
+
+- (void)testCommitDatabase_WordExtraction {
+  XCTAssertEqualObjects(_ExtractUniqueWords(@""), @"");
+  XCTAssertEqualObjects(_ExtractUniqueWords(@"x + y\n"), @"");
+  XCTAssertEqualObjects(_ExtractUniqueWords(@"Foo foo FOO bar_baz\nbar_baz"), @"Foo bar_baz ");
+  XCTAssertEqualObjects(_ExtractUniqueWords(@"return the value of this;\nstatic const int count = 0;"), @"value count ");
+  XCTAssertEqualObjects(_ExtractUniqueWords(@"café CAFÉ café"), @"café CAFÉ ");
+  XCTAssertEqualObjects(_ExtractUniqueWords(@"-(void)aVeryLongIdentifierSpanningSeveralBlocks:(id)arg{}42"), @"aVeryLongIdentifierSpanningSeveralBlocks id arg 42 ");
+
+  // Check deduplication is exact when the word set grows
+  NSMutableString* lines = [NSMutableString string];
+  NSMutableString* expected = [NSMutableString string];
+  for (NSUInteger i = 0; i < 5000; ++i) {
+    [lines appendFormat:@"word%lu WORD%lu\n", (unsigned long)i, (unsigned long)i];
+    [expected appendFormat:@"word%lu ", (unsigned long)i];
+  }
+  [lines appendString:[lines copy]];
+  XCTAssertEqualObjects(_ExtractUniqueWords(lines), expected);
+}
+
+// Baseline implementation scanning byte by byte and deduplicating through a set of lowercased words (stop words are not removed)
+static NSSet* _ExtractUniqueWordsNaively(NSData* lines) {
+  NSMutableSet* words = [NSMutableSet set];
+  const unsigned char* bytes = lines.bytes;
+  NSUInteger length = lines.length;
+  NSUInteger start = NSNotFound;
+  for (NSUInteger i = 0; i <= length; ++i) {
+    unsigned char c = i < length ? bytes[i] : ' ';
+    BOOL delimiter = (c < 0x80) && !isalnum(c) && (c != '_');
+    if (!delimiter && (start == NSNotFound)) {
+      start = i;
+    } else if (delimiter && (start != NSNotFound)) {
+      if (i - start >= 2) {
+        NSMutableData* word = [NSMutableData dataWithBytes:&bytes[start] length:(i - start)];
+        unsigned char* wordBytes = word.mutableBytes;
+        for (NSUInteger j = 0; j < word.length; ++j) {
+          wordBytes[j] = (wordBytes[j] < 0x80) ? tolower(wordBytes[j]) : wordBytes[j];
+        }
+        [words addObject:word];
+      }
+      start = NSNotFound;
+    }
+  }
+  return words;
+}
+
+// Uses the GitUpKit sources as a diff corpus
+- (void)testCommitDatabase_WordExtractionPerformance {
+  NSString* folder = [@__FILE__ stringByDeletingLastPathComponent];
+  NSMutableData* lines = [NSMutableData data];
+  for (NSString* file in [[NSFileManager defaultManager] contentsOfDirectoryAtPath:folder error:NULL]) {
+    if ([file.pathExtension isEqualToString:@"h"] || [file.pathExtension isEqualToString:@"m"]) {
+      [lines appendData:[NSData dataWithContentsOfFile:[folder stringByAppendingPathComponent:file]]];
+    }
+  }
+  XCTAssertGreaterThan(lines.length, 0);
+
+  CFAbsoluteTime time = CFAbsoluteTimeGetCurrent();
+  NSData* words = [GCCommitDatabase extractUniqueWordsFromLines:lines];
+  time = CFAbsoluteTimeGetCurrent() - time;
+  CFAbsoluteTime baselineTime = CFAbsoluteTimeGetCurrent();
+  NSSet* baselineWords = _ExtractUniqueWordsNaively(lines);
+  baselineTime = CFAbsoluteTimeGetCurrent() - baselineTime;
+  XLOG_INFO(@"Extracted %lu bytes of words from %lu bytes of lines (%.1f%%) at %.1f MB/s (%.1fx the baseline)", (unsigned long)words.length, (unsigned long)lines.length, 100.0 * (double)words.length / (double)lines.length, (double)lines.length / time / (1024.0 * 1024.0), baselineTime / time);
+  XCTAssertLessThan(words.length, lines.length / 4);
+
+  // Check words are unique and the same as the baseline minus the stop words
+  NSSet* uniqueWords = _ExtractUniqueWordsNaively(words);
+  NSUInteger wordCount = 0;
+  for (NSUInteger i = 0; i < words.length; ++i) {
+    if (((const char*)words.bytes)[i] == ' ') {  // Each word is followed by a space
+      wordCount += 1;
+    }
+  }
+  XCTAssertEqual(uniqueWords.count, wordCount);
+  XCTAssertTrue([uniqueWords isSubsetOfSet:baselineWords]);
+  XCTAssertLessThan(uniqueWords.count, baselineWords.count);
+  XCTAssertGreaterThan(uniqueWords.count, baselineWords.count * 9 / 10);
+
+  [self measureBlock:^{
+    XCTAssertEqual([GCCommitDatabase extractUniqueWordsFromLines:lines].length, words.length);
+  }];
+}
+
 @end
 
 @implementation GCSingleCommitRepositoryTests (GCCommitDatabase)
@@ -231,4 +384,410 @@
   XCTAssertTrue([[NSFileManager defaultManager] removeItemAtPath:path error:NULL]);
 }
 
+- (void)testCommitDatabase_SearchCursor {
+  NSString* path = [NSTemporaryDirectory() stringByAppendingPathComponent:[[[NSProcessInfo processInfo] globallyUniqueString] stringByAppendingPathExtension:@"db"]];
+
+  // Make commits
+  GCCommit* commit1 = [self.repository createCommitFromHEADWithMessage:@"Fix parser" error:NULL];
+  XCTAssertNotNil(commit1);
+  GCCommit* commit2 = [self.repository createCommitFromHEADWithMessage:@"Fix fix fix crash" error:NULL];
+  XCTAssertNotNil(commit2);
+  GCCommit* commit3 = [self.repository createCommitFromHEADWithMessage:@"Refactor parser" error:NULL];
+  XCTAssertNotNil(commit3);
+  GCCommit* commit4 = [self.repository createCommitFromHEADWithMessage:@"Fix typo in the documentation of the parser module" error:NULL];
+  XCTAssertNotNil(commit4);
+  GCCommit* commit5 = [self.repository createCommitFromHEADWithMessage:@"Fix \"quotes\" (again)" error:NULL];
+  XCTAssertNotNil(commit5);
+
+  // Create and populate database
+  GCCommitDatabase* database = [[GCCommitDatabase alloc] initWithRepository:self.repository databasePath:path options:0 error:NULL];
+  XCTAssertNotNil(database);
+  XCTAssertTrue([database updateWithProgressHandler:NULL error:NULL]);
+
+  // Test paginating results
+  NSArray* results = [database findCommitsMatching:@"fix" error:NULL];
+  XCTAssertEqual(results.count, 4);
+  GCCommitDatabaseSearchCursor* cursor = [database searchCursorForCommitsMatching:@"fix" order:kGCCommitDatabaseSearchOrder_Time];
+  NSMutableArray* pages = [NSMutableArray array];
+  while (!cursor.exhausted) {
+    NSArray* page = [database fetchCommitsFromCursor:cursor maximumCount:3 error:NULL];
+    XCTAssertNotNil(page);
+    XCTAssertLessThanOrEqual(page.count, 3);
+    [pages addObjectsFromArray:page];
+  }
+  XCTAssertEqualObjects(pages, results);
+  XCTAssertEqualObjects([database fetchCommitsFromCursor:cursor maximumCount:3 error:NULL], @[]);
+
+  // Test ranking results
+  cursor = [database searchCursorForCommitsMatching:@"fix" order:kGCCommitDatabaseSearchOrder_Relevance];
+  XCTAssertEqualObjects([database fetchCommitsFromCursor:cursor maximumCount:1 error:NULL], @[ commit2 ]);
+  XCTAssertEqual([database fetchCommitsFromCursor:cursor maximumCount:10 error:NULL].count, 3);
+  XCTAssertTrue(cursor.exhausted);
+
+  // Test prefix, operators and punctuation
+  XCTAssertEqualObjects([database findCommitsMatching:@"refact*" error:NULL], @[ commit3 ]);
+  NSSet* results2 = [NSSet setWithObjects:commit2, commit3, nil];
+  XCTAssertEqualObjects([NSSet setWithArray:[database findCommitsMatching:@"crash OR refactor" error:NULL]], results2);
+  XCTAssertEqualObjects([database findCommitsMatching:@"\"quotes\" (again)" error:NULL], @[ commit5 ]);
+  XCTAssertEqualObjects([database findCommitsMatching:@"parser NOT fix" error:NULL], @[ commit3 ]);
+
+  // Delete database
+  database = nil;
+  XCTAssertTrue([[NSFileManager defaultManager] removeItemAtPath:path error:NULL]);
+}
+
+- (void)testCommitDatabase_ParallelDiffs {
+  // Make commits on two branches
+  for (NSUInteger i = 0; i < 30; ++i) {
+    XCTAssertNotNil([self makeCommitWithUpdatedFileAtPath:[NSString stringWithFormat:@"file%lu.txt", (unsigned long)(i % 3)] string:[NSString stringWithFormat:@"line_%lu\nshared\n", (unsigned long)i] message:@"master"]);
+  }
+  GCLocalBranch* topicBranch = [self.repository createLocalBranchFromCommit:self.initialCommit withName:@"topic" force:NO error:NULL];
+  XCTAssertNotNil(topicBranch);
+  XCTAssertTrue([self.repository checkoutLocalBranch:topicBranch options:kGCCheckoutOption_Force error:NULL]);
+  for (NSUInteger i = 0; i < 10; ++i) {
+    XCTAssertNotNil([self makeCommitWithUpdatedFileAtPath:@"topic.txt" string:[NSString stringWithFormat:@"topic_%lu\n", (unsigned long)i] message:@"topic"]);
+  }
+
+  // Check databases populated serially and in parallel are identical
+  NSString* path1 = [NSTemporaryDirectory() stringByAppendingPathComponent:[[[NSProcessInfo processInfo] globallyUniqueString] stringByAppendingPathExtension:@"db"]];
+  GCCommitDatabase* database1 = [[GCCommitDatabase alloc] initWithRepository:self.repository databasePath:path1 options:kGCCommitDatabaseOptions_IndexDiffs error:NULL];
+  XCTAssertNotNil(database1);
+  database1.diffWorkerCount = 0;
+  XCTAssertTrue([database1 updateWithProgressHandler:NULL error:NULL]);
+  NSString* path2 = [NSTemporaryDirectory() stringByAppendingPathComponent:[[[NSProcessInfo processInfo] globallyUniqueString] stringByAppendingPathExtension:@"db"]];
+  GCCommitDatabase* database2 = [[GCCommitDatabase alloc] initWithRepository:self.repository databasePath:path2 options:kGCCommitDatabaseOptions_IndexDiffs error:NULL];
+  XCTAssertNotNil(database2);
+  database2.diffWorkerCount = 4;
+  XCTAssertTrue([database2 updateWithProgressHandler:NULL error:NULL]);
+  XCTAssertEqual([database2 countCommits], 1 + 30 + 10);
+  XCTAssertEqual([database2 countRelations], [database1 countRelations]);
+  NSArray* diffs = [database1 listIndexedDiffs];
+  XCTAssertEqual(diffs.count, 1 + 30 + 10);
+  XCTAssertEqualObjects([database2 listIndexedDiffs], diffs);
+  XCTAssertEqual([database2 findCommitsMatching:@"line_17" error:NULL].count, 1);
+  XCTAssertEqual([database2 findCommitsMatching:@"topic_3" error:NULL].count, 1);
+
+  // Check cancelling while diffs are computed in parallel
+  NSString* path3 = [NSTemporaryDirectory() stringByAppendingPathComponent:[[[NSProcessInfo processInfo] globallyUniqueString] stringByAppendingPathExtension:@"db"]];
+  GCCommitDatabase* database3 = [[GCCommitDatabase alloc] initWithRepository:self.repository databasePath:path3 options:kGCCommitDatabaseOptions_IndexDiffs error:NULL];
+  XCTAssertNotNil(database3);
+  database3.diffWorkerCount = 4;
+  XCTAssertFalse([database3 updateWithProgressHandler:^BOOL(BOOL firstUpdate, NSUInteger addedCommits, NSUInteger removedCommits) {
+    return addedCommits < 5;
+  }
+                                                 error:NULL]);
+
+  // Delete databases
+  database1 = nil;
+  database2 = nil;
+  database3 = nil;
+  XCTAssertTrue([[NSFileManager defaultManager] removeItemAtPath:path1 error:NULL]);
+  XCTAssertTrue([[NSFileManager defaultManager] removeItemAtPath:path2 error:NULL]);
+  XCTAssertTrue([[NSFileManager defaultManager] removeItemAtPath:path3 error:NULL]);
+}
+
+- (void)testCommitDatabase_Paths {
+  // Make commits including a rename
+  XCTAssertTrue([[NSFileManager defaultManager] createDirectoryAtPath:[self.repository.workingDirectoryPath stringByAppendingPathComponent:@"src"] withIntermediateDirectories:NO attributes:nil error:NULL]);
+  XCTAssertTrue([[NSFileManager defaultManager] createDirectoryAtPath:[self.repository.workingDirectoryPath stringByAppendingPathComponent:@"docs"] withIntermediateDirectories:NO attributes:nil error:NULL]);
+  GCCommit* commit1 = [self makeCommitWithUpdatedFileAtPath:@"src/old.txt" string:@"Hello\nWorld\n" message:@"Add"];
+  XCTAssertNotNil(commit1);
+  GCCommit* commit2 = [self makeCommitWithUpdatedFileAtPath:@"src/old.txt" string:@"Hello\nWorld\nAgain\n" message:@"Modify"];
+  XCTAssertNotNil(commit2);
+  XCTAssertTrue([[NSFileManager defaultManager] moveItemAtPath:[self.repository.workingDirectoryPath stringByAppendingPathComponent:@"src/old.txt"]
+                                                        toPath:[self.repository.workingDirectoryPath stringByAppendingPathComponent:@"src/new.txt"]
+                                                         error:NULL]);
+  XCTAssertTrue([self.repository removeFileFromIndex:@"src/old.txt" error:NULL]);
+  XCTAssertTrue([self.repository addFileToIndex:@"src/new.txt" error:NULL]);
+  GCCommit* commit3 = [self.repository createCommitFromHEADWithMessage:@"Rename" error:NULL];
+  XCTAssertNotNil(commit3);
+  GCCommit* commit4 = [self makeCommitWithUpdatedFileAtPath:@"docs/readme.md" string:@"Docs\n" message:@"Document"];
+  XCTAssertNotNil(commit4);
+  GCCommit* commit5 = [self makeCommitWithUpdatedFileAtPath:@"src/new.txt" string:@"Hello\nWorld\nAgain\nAnd again\n" message:@"Modify"];
+  XCTAssertNotNil(commit5);
+
+  // Create and populate database
+  NSString* path = [NSTemporaryDirectory() stringByAppendingPathComponent:[[[NSProcessInfo processInfo] globallyUniqueString] stringByAppendingPathExtension:@"db"]];
+  GCCommitDatabase* database = [[GCCommitDatabase alloc] initWithRepository:self.repository databasePath:path options:kGCCommitDatabaseOptions_IndexDiffs error:NULL];
+  XCTAssertNotNil(database);
+  XCTAssertTrue([database updateWithProgressHandler:NULL error:NULL]);
+
+  // Check file history
+  NSSet* results1 = [NSSet setWithObjects:commit5, commit3, nil];
+  XCTAssertEqualObjects([NSSet setWithArray:[database findCommitsForFile:@"src/new.txt" followRenames:NO error:NULL]], results1);
+  NSSet* results2 = [NSSet setWithObjects:commit5, commit3, commit2, commit1, nil];
+  XCTAssertEqualObjects([NSSet setWithArray:[database findCommitsForFile:@"src/new.txt" followRenames:YES error:NULL]], results2);
+  XCTAssertEqual([database findCommitsForFile:@"src/new.txt" followRenames:YES error:NULL].count, 4);
+  XCTAssertEqualObjects([database findCommitsForFile:@"missing.txt" followRenames:YES error:NULL], @[]);
+
+  // Check path searches
+  NSSet* results3 = [NSSet setWithObjects:commit5, commit3, commit2, commit1, nil];
+  XCTAssertEqualObjects([NSSet setWithArray:[database findCommitsMatching:@"path:src" error:NULL]], results3);
+  XCTAssertEqualObjects([NSSet setWithArray:[database findCommitsMatching:@"path:src/" error:NULL]], results3);
+  XCTAssertEqualObjects([database findCommitsMatching:@"path:docs/*.md" error:NULL], @[ commit4 ]);
+  XCTAssertEqualObjects([NSSet setWithArray:[database findCommitsMatching:@"path:*.txt" error:NULL]], [results3 setByAddingObject:self.initialCommit]);
+  XCTAssertEqualObjects([database findCommitsMatching:@"path:src/new.txt rename" error:NULL], @[ commit3 ]);
+  XCTAssertEqualObjects([database findCommitsMatching:@"path:src path:docs" error:NULL], @[]);
+
+  // Check paths are removed with their commits
+  XCTAssertTrue([self.repository resetToCommit:commit4 mode:kGCResetMode_Hard error:NULL]);
+  XCTAssertTrue([database updateWithProgressHandler:NULL error:NULL]);
+  XCTAssertEqualObjects([NSSet setWithArray:[database findCommitsForFile:@"src/new.txt" followRenames:NO error:NULL]], [NSSet setWithObject:commit3]);
+
+  // Delete database
+  database = nil;
+  XCTAssertTrue([[NSFileManager defaultManager] removeItemAtPath:path error:NULL]);
+}
+
+- (void)testCommitDatabase_ResumableUpdate {
+  // Make commits
+  for (NSUInteger i = 0; i < 20; ++i) {
+    XCTAssertNotNil([self makeCommitWithUpdatedFileAtPath:@"file.txt" string:[NSString stringWithFormat:@"line_%lu\n", (unsigned long)i] message:[NSString stringWithFormat:@"chunk_%lu", (unsigned long)(i + 1)]]);
+  }
+
+  // Interrupt initial update after a few chunks have been committed
+  NSString* path1 = [NSTemporaryDirectory() stringByAppendingPathComponent:[[[NSProcessInfo processInfo] globallyUniqueString] stringByAppendingPathExtension:@"db"]];
+  GCCommitDatabase* database1 = [[GCCommitDatabase alloc] initWithRepository:self.repository databasePath:path1 options:kGCCommitDatabaseOptions_IndexDiffs error:NULL];
+  XCTAssertNotNil(database1);
+  database1.updateChunkSize = 3;
+  XCTAssertFalse([database1 updateWithProgressHandler:^BOOL(BOOL firstUpdate, NSUInteger addedCommits, NSUInteger removedCommits) {
+    return addedCommits < 10;
+  }
+                                                 error:NULL]);
+  XCTAssertEqual([database1 countCommits], 9);
+
+  // Check committed chunks can already be searched
+  GCCommitDatabase* queryDatabase = [[GCCommitDatabase alloc] initWithRepository:self.repository databasePath:path1 options:(kGCCommitDatabaseOptions_IndexDiffs | kGCCommitDatabaseOptions_QueryOnly) error:NULL];
+  XCTAssertNotNil(queryDatabase);
+  XCTAssertEqual([queryDatabase findCommitsMatching:@"chunk_20" error:NULL].count, 1);
+  XCTAssertEqual([queryDatabase findCommitsMatching:@"chunk_5" error:NULL].count, 0);
+  queryDatabase = nil;
+
+  // Resume update and check database is identical to one populated in a single update
+  XCTAssertTrue([database1 updateWithProgressHandler:NULL error:NULL]);
+  NSString* path2 = [NSTemporaryDirectory() stringByAppendingPathComponent:[[[NSProcessInfo processInfo] globallyUniqueString] stringByAppendingPathExtension:@"db"]];
+  GCCommitDatabase* database2 = [[GCCommitDatabase alloc] initWithRepository:self.repository databasePath:path2 options:kGCCommitDatabaseOptions_IndexDiffs error:NULL];
+  XCTAssertNotNil(database2);
+  XCTAssertTrue([database2 updateWithProgressHandler:NULL error:NULL]);
+  XCTAssertEqual([database1 countCommits], 1 + 20);
+  XCTAssertEqual([database1 countTips], [database2 countTips]);
+  XCTAssertEqual([database1 countRelations], [database2 countRelations]);
+  XCTAssertEqual([database1 totalCommitRetainCount], [database2 totalCommitRetainCount]);
+  XCTAssertEqualObjects([NSSet setWithArray:[database1 listIndexedDiffs]], [NSSet setWithArray:[database2 listIndexedDiffs]]);
+  XCTAssertEqual([database1 findCommitsMatching:@"chunk_5" error:NULL].count, 1);
+
+  // Check subsequent updates still work
+  XCTAssertNotNil([self makeCommitWithUpdatedFileAtPath:@"file.txt" string:@"line_20\n" message:@"chunk_21"]);
+  XCTAssertTrue([database1 updateWithProgressHandler:NULL error:NULL]);
+  XCTAssertEqual([database1 countCommits], 1 + 21);
+
+  // Delete databases
+  database1 = nil;
+  database2 = nil;
+  XCTAssertTrue([[NSFileManager defaultManager] removeItemAtPath:path1 error:NULL]);
+  XCTAssertTrue([[NSFileManager defaultManager] removeItemAtPath:path2 error:NULL]);
+}
+
+- (void)testCommitDatabase_ConcurrentSearches {
+  // Make commits
+  for (NSUInteger i = 0; i < 10; ++i) {
+    XCTAssertNotNil([self makeCommitWithUpdatedFileAtPath:@"file.txt" string:[NSString stringWithFormat:@"line_%lu\n", (unsigned long)i] message:[NSString stringWithFormat:@"first_%lu", (unsigned long)i]]);
+  }
+
+  // Create and populate database
+  NSString* path = [NSTemporaryDirectory() stringByAppendingPathComponent:[[[NSProcessInfo processInfo] globallyUniqueString] stringByAppendingPathExtension:@"db"]];
+  GCCommitDatabase* database = [[GCCommitDatabase alloc] initWithRepository:self.repository databasePath:path options:0 error:NULL];
+  XCTAssertNotNil(database);
+  XCTAssertTrue([database updateWithProgressHandler:NULL error:NULL]);
+  GCCommitDatabase* queryDatabase = [[GCCommitDatabase alloc] initWithRepository:self.repository databasePath:path options:kGCCommitDatabaseOptions_QueryOnly error:NULL];
+  XCTAssertNotNil(queryDatabase);
+
+  // Check searches from other threads don't wait on an update in progress and only see committed commits (commits are looked up in a history as the repository cannot be shared across threads)
+  for (NSUInteger i = 0; i < 10; ++i) {
+    XCTAssertNotNil([self makeCommitWithUpdatedFileAtPath:@"file.txt" string:[NSString stringWithFormat:@"line_%lu\n", (unsigned long)(10 + i)] message:[NSString stringWithFormat:@"second_%lu", (unsigned long)i]]);
+  }
+  GCHistory* history = [self.repository loadHistoryUsingSorting:kGCHistorySorting_None error:NULL];
+  XCTAssertNotNil(history);
+  __block NSUInteger searchCount = 0;
+  XCTAssertTrue([database updateWithProgressHandler:^BOOL(BOOL firstUpdate, NSUInteger addedCommits, NSUInteger removedCommits) {
+    if (addedCommits == 5) {
+      dispatch_apply(8, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t index) {
+        GCCommitDatabase* searchDatabase = index % 2 ? database : queryDatabase;
+        NSError* error;
+        NSArray* results1 = [searchDatabase findCommitsUsingHistory:history matching:[NSString stringWithFormat:@"first_%lu", (unsigned long)index] error:&error];
+        XCTAssertNotNil(results1, @"%@", error);
+        XCTAssertEqual(results1.count, 1);
+        NSArray* results2 = [searchDatabase findCommitsUsingHistory:history matching:@"second_9" error:&error];
+        XCTAssertNotNil(results2, @"%@", error);
+        XCTAssertEqual(results2.count, 0);
+        @synchronized(self) {
+          ++searchCount;
+        }
+      });
+    }
+    return YES;
+  }
+                                          error:NULL]);
+  XCTAssertEqual(searchCount, 8);
+  XCTAssertEqual([queryDatabase findCommitsMatching:@"second_9" error:NULL].count, 1);
+
+  // Delete database
+  queryDatabase = nil;
+  database = nil;
+  XCTAssertTrue([[NSFileManager defaultManager] removeItemAtPath:path error:NULL]);
+}
+
+// Author and committer are the same and the commit is created on top of HEAD
+- (GCCommit*)_makeCommitWithMessage:(NSString*)message userName:(const char*)name email:(const char*)email time:(git_time_t)time {
+  git_signature* signature = NULL;
+  git_commit* parent = NULL;
+  git_tree* tree = NULL;
+  git_oid oid;
+  XCTAssertEqual(git_signature_new(&signature, name, email, time, 0), GIT_OK);
+  XCTAssertEqual(git_revparse_single((git_object**)&parent, self.repository.private, "HEAD^{commit}"), GIT_OK);
+  XCTAssertEqual(git_commit_tree(&tree, parent), GIT_OK);
+  XCTAssertEqual(git_commit_create(&oid, self.repository.private, "HEAD", signature, signature, NULL, message.UTF8String, tree, 1, (const git_commit**)&parent), GIT_OK);
+  git_tree_free(tree);
+  git_commit_free(parent);
+  git_signature_free(signature);
+  return [self.repository findCommitWithSHA1:GCGitOIDToSHA1(&oid) error:NULL];
+}
+
+- (void)testCommitDatabase_Filters {
+  // Make commits (times are in the middle of the month so time zones don't matter)
+  GCCommit* commit1 = [self _makeCommitWithMessage:@"Fix parser" userName:"Alice" email:"alice@example.com" time:1584273600];  // 2020-03-15
+  XCTAssertNotNil(commit1);
+  GCCommit* commit2 = [self _makeCommitWithMessage:@"Fix crash" userName:"Bob" email:"bob@example.com" time:1623758400];  // 2021-06-15
+  XCTAssertNotNil(commit2);
+  GCCommit* commit3 = [self _makeCommitWithMessage:@"Refactor parser" userName:"Alice" email:"alice@example.com" time:1642248000];  // 2022-01-15
+  XCTAssertNotNil(commit3);
+
+  // Create and populate database
+  NSString* path = [NSTemporaryDirectory() stringByAppendingPathComponent:[[[NSProcessInfo processInfo] globallyUniqueString] stringByAppendingPathExtension:@"db"]];
+  GCCommitDatabase* database = [[GCCommitDatabase alloc] initWithRepository:self.repository databasePath:path options:0 error:NULL];
+  XCTAssertNotNil(database);
+  XCTAssertTrue([database updateWithProgressHandler:NULL error:NULL]);
+
+  // Test user filters
+  NSArray* results1 = @[ commit3, commit1 ];
+  XCTAssertEqualObjects([database findCommitsMatching:@"author:alice" error:NULL], results1);
+  XCTAssertEqualObjects([database findCommitsMatching:@"author:alice@example.com" error:NULL], results1);
+  XCTAssertEqualObjects([database findCommitsMatching:@"author:ali*" error:NULL], results1);
+  XCTAssertEqualObjects([database findCommitsMatching:@"author:alice fix" error:NULL], @[ commit1 ]);
+  NSArray* results2 = @[ commit3, commit2, commit1 ];
+  XCTAssertEqualObjects([database findCommitsMatching:@"author:alice author:bob" error:NULL], results2);
+  XCTAssertEqualObjects([database findCommitsMatching:@"committer:bob" error:NULL], @[ commit2 ]);
+  XCTAssertEqualObjects([database findCommitsMatching:@"committer:carol" error:NULL], @[]);
+
+  // Test time filters
+  XCTAssertEqualObjects([database findCommitsMatching:@"after:2021 before:2022" error:NULL], @[ commit2 ]);
+  XCTAssertEqualObjects([database findCommitsMatching:@"after:2021-01-01 author:alice" error:NULL], @[ commit3 ]);
+  XCTAssertEqualObjects([database findCommitsMatching:@"before:2020-04 parser" error:NULL], @[ commit1 ]);
+  XCTAssertEqualObjects([database findCommitsMatching:@"after:2023 before:2021" error:NULL], @[]);
+  XCTAssertEqualObjects([database findCommitsMatching:@"after:yesterday" error:NULL], @[]);  // Searched as free text
+
+  // Test scoped terms
+  XCTAssertEqualObjects([database findCommitsMatching:@"message:parser" error:NULL], results1);
+  XCTAssertEqualObjects([database findCommitsMatching:@"message:alice" error:NULL], @[]);
+  XCTAssertEqualObjects([database findCommitsMatching:@"diff:parser" error:NULL], @[]);  // Diffs are not indexed
+
+  // Test ranking filtered results
+  GCCommitDatabaseSearchCursor* cursor = [database searchCursorForCommitsMatching:@"message:parser after:2022" order:kGCCommitDatabaseSearchOrder_Relevance];
+  XCTAssertEqualObjects([database fetchCommitsFromCursor:cursor maximumCount:10 error:NULL], @[ commit3 ]);
+  XCTAssertTrue(cursor.exhausted);
+  cursor = [database searchCursorForCommitsMatching:@"author:alice" order:kGCCommitDatabaseSearchOrder_Relevance];  // Without full text terms results are ordered by time
+  XCTAssertEqualObjects([database fetchCommitsFromCursor:cursor maximumCount:1 error:NULL], @[ commit3 ]);
+  XCTAssertEqualObjects([database fetchCommitsFromCursor:cursor maximumCount:10 error:NULL], @[ commit1 ]);
+
+  // Delete database
+  database = nil;
+  XCTAssertTrue([[NSFileManager defaultManager] removeItemAtPath:path error:NULL]);
+}
+
+- (void)testCommitDatabase_SearchSession {
+  // Make commits
+  GCCommit* commit1 = [self.repository createCommitFromHEADWithMessage:@"Fix parser" error:NULL];
+  XCTAssertNotNil(commit1);
+  GCCommit* commit2 = [self.repository createCommitFromHEADWithMessage:@"Fix crash in parser" error:NULL];
+  XCTAssertNotNil(commit2);
+  GCCommit* commit3 = [self.repository createCommitFromHEADWithMessage:@"Refactor parsing" error:NULL];
+  XCTAssertNotNil(commit3);
+  GCCommit* commit4 = [self.repository createCommitFromHEADWithMessage:@"Update docs" error:NULL];
+  XCTAssertNotNil(commit4);
+
+  // Create and populate database
+  NSString* path = [NSTemporaryDirectory() stringByAppendingPathComponent:[[[NSProcessInfo processInfo] globallyUniqueString] stringByAppendingPathExtension:@"db"]];
+  GCCommitDatabase* database = [[GCCommitDatabase alloc] initWithRepository:self.repository databasePath:path options:0 error:NULL];
+  XCTAssertNotNil(database);
+  XCTAssertTrue([database updateWithProgressHandler:NULL error:NULL]);
+
+  // Check refined and full searches while typing return the same results as independent searches
+  GCCommitDatabaseSearchSession* session = [database searchSession];
+  session.matchesLastTermAsPrefix = YES;
+  NSArray* matches = @[ @"p", @"pa", @"par", @"pars", @"parse", @"parser", @"parser ", @"parser f", @"parser fix", @"parser fix author:nobody", @"fix", @"fix OR docs", @"message:fix", @"message:fix crash" ];
+  NSArray* expectedMatches = @[ @"p*", @"pa*", @"par*", @"pars*", @"parse*", @"parser*", @"parser", @"parser f*", @"parser fix*", @"parser fix author:nobody", @"fix*", @"fix OR docs*", @"message:fix*", @"message:fix crash*" ];
+  for (NSUInteger i = 0; i < matches.count; ++i) {
+    NSArray* results = [session findCommitsMatching:matches[i] error:NULL];
+    XCTAssertNotNil(results);
+    XCTAssertEqualObjects(results, [database findCommitsMatching:expectedMatches[i] error:NULL], @"%@", matches[i]);
+  }
+
+  // Check commits are memoized
+  NSArray* results1 = [session findCommitsMatching:@"pars" error:NULL];
+  XCTAssertEqual(results1.count, 3);
+  NSArray* results2 = [session findCommitsMatching:@"parser" error:NULL];  // Refined
+  XCTAssertEqual(results2.count, 2);
+  for (GCCommit* commit in results2) {
+    XCTAssertTrue(results1[[results1 indexOfObject:commit]] == commit);
+  }
+  NSArray* results3 = [session findCommitsMatching:@"fix" error:NULL];  // Not refined
+  XCTAssertEqual(results3.count, 2);
+  for (GCCommit* commit in results3) {
+    XCTAssertTrue(results1[[results1 indexOfObject:commit]] == commit);
+  }
+
+  // Check terms are matched exactly by default
+  GCCommitDatabaseSearchSession* session2 = [database searchSession];
+  XCTAssertEqual([session2 findCommitsMatching:@"fix" error:NULL].count, 2);
+  XCTAssertEqualObjects([session2 findCommitsMatching:@"fixe" error:NULL], @[]);
+
+  // Delete database
+  database = nil;
+  XCTAssertTrue([[NSFileManager defaultManager] removeItemAtPath:path error:NULL]);
+}
+
+// Measures the time per keystroke of typing a query whose results are refined at each step
+- (void)testCommitDatabase_SearchSessionPerformance {
+  // Make commits
+  NSArray* subjects = @[ @"Fix parser", @"Refactor parsing", @"Update docs", @"Speed up parallel diffs" ];
+  for (NSUInteger i = 0; i < 2000; ++i) {
+    NSString* message = [NSString stringWithFormat:@"%@ (part %lu)", subjects[i % subjects.count], (unsigned long)i];
+    XCTAssertNotNil([self.repository createCommitFromHEADWithMessage:message error:NULL]);
+  }
+
+  // Create and populate database
+  NSString* path = [NSTemporaryDirectory() stringByAppendingPathComponent:[[[NSProcessInfo processInfo] globallyUniqueString] stringByAppendingPathExtension:@"db"]];
+  GCCommitDatabase* database = [[GCCommitDatabase alloc] initWithRepository:self.repository databasePath:path options:0 error:NULL];
+  XCTAssertNotNil(database);
+  XCTAssertTrue([database updateWithProgressHandler:NULL error:NULL]);
+
+  // Type a query one character at a time
+  NSString* query = @"parser fix";
+  [self measureBlock:^{
+    GCCommitDatabaseSearchSession* session = [database searchSession];
+    session.matchesLastTermAsPrefix = YES;
+    CFAbsoluteTime time = CFAbsoluteTimeGetCurrent();
+    for (NSUInteger i = 1; i <= query.length; ++i) {
+      XCTAssertNotNil([session findCommitsMatching:[query substringToIndex:i] error:NULL]);
+    }
+    time = CFAbsoluteTimeGetCurrent() - time;
+    XLOG_INFO(@"Searched %lu commits at %.2f ms per keystroke", (unsigned long)(subjects.count * 500), 1000.0 * time / (double)query.length);
+    XCTAssertEqual([session findCommitsMatching:query error:NULL].count, 500);
+  }];
+
+  // Delete database
+  database = nil;
+  XCTAssertTrue([[NSFileManager defaultManager] removeItemAtPath:path error:NULL]);
+}
+
 @end
@@ -17,21 +17,45 @@
 
 typedef NS_OPTIONS(NSUInteger, GCCommitDatabaseOptions) {
   kGCCommitDatabaseOptions_IndexDiffs = (1 << 0),
-  kGCCommitDatabaseOptions_QueryOnly = (1 << 1)
+  kGCCommitDatabaseOptions_QueryOnly = (1 << 1),
+  kGCCommitDatabaseOptions_Shared = (1 << 2)  // Database can be shared by repositories with common history (e.g. clones and worktrees) as long as they all use the same options - Commits and diffs are indexed once and kept until no repository references them anymore
+};
+
+typedef NS_ENUM(NSUInteger, GCCommitDatabaseSearchOrder) {
+  kGCCommitDatabaseSearchOrder_Time = 0,  // Newest first
+  kGCCommitDatabaseSearchOrder_Relevance  // Best match first
 };
 
 typedef BOOL (^GCCommitDatabaseProgressHandler)(BOOL firstUpdate, NSUInteger addedCommits, NSUInteger removedCommits);
 
-@class GCRepository;
+@class GCRepository, GCCommitDatabase;
 
 extern NSString* const SQLiteErrorDomain;
 
-// This class CANNOT be used from multiple threads simultaneously
+@interface GCCommitDatabaseSearchCursor : NSObject
+@property(nonatomic, readonly) NSString* match;
+@property(nonatomic, readonly) GCCommitDatabaseSearchOrder order;
+@property(nonatomic, readonly, getter=isExhausted) BOOL exhausted;
+@end
+
+// Sessions keep the results of the last search so a search refining it (more terms, longer prefix terms or narrower filters) only checks these results again
+@interface GCCommitDatabaseSearchSession : NSObject
+@property(nonatomic, readonly) GCCommitDatabase* database;
+@property(nonatomic) BOOL matchesLastTermAsPrefix;  // Default is NO - Set to YES for search-as-you-type so typing more characters refines the previous search
+- (NSArray*)findCommitsMatching:(NSString*)match error:(NSError**)error;  // Same as -[GCCommitDatabase findCommitsMatching:error:]
+@end
+
+// Searches query the database from multiple threads simultaneously and while an update is in progress but updates CANNOT run concurrently
+// However the commits found are looked up in the repository on the calling thread and like any GCRepository it CANNOT be used from multiple threads simultaneously
 @interface GCCommitDatabase : NSObject
 @property(nonatomic, readonly) GCRepository* repository;  // NOT RETAINED
 @property(nonatomic, readonly) NSString* databasePath;
 @property(nonatomic, readonly) GCCommitDatabaseOptions options;
 - (instancetype)initWithRepository:(GCRepository*)repository databasePath:(NSString*)path options:(GCCommitDatabaseOptions)options error:(NSError**)error;
-- (BOOL)updateWithProgressHandler:(GCCommitDatabaseProgressHandler)handler error:(NSError**)error;  // Handler can be NULL - Return NO from handler to cancel
-- (NSArray*)findCommitsMatching:(NSString*)match error:(NSError**)error;  // Search commit messages, authors and committers and orders results from newest to oldest - Returns nil on error
+- (BOOL)updateWithProgressHandler:(GCCommitDatabaseProgressHandler)handler error:(NSError**)error;  // Handler can be NULL - Return NO from handler to cancel (changes committed in previous chunks are kept and the next update resumes from there)
+- (NSArray*)findCommitsMatching:(NSString*)match error:(NSError**)error;  // Search commit messages, diffs, authors and committers and orders results from newest to oldest - See below for filters - Returns nil on error
+- (NSArray*)findCommitsForFile:(NSString*)path followRenames:(BOOL)follow error:(NSError**)error;  // Requires kGCCommitDatabaseOptions_IndexDiffs - Orders results from newest to oldest - Returns nil on error
+- (GCCommitDatabaseSearchCursor*)searchCursorForCommitsMatching:(NSString*)match order:(GCCommitDatabaseSearchOrder)order;  // Terms ending with '*' match as prefixes - Filters "author:", "committer:", "message:", "diff:", "path:src/*.m", "after:YYYY[-MM[-DD]]" and "before:YYYY[-MM[-DD]]" restrict results
+- (NSArray*)fetchCommitsFromCursor:(GCCommitDatabaseSearchCursor*)cursor maximumCount:(NSUInteger)count error:(NSError**)error;  // Returns the next page of results (empty once the cursor is exhausted) - Returns nil on error
+- (GCCommitDatabaseSearchSession*)searchSession;  // Sessions must be discarded after the database is updated
 @end
@@ -18,34 +18,77 @@
 #endif
 
 #import <sqlite3.h>
+#import <pthread.h>
+#import <sys/stat.h>
+#if defined(__SSE2__)
+#import <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#import <arm_neon.h>
+#endif
 
 #import "GCPrivate.h"
 
 #define __UNIQUE_RELATIONS__ 1
 #define __CHECK_CONSISTENCY__ 0
 
-#define kSchemaVersion 3
+#define kSchemaVersion 8
 
+#define kRepositoriesTableName "repositories"
 #define kTipsTableName "tips"
 #define kCommitsTableName "commits"
 #define kRelationsTableName "relations"
 #define kUsersTableName "users"
+#define kPathsTableName "paths"
+#define kCommitPathsTableName "commit_paths"
+#define kFrontierTableName "frontier"
 
 #define kFTSPrefix "fts_"
 #define kFTSMessagesTableName kFTSPrefix "messages"
 #define kFTSDiffsTableName kFTSPrefix "diffs"
 #define kFTSUsersTableName kFTSPrefix "users"
 
+#define kFTSTokenizer "tokenize=\"unicode61 tokenchars '_'\""  // Don't split tokens on '_'
+#define kFTSPrefixIndexes "prefix='2 3 4'"  // Speeds up prefix queries like "refact*"
+
+#define kMaxSearchStatements 32  // Per reader
+#define kMaxRefinedSearchResults 10000  // Above this running the search again is about as fast as intersecting the previous results
+#define kMaxMemoizedSearchCommits 100000  // Per session
+
+#define kAuthorSearchPrefix "author:"
+#define kCommitterSearchPrefix "committer:"
+#define kMessageSearchPrefix "message:"
+#define kDiffSearchPrefix "diff:"
+#define kPathSearchPrefix "path:"
+#define kAfterSearchPrefix "after:"
+#define kBeforeSearchPrefix "before:"
+
+// Search statements bind the keyset to continue from to ?1 and ?2, the limit to ?3 and the arguments of the compiled search from ?4 on
+#define kFirstSearchArgument 4
+
+// Returns the ID and bm25 score (lower is better) of commits whose message, diff, author or committer match (free text terms are always the first argument of the search)
+#define kSearchMatchesQuery                                                                                                                                                                                 \
+  "SELECT rowid AS id, bm25(" kFTSMessagesTableName ") AS score FROM " kFTSMessagesTableName " WHERE " kFTSMessagesTableName " MATCH ?4"                                                                 \
+  " UNION ALL SELECT rowid, bm25(" kFTSDiffsTableName ") FROM " kFTSDiffsTableName " WHERE " kFTSDiffsTableName " MATCH ?4"                                                                              \
+  " UNION ALL SELECT " kCommitsTableName "._id_, bm25(" kFTSUsersTableName ") FROM " kFTSUsersTableName " JOIN " kCommitsTableName " ON " kCommitsTableName ".author=" kFTSUsersTableName ".rowid WHERE " kFTSUsersTableName " MATCH ?4" \
+  " UNION ALL SELECT " kCommitsTableName "._id_, bm25(" kFTSUsersTableName ") FROM " kFTSUsersTableName " JOIN " kCommitsTableName " ON " kCommitsTableName ".committer=" kFTSUsersTableName ".rowid WHERE " kFTSUsersTableName " MATCH ?4"
+
 #define kMinWordLength 2
-#define kWordCacheSize 1024
+#define kWordSetInitialCapacity 1024  // Must be a power of 2
+#define kScanBlockSize 16
 
 #define kMaxFileSizeForTextDiff (32 * 1024 * 1024)  // libgit2 default is 512 MiB
 
+#define kDefaultUpdateChunkSize 10000  // Number of added commits after which the update is committed
+
+#define kMaxDiffWorkers 8
+#define kMaxReaders 4  // Maximum number of read-only connections used to run searches concurrently
+#define kReaderBusyTimeout 1000  // Milliseconds
+#define kSharedWriterBusyTimeout 60000  // Milliseconds - Updates of other repositories sharing the database hold the write lock for at most a chunk
+#define kDiffWindowPerWorker 64  // Maximum number of computed diffs waiting to be written per worker
+
 #define IS_ALPHANUMERICAL(c) (((c) >= '0' && (c) <= '9') || ((c) >= 'A' && (c) <= 'Z') || ((c) >= 'a' && (c) <= 'z'))
 #define IS_DELIMITER(c) (((c) < 0x80) && !IS_ALPHANUMERICAL(c) && ((c) != '_'))  // Don't split tokens on '_'
-
-#define SET_BIT(a, n) (a[(n) / CHAR_BIT] |= (1 << ((n) % CHAR_BIT)))
-#define GET_BIT(a, n) (a[(n) / CHAR_BIT] & (1 << ((n) % CHAR_BIT)))
+#define TO_LOWER(c) ((((c) >= 'A') && ((c) <= 'Z')) ? (c) + ('a' - 'A') : (c))
 
 #define LOG_SQLITE_ERROR(__CODE__)                                              \
   do {                                                                          \
@@ -94,21 +137,59 @@ typedef NS_ENUM(int, Statement) {
   kStatement_AddFTSUser,
   kStatement_AddFTSMessage,
   kStatement_AddFTSDiff,
+  kStatement_AddPath,
+  kStatement_AddCommitPath,
+  kStatement_ListFrontier,
+  kStatement_AddFrontier,
+  kStatement_ClearFrontier,
   kStatement_EndTransaction,
-  kStatement_SearchCommits,
+  kStatement_FindPathID,
+  kStatement_FindCommitsForPath,
   kNumStatements
 };
 
 typedef struct {
   const unsigned char* start;
   size_t length;
+  unsigned int hash;
 } Word;
 
+typedef struct {
+  Word* slots;  // Open-addressing table with linear probing where empty slots have a NULL start
+  size_t mask;
+  size_t count;
+} WordSet;
+
 typedef struct {
   git_commit* commit;
   sqlite3_int64 childID;
 } Item;
 
+typedef NS_ENUM(int, DiffResult) {
+  kDiffResult_NotQueued = 0,
+  kDiffResult_Success,
+  kDiffResult_Failed
+};
+
+// Computes diffs on worker threads (each with its own libgit2 repository) in the order the commits will be written to the database
+@interface GCDiffPipeline : NSObject
+- (instancetype)initWithRepositoryPath:(NSString*)path commitOIDs:(const git_oid*)oids count:(NSUInteger)count workerCount:(NSUInteger)workerCount;
+- (DiffResult)takeDiffForCommit:(const git_oid*)oid addedWords:(NSMutableData*)addedWords deletedWords:(NSMutableData*)deletedWords paths:(NSMutableData*)paths hasChanges:(BOOL*)hasChanges;  // Blocks if the diff is being computed - Returns kDiffResult_NotQueued if the caller must compute the diff itself
+- (void)finish;  // Must be called before releasing
+@end
+
+@class GCSearchQuery;
+
+@interface GCCommitDatabase ()
+- (BOOL)_findCommitIDs:(NSMutableData*)commitIDs oids:(NSMutableData*)oids matchingQuery:(GCSearchQuery*)query error:(NSError**)error;  // From newest to oldest
+- (NSIndexSet*)_filterCommitIDs:(NSData*)commitIDs withQuery:(GCSearchQuery*)query previousQuery:(GCSearchQuery*)previousQuery error:(NSError**)error;  // Returns the indexes of the commits still matching
+- (BOOL)_addCommitWithOID:(const git_oid*)oid toResults:(NSMutableArray*)results usingHistory:(GCHistory*)history error:(NSError**)error;
+@end
+
+@interface GCCommitDatabaseSearchSession ()
+- (instancetype)initWithDatabase:(GCCommitDatabase*)database history:(GCHistory*)history;
+@end
+
 NSString* const SQLiteErrorDomain = @"SQLiteErrorDomain";
 
 static NSError* _NewSQLiteError(int code, const char* message) {
@@ -117,12 +198,62 @@ static NSError* _NewSQLiteError(int code, const char* message) {
                          userInfo:@{NSLocalizedDescriptionKey : [NSString stringWithUTF8String:message]}];
 }
 
+@interface GCCommitDatabaseSearchCursor ()
+@property(nonatomic, readonly) NSString* sql;  // nil if there is nothing to search
+@property(nonatomic, readonly) NSArray* arguments;
+@property(nonatomic, readonly, getter=isScored) BOOL scored;  // Results are ordered by relevance
+@property(nonatomic, getter=isExhausted) BOOL exhausted;
+@property(nonatomic) sqlite3_int64 lastTime;
+@property(nonatomic) double lastScore;
+@property(nonatomic) sqlite3_int64 lastID;
+@end
+
+@implementation GCCommitDatabaseSearchCursor
+
+- (instancetype)initWithMatch:(NSString*)match sql:(NSString*)sql arguments:(NSArray*)arguments scored:(BOOL)scored order:(GCCommitDatabaseSearchOrder)order {
+  if ((self = [super init])) {
+    _match = [match copy];
+    _sql = [sql copy];
+    _arguments = [arguments copy];
+    _scored = scored;
+    _order = order;
+    if (_scored) {
+      _lastScore = -DBL_MAX;  // Scores are negative and lower is better
+      _lastID = 0;
+    } else {
+      _lastTime = INT64_MAX;
+      _lastID = INT64_MAX;
+    }
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [_match release];
+  [_sql release];
+  [_arguments release];
+
+  [super dealloc];
+}
+
+@end
+
 // TODO: Consider using triggers to handle retain/release
 // TODO: Garbage collect users table
 @implementation GCCommitDatabase {
   sqlite3* _database;
   sqlite3_stmt** _statements;
   BOOL _ready;
+  NSUInteger _diffWorkerCount;
+  NSUInteger _updateChunkSize;
+  NSUInteger _uncommittedCount;  // Number of commits added since the last chunk was committed
+  BOOL _reader;  // Read-only connection owned by the pool of another instance
+  sqlite3_int64 _repositoryID;  // Identifies the tips and frontier of the repository in shared databases
+  NSMutableDictionary* _searchStatements;  // Maps compiled searches to their prepared statements
+  NSMutableArray* _idleReaders;
+  NSUInteger _readerCount;
+  pthread_mutex_t _readerMutex;
+  pthread_cond_t _readerCondition;
 }
 
 static void _SQLiteLog(void* unused, int error, const char* message) {
@@ -164,9 +295,17 @@ static int _CaseInsensitiveUTF8Compare(void* context, int length1, const void* b
   return (int)result;
 }
 
+// Readers use a private cache as table-level locking of the shared cache would otherwise make them wait on the writer despite the WAL journal
+// Shared databases also use a private cache so writers for different repositories wait on each other's transactions instead of failing with SQLITE_LOCKED
 - (BOOL)_initializeDatabase:(NSString*)path error:(NSError**)error {
-  CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_open_v2, path.fileSystemRepresentation, &_database, SQLITE_OPEN_CREATE | SQLITE_OPEN_READWRITE | SQLITE_OPEN_NOMUTEX | SQLITE_OPEN_SHAREDCACHE, NULL);
+  BOOL shared = _options & kGCCommitDatabaseOptions_Shared ? YES : NO;
+  CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_open_v2, path.fileSystemRepresentation, &_database, SQLITE_OPEN_CREATE | SQLITE_OPEN_READWRITE | SQLITE_OPEN_NOMUTEX | (_reader || shared ? SQLITE_OPEN_PRIVATECACHE : SQLITE_OPEN_SHAREDCACHE), NULL);
   CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_extended_result_codes, _database, true);
+  if (_reader) {
+    CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_busy_timeout, _database, kReaderBusyTimeout);  // Only needed in the rare cases where WAL readers must wait e.g. while the WAL index is rebuilt
+  } else if (shared) {
+    CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_busy_timeout, _database, kSharedWriterBusyTimeout);
+  }
   CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_exec, _database, "PRAGMA page_size = 32768", NULL, NULL, NULL);  // Default appears to be 4096 on OS X
   CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_exec, _database, "PRAGMA cache_size = 500", NULL, NULL, NULL);  // Default appears to be 500 on OS X
   CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_exec, _database, "PRAGMA journal_mode = WAL", NULL, NULL, NULL);
@@ -219,21 +358,54 @@ static int _CaseInsensitiveUTF8Compare(void* context, int length1, const void* b
   CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_exec, _database, "CREATE UNIQUE INDEX " kRelationsTableName "_child_parent on " kRelationsTableName "(child, parent)", NULL, NULL, NULL);
 #endif
 
-  // Tips table
+  // Repositories table (with implicit index for "path")
+  CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_exec, _database, "CREATE TABLE " kRepositoriesTableName "("
+                                                           "_id_ INTEGER PRIMARY KEY,"
+                                                           "path TEXT UNIQUE NOT NULL"
+                                                           ")",
+                              NULL, NULL, NULL);
+
+  // Tips table (each repository retains its tip commits so commits are shared by all repositories whose history contains them)
   CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_exec, _database, "CREATE TABLE " kTipsTableName "("
                                                            "_id_ INTEGER PRIMARY KEY,"
+                                                           "repository INTEGER NOT NULL,"
                                                            "`commit` INTEGER NOT NULL"
                                                            ")",
                               NULL, NULL, NULL);
 
+  // Paths table (with implicit index for "path" which also serves GLOB queries with a constant prefix)
+  CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_exec, _database, "CREATE TABLE " kPathsTableName "("
+                                                           "_id_ INTEGER PRIMARY KEY,"
+                                                           "path TEXT UNIQUE NOT NULL"
+                                                           ")",
+                              NULL, NULL, NULL);
+
+  // Commit paths table ("previous" is the old path of renamed files)
+  CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_exec, _database, "CREATE TABLE " kCommitPathsTableName "("
+                                                           "_id_ INTEGER PRIMARY KEY,"
+                                                           "`commit` INTEGER NOT NULL,"
+                                                           "path INTEGER NOT NULL,"
+                                                           "previous INTEGER"
+                                                           ")",
+                              NULL, NULL, NULL);
+
+  // Frontier table (commits queued for adding when the last chunk of an update of a repository was committed and the ID of their child)
+  CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_exec, _database, "CREATE TABLE " kFrontierTableName "("
+                                                           "_id_ INTEGER PRIMARY KEY,"
+                                                           "repository INTEGER NOT NULL,"
+                                                           "sha1 BLOB NOT NULL,"
+                                                           "child INTEGER NOT NULL"
+                                                           ")",
+                              NULL, NULL, NULL);
+
   // FTS for commit messages (external content)
-  CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_exec, _database, "CREATE VIRTUAL TABLE " kFTSMessagesTableName " USING fts4(content='" kCommitsTableName "', message, tokenize=unicode61 'tokenchars=_')", NULL, NULL, NULL);  // Don't split tokens on '_'
+  CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_exec, _database, "CREATE VIRTUAL TABLE " kFTSMessagesTableName " USING fts5(message, content='" kCommitsTableName "', content_rowid='_id_', " kFTSTokenizer ", " kFTSPrefixIndexes ")", NULL, NULL, NULL);
 
   // FTS for commit diffs (stored content)
-  CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_exec, _database, "CREATE VIRTUAL TABLE " kFTSDiffsTableName " USING fts4(added, deleted, tokenize=unicode61 'tokenchars=_')", NULL, NULL, NULL);  // Don't split tokens on '_'
+  CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_exec, _database, "CREATE VIRTUAL TABLE " kFTSDiffsTableName " USING fts5(added, deleted, " kFTSTokenizer ", " kFTSPrefixIndexes ")", NULL, NULL, NULL);
 
   // FTS for users (external content)
-  CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_exec, _database, "CREATE VIRTUAL TABLE " kFTSUsersTableName " USING fts4(content='" kUsersTableName "', email, name, tokenize=unicode61)", NULL, NULL, NULL);
+  CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_exec, _database, "CREATE VIRTUAL TABLE " kFTSUsersTableName " USING fts5(email, name, content='" kUsersTableName "', content_rowid='_id_', tokenize=unicode61, " kFTSPrefixIndexes ")", NULL, NULL, NULL);
 
   // Save version
   CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_exec, _database, [[NSString stringWithFormat:@"PRAGMA user_version = %i", version] UTF8String], NULL, NULL, NULL);
@@ -242,21 +414,24 @@ static int _CaseInsensitiveUTF8Compare(void* context, int length1, const void* b
 }
 
 // DELETE triggers are required because we must delete from FTS *before* deleting from content table which is impractical to do in -_removeCommitsForTip
+// External content FTS5 tables must be passed the indexed values to delete a row
 // We don't need INSERT or UPDATE triggers since we never update content that is indexed by FTS
+// Triggers and deferred indexes may already have been created by the update of another repository sharing the database
 - (BOOL)_initializeTriggers:(NSError**)error {
   // Triggers for FTS commits
   CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_exec, _database, "\
-    CREATE TRIGGER " kCommitsTableName "_before_delete BEFORE DELETE ON " kCommitsTableName " BEGIN \
-      DELETE FROM " kFTSMessagesTableName " WHERE docid=old.rowid; \
-      DELETE FROM " kFTSDiffsTableName " WHERE docid=old.rowid; \
+    CREATE TRIGGER IF NOT EXISTS " kCommitsTableName "_before_delete BEFORE DELETE ON " kCommitsTableName " BEGIN \
+      INSERT INTO " kFTSMessagesTableName "(" kFTSMessagesTableName ", rowid, message) VALUES('delete', old._id_, old.message); \
+      DELETE FROM " kFTSDiffsTableName " WHERE rowid=old._id_; \
+      DELETE FROM " kCommitPathsTableName " WHERE `commit`=old._id_; \
     END; \
   ",
                               NULL, NULL, NULL);
 
   // Triggers for FTS users
   CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_exec, _database, "\
-    CREATE TRIGGER " kUsersTableName "_before_delete BEFORE DELETE ON " kUsersTableName " BEGIN \
-      DELETE FROM " kFTSUsersTableName " WHERE docid=old.rowid; \
+    CREATE TRIGGER IF NOT EXISTS " kUsersTableName "_before_delete BEFORE DELETE ON " kUsersTableName " BEGIN \
+      INSERT INTO " kFTSUsersTableName "(" kFTSUsersTableName ", rowid, email, name) VALUES('delete', old._id_, old.email, old.name); \
     END; \
   ",
                               NULL, NULL, NULL);
@@ -266,16 +441,23 @@ static int _CaseInsensitiveUTF8Compare(void* context, int length1, const void* b
 
 - (BOOL)_initializeDeferredIndexes:(NSError**)error {
   // Indexes for finding commits by author or comitter
-  CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_exec, _database, "CREATE INDEX " kCommitsTableName "_author on " kCommitsTableName "(author)", NULL, NULL, NULL);
-  CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_exec, _database, "CREATE INDEX " kCommitsTableName "_committer on " kCommitsTableName "(committer)", NULL, NULL, NULL);
+  CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_exec, _database, "CREATE INDEX IF NOT EXISTS " kCommitsTableName "_author on " kCommitsTableName "(author)", NULL, NULL, NULL);
+  CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_exec, _database, "CREATE INDEX IF NOT EXISTS " kCommitsTableName "_committer on " kCommitsTableName "(committer)", NULL, NULL, NULL);
+
+  // Index for restricting searches to a time range and returning their results from newest to oldest
+  CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_exec, _database, "CREATE INDEX IF NOT EXISTS " kCommitsTableName "_time on " kCommitsTableName "(time)", NULL, NULL, NULL);
 
 #if !__UNIQUE_RELATIONS__
   // Index for finding parents of a given child (works as a covering index too)
-  CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_exec, _database, "CREATE INDEX " kRelationsTableName "_child_parent on " kRelationsTableName "(child, parent)", NULL, NULL, NULL);
+  CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_exec, _database, "CREATE INDEX IF NOT EXISTS " kRelationsTableName "_child_parent on " kRelationsTableName "(child, parent)", NULL, NULL, NULL);
 #endif
 
-  // Index for deleting tips by commit ID
-  CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_exec, _database, "CREATE INDEX " kTipsTableName "_commit on " kTipsTableName "(`commit`)", NULL, NULL, NULL);
+  // Indexes for finding commits by path (works as a covering index too) and deleting commit paths by commit ID
+  CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_exec, _database, "CREATE INDEX IF NOT EXISTS " kCommitPathsTableName "_path_commit on " kCommitPathsTableName "(path, `commit`)", NULL, NULL, NULL);
+  CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_exec, _database, "CREATE INDEX IF NOT EXISTS " kCommitPathsTableName "_commit on " kCommitPathsTableName "(`commit`)", NULL, NULL, NULL);
+
+  // Index for listing the tips of a repository and deleting them by commit ID
+  CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_exec, _database, "CREATE INDEX IF NOT EXISTS " kTipsTableName "_repository_commit on " kTipsTableName "(repository, `commit`)", NULL, NULL, NULL);
 
   return YES;
 }
@@ -284,42 +466,60 @@ static int _CaseInsensitiveUTF8Compare(void* context, int length1, const void* b
   _statements = calloc(kNumStatements, sizeof(sqlite3_stmt*));
 
   if (!(_options & kGCCommitDatabaseOptions_QueryOnly)) {
+    XLOG_DEBUG_CHECK(!_reader);
     CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_prepare_v2, _database, "BEGIN IMMEDIATE TRANSACTION", -1, &_statements[kStatement_BeginTransaction], NULL);
 
-    CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_prepare_v2, _database, "SELECT " kCommitsTableName ".sha1 FROM " kCommitsTableName " JOIN " kTipsTableName " ON " kTipsTableName ".`commit`=" kCommitsTableName "._id_", -1, &_statements[kStatement_ListTipSHA1s], NULL);
+    CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_prepare_v2, _database, "SELECT " kCommitsTableName ".sha1 FROM " kCommitsTableName " JOIN " kTipsTableName " ON " kTipsTableName ".`commit`=" kCommitsTableName "._id_ WHERE " kTipsTableName ".repository=?1", -1, &_statements[kStatement_ListTipSHA1s], NULL);
     CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_prepare_v2, _database, "SELECT _id_ FROM " kCommitsTableName " WHERE sha1=?1", -1, &_statements[kStatement_FindCommitID], NULL);
     CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_prepare_v2, _database, "SELECT parent FROM " kRelationsTableName " WHERE child=?1", -1, &_statements[kStatement_LookupCommitParentIDs], NULL);
     CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_prepare_v2, _database, "SELECT _id_ FROM " kUsersTableName " WHERE email=?1 AND name=?2", -1, &_statements[kStatement_FindUserID], NULL);
 
-    CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_prepare_v2, _database, "INSERT INTO " kTipsTableName " VALUES (NULL, ?1)", -1, &_statements[kStatement_AddTip], NULL);
+    CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_prepare_v2, _database, "INSERT INTO " kTipsTableName " VALUES (NULL, ?2, ?1)", -1, &_statements[kStatement_AddTip], NULL);
     CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_prepare_v2, _database, "INSERT INTO " kCommitsTableName " VALUES (NULL, ?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8)", -1, &_statements[kStatement_AddCommit], NULL);
     CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_prepare_v2, _database, "INSERT INTO " kUsersTableName " VALUES (NULL, ?1, ?2)", -1, &_statements[kStatement_AddUser], NULL);
     CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_prepare_v2, _database, "INSERT INTO " kRelationsTableName " VALUES (NULL, ?1, ?2)", -1, &_statements[kStatement_AddRelation], NULL);
+    CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_prepare_v2, _database, "INSERT INTO " kPathsTableName " VALUES (NULL, ?1)", -1, &_statements[kStatement_AddPath], NULL);
+    CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_prepare_v2, _database, "INSERT INTO " kCommitPathsTableName " VALUES (NULL, ?1, ?2, ?3)", -1, &_statements[kStatement_AddCommitPath], NULL);
+
+    CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_prepare_v2, _database, "SELECT sha1, child FROM " kFrontierTableName " WHERE repository=?1 ORDER BY _id_", -1, &_statements[kStatement_ListFrontier], NULL);
+    CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_prepare_v2, _database, "INSERT INTO " kFrontierTableName " VALUES (NULL, ?3, ?1, ?2)", -1, &_statements[kStatement_AddFrontier], NULL);
+    CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_prepare_v2, _database, "DELETE FROM " kFrontierTableName " WHERE repository=?1", -1, &_statements[kStatement_ClearFrontier], NULL);
 
     CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_prepare_v2, _database, "UPDATE " kCommitsTableName " SET retain_count=retain_count+1 WHERE _id_=?1", -1, &_statements[kStatement_RetainCommit], NULL);
     CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_prepare_v2, _database, "UPDATE " kCommitsTableName " SET retain_count=retain_count-1 WHERE _id_=?1", -1, &_statements[kStatement_ReleaseCommit], NULL);
 
-    CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_prepare_v2, _database, "DELETE FROM " kTipsTableName " WHERE `commit`=?1", -1, &_statements[kStatement_DeleteTip], NULL);
+    CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_prepare_v2, _database, "DELETE FROM " kTipsTableName " WHERE repository=?2 AND `commit`=?1", -1, &_statements[kStatement_DeleteTip], NULL);
     CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_prepare_v2, _database, "DELETE FROM " kCommitsTableName " WHERE _id_=?1 AND retain_count=0", -1, &_statements[kStatement_DeleteOrphanCommit], NULL);
     CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_prepare_v2, _database, "DELETE FROM " kRelationsTableName " WHERE child=?1 OR parent=?1", -1, &_statements[kStatement_DeleteCommitRelations], NULL);
 
-    CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_prepare_v2, _database, "INSERT INTO " kFTSUsersTableName "(docid, email, name) VALUES(?1, ?2, ?3)", -1, &_statements[kStatement_AddFTSUser], NULL);
-    CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_prepare_v2, _database, "INSERT INTO " kFTSMessagesTableName "(docid, message) VALUES(?1, ?2)", -1, &_statements[kStatement_AddFTSMessage], NULL);
-    CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_prepare_v2, _database, "INSERT INTO " kFTSDiffsTableName "(docid, added, deleted) VALUES(?1, ?2, ?3)", -1, &_statements[kStatement_AddFTSDiff], NULL);
+    CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_prepare_v2, _database, "INSERT INTO " kFTSUsersTableName "(rowid, email, name) VALUES(?1, ?2, ?3)", -1, &_statements[kStatement_AddFTSUser], NULL);
+    CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_prepare_v2, _database, "INSERT INTO " kFTSMessagesTableName "(rowid, message) VALUES(?1, ?2)", -1, &_statements[kStatement_AddFTSMessage], NULL);
+    CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_prepare_v2, _database, "INSERT INTO " kFTSDiffsTableName "(rowid, added, deleted) VALUES(?1, ?2, ?3)", -1, &_statements[kStatement_AddFTSDiff], NULL);
 
     CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_prepare_v2, _database, "END TRANSACTION", -1, &_statements[kStatement_EndTransaction], NULL);
+
+    // Bind the repository once as bindings persist across resets
+    CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_bind_int64, _statements[kStatement_ListTipSHA1s], 1, _repositoryID);
+    CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_bind_int64, _statements[kStatement_AddTip], 2, _repositoryID);
+    CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_bind_int64, _statements[kStatement_DeleteTip], 2, _repositoryID);
+    CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_bind_int64, _statements[kStatement_ListFrontier], 1, _repositoryID);
+    CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_bind_int64, _statements[kStatement_AddFrontier], 3, _repositoryID);
+    CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_bind_int64, _statements[kStatement_ClearFrontier], 1, _repositoryID);
+  }
+
+  // Used by updates to look up existing paths and by searches to find the path to search for
+  CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_prepare_v2, _database, "SELECT _id_ FROM " kPathsTableName " WHERE path=?1", -1, &_statements[kStatement_FindPathID], NULL);
+
+  // Searches only run on readers (search statements depend on the search and are prepared on demand)
+  if (!_reader) {
+    return YES;
   }
 
+  // Path statements return commits from newest to oldest
   CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_prepare_v2, _database, " \
-                              SELECT sha1, time FROM " kFTSMessagesTableName " JOIN " kCommitsTableName " ON " kCommitsTableName ".rowid=" kFTSMessagesTableName ".docid WHERE " kFTSMessagesTableName " MATCH ?1 \
-                              UNION \
-                              SELECT sha1, time FROM " kFTSDiffsTableName " JOIN " kCommitsTableName " ON " kCommitsTableName ".rowid=" kFTSDiffsTableName ".docid WHERE " kFTSDiffsTableName " MATCH ?1 \
-                              UNION \
-                              SELECT sha1, time FROM " kFTSUsersTableName " JOIN " kUsersTableName " ON " kUsersTableName ".rowid=" kFTSUsersTableName ".docid JOIN " kCommitsTableName " ON " kCommitsTableName ".author=" kUsersTableName "._id_ WHERE " kFTSUsersTableName " MATCH ?1 \
-                              UNION \
-                              SELECT sha1, time FROM " kFTSUsersTableName " JOIN " kUsersTableName " ON " kUsersTableName ".rowid=" kFTSUsersTableName ".docid JOIN " kCommitsTableName " ON " kCommitsTableName ".committer=" kUsersTableName "._id_ WHERE " kFTSUsersTableName " MATCH ?1 \
-                              ORDER BY time DESC",
-                              -1, &_statements[kStatement_SearchCommits], NULL);
+                              SELECT sha1, time, " kCommitsTableName "._id_, previous FROM " kCommitPathsTableName " JOIN " kCommitsTableName " ON " kCommitsTableName "._id_=" kCommitPathsTableName ".`commit` \
+                              WHERE " kCommitPathsTableName ".path=?1 AND time <= ?2 ORDER BY time DESC, " kCommitsTableName "._id_ DESC",
+                              -1, &_statements[kStatement_FindCommitsForPath], NULL);
 
   return YES;
 }
@@ -348,11 +548,38 @@ static int _CaseInsensitiveUTF8Compare(void* context, int length1, const void* b
   return version;
 }
 
+// Repositories are identified by the path of their ".git" directory which is unique for each clone and worktree
+// Repositories that were deleted or moved are pruned by the next update of another repository sharing the database
+- (BOOL)_initializeRepositoryID:(NSError**)error {
+  BOOL success = NO;
+  const char* path = _repository.repositoryPath.fileSystemRepresentation;
+  sqlite3_stmt* insertStatement = NULL;
+  sqlite3_stmt* selectStatement = NULL;
+  int result;
+
+  CALL_SQLITE_FUNCTION_GOTO(cleanup, sqlite3_prepare_v2, _database, "INSERT OR IGNORE INTO " kRepositoriesTableName " VALUES (NULL, ?1)", -1, &insertStatement, NULL);
+  CALL_SQLITE_FUNCTION_GOTO(cleanup, sqlite3_bind_text, insertStatement, 1, path, -1, SQLITE_STATIC);
+  result = sqlite3_step(insertStatement);
+  CHECK_SQLITE_FUNCTION_CALL(goto cleanup, result, == SQLITE_DONE);
+
+  CALL_SQLITE_FUNCTION_GOTO(cleanup, sqlite3_prepare_v2, _database, "SELECT _id_ FROM " kRepositoriesTableName " WHERE path=?1", -1, &selectStatement, NULL);
+  CALL_SQLITE_FUNCTION_GOTO(cleanup, sqlite3_bind_text, selectStatement, 1, path, -1, SQLITE_STATIC);
+  result = sqlite3_step(selectStatement);
+  CHECK_SQLITE_FUNCTION_CALL(goto cleanup, result, == SQLITE_ROW);
+  _repositoryID = sqlite3_column_int64(selectStatement, 0);
+  success = YES;
+
+cleanup:
+  sqlite3_finalize(selectStatement);
+  sqlite3_finalize(insertStatement);
+  return success;
+}
+
 - (BOOL)_checkReady:(NSError**)error {
   sqlite3_stmt* statement;
-  CALL_LIBGIT2_FUNCTION_RETURN(NO, sqlite3_prepare_v2, _database, "SELECT 1 FROM sqlite_master WHERE type='trigger'", -1, &statement, NULL);
+  CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_prepare_v2, _database, "SELECT 1 FROM sqlite_master WHERE type='trigger'", -1, &statement, NULL);
   int result = sqlite3_step(statement);
-  CALL_LIBGIT2_FUNCTION_RETURN(NO, sqlite3_finalize, statement);
+  CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_finalize, statement);
   if (result == SQLITE_ROW) {
     _ready = YES;
   } else {
@@ -366,6 +593,11 @@ static int _CaseInsensitiveUTF8Compare(void* context, int length1, const void* b
     _repository = repository;
     _databasePath = [path copy];
     _options = options;
+    _diffWorkerCount = MIN(MAX([[NSProcessInfo processInfo] activeProcessorCount], (NSUInteger)1) - 1, kMaxDiffWorkers);  // Leave a core to the writer
+    _updateChunkSize = kDefaultUpdateChunkSize;
+    _idleReaders = [[NSMutableArray alloc] init];
+    pthread_mutex_init(&_readerMutex, NULL);
+    pthread_cond_init(&_readerCondition, NULL);
 
     if (![self _initializeDatabase:path error:error]) {
       [self release];
@@ -386,6 +618,11 @@ static int _CaseInsensitiveUTF8Compare(void* context, int length1, const void* b
           [self release];
           return nil;
         }
+        if ((_options & kGCCommitDatabaseOptions_Shared) && (currentVersion / 2 == kSchemaVersion)) {  // Don't throw away the work of the other repositories
+          GC_SET_GENERIC_ERROR(@"Shared database was created %@ indexing diffs", currentVersion % 2 ? @"with" : @"without");
+          [self release];
+          return nil;
+        }
         sqlite3_close(_database);
         _database = NULL;
         XLOG_WARNING(@"Commit database for \"%@\" has an incompatible version (%li) and must be regenerated", _repository.repositoryPath, (long)currentVersion);
@@ -401,6 +638,11 @@ static int _CaseInsensitiveUTF8Compare(void* context, int length1, const void* b
       }
     }
 
+    if (!(_options & kGCCommitDatabaseOptions_QueryOnly) && ![self _initializeRepositoryID:error]) {
+      [self release];
+      return nil;
+    }
+
     if (![self _initializeStatements:error]) {
       [self release];
       return nil;
@@ -409,7 +651,33 @@ static int _CaseInsensitiveUTF8Compare(void* context, int length1, const void* b
   return self;
 }
 
+- (instancetype)_initReaderWithDatabase:(GCCommitDatabase*)database error:(NSError**)error {
+  if ((self = [super init])) {
+    _repository = database.repository;
+    _databasePath = [database.databasePath copy];
+    _options = database.options | kGCCommitDatabaseOptions_QueryOnly;
+    _reader = YES;
+    _searchStatements = [[NSMutableDictionary alloc] init];
+
+    if (![self _initializeDatabase:_databasePath error:error] || ![self _initializeStatements:error]) {
+      [self release];
+      return nil;
+    }
+  }
+  return self;
+}
+
 - (void)dealloc {
+  if (!_reader) {
+    XLOG_DEBUG_CHECK(_idleReaders.count == _readerCount);
+    [_idleReaders release];
+    pthread_cond_destroy(&_readerCondition);
+    pthread_mutex_destroy(&_readerMutex);
+  }
+  for (NSValue* value in _searchStatements.objectEnumerator) {
+    sqlite3_finalize(value.pointerValue);
+  }
+  [_searchStatements release];
   if (_statements) {
     for (int i = 0; i < kNumStatements; ++i) {
       sqlite3_finalize(_statements[i]);
@@ -423,70 +691,163 @@ static int _CaseInsensitiveUTF8Compare(void* context, int length1, const void* b
   [super dealloc];
 }
 
-#if DEBUG
-static  // Ensure function is inlined per C99 specs by leaving "static" out
-#endif
-    inline unsigned int
-    _hash_buffer(const unsigned char* key, size_t length) {
+// Common English words and programming keywords which appear in most diffs and are therefore useless for searching (must be lowercase)
+static const char* _stopWords[] = {
+  "about", "after", "all", "also", "an", "and", "any", "are", "as", "at", "be", "been", "but", "by", "can", "do", "does", "for", "from", "has", "have", "he",
+  "her", "his", "if", "in", "into", "is", "it", "its", "no", "not", "of", "on", "one", "or", "our", "she", "so", "some", "such", "than", "that", "the", "their",
+  "them", "then", "there", "these", "they", "this", "to", "us", "was", "we", "were", "what", "when", "which", "who", "will", "with", "would", "you", "your",
+  "bool", "break", "case", "catch", "char", "class", "const", "continue", "def", "default", "define", "double", "else", "elif", "endif", "enum", "export", "extern",
+  "false", "float", "func", "function", "ifdef", "ifndef", "import", "include", "int", "interface", "let", "long", "new", "nil", "null", "private",
+  "property", "protected", "public", "return", "self", "static", "struct", "switch", "true", "try", "typedef", "unsigned", "var", "void", "while"};
+
+static inline unsigned int _HashWord(const unsigned char* start, size_t length) {
   unsigned int h = 0;
-  const unsigned char* max = key + length;
-  while (key < max) {
-#if 1
-    h = *key++ + (h << 6) + (h << 16) - h;  // SDBM (seems to produces fewer false positives for about the same speed as SAX)
+  const unsigned char* max = start + length;
+  while (start < max) {
+    h = TO_LOWER(*start) + (h << 6) + (h << 16) - h;  // SDBM on the lowercase word since the FTS tokenizer is case-insensitive anyway
+    ++start;
+  }
+  return h;
+}
+
+static inline BOOL _EqualWords(const unsigned char* word1, const unsigned char* word2, size_t length) {
+  for (size_t i = 0; i < length; ++i) {
+    if (TO_LOWER(word1[i]) != TO_LOWER(word2[i])) {
+      return NO;
+    }
+  }
+  return YES;
+}
+
+static void _GrowWordSet(WordSet* set) {
+  size_t capacity = 2 * (set->mask + 1);
+  Word* slots = calloc(capacity, sizeof(Word));
+  for (size_t i = 0; i <= set->mask; ++i) {
+    Word* word = &set->slots[i];
+    if (word->start) {
+      size_t index = word->hash & (capacity - 1);
+      while (slots[index].start) {
+        index = (index + 1) & (capacity - 1);
+      }
+      slots[index] = *word;
+    }
+  }
+  free(set->slots);
+  set->slots = slots;
+  set->mask = capacity - 1;
+}
+
+// Returns NO if the word was already in the set
+static BOOL _AddWordToSet(WordSet* set, const unsigned char* start, size_t length) {
+  unsigned int hash = _HashWord(start, length);
+  size_t index = hash & set->mask;
+  while (set->slots[index].start) {
+    Word* word = &set->slots[index];
+    if ((word->hash == hash) && (word->length == length) && _EqualWords(word->start, start, length)) {
+      return NO;
+    }
+    index = (index + 1) & set->mask;
+  }
+  Word word = {start, length, hash};
+  set->slots[index] = word;
+  set->count += 1;
+  if (2 * set->count > set->mask + 1) {  // Keep the load factor under 50%
+    _GrowWordSet(set);
+  }
+  return YES;
+}
+
+// Returns a mask where bit N is set if byte N of the block is not a delimiter
+static inline unsigned int _ScanBlock(const unsigned char* bytes) {
+#if defined(__SSE2__)
+  __m128i v = _mm_loadu_si128((const __m128i*)bytes);
+  __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));  // Comparisons are signed so bytes >= 0x80 never match the ranges below
+  __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+  __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1)));
+  __m128i underscore = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+  return _mm_movemask_epi8(_mm_or_si128(v, _mm_or_si128(digit, _mm_or_si128(alpha, underscore))));  // Bytes >= 0x80 already have their high bit set
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  static const uint8_t bits[kScanBlockSize] = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+  uint8x16_t v = vld1q_u8(bytes);
+  uint8x16_t lower = vorrq_u8(v, vdupq_n_u8(0x20));
+  uint8x16_t word = vcgeq_u8(v, vdupq_n_u8(0x80));
+  word = vorrq_u8(word, vandq_u8(vcgeq_u8(v, vdupq_n_u8('0')), vcleq_u8(v, vdupq_n_u8('9'))));
+  word = vorrq_u8(word, vandq_u8(vcgeq_u8(lower, vdupq_n_u8('a')), vcleq_u8(lower, vdupq_n_u8('z'))));
+  word = vorrq_u8(word, vceqq_u8(v, vdupq_n_u8('_')));
+  uint8x16_t masked = vandq_u8(word, vld1q_u8(bits));  // There is no NEON equivalent to "movemask" so sum the bits of each half instead
+  return vaddv_u8(vget_low_u8(masked)) | (vaddv_u8(vget_high_u8(masked)) << 8);
 #else
-    h ^= (h << 5) + (h >> 2) + *key++;  // SAX
+  unsigned int mask = 0;
+  for (unsigned int i = 0; i < kScanBlockSize; ++i) {
+    if (!IS_DELIMITER(bytes[i])) {
+      mask |= 1 << i;
+    }
+  }
+  return mask;
 #endif
+}
+
+static inline void _AppendUniqueWord(WordSet* set, const unsigned char* start, const unsigned char* end, NSMutableData* words) {
+  size_t length = end - start;
+  if ((length >= kMinWordLength) && _AddWordToSet(set, start, length)) {
+    [words appendBytes:start length:length];
+    [words appendBytes:" " length:1];
   }
-  return h;
 }
 
-// TODO: Skip common English words
-// TODO: Skip programming keywords
-// This uses a simple hash-based cache to reduce the lines to their unique words
-// There can be false positives i.e. words repeated more than once in the result, but that's an acceptable speed trade-off considering SQLite FTS will fix this anyway
-static void _ExtractUniqueWordsFromLines(NSMutableData* lines, NSMutableData* words) {
-  GC_LIST_ALLOCATE(list, kWordCacheSize, Word);
-  unsigned char* cache = calloc(kWordCacheSize / CHAR_BIT, sizeof(unsigned char));
-  Word* wordPtr;
+// This scans the lines one block at a time to find word boundaries and reduces them to their unique words using an exact hash set
+// Words are compared case-insensitively for ASCII to match the FTS tokenizer and the set entries point directly into the lines so no memory is allocated per word
+static void _ExtractUniqueWordsFromLines(NSData* lines, NSMutableData* words) {
+  WordSet set = {calloc(kWordSetInitialCapacity, sizeof(Word)), kWordSetInitialCapacity - 1, 0};
+  for (size_t i = 0; i < sizeof(_stopWords) / sizeof(*_stopWords); ++i) {
+    _AddWordToSet(&set, (const unsigned char*)_stopWords[i], strlen(_stopWords[i]));
+  }
 
-  const unsigned char* max = (unsigned char*)lines.bytes + lines.length;
-  const unsigned char* current = lines.bytes;
+  const unsigned char* bytes = lines.bytes;
+  size_t length = lines.length;
   const unsigned char* start = NULL;
-  do {
-    if ((current == max) || IS_DELIMITER(*current)) {
-      if (start != NULL) {
-        size_t length = current - start;
-        unsigned int hash = _hash_buffer(start, length);
-        if (length >= kMinWordLength) {
-          if (!GET_BIT(cache, hash % kWordCacheSize)) {
-            Word word = {start, length};
-            GC_LIST_APPEND(list, &word);
-            SET_BIT(cache, hash % kWordCacheSize);
-          }
-        }
-        start = NULL;
-      }
+  for (size_t offset = 0; offset < length; offset += kScanBlockSize) {
+    unsigned int size = kScanBlockSize;
+    unsigned int mask;
+    if (length - offset >= kScanBlockSize) {
+      mask = _ScanBlock(bytes + offset);
     } else {
-      if (start == NULL) {
-        start = current;
+      size = (unsigned int)(length - offset);
+      mask = 0;
+      for (unsigned int i = 0; i < size; ++i) {
+        if (!IS_DELIMITER(bytes[offset + i])) {
+          mask |= 1 << i;
+        }
       }
     }
-    ++current;
-  } while (current <= max);
 
-  char space = ' ';
-  GC_LIST_FOR_LOOP_POINTER(list, wordPtr) {
-    [words appendBytes:wordPtr->start length:wordPtr->length];
-    [words appendBytes:&space length:1];
+    // Jump from one word boundary to the next within the block
+    unsigned int position = 0;
+    while (position < size) {
+      unsigned int pending = (start ? ~mask : mask) & ((1 << size) - 1) & (~0U << position);
+      if (pending == 0) {
+        break;
+      }
+      position = __builtin_ctz(pending);
+      if (start) {
+        _AppendUniqueWord(&set, start, bytes + offset + position, words);
+        start = NULL;
+      } else {
+        start = bytes + offset + position;
+      }
+      ++position;
+    }
+  }
+  if (start) {
+    _AppendUniqueWord(&set, start, bytes + length, words);
   }
 
-  free(cache);
-  GC_LIST_FREE(list);
+  free(set.slots);
 }
 
 // We don't use the GCDiff wrappers because we need the best possible performance
-// TODO: Consider indexing file names
-static BOOL _ProcessDiff(git_repository* repo, git_commit* commit, git_commit* parent, NSMutableData* addedLines, NSMutableData* deletedLines) {
+// Paths are appended as NUL-terminated pairs of the new path and the old path (empty unless the file was renamed)
+static BOOL _ProcessDiff(git_repository* repo, git_commit* commit, git_commit* parent, NSMutableData* addedLines, NSMutableData* deletedLines, NSMutableData* paths) {
   BOOL success = NO;
   git_tree* newTree;
   int status = git_commit_tree(&newTree, commit);
@@ -510,6 +871,14 @@ static BOOL _ProcessDiff(git_repository* repo, git_commit* commit, git_commit* p
         if (status == GIT_OK) {
           success = YES;
           for (size_t i = 0, iMax = git_diff_num_deltas(diff); i < iMax; ++i) {
+            const git_diff_delta* delta = git_diff_get_delta(diff, i);
+            [paths appendBytes:delta->new_file.path length:(strlen(delta->new_file.path) + 1)];
+            if (strcmp(delta->old_file.path, delta->new_file.path)) {
+              [paths appendBytes:delta->old_file.path length:(strlen(delta->old_file.path) + 1)];
+            } else {
+              [paths appendBytes:"" length:1];
+            }
+
             git_patch* patch;
             status = git_patch_from_diff(&patch, diff, i);
             if (status == GIT_OK) {
@@ -553,6 +922,197 @@ static BOOL _ProcessDiff(git_repository* repo, git_commit* commit, git_commit* p
   return success;
 }
 
+static BOOL _ComputeDiffWords(git_repository* repo, git_commit* commit, git_commit* parent, NSMutableData* addedLines, NSMutableData* deletedLines, NSMutableData* addedWords, NSMutableData* deletedWords, NSMutableData* paths, BOOL* hasChanges) {
+  addedLines.length = 0;
+  deletedLines.length = 0;
+  paths.length = 0;
+  if (!_ProcessDiff(repo, commit, parent, addedLines, deletedLines, paths)) {
+    return NO;
+  }
+  *hasChanges = addedLines.length || deletedLines.length;
+  if (*hasChanges) {
+    addedWords.length = 0;
+    _ExtractUniqueWordsFromLines(addedLines, addedWords);
+    deletedWords.length = 0;
+    _ExtractUniqueWordsFromLines(deletedLines, deletedWords);
+  }
+  return YES;
+}
+
+- (NSUInteger)diffWorkerCount {
+  return _diffWorkerCount;
+}
+
+- (void)setDiffWorkerCount:(NSUInteger)count {
+  _diffWorkerCount = MIN(count, kMaxDiffWorkers);
+}
+
+- (NSUInteger)updateChunkSize {
+  return _updateChunkSize;
+}
+
+- (void)setUpdateChunkSize:(NSUInteger)size {
+  _updateChunkSize = MAX(size, (NSUInteger)1);
+}
+
+// Walks the new commits reachable from the queued ones the same way -_addCommitsForTip does so the diff pipeline computes diffs in the order they are consumed
+// Failures are not fatal as diffs missing from the pipeline are simply computed by the writer
+- (GCDiffPipeline*)_newDiffPipelineForItems:(const Item*)items count:(size_t)count {
+  GCDiffPipeline* pipeline = nil;
+  GC_LIST_ALLOCATE(oids, 1024, git_oid);
+  GC_LIST_ALLOCATE(row, 16, git_commit*);
+  GC_LIST_ALLOCATE(newRow, 16, git_commit*);
+  CFSetCallBacks callbacks = {0, GCOIDCopyCallBack, GCFreeReleaseCallBack, NULL, GCOIDEqualCallBack, GCOIDHashCallBack};
+  CFMutableSetRef visited = CFSetCreateMutable(kCFAllocatorDefault, 0, &callbacks);
+  sqlite3_stmt* statement = _statements[kStatement_FindCommitID];
+  git_commit* commit;
+  git_commit** commitPtr;
+
+  for (size_t i = 0; i < count; ++i) {
+    git_object_dup((git_object**)&commit, (git_object*)items[i].commit);  // This just increases the retain count and cannot fail
+    GC_LIST_APPEND(row, &commit);
+    CFSetAddValue(visited, git_commit_id(commit));
+  }
+  while (GC_LIST_COUNT(row)) {
+    GC_LIST_FOR_LOOP_POINTER(row, commitPtr) {
+      GC_LIST_APPEND(oids, git_commit_id(*commitPtr));
+      for (unsigned int i = 0, count = git_commit_parentcount(*commitPtr); i < count; ++i) {
+        const git_oid* parentOID = git_commit_parent_id(*commitPtr, i);
+        if (CFSetContainsValue(visited, parentOID)) {
+          continue;
+        }
+        CFSetAddValue(visited, parentOID);
+        sqlite3_bind_blob(statement, 1, parentOID, GIT_OID_RAWSZ, SQLITE_STATIC);
+        int result = sqlite3_step(statement);
+        sqlite3_reset(statement);
+        if (result == SQLITE_DONE) {
+          git_commit* parentCommit;
+          if (git_commit_lookup(&parentCommit, _repository.private, parentOID) == GIT_OK) {
+            GC_LIST_APPEND(newRow, &parentCommit);
+          }
+        } else if (result != SQLITE_ROW) {
+          LOG_SQLITE_ERROR(result);
+        }
+      }
+      git_commit_free(*commitPtr);
+    }
+    GC_LIST_RESET(row);
+    GC_LIST_SWAP(newRow, row);
+  }
+
+  if (GC_LIST_COUNT(oids) > 1) {
+    pipeline = [[GCDiffPipeline alloc] initWithRepositoryPath:_repository.repositoryPath commitOIDs:(const git_oid*)GC_LIST_ROOT_POINTER(oids) count:GC_LIST_COUNT(oids) workerCount:_diffWorkerCount];
+  }
+
+  CFRelease(visited);
+  GC_LIST_FREE(newRow);
+  GC_LIST_FREE(row);
+  GC_LIST_FREE(oids);
+  return pipeline;
+}
+
+- (BOOL)_findOrAddPath:(const char*)path pathID:(sqlite3_int64*)pathID error:(NSError**)error {
+  sqlite3_stmt** statements = _statements;
+  CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_bind_text, statements[kStatement_FindPathID], 1, path, -1, SQLITE_STATIC);
+  int result = sqlite3_step(statements[kStatement_FindPathID]);
+  if (result == SQLITE_ROW) {
+    *pathID = sqlite3_column_int64(statements[kStatement_FindPathID], 0);
+  } else {
+    CHECK_SQLITE_FUNCTION_CALL(return NO, result, == SQLITE_DONE);
+
+    // Create path
+    CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_bind_text, statements[kStatement_AddPath], 1, path, -1, SQLITE_STATIC);
+    result = sqlite3_step(statements[kStatement_AddPath]);
+    CHECK_SQLITE_FUNCTION_CALL(return NO, result, == SQLITE_DONE);
+    *pathID = sqlite3_last_insert_rowid(_database);
+    CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_reset, statements[kStatement_AddPath]);
+    XLOG_DEBUG_CHECK(sqlite3_changes(_database) == 1);
+  }
+  CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_reset, statements[kStatement_FindPathID]);
+  return YES;
+}
+
+- (BOOL)_addCommitPathWithCommitID:(sqlite3_int64)commitID pathID:(sqlite3_int64)pathID previousPathID:(sqlite3_int64)previousPathID error:(NSError**)error {
+  sqlite3_stmt* statement = _statements[kStatement_AddCommitPath];
+  CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_bind_int64, statement, 1, commitID);
+  CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_bind_int64, statement, 2, pathID);
+  if (previousPathID) {
+    CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_bind_int64, statement, 3, previousPathID);
+  } else {
+    CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_bind_null, statement, 3);
+  }
+  int result = sqlite3_step(statement);
+  CHECK_SQLITE_FUNCTION_CALL(return NO, result, == SQLITE_DONE);
+  CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_reset, statement);
+  XLOG_DEBUG_CHECK(sqlite3_changes(_database) == 1);
+  return YES;
+}
+
+// Renamed files are recorded under both their new path (with the old one as previous path) and their old path
+- (BOOL)_addPaths:(NSData*)paths forCommitID:(sqlite3_int64)commitID error:(NSError**)error {
+  const char* bytes = paths.bytes;
+  const char* max = bytes + paths.length;
+  while (bytes < max) {
+    const char* path = bytes;
+    const char* oldPath = path + strlen(path) + 1;
+    bytes = oldPath + strlen(oldPath) + 1;
+
+    sqlite3_int64 pathID;
+    if (![self _findOrAddPath:path pathID:&pathID error:error]) {
+      return NO;
+    }
+    if (*oldPath) {
+      sqlite3_int64 oldPathID;
+      if (![self _findOrAddPath:oldPath pathID:&oldPathID error:error]
+          || ![self _addCommitPathWithCommitID:commitID pathID:pathID previousPathID:oldPathID error:error]
+          || ![self _addCommitPathWithCommitID:commitID pathID:oldPathID previousPathID:0 error:error]) {
+        return NO;
+      }
+    } else if (![self _addCommitPathWithCommitID:commitID pathID:pathID previousPathID:0 error:error]) {
+      return NO;
+    }
+  }
+  return YES;
+}
+
+- (BOOL)_commitChunkWithFrontier:(const Item*)items count:(size_t)count error:(NSError**)error {
+  sqlite3_stmt** statements = _statements;
+  int result;
+
+  // Save frontier
+  result = sqlite3_step(statements[kStatement_ClearFrontier]);
+  CHECK_SQLITE_FUNCTION_CALL(return NO, result, == SQLITE_DONE);
+  CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_reset, statements[kStatement_ClearFrontier]);
+  for (size_t i = 0; i < count; ++i) {
+    CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_bind_blob, statements[kStatement_AddFrontier], 1, git_commit_id(items[i].commit), GIT_OID_RAWSZ, SQLITE_STATIC);
+    CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_bind_int64, statements[kStatement_AddFrontier], 2, items[i].childID);
+    result = sqlite3_step(statements[kStatement_AddFrontier]);
+    CHECK_SQLITE_FUNCTION_CALL(return NO, result, == SQLITE_DONE);
+    CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_reset, statements[kStatement_AddFrontier]);
+  }
+
+  // End transaction
+  result = sqlite3_step(statements[kStatement_EndTransaction]);
+  CHECK_SQLITE_FUNCTION_CALL(return NO, result, == SQLITE_DONE);
+  CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_reset, statements[kStatement_EndTransaction]);
+
+  // WAL manual checkpoint to keep it from growing unbounded (ignore errors and don't wait for readers)
+  result = sqlite3_wal_checkpoint_v2(_database, NULL, SQLITE_CHECKPOINT_PASSIVE, NULL, NULL);
+  if (result != SQLITE_OK) {
+    XLOG_ERROR(@"Failed checkpointing commit database at \"%@\" (%i): %s", _databasePath, result, sqlite3_errmsg(_database));
+  }
+
+  // Begin new transaction
+  result = sqlite3_step(statements[kStatement_BeginTransaction]);
+  CHECK_SQLITE_FUNCTION_CALL(return NO, result, == SQLITE_DONE);
+  CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_reset, statements[kStatement_BeginTransaction]);
+
+  XLOG_VERBOSE(@"Commit database for \"%@\" committed %lu commits (%lu queued)", _repository.repositoryPath, (unsigned long)_uncommittedCount, (unsigned long)count);
+  _uncommittedCount = 0;
+  return YES;
+}
+
+// Pass a NULL tip to resume adding the commits queued by an interrupted update
 - (BOOL)_addCommitsForTip:(const git_oid*)tipOID handler:(BOOL (^)())handler error:(NSError**)error {
   BOOL success = NO;
   GC_LIST_ALLOCATE(row, 16, Item);
@@ -562,52 +1122,82 @@ static BOOL _ProcessDiff(git_repository* repo, git_commit* commit, git_commit* p
   NSMutableData* deletedLines = [[NSMutableData alloc] initWithCapacity:(64 * 1024)];
   NSMutableData* addedWords = [[NSMutableData alloc] initWithCapacity:(32 * 1024)];
   NSMutableData* deletedWords = [[NSMutableData alloc] initWithCapacity:(32 * 1024)];
+  NSMutableData* paths = [[NSMutableData alloc] initWithCapacity:1024];
   sqlite3_stmt** statements = _statements;
   BOOL indexDiffs = _options & kGCCommitDatabaseOptions_IndexDiffs ? YES : NO;
+  GCDiffPipeline* pipeline = nil;
   git_commit* commit;
   int result;
   int status;
   Item item;
   const Item* itemPtr;
 
-  // Check if commit is already in database
-  CALL_SQLITE_FUNCTION_GOTO(cleanup, sqlite3_bind_blob, statements[kStatement_FindCommitID], 1, tipOID, GIT_OID_RAWSZ, SQLITE_STATIC);
-  result = sqlite3_step(statements[kStatement_FindCommitID]);
-  if (result == SQLITE_ROW) {
-    sqlite3_int64 tipID = sqlite3_column_int64(statements[kStatement_FindCommitID], 0);
-    CALL_SQLITE_FUNCTION_GOTO(cleanup, sqlite3_reset, statements[kStatement_FindCommitID]);
+  if (tipOID) {
+    // Check if commit is already in database
+    CALL_SQLITE_FUNCTION_GOTO(cleanup, sqlite3_bind_blob, statements[kStatement_FindCommitID], 1, tipOID, GIT_OID_RAWSZ, SQLITE_STATIC);
+    result = sqlite3_step(statements[kStatement_FindCommitID]);
+    if (result == SQLITE_ROW) {
+      sqlite3_int64 tipID = sqlite3_column_int64(statements[kStatement_FindCommitID], 0);
+      CALL_SQLITE_FUNCTION_GOTO(cleanup, sqlite3_reset, statements[kStatement_FindCommitID]);
+
+      // Create tip
+      CALL_SQLITE_FUNCTION_GOTO(cleanup, sqlite3_bind_int64, statements[kStatement_AddTip], 1, tipID);
+      result = sqlite3_step(statements[kStatement_AddTip]);
+      CHECK_SQLITE_FUNCTION_CALL(goto cleanup, result, == SQLITE_DONE);
+      CALL_SQLITE_FUNCTION_GOTO(cleanup, sqlite3_reset, statements[kStatement_AddTip]);
+      XLOG_DEBUG_CHECK(sqlite3_changes(_database) == 1);
 
-    // Create tip
-    CALL_SQLITE_FUNCTION_GOTO(cleanup, sqlite3_bind_int64, statements[kStatement_AddTip], 1, tipID);
-    result = sqlite3_step(statements[kStatement_AddTip]);
-    CHECK_SQLITE_FUNCTION_CALL(goto cleanup, result, == SQLITE_DONE);
-    CALL_SQLITE_FUNCTION_GOTO(cleanup, sqlite3_reset, statements[kStatement_AddTip]);
-    XLOG_DEBUG_CHECK(sqlite3_changes(_database) == 1);
+      // Retain commit
+      CALL_SQLITE_FUNCTION_GOTO(cleanup, sqlite3_bind_int64, statements[kStatement_RetainCommit], 1, tipID);
+      result = sqlite3_step(statements[kStatement_RetainCommit]);
+      CHECK_SQLITE_FUNCTION_CALL(goto cleanup, result, == SQLITE_DONE);
+      CALL_SQLITE_FUNCTION_GOTO(cleanup, sqlite3_reset, statements[kStatement_RetainCommit]);
+      XLOG_DEBUG_CHECK(sqlite3_changes(_database) == 1);
 
-    // Retain commit
-    CALL_SQLITE_FUNCTION_GOTO(cleanup, sqlite3_bind_int64, statements[kStatement_RetainCommit], 1, tipID);
-    result = sqlite3_step(statements[kStatement_RetainCommit]);
+      success = YES;
+      goto cleanup;
+    }
     CHECK_SQLITE_FUNCTION_CALL(goto cleanup, result, == SQLITE_DONE);
-    CALL_SQLITE_FUNCTION_GOTO(cleanup, sqlite3_reset, statements[kStatement_RetainCommit]);
-    XLOG_DEBUG_CHECK(sqlite3_changes(_database) == 1);
+    CALL_SQLITE_FUNCTION_GOTO(cleanup, sqlite3_reset, statements[kStatement_FindCommitID]);
 
-    success = YES;
-    goto cleanup;
+    // Load tip commit and queue it
+    status = git_commit_lookup(&commit, _repository.private, tipOID);
+    if (status == GIT_ENOTFOUND) {
+      XLOG_WARNING(@"Missing tip commit %s from repository \"%@\"", git_oid_tostr_s(tipOID), _repository.repositoryPath);
+      success = YES;
+      goto cleanup;
+    }
+    CHECK_LIBGIT2_FUNCTION_CALL(goto cleanup, status, == GIT_OK);
+    item.commit = commit;
+    item.childID = 0;
+    GC_LIST_APPEND(row, &item);
+  } else {
+    // Load commits queued when the last chunk of an interrupted update was committed
+    while (1) {
+      result = sqlite3_step(statements[kStatement_ListFrontier]);
+      if (result == SQLITE_DONE) {
+        break;
+      }
+      CHECK_SQLITE_FUNCTION_CALL(goto cleanup, result, == SQLITE_ROW);
+      XLOG_DEBUG_CHECK(sqlite3_column_bytes(statements[kStatement_ListFrontier], 0) == GIT_OID_RAWSZ);
+      const git_oid* oid = sqlite3_column_blob(statements[kStatement_ListFrontier], 0);
+      status = git_commit_lookup(&commit, _repository.private, oid);
+      if (status == GIT_ENOTFOUND) {
+        XLOG_WARNING(@"Missing commit %s from repository \"%@\"", git_oid_tostr_s(oid), _repository.repositoryPath);
+        continue;
+      }
+      CHECK_LIBGIT2_FUNCTION_CALL(goto cleanup, status, == GIT_OK);
+      item.commit = commit;
+      item.childID = sqlite3_column_int64(statements[kStatement_ListFrontier], 1);
+      GC_LIST_APPEND(row, &item);
+    }
+    CALL_SQLITE_FUNCTION_GOTO(cleanup, sqlite3_reset, statements[kStatement_ListFrontier]);
   }
-  CHECK_SQLITE_FUNCTION_CALL(goto cleanup, result, == SQLITE_DONE);
-  CALL_SQLITE_FUNCTION_GOTO(cleanup, sqlite3_reset, statements[kStatement_FindCommitID]);
 
-  // Load tip commit and queue it
-  status = git_commit_lookup(&commit, _repository.private, tipOID);
-  if (status == GIT_ENOTFOUND) {
-    XLOG_WARNING(@"Missing tip commit %s from repository \"%@\"", git_oid_tostr_s(tipOID), _repository.repositoryPath);
-    success = YES;
-    goto cleanup;
+  // Start computing diffs in parallel if needed
+  if (indexDiffs && _diffWorkerCount) {
+    pipeline = [self _newDiffPipelineForItems:(const Item*)GC_LIST_ROOT_POINTER(row) count:GC_LIST_COUNT(row)];
   }
-  CHECK_LIBGIT2_FUNCTION_CALL(goto cleanup, status, == GIT_OK);
-  item.commit = commit;
-  item.childID = 0;
-  GC_LIST_APPEND(row, &item);
 
   // Create commits for the tip and its ancestors
   while (1) {
@@ -759,28 +1349,33 @@ static BOOL _ProcessDiff(git_repository* repo, git_commit* commit, git_commit* p
           } else {
             status = GIT_OK;
           }
-          addedLines.length = 0;
-          deletedLines.length = 0;
-          if ((status == GIT_OK) && _ProcessDiff(_repository.private, itemPtr->commit, mainParent, addedLines, deletedLines)) {
-            if (addedLines.length || deletedLines.length) {
+          BOOL hasChanges = NO;
+          DiffResult diffResult = pipeline ? [pipeline takeDiffForCommit:git_commit_id(itemPtr->commit) addedWords:addedWords deletedWords:deletedWords paths:paths hasChanges:&hasChanges] : kDiffResult_NotQueued;
+          if (diffResult == kDiffResult_NotQueued) {
+            diffResult = (status == GIT_OK) && _ComputeDiffWords(_repository.private, itemPtr->commit, mainParent, addedLines, deletedLines, addedWords, deletedWords, paths, &hasChanges) ? kDiffResult_Success : kDiffResult_Failed;
+          }
+          if (diffResult == kDiffResult_Success) {
+            if (hasChanges) {
               CALL_SQLITE_FUNCTION_GOTO(cleanup, sqlite3_bind_int64, statements[kStatement_AddFTSDiff], 1, commitID);
-              addedWords.length = 0;
-              _ExtractUniqueWordsFromLines(addedLines, addedWords);
               CALL_SQLITE_FUNCTION_GOTO(cleanup, sqlite3_bind_blob, statements[kStatement_AddFTSDiff], 2, addedWords.bytes, (int)addedWords.length, SQLITE_STATIC);
-              deletedWords.length = 0;
-              _ExtractUniqueWordsFromLines(deletedLines, deletedWords);
               CALL_SQLITE_FUNCTION_GOTO(cleanup, sqlite3_bind_blob, statements[kStatement_AddFTSDiff], 3, deletedWords.bytes, (int)deletedWords.length, SQLITE_STATIC);
               result = sqlite3_step(statements[kStatement_AddFTSDiff]);
               CHECK_SQLITE_FUNCTION_CALL(goto cleanup, result, == SQLITE_DONE);
               CALL_SQLITE_FUNCTION_GOTO(cleanup, sqlite3_reset, statements[kStatement_AddFTSDiff]);
               XLOG_DEBUG_CHECK(sqlite3_changes(_database) == 1);
             }
+
+            // Update commit paths
+            if (![self _addPaths:paths forCommitID:commitID error:error]) {
+              goto cleanup;
+            }
           } else {
             XLOG_WARNING(@"Unable to compute diff for commit %s from repository \"%@\"", git_oid_tostr_s(git_commit_id(itemPtr->commit)), _repository.repositoryPath);
           }
         }
 
         // Call handler
+        ++_uncommittedCount;
         if (!handler()) {
           if (error) {
             *error = GCNewError(kGCErrorCode_UserCancelled, @"");
@@ -896,6 +1491,13 @@ static BOOL _ProcessDiff(git_repository* repo, git_commit* commit, git_commit* p
     if (GC_LIST_COUNT(newRow) == 0) {
       break;
     }
+
+    // Commit the update so far if needed (rows are always complete at this point so the queued commits are all that's needed to resume)
+    if (_uncommittedCount >= _updateChunkSize) {
+      if (![self _commitChunkWithFrontier:(const Item*)GC_LIST_ROOT_POINTER(newRow) count:GC_LIST_COUNT(newRow) error:error]) {
+        goto cleanup;
+      }
+    }
     GC_LIST_SWAP(newRow, row);
   }
 
@@ -903,6 +1505,9 @@ static BOOL _ProcessDiff(git_repository* repo, git_commit* commit, git_commit* p
   success = YES;
 
 cleanup:
+  [pipeline finish];
+  [pipeline release];
+  [paths release];
   [deletedWords release];
   [addedWords release];
   [deletedLines release];
@@ -1012,22 +1617,142 @@ cleanup:
   return success;
 }
 
-// TODO: Use a custom container instead of GC_LIST + CFSet combo
-// TODO: Vacuum database when needed (this is expensive as it actually copies the database to rebuild it)
-- (BOOL)updateWithProgressHandler:(GCCommitDatabaseProgressHandler)handler error:(NSError**)error {
-  XLOG_DEBUG_CHECK(!(_options & kGCCommitDatabaseOptions_QueryOnly));
+// Repositories on volumes that are not mounted are not considered missing
+static BOOL _IsMissingRepositoryPath(const char* path) {
+  struct stat info;
+  if (!lstat(path, &info) || (errno != ENOENT)) {
+    return NO;
+  }
+  if (!strncmp(path, "/Volumes/", 9)) {
+    const char* separator = strchr(&path[9], '/');
+    if (separator) {
+      char* volume = strndup(path, separator - path);
+      BOOL mounted = !lstat(volume, &info);
+      free(volume);
+      return mounted;
+    }
+  }
+  return YES;
+}
+
+// Repositories sharing the database that were deleted or moved would otherwise retain the commits of their tips forever
+// The tip statements are temporarily bound to each missing repository to reuse -_removeCommitsForTip
+- (BOOL)_pruneMissingRepositoriesWithHandler:(BOOL (^)())handler error:(NSError**)error {
   BOOL success = NO;
-  GC_LIST_ALLOCATE(oldTips, 64, git_oid);
-  GC_LIST_ALLOCATE(newTips, 64, git_oid);
-  CFSetCallBacks callbacks = {0, GCOIDCopyCallBack, GCFreeReleaseCallBack, NULL, GCOIDEqualCallBack, GCOIDHashCallBack};
+  GC_LIST_ALLOCATE(repositoryIDs, 4, sqlite3_int64);
+  GC_LIST_ALLOCATE(tips, 64, git_oid);
+  sqlite3_stmt** statements = _statements;
+  sqlite3_stmt* listStatement = NULL;
+  sqlite3_stmt* frontierStatement = NULL;
+  sqlite3_stmt* repositoryStatement = NULL;
+  sqlite3_int64* int64Ptr;
+  const git_oid* tip;
+  int result;
+
+  // Find missing repositories
+  CALL_SQLITE_FUNCTION_GOTO(cleanup, sqlite3_prepare_v2, _database, "SELECT _id_, path FROM " kRepositoriesTableName " WHERE _id_!=?1", -1, &listStatement, NULL);
+  CALL_SQLITE_FUNCTION_GOTO(cleanup, sqlite3_bind_int64, listStatement, 1, _repositoryID);
+  while (1) {
+    result = sqlite3_step(listStatement);
+    if (result == SQLITE_DONE) {
+      break;
+    }
+    CHECK_SQLITE_FUNCTION_CALL(goto cleanup, result, == SQLITE_ROW);
+    const char* path = (const char*)sqlite3_column_text(listStatement, 1);
+    if (_IsMissingRepositoryPath(path)) {
+      sqlite3_int64 repositoryID = sqlite3_column_int64(listStatement, 0);
+      GC_LIST_APPEND(repositoryIDs, &repositoryID);
+      XLOG_VERBOSE(@"Pruning missing repository \"%s\" from commit database at \"%@\"", path, _databasePath);
+    }
+  }
+  if (GC_LIST_COUNT(repositoryIDs) == 0) {
+    success = YES;
+    goto cleanup;
+  }
+
+  CALL_SQLITE_FUNCTION_GOTO(cleanup, sqlite3_prepare_v2, _database, "DELETE FROM " kFrontierTableName " WHERE repository=?1", -1, &frontierStatement, NULL);
+  CALL_SQLITE_FUNCTION_GOTO(cleanup, sqlite3_prepare_v2, _database, "DELETE FROM " kRepositoriesTableName " WHERE _id_=?1", -1, &repositoryStatement, NULL);
+  GC_LIST_FOR_LOOP_POINTER(repositoryIDs, int64Ptr) {
+    sqlite3_int64 repositoryID = *int64Ptr;
+
+    // Load tips
+    GC_LIST_RESET(tips);
+    CALL_SQLITE_FUNCTION_GOTO(cleanup, sqlite3_bind_int64, statements[kStatement_ListTipSHA1s], 1, repositoryID);
+    while (1) {
+      result = sqlite3_step(statements[kStatement_ListTipSHA1s]);
+      if (result == SQLITE_DONE) {
+        break;
+      }
+      CHECK_SQLITE_FUNCTION_CALL(goto cleanup, result, == SQLITE_ROW);
+      XLOG_DEBUG_CHECK(sqlite3_column_bytes(statements[kStatement_ListTipSHA1s], 0) == GIT_OID_RAWSZ);
+      GC_LIST_APPEND(tips, sqlite3_column_blob(statements[kStatement_ListTipSHA1s], 0));
+    }
+    CALL_SQLITE_FUNCTION_GOTO(cleanup, sqlite3_reset, statements[kStatement_ListTipSHA1s]);
+
+    // Release commits of tips
+    CALL_SQLITE_FUNCTION_GOTO(cleanup, sqlite3_bind_int64, statements[kStatement_DeleteTip], 2, repositoryID);
+    GC_LIST_FOR_LOOP_POINTER(tips, tip) {
+      if (![self _removeCommitsForTip:tip handler:handler error:error]) {
+        goto cleanup;
+      }
+    }
+
+    // Delete frontier and repository
+    CALL_SQLITE_FUNCTION_GOTO(cleanup, sqlite3_bind_int64, frontierStatement, 1, repositoryID);
+    result = sqlite3_step(frontierStatement);
+    CHECK_SQLITE_FUNCTION_CALL(goto cleanup, result, == SQLITE_DONE);
+    CALL_SQLITE_FUNCTION_GOTO(cleanup, sqlite3_reset, frontierStatement);
+    CALL_SQLITE_FUNCTION_GOTO(cleanup, sqlite3_bind_int64, repositoryStatement, 1, repositoryID);
+    result = sqlite3_step(repositoryStatement);
+    CHECK_SQLITE_FUNCTION_CALL(goto cleanup, result, == SQLITE_DONE);
+    CALL_SQLITE_FUNCTION_GOTO(cleanup, sqlite3_reset, repositoryStatement);
+  }
+
+  // We're done
+  success = YES;
+
+cleanup:
+  sqlite3_reset(statements[kStatement_ListTipSHA1s]);  // Statements must be reset before being bound again
+  sqlite3_reset(statements[kStatement_DeleteTip]);
+  sqlite3_bind_int64(statements[kStatement_ListTipSHA1s], 1, _repositoryID);
+  sqlite3_bind_int64(statements[kStatement_DeleteTip], 2, _repositoryID);
+  sqlite3_finalize(repositoryStatement);
+  sqlite3_finalize(frontierStatement);
+  sqlite3_finalize(listStatement);
+  GC_LIST_FREE(tips);
+  GC_LIST_FREE(repositoryIDs);
+  return success;
+}
+
+// TODO: Use a custom container instead of GC_LIST + CFSet combo
+// TODO: Vacuum database when needed (this is expensive as it actually copies the database to rebuild it)
+- (BOOL)updateWithProgressHandler:(GCCommitDatabaseProgressHandler)handler error:(NSError**)error {
+  XLOG_DEBUG_CHECK(!(_options & kGCCommitDatabaseOptions_QueryOnly));
+  BOOL success = NO;
+  GC_LIST_ALLOCATE(oldTips, 64, git_oid);
+  GC_LIST_ALLOCATE(newTips, 64, git_oid);
+  CFSetCallBacks callbacks = {0, GCOIDCopyCallBack, GCFreeReleaseCallBack, NULL, GCOIDEqualCallBack, GCOIDHashCallBack};
   CFMutableSetRef oldSet = CFSetCreateMutable(kCFAllocatorDefault, 0, &callbacks);
   CFMutableSetRef newSet = CFSetCreateMutable(kCFAllocatorDefault, 0, &callbacks);
   sqlite3_stmt** statements = _statements;
   __block NSUInteger addedCommits = 0;
   __block NSUInteger removedCommits = 0;
   CFAbsoluteTime time = CFAbsoluteTimeGetCurrent();
+  BOOL (^addHandler)() = ^BOOL {
+    ++addedCommits;
+    return !handler || handler(!_ready, addedCommits, removedCommits);
+  };
+  BOOL (^removeHandler)() = ^BOOL {
+    ++removedCommits;
+    return !handler || handler(!_ready, addedCommits, removedCommits);
+  };
   int result;
 
+  // Check if the update of another repository sharing the database finished initializing it
+  if (!_ready && (_options & kGCCommitDatabaseOptions_Shared) && ![self _checkReady:error]) {
+    goto cleanup;
+  }
+
   // Load old tip SHA1 (already unique)
   while (1) {
     result = sqlite3_step(statements[kStatement_ListTipSHA1s]);
@@ -1042,7 +1767,6 @@ cleanup:
     CFSetAddValue(oldSet, oid);
   }
   CALL_SQLITE_FUNCTION_GOTO(cleanup, sqlite3_reset, statements[kStatement_ListTipSHA1s]);
-  XLOG_DEBUG_CHECK(_ready || !GC_LIST_COUNT(oldTips));
 
   // Load new tips (ensure unique)
   if (![_repository enumerateReferencesWithOptions:kGCReferenceEnumerationOption_IncludeHEAD
@@ -1092,44 +1816,50 @@ cleanup:
   result = sqlite3_step(statements[kStatement_BeginTransaction]);
   CHECK_SQLITE_FUNCTION_CALL(goto cleanup, result, == SQLITE_DONE);
   CALL_SQLITE_FUNCTION_GOTO(cleanup, sqlite3_reset, statements[kStatement_BeginTransaction]);
+  _uncommittedCount = 0;
+
+  // Resume interrupted update if any (its tip is already listed in the old tips)
+  if (![self _addCommitsForTip:NULL handler:addHandler error:error]) {
+    goto cleanup;
+  }
 
   // Find added tips
   const git_oid* newTip;
   GC_LIST_FOR_LOOP_POINTER(newTips, newTip) {
     if (!CFSetContainsValue(oldSet, newTip)) {
-      if (![self _addCommitsForTip:newTip
-                           handler:^BOOL {
-                             ++addedCommits;
-                             return !handler || handler(!_ready, addedCommits, removedCommits);
-                           }
-                             error:error]) {
+      if (![self _addCommitsForTip:newTip handler:addHandler error:error]) {
         goto cleanup;
       }
     }
   }
 
+  // Finish database initialization if needed (before removing commits as the triggers are required to delete them and an interrupted update may have left tips that are now gone)
+  if (!_ready) {
+    if (![self _initializeDeferredIndexes:error] || ![self _initializeTriggers:error]) {
+      goto cleanup;
+    }
+  }
+
   // Find removed tips
   const git_oid* oldTip;
   GC_LIST_FOR_LOOP_POINTER(oldTips, oldTip) {
     if (!CFSetContainsValue(newSet, oldTip)) {
-      if (![self _removeCommitsForTip:oldTip
-                              handler:^BOOL {
-                                ++removedCommits;
-                                return !handler || handler(!_ready, addedCommits, removedCommits);
-                              }
-                                error:error]) {
+      if (![self _removeCommitsForTip:oldTip handler:removeHandler error:error]) {
         goto cleanup;
       }
     }
   }
 
-  // Finish database initialization if needed
-  if (!_ready) {
-    if (![self _initializeDeferredIndexes:error] || ![self _initializeTriggers:error]) {
-      goto cleanup;
-    }
+  // Prune repositories sharing the database that no longer exist
+  if ((_options & kGCCommitDatabaseOptions_Shared) && ![self _pruneMissingRepositoriesWithHandler:removeHandler error:error]) {
+    goto cleanup;
   }
 
+  // Clear frontier saved by the last chunk if any
+  result = sqlite3_step(statements[kStatement_ClearFrontier]);
+  CHECK_SQLITE_FUNCTION_CALL(goto cleanup, result, == SQLITE_DONE);
+  CALL_SQLITE_FUNCTION_GOTO(cleanup, sqlite3_reset, statements[kStatement_ClearFrontier]);
+
   // End transaction
   result = sqlite3_step(statements[kStatement_EndTransaction]);
   CHECK_SQLITE_FUNCTION_CALL(goto cleanup, result, == SQLITE_DONE);
@@ -1137,7 +1867,9 @@ cleanup:
 
   // WAL manual checkpoint (ignore errors)
   result = sqlite3_wal_checkpoint_v2(_database, NULL, _ready ? SQLITE_CHECKPOINT_FULL : SQLITE_CHECKPOINT_TRUNCATE, NULL, NULL);
-  if (result != SQLITE_OK) {
+  if (result == SQLITE_BUSY) {
+    XLOG_VERBOSE(@"Commit database at \"%@\" was only partially checkpointed because of concurrent searches", _databasePath);  // The remaining frames are checkpointed by the next update
+  } else if (result != SQLITE_OK) {
     XLOG_ERROR(@"Failed checkpointing commit database at \"%@\" (%i): %s", _databasePath, result, sqlite3_errmsg(_database));
     XLOG_DEBUG_UNREACHABLE();
   }
@@ -1157,6 +1889,9 @@ cleanup:
     for (int i = 0; i < kNumStatements; ++i) {
       sqlite3_reset(_statements[i]);  // If the update failed, make sure to reset all statements to ensure they are in clean state for next time and release the database writer lock
     }
+    if (!sqlite3_get_autocommit(_database)) {
+      sqlite3_exec(_database, "ROLLBACK", NULL, NULL, NULL);  // Only discards the changes since the last committed chunk
+    }
   }
   CFRelease(newSet);
   CFRelease(oldSet);
@@ -1165,49 +1900,713 @@ cleanup:
   return success;
 }
 
-- (NSArray*)findCommitsMatching:(NSString*)match error:(NSError**)error {
-  return [self findCommitsUsingHistory:nil matching:match error:error];
+// Converts free text typed by the user to a safe FTS5 query: each term is quoted so punctuation cannot cause syntax errors, a trailing '*' is kept as a prefix query and AND / OR / NOT between terms are kept as operators
+static NSString* _FTSQueryFromString(NSString* string) {
+  NSMutableArray* terms = [NSMutableArray array];
+  for (NSString* word in [string componentsSeparatedByCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]]) {
+    if (word.length) {
+      [terms addObject:word];
+    }
+  }
+  NSMutableString* query = [NSMutableString string];
+  for (NSUInteger i = 0; i < terms.count; ++i) {
+    NSString* term = terms[i];
+    if (query.length) {
+      [query appendString:@" "];
+    }
+    if ((i > 0) && (i < terms.count - 1) && ([term isEqualToString:@"AND"] || [term isEqualToString:@"OR"] || [term isEqualToString:@"NOT"])) {
+      [query appendString:term];
+      continue;
+    }
+    BOOL prefix = (term.length > 1) && [term hasSuffix:@"*"];
+    if (prefix) {
+      term = [term substringToIndex:(term.length - 1)];
+    }
+    [query appendFormat:@"\"%@\"%s", [term stringByReplacingOccurrencesOfString:@"\"" withString:@"\"\""], prefix ? "*" : ""];
+  }
+  return query;
 }
 
-- (NSArray*)findCommitsUsingHistory:(GCHistory*)history matching:(NSString*)match error:(NSError**)error {
-  BOOL success = NO;
+// Returns the value of a filter term like "author:alice" or nil if the term is not a filter with a value
+static NSString* _SearchFilterValue(NSString* word, const char* prefix) {
+  NSString* string = [NSString stringWithUTF8String:prefix];
+  if ([word hasPrefix:string] && (word.length > string.length)) {
+    return [word substringFromIndex:string.length];
+  }
+  return nil;
+}
+
+// Accepts "YYYY", "YYYY-MM" or "YYYY-MM-DD" and returns the start of that period in the local time zone
+static BOOL _ParseSearchDate(NSString* string, sqlite3_int64* time) {
+  const char* utf8String = string.UTF8String;
+  int year;
+  int month = 1;
+  int day = 1;
+  int length = 0;
+  if ((sscanf(utf8String, "%4d-%2d-%2d%n", &year, &month, &day, &length) != 3) && (sscanf(utf8String, "%4d-%2d%n", &year, &month, &length) != 2) && (sscanf(utf8String, "%4d%n", &year, &length) != 1)) {
+    return NO;
+  }
+  if ((length != (int)strlen(utf8String)) || (year < 1970) || (month < 1) || (month > 12) || (day < 1) || (day > 31)) {
+    return NO;
+  }
+  NSCalendar* calendar = [[NSCalendar alloc] initWithCalendarIdentifier:NSCalendarIdentifierGregorian];
+  NSDateComponents* components = [[NSDateComponents alloc] init];
+  components.year = year;
+  components.month = month;
+  components.day = day;
+  NSDate* date = [calendar dateFromComponents:components];
+  [components release];
+  [calendar release];
+  if (date == nil) {
+    return NO;
+  }
+  *time = (sqlite3_int64)date.timeIntervalSince1970;
+  return YES;
+}
+
+@interface GCSearchQuery : NSObject
+@property(nonatomic, readonly) NSArray* terms;
+@property(nonatomic, readonly) NSArray* messageTerms;
+@property(nonatomic, readonly) NSArray* diffTerms;
+@property(nonatomic, readonly) NSArray* authors;
+@property(nonatomic, readonly) NSArray* committers;
+@property(nonatomic, readonly) NSArray* pathPatterns;  // Without leading or trailing slashes
+@property(nonatomic, readonly) sqlite3_int64 afterTime;  // INT64_MIN if none
+@property(nonatomic, readonly) sqlite3_int64 beforeTime;  // INT64_MAX if none
+@property(nonatomic, readonly, getter=isEmpty) BOOL empty;
+- (instancetype)initWithString:(NSString*)string matchLastTermAsPrefix:(BOOL)prefix;
+- (BOOL)isRefinementOfQuery:(GCSearchQuery*)query;  // Returns YES if the results of the receiver are guaranteed to be a subset of the results of the query
+@end
+
+static BOOL _IsOperator(NSString* term) {
+  return [term isEqualToString:@"AND"] || [term isEqualToString:@"OR"] || [term isEqualToString:@"NOT"];
+}
+
+// Each term of the other query must be implied by a term of the receiver: either the same term or one extending a prefix term (FTS matching is case-insensitive)
+// Operators are not supported as they can make results grow
+static BOOL _TermsRefineTerms(NSArray* terms, NSArray* otherTerms) {
+  for (NSString* term in terms) {
+    if (_IsOperator(term)) {
+      return NO;
+    }
+  }
+  for (NSString* otherTerm in otherTerms) {
+    if (_IsOperator(otherTerm)) {
+      return NO;
+    }
+    BOOL prefix = (otherTerm.length > 1) && [otherTerm hasSuffix:@"*"];
+    NSString* stem = prefix ? [otherTerm substringToIndex:(otherTerm.length - 1)] : nil;
+    BOOL implied = NO;
+    for (NSString* term in terms) {
+      if ([term isEqualToString:otherTerm] || (prefix && ([term rangeOfString:stem options:(NSAnchoredSearch | NSCaseInsensitiveSearch)].location != NSNotFound))) {
+        implied = YES;
+        break;
+      }
+    }
+    if (!implied) {
+      return NO;
+    }
+  }
+  return YES;
+}
+
+@implementation GCSearchQuery
+
+// "message:" and "diff:" scope terms to messages or diffs, several "author:" or "committer:" filters match any of the users and several "path:" filters must all match
+// Filters without a value or with an invalid date are searched as free text
+- (instancetype)initWithString:(NSString*)string matchLastTermAsPrefix:(BOOL)prefix {
+  if ((self = [super init])) {
+    NSMutableArray* terms = [[NSMutableArray alloc] init];
+    NSMutableArray* messageTerms = [[NSMutableArray alloc] init];
+    NSMutableArray* diffTerms = [[NSMutableArray alloc] init];
+    NSMutableArray* authors = [[NSMutableArray alloc] init];
+    NSMutableArray* committers = [[NSMutableArray alloc] init];
+    NSMutableArray* pathPatterns = [[NSMutableArray alloc] init];
+    NSMutableArray* lastTerms = nil;
+    _afterTime = INT64_MIN;
+    _beforeTime = INT64_MAX;
+    for (NSString* word in [string componentsSeparatedByCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]]) {
+      NSString* value;
+      sqlite3_int64 time;
+      lastTerms = nil;
+      if (!word.length) {
+        continue;
+      } else if ((value = _SearchFilterValue(word, kAuthorSearchPrefix))) {
+        [authors addObject:value];
+      } else if ((value = _SearchFilterValue(word, kCommitterSearchPrefix))) {
+        [committers addObject:value];
+      } else if ((value = _SearchFilterValue(word, kMessageSearchPrefix))) {
+        [messageTerms addObject:value];
+        lastTerms = messageTerms;
+      } else if ((value = _SearchFilterValue(word, kDiffSearchPrefix))) {
+        [diffTerms addObject:value];
+        lastTerms = diffTerms;
+      } else if ((value = _SearchFilterValue(word, kPathSearchPrefix))) {
+        while ([value hasPrefix:@"/"]) {
+          value = [value substringFromIndex:1];
+        }
+        while ([value hasSuffix:@"/"]) {
+          value = [value substringToIndex:(value.length - 1)];
+        }
+        [pathPatterns addObject:value];
+      } else if ((value = _SearchFilterValue(word, kAfterSearchPrefix)) && _ParseSearchDate(value, &time)) {
+        _afterTime = MAX(_afterTime, time);
+      } else if ((value = _SearchFilterValue(word, kBeforeSearchPrefix)) && _ParseSearchDate(value, &time)) {
+        _beforeTime = MIN(_beforeTime, time);
+      } else {
+        [terms addObject:word];
+        lastTerms = terms;
+      }
+    }
+    if (prefix && lastTerms && ![lastTerms.lastObject hasSuffix:@"*"]) {
+      [lastTerms replaceObjectAtIndex:(lastTerms.count - 1) withObject:[lastTerms.lastObject stringByAppendingString:@"*"]];
+    }
+    _terms = terms;
+    _messageTerms = messageTerms;
+    _diffTerms = diffTerms;
+    _authors = authors;
+    _committers = committers;
+    _pathPatterns = pathPatterns;
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [_terms release];
+  [_messageTerms release];
+  [_diffTerms release];
+  [_authors release];
+  [_committers release];
+  [_pathPatterns release];
+
+  [super dealloc];
+}
+
+- (BOOL)isEmpty {
+  return !_terms.count && !_messageTerms.count && !_diffTerms.count && !_authors.count && !_committers.count && !_pathPatterns.count && (_afterTime == INT64_MIN) && (_beforeTime == INT64_MAX);
+}
+
+- (BOOL)isRefinementOfQuery:(GCSearchQuery*)query {
+  if (!_TermsRefineTerms(_terms, query.terms) || !_TermsRefineTerms(_messageTerms, query.messageTerms) || !_TermsRefineTerms(_diffTerms, query.diffTerms)) {
+    return NO;
+  }
+  if ((query.authors.count && ![_authors isEqualToArray:query.authors]) || (query.committers.count && ![_committers isEqualToArray:query.committers])) {
+    return NO;
+  }
+  if ((_afterTime < query.afterTime) || (_beforeTime > query.beforeTime)) {
+    return NO;
+  }
+  for (NSString* pattern in query.pathPatterns) {
+    if (![_pathPatterns containsObject:pattern]) {
+      return NO;
+    }
+  }
+  return YES;
+}
+
+@end
+
+static NSUInteger _AddSearchArgument(NSMutableArray* arguments, id argument) {
+  [arguments addObject:argument];
+  return kFirstSearchArgument + arguments.count - 1;
+}
+
+// Patterns without wildcards also match the files below them so directories can be passed as-is
+static NSString* _SubpatternForPathPattern(NSString* pattern) {
+  BOOL wildcards = [pattern rangeOfCharacterFromSet:[NSCharacterSet characterSetWithCharactersInString:@"*?["]].location != NSNotFound;
+  return wildcards ? pattern : [pattern stringByAppendingString:@"/*"];
+}
+
+// Compiles a search to SQL: free text terms match messages, diffs, authors and committers while filters restrict the results using the indexes of the commits table
+// Returns nil if there is nothing to search
+static NSString* _CompileSearch(GCSearchQuery* query, GCCommitDatabaseSearchOrder order, NSMutableArray* arguments, BOOL* scored) {
+  XLOG_DEBUG_CHECK(arguments.count == 0);
+  if (query.empty) {
+    return nil;
+  }
+
+  // Full text searches return the ID and score of matching commits (free text terms must be the first argument)
+  NSMutableArray* sources = [NSMutableArray array];
+  if (query.terms.count) {
+    _AddSearchArgument(arguments, _FTSQueryFromString([query.terms componentsJoinedByString:@" "]));
+    [sources addObject:@kSearchMatchesQuery];
+  }
+  if (query.messageTerms.count) {
+    NSUInteger index = _AddSearchArgument(arguments, _FTSQueryFromString([query.messageTerms componentsJoinedByString:@" "]));
+    [sources addObject:[NSString stringWithFormat:@"SELECT rowid AS id, bm25(" kFTSMessagesTableName ") AS score FROM " kFTSMessagesTableName " WHERE " kFTSMessagesTableName " MATCH ?%lu", (unsigned long)index]];
+  }
+  if (query.diffTerms.count) {
+    NSUInteger index = _AddSearchArgument(arguments, _FTSQueryFromString([query.diffTerms componentsJoinedByString:@" "]));
+    [sources addObject:[NSString stringWithFormat:@"SELECT rowid AS id, bm25(" kFTSDiffsTableName ") AS score FROM " kFTSDiffsTableName " WHERE " kFTSDiffsTableName " MATCH ?%lu", (unsigned long)index]];
+  }
+
+  // Filters use the indexes on the author, committer and time columns of the commits table and on the path column of the commit paths table
+  NSMutableArray* conditions = [NSMutableArray array];
+  if (query.authors.count) {
+    NSUInteger index = _AddSearchArgument(arguments, _FTSQueryFromString([query.authors componentsJoinedByString:@" OR "]));
+    [conditions addObject:[NSString stringWithFormat:@"author IN (SELECT rowid FROM " kFTSUsersTableName " WHERE " kFTSUsersTableName " MATCH ?%lu)", (unsigned long)index]];
+  }
+  if (query.committers.count) {
+    NSUInteger index = _AddSearchArgument(arguments, _FTSQueryFromString([query.committers componentsJoinedByString:@" OR "]));
+    [conditions addObject:[NSString stringWithFormat:@"committer IN (SELECT rowid FROM " kFTSUsersTableName " WHERE " kFTSUsersTableName " MATCH ?%lu)", (unsigned long)index]];
+  }
+  if (query.afterTime != INT64_MIN) {
+    NSUInteger index = _AddSearchArgument(arguments, [NSNumber numberWithLongLong:query.afterTime]);
+    [conditions addObject:[NSString stringWithFormat:@"time >= ?%lu", (unsigned long)index]];
+  }
+  if (query.beforeTime != INT64_MAX) {
+    NSUInteger index = _AddSearchArgument(arguments, [NSNumber numberWithLongLong:query.beforeTime]);
+    [conditions addObject:[NSString stringWithFormat:@"time < ?%lu", (unsigned long)index]];
+  }
+  for (NSString* pattern in query.pathPatterns) {
+    NSUInteger index1 = _AddSearchArgument(arguments, pattern);
+    NSUInteger index2 = _AddSearchArgument(arguments, _SubpatternForPathPattern(pattern));
+    [conditions addObject:[NSString stringWithFormat:@"_id_ IN (SELECT `commit` FROM " kCommitPathsTableName " WHERE path IN (SELECT _id_ FROM " kPathsTableName " WHERE path GLOB ?%lu OR path GLOB ?%lu))", (unsigned long)index1, (unsigned long)index2]];
+  }
+
+  // Relevance is given by the first full text search if any while the other ones are used as filters
+  *scored = (order == kGCCommitDatabaseSearchOrder_Relevance) && sources.count;
+  for (NSUInteger i = *scored ? 1 : 0; i < sources.count; ++i) {
+    [conditions addObject:[NSString stringWithFormat:@"_id_ IN (SELECT id FROM (%@))", sources[i]]];
+  }
+  [conditions addObject:(*scored ? @"(score, id) > (?1, ?2)" : @"(time, _id_) < (?1, ?2)")];
+  if (*scored) {
+    return [NSString stringWithFormat:@"SELECT sha1, score, id FROM (SELECT id, MIN(score) AS score FROM (%@) GROUP BY id) JOIN " kCommitsTableName " ON " kCommitsTableName "._id_=id WHERE %@ ORDER BY score, id LIMIT ?3",
+                                      sources[0], [conditions componentsJoinedByString:@" AND "]];
+  }
+  return [NSString stringWithFormat:@"SELECT sha1, time, _id_ FROM " kCommitsTableName " WHERE %@ ORDER BY time DESC, _id_ DESC LIMIT ?3", [conditions componentsJoinedByString:@" AND "]];
+}
+
+// Compiles a search to SQL returning the IDs in the ?1 to ?2 range of the commits matching the conditions of the query not already implied by the previous one
+// Conditions are not correlated to the commits so each full text search runs once for all the previous results instead of being probed for each of them
+// Returns nil if the previous query already implies all the conditions
+static NSString* _CompileSearchFilter(GCSearchQuery* query, GCSearchQuery* previousQuery, NSMutableArray* arguments) {
+  XLOG_DEBUG_CHECK(arguments.count == 0);
+  XLOG_DEBUG_CHECK(!query.empty);
+  NSMutableArray* conditions = [NSMutableArray array];
+  if (query.terms.count && ![query.terms isEqualToArray:previousQuery.terms]) {
+    NSUInteger index = _AddSearchArgument(arguments, _FTSQueryFromString([query.terms componentsJoinedByString:@" "]));
+    [conditions addObject:[NSString stringWithFormat:@"(_id_ IN (SELECT rowid FROM " kFTSMessagesTableName " WHERE " kFTSMessagesTableName " MATCH ?%lu)"
+                                                     " OR _id_ IN (SELECT rowid FROM " kFTSDiffsTableName " WHERE " kFTSDiffsTableName " MATCH ?%lu)"
+                                                     " OR author IN (SELECT rowid FROM " kFTSUsersTableName " WHERE " kFTSUsersTableName " MATCH ?%lu)"
+                                                     " OR committer IN (SELECT rowid FROM " kFTSUsersTableName " WHERE " kFTSUsersTableName " MATCH ?%lu))",
+                                                     (unsigned long)index, (unsigned long)index, (unsigned long)index, (unsigned long)index]];
+  }
+  if (query.messageTerms.count && ![query.messageTerms isEqualToArray:previousQuery.messageTerms]) {
+    NSUInteger index = _AddSearchArgument(arguments, _FTSQueryFromString([query.messageTerms componentsJoinedByString:@" "]));
+    [conditions addObject:[NSString stringWithFormat:@"_id_ IN (SELECT rowid FROM " kFTSMessagesTableName " WHERE " kFTSMessagesTableName " MATCH ?%lu)", (unsigned long)index]];
+  }
+  if (query.diffTerms.count && ![query.diffTerms isEqualToArray:previousQuery.diffTerms]) {
+    NSUInteger index = _AddSearchArgument(arguments, _FTSQueryFromString([query.diffTerms componentsJoinedByString:@" "]));
+    [conditions addObject:[NSString stringWithFormat:@"_id_ IN (SELECT rowid FROM " kFTSDiffsTableName " WHERE " kFTSDiffsTableName " MATCH ?%lu)", (unsigned long)index]];
+  }
+  if (query.authors.count && ![query.authors isEqualToArray:previousQuery.authors]) {
+    NSUInteger index = _AddSearchArgument(arguments, _FTSQueryFromString([query.authors componentsJoinedByString:@" OR "]));
+    [conditions addObject:[NSString stringWithFormat:@"author IN (SELECT rowid FROM " kFTSUsersTableName " WHERE " kFTSUsersTableName " MATCH ?%lu)", (unsigned long)index]];
+  }
+  if (query.committers.count && ![query.committers isEqualToArray:previousQuery.committers]) {
+    NSUInteger index = _AddSearchArgument(arguments, _FTSQueryFromString([query.committers componentsJoinedByString:@" OR "]));
+    [conditions addObject:[NSString stringWithFormat:@"committer IN (SELECT rowid FROM " kFTSUsersTableName " WHERE " kFTSUsersTableName " MATCH ?%lu)", (unsigned long)index]];
+  }
+  if (query.afterTime != previousQuery.afterTime) {
+    NSUInteger index = _AddSearchArgument(arguments, [NSNumber numberWithLongLong:query.afterTime]);
+    [conditions addObject:[NSString stringWithFormat:@"time >= ?%lu", (unsigned long)index]];
+  }
+  if (query.beforeTime != previousQuery.beforeTime) {
+    NSUInteger index = _AddSearchArgument(arguments, [NSNumber numberWithLongLong:query.beforeTime]);
+    [conditions addObject:[NSString stringWithFormat:@"time < ?%lu", (unsigned long)index]];
+  }
+  for (NSString* pattern in query.pathPatterns) {
+    if ([previousQuery.pathPatterns containsObject:pattern]) {
+      continue;
+    }
+    NSUInteger index1 = _AddSearchArgument(arguments, pattern);
+    NSUInteger index2 = _AddSearchArgument(arguments, _SubpatternForPathPattern(pattern));
+    [conditions addObject:[NSString stringWithFormat:@"_id_ IN (SELECT `commit` FROM " kCommitPathsTableName " WHERE path IN (SELECT _id_ FROM " kPathsTableName " WHERE path GLOB ?%lu OR path GLOB ?%lu))", (unsigned long)index1, (unsigned long)index2]];
+  }
+  if (conditions.count == 0) {
+    return nil;
+  }
+  return [NSString stringWithFormat:@"SELECT _id_ FROM " kCommitsTableName " WHERE _id_ BETWEEN ?1 AND ?2 AND %@", [conditions componentsJoinedByString:@" AND "]];
+}
+
+// Searches run on read-only connections from a pool (created on demand) so they can run concurrently with each other and with an update in progress
+// Blocks if all readers are in use
+- (id)_performSearchUsingBlock:(id (^)(GCCommitDatabase* reader))block error:(NSError**)error {
+  GCCommitDatabase* reader = nil;
+  BOOL create = NO;
+  pthread_mutex_lock(&_readerMutex);
+  while (1) {
+    if (_idleReaders.count) {
+      reader = [_idleReaders.lastObject retain];
+      [_idleReaders removeLastObject];
+      break;
+    }
+    if (_readerCount < kMaxReaders) {
+      ++_readerCount;
+      create = YES;
+      break;
+    }
+    pthread_cond_wait(&_readerCondition, &_readerMutex);
+  }
+  pthread_mutex_unlock(&_readerMutex);
+
+  if (create) {
+    reader = [[GCCommitDatabase alloc] _initReaderWithDatabase:self error:error];
+    if (reader == nil) {
+      pthread_mutex_lock(&_readerMutex);
+      --_readerCount;
+      pthread_cond_signal(&_readerCondition);
+      pthread_mutex_unlock(&_readerMutex);
+      return nil;
+    }
+  }
+
+  id result = block(reader);
+
+  pthread_mutex_lock(&_readerMutex);
+  [_idleReaders addObject:reader];
+  pthread_cond_signal(&_readerCondition);
+  pthread_mutex_unlock(&_readerMutex);
+  [reader release];
+  return result;
+}
+
+- (GCCommitDatabaseSearchCursor*)searchCursorForCommitsMatching:(NSString*)match order:(GCCommitDatabaseSearchOrder)order {
+  GCSearchQuery* query = [[GCSearchQuery alloc] initWithString:match matchLastTermAsPrefix:NO];
+  NSMutableArray* arguments = [NSMutableArray array];
+  BOOL scored = NO;
+  NSString* sql = _CompileSearch(query, order, arguments, &scored);
+  [query release];
+  return [[[GCCommitDatabaseSearchCursor alloc] initWithMatch:match sql:sql arguments:arguments scored:scored order:order] autorelease];
+}
+
+- (BOOL)_bindSearchArguments:(NSArray*)arguments toStatement:(sqlite3_stmt*)statement error:(NSError**)error {
+  for (NSUInteger i = 0; i < arguments.count; ++i) {
+    id argument = arguments[i];
+    if ([argument isKindOfClass:[NSString class]]) {
+      CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_bind_text, statement, (int)(kFirstSearchArgument + i), [argument UTF8String], -1, SQLITE_TRANSIENT);
+    } else {
+      CALL_SQLITE_FUNCTION_RETURN(NO, sqlite3_bind_int64, statement, (int)(kFirstSearchArgument + i), [argument longLongValue]);
+    }
+  }
+  return YES;
+}
+
+// Statements are cached by SQL since searches compile to a small number of distinct queries
+- (sqlite3_stmt*)_statementForSearchSQL:(NSString*)sql error:(NSError**)error {
+  NSValue* value = [_searchStatements objectForKey:sql];
+  if (value) {
+    return value.pointerValue;
+  }
+  if (_searchStatements.count >= kMaxSearchStatements) {
+    for (value in _searchStatements.objectEnumerator) {
+      sqlite3_finalize(value.pointerValue);
+    }
+    [_searchStatements removeAllObjects];
+  }
+  sqlite3_stmt* statement;
+  CALL_SQLITE_FUNCTION_RETURN(NULL, sqlite3_prepare_v2, _database, sql.UTF8String, -1, &statement, NULL);
+  [_searchStatements setObject:[NSValue valueWithPointer:statement] forKey:sql];
+  return statement;
+}
+
+// Commits missing from the history or the repository are skipped
+// This must never be called on a reader as GCHistory and libgit2 repositories cannot be used from multiple threads simultaneously
+- (BOOL)_addCommitWithOID:(const git_oid*)oid toResults:(NSMutableArray*)results usingHistory:(GCHistory*)history error:(NSError**)error {
+  if (history) {
+    GCHistoryCommit* commit = [history historyCommitForOID:oid];
+    if (commit) {
+      [results addObject:commit];
+    }
+  } else {
+    git_commit* rawCommit;
+    int status = git_commit_lookup(&rawCommit, _repository.private, oid);
+    if (status != GIT_ENOTFOUND) {
+      CHECK_LIBGIT2_FUNCTION_CALL(return NO, status, == GIT_OK);
+      GCCommit* commit = [[GCCommit alloc] initWithRepository:_repository commit:rawCommit];
+      [results addObject:commit];
+      [commit release];
+    }
+  }
+  return YES;
+}
+
+// Readers only return OIDs which are resolved into commits on the calling thread
+- (NSArray*)_commitsForOIDs:(NSData*)oids usingHistory:(GCHistory*)history error:(NSError**)error {
+  XLOG_DEBUG_CHECK(!_reader);
   NSMutableArray* results = [NSMutableArray array];
-  sqlite3_stmt** statements = _statements;
+  const git_oid* oid = oids.bytes;
+  for (NSUInteger i = 0, count = oids.length / sizeof(git_oid); i < count; ++i) {
+    if (![self _addCommitWithOID:&oid[i] toResults:results usingHistory:history error:error]) {
+      return nil;
+    }
+  }
+  return results;
+}
+
+- (NSArray*)fetchCommitsFromCursor:(GCCommitDatabaseSearchCursor*)cursor usingHistory:(GCHistory*)history maximumCount:(NSUInteger)maximumCount error:(NSError**)error {
+  NSMutableData* oids = [NSMutableData data];
+  if (![self _fetchOIDs:oids fromCursor:cursor maximumCount:maximumCount error:error]) {
+    return nil;
+  }
+  return [self _commitsForOIDs:oids usingHistory:history error:error];
+}
 
-  CALL_SQLITE_FUNCTION_GOTO(cleanup, sqlite3_bind_text, statements[kStatement_SearchCommits], 1, match.UTF8String, -1, SQLITE_STATIC);
+- (BOOL)_fetchOIDs:(NSMutableData*)oids fromCursor:(GCCommitDatabaseSearchCursor*)cursor maximumCount:(NSUInteger)maximumCount error:(NSError**)error {
+  if (!_reader) {
+    return [[self _performSearchUsingBlock:^id(GCCommitDatabase* reader) {
+      return [reader _fetchOIDs:oids fromCursor:cursor maximumCount:maximumCount error:error] ? @YES : nil;
+    }
+                                     error:error] boolValue];
+  }
+  BOOL success = NO;
+  sqlite3_stmt* statement;
+  NSUInteger count = 0;
+  if (cursor.exhausted || !cursor.sql) {
+    cursor.exhausted = YES;
+    return YES;
+  }
+  statement = [self _statementForSearchSQL:cursor.sql error:error];
+  if (statement == NULL) {
+    return NO;
+  }
+
+  if (cursor.scored) {
+    CALL_SQLITE_FUNCTION_GOTO(cleanup, sqlite3_bind_double, statement, 1, cursor.lastScore);
+  } else {
+    CALL_SQLITE_FUNCTION_GOTO(cleanup, sqlite3_bind_int64, statement, 1, cursor.lastTime);
+  }
+  CALL_SQLITE_FUNCTION_GOTO(cleanup, sqlite3_bind_int64, statement, 2, cursor.lastID);
+  CALL_SQLITE_FUNCTION_GOTO(cleanup, sqlite3_bind_int64, statement, 3, (sqlite3_int64)MIN(maximumCount, (NSUInteger)INT64_MAX));
+  if (![self _bindSearchArguments:cursor.arguments toStatement:statement error:error]) {
+    goto cleanup;
+  }
   while (1) {
-    int result = sqlite3_step(statements[kStatement_SearchCommits]);
+    int result = sqlite3_step(statement);
     if (result != SQLITE_ROW) {
       CHECK_SQLITE_FUNCTION_CALL(goto cleanup, result, == SQLITE_DONE);
       break;
     }
-    XLOG_DEBUG_CHECK(sqlite3_column_bytes(statements[kStatement_SearchCommits], 0) == GIT_OID_RAWSZ);
-    const git_oid* oid = sqlite3_column_blob(statements[kStatement_SearchCommits], 0);
-    if (history) {
-      GCHistoryCommit* commit = [history historyCommitForOID:oid];
-      if (commit) {
-        [results addObject:commit];
-      }
+    ++count;
+    if (cursor.scored) {
+      cursor.lastScore = sqlite3_column_double(statement, 1);
     } else {
-      git_commit* rawCommit;
-      int status = git_commit_lookup(&rawCommit, _repository.private, oid);
-      if (status == GIT_ENOTFOUND) {
+      cursor.lastTime = sqlite3_column_int64(statement, 1);
+    }
+    cursor.lastID = sqlite3_column_int64(statement, 2);
+
+    XLOG_DEBUG_CHECK(sqlite3_column_bytes(statement, 0) == GIT_OID_RAWSZ);
+    [oids appendBytes:sqlite3_column_blob(statement, 0) length:sizeof(git_oid)];
+  }
+  CALL_SQLITE_FUNCTION_GOTO(cleanup, sqlite3_reset, statement);
+  if (count < maximumCount) {
+    cursor.exhausted = YES;
+  }
+  success = YES;
+
+cleanup:
+  if (!success) {
+    sqlite3_reset(statement);
+  }
+  return success;
+}
+
+- (NSArray*)fetchCommitsFromCursor:(GCCommitDatabaseSearchCursor*)cursor maximumCount:(NSUInteger)count error:(NSError**)error {
+  return [self fetchCommitsFromCursor:cursor usingHistory:nil maximumCount:count error:error];
+}
+
+- (NSArray*)findCommitsMatching:(NSString*)match error:(NSError**)error {
+  return [self findCommitsUsingHistory:nil matching:match error:error];
+}
+
+- (NSArray*)findCommitsForFile:(NSString*)path followRenames:(BOOL)follow error:(NSError**)error {
+  return [self findCommitsUsingHistory:nil forFile:path followRenames:follow error:error];
+}
+
+// Renames are followed by continuing with the history of the old path up to the time of the commit that renamed the file
+// Commits with equal times have no reliable order so commits already found are skipped instead of resuming strictly after the rename
+- (NSArray*)findCommitsUsingHistory:(GCHistory*)history forFile:(NSString*)path followRenames:(BOOL)follow error:(NSError**)error {
+  NSMutableData* oids = [NSMutableData data];
+  if (![self _findOIDs:oids forFile:path followRenames:follow error:error]) {
+    return nil;
+  }
+  return [self _commitsForOIDs:oids usingHistory:history error:error];
+}
+
+- (BOOL)_findOIDs:(NSMutableData*)oids forFile:(NSString*)path followRenames:(BOOL)follow error:(NSError**)error {
+  if (!_reader) {
+    return [[self _performSearchUsingBlock:^id(GCCommitDatabase* reader) {
+      return [reader _findOIDs:oids forFile:path followRenames:follow error:error] ? @YES : nil;
+    }
+                                     error:error] boolValue];
+  }
+  BOOL success = NO;
+  NSMutableIndexSet* commitIDs = [NSMutableIndexSet indexSet];
+  NSMutableIndexSet* pathIDs = [NSMutableIndexSet indexSet];
+  sqlite3_stmt* statement = _statements[kStatement_FindCommitsForPath];
+  sqlite3_int64 pathID = 0;
+  sqlite3_int64 maxTime = INT64_MAX;
+  int result;
+
+  CALL_SQLITE_FUNCTION_GOTO(cleanup, sqlite3_bind_text, _statements[kStatement_FindPathID], 1, path.UTF8String, -1, SQLITE_TRANSIENT);
+  result = sqlite3_step(_statements[kStatement_FindPathID]);
+  if (result == SQLITE_ROW) {
+    pathID = sqlite3_column_int64(_statements[kStatement_FindPathID], 0);
+  } else {
+    CHECK_SQLITE_FUNCTION_CALL(goto cleanup, result, == SQLITE_DONE);
+  }
+  CALL_SQLITE_FUNCTION_GOTO(cleanup, sqlite3_reset, _statements[kStatement_FindPathID]);
+
+  while (pathID && ![pathIDs containsIndex:pathID]) {  // Don't loop forever if a file was renamed back and forth
+    sqlite3_int64 previousPathID = 0;
+    sqlite3_int64 renameTime = 0;
+    [pathIDs addIndex:pathID];
+    CALL_SQLITE_FUNCTION_GOTO(cleanup, sqlite3_bind_int64, statement, 1, pathID);
+    CALL_SQLITE_FUNCTION_GOTO(cleanup, sqlite3_bind_int64, statement, 2, maxTime);
+    while (1) {
+      result = sqlite3_step(statement);
+      if (result != SQLITE_ROW) {
+        CHECK_SQLITE_FUNCTION_CALL(goto cleanup, result, == SQLITE_DONE);
+        break;
+      }
+      sqlite3_int64 commitID = sqlite3_column_int64(statement, 2);
+      if ([commitIDs containsIndex:commitID]) {
         continue;
       }
-      CHECK_LIBGIT2_FUNCTION_CALL(goto cleanup, status, == GIT_OK);
-      GCCommit* commit = [[GCCommit alloc] initWithRepository:_repository commit:rawCommit];
-      [results addObject:commit];
-      [commit release];
+      [commitIDs addIndex:commitID];
+      XLOG_DEBUG_CHECK(sqlite3_column_bytes(statement, 0) == GIT_OID_RAWSZ);
+      [oids appendBytes:sqlite3_column_blob(statement, 0) length:sizeof(git_oid)];
+      if (follow && !previousPathID && (sqlite3_column_type(statement, 3) != SQLITE_NULL)) {
+        previousPathID = sqlite3_column_int64(statement, 3);
+        renameTime = sqlite3_column_int64(statement, 1);
+      }
     }
+    CALL_SQLITE_FUNCTION_GOTO(cleanup, sqlite3_reset, statement);
+    pathID = previousPathID;
+    maxTime = renameTime;
   }
-  CALL_SQLITE_FUNCTION_GOTO(cleanup, sqlite3_reset, statements[kStatement_SearchCommits]);
   success = YES;
 
 cleanup:
   if (!success) {
-    sqlite3_reset(statements[kStatement_SearchCommits]);
+    sqlite3_reset(_statements[kStatement_FindPathID]);
+    sqlite3_reset(statement);
+  }
+  return success;
+}
+
+// Fetch all results in a single run of the query as paging through the cursor would run the full text match again for each page
+- (NSArray*)findCommitsUsingHistory:(GCHistory*)history matching:(NSString*)match error:(NSError**)error {
+  NSMutableData* oids = [NSMutableData data];
+  GCCommitDatabaseSearchCursor* cursor = [self searchCursorForCommitsMatching:match order:kGCCommitDatabaseSearchOrder_Time];
+  if (![self _fetchOIDs:oids fromCursor:cursor maximumCount:NSUIntegerMax error:error]) {
+    return nil;
+  }
+  XLOG_DEBUG_CHECK(cursor.exhausted);
+  return [self _commitsForOIDs:oids usingHistory:history error:error];
+}
+
+- (BOOL)_findCommitIDs:(NSMutableData*)commitIDs oids:(NSMutableData*)oids matchingQuery:(GCSearchQuery*)query error:(NSError**)error {
+  if (!_reader) {
+    return [[self _performSearchUsingBlock:^id(GCCommitDatabase* reader) {
+      return [reader _findCommitIDs:commitIDs oids:oids matchingQuery:query error:error] ? @YES : nil;
+    }
+                                     error:error] boolValue];
+  }
+  BOOL success = NO;
+  NSMutableArray* arguments = [NSMutableArray array];
+  BOOL scored;
+  NSString* sql = _CompileSearch(query, kGCCommitDatabaseSearchOrder_Time, arguments, &scored);
+  sqlite3_stmt* statement = sql ? [self _statementForSearchSQL:sql error:error] : NULL;
+  if (statement == NULL) {
+    return (sql == nil);
+  }
+
+  CALL_SQLITE_FUNCTION_GOTO(cleanup, sqlite3_bind_int64, statement, 1, INT64_MAX);
+  CALL_SQLITE_FUNCTION_GOTO(cleanup, sqlite3_bind_int64, statement, 2, INT64_MAX);
+  CALL_SQLITE_FUNCTION_GOTO(cleanup, sqlite3_bind_int64, statement, 3, -1);  // No limit
+  if (![self _bindSearchArguments:arguments toStatement:statement error:error]) {
+    goto cleanup;
   }
-  return success ? results : nil;
+  while (1) {
+    int result = sqlite3_step(statement);
+    if (result != SQLITE_ROW) {
+      CHECK_SQLITE_FUNCTION_CALL(goto cleanup, result, == SQLITE_DONE);
+      break;
+    }
+    sqlite3_int64 commitID = sqlite3_column_int64(statement, 2);
+    [commitIDs appendBytes:&commitID length:sizeof(sqlite3_int64)];
+    XLOG_DEBUG_CHECK(sqlite3_column_bytes(statement, 0) == GIT_OID_RAWSZ);
+    [oids appendBytes:sqlite3_column_blob(statement, 0) length:sizeof(git_oid)];
+  }
+  success = YES;
+
+cleanup:
+  sqlite3_reset(statement);
+  return success;
+}
+
+- (NSIndexSet*)_filterCommitIDs:(NSData*)commitIDs withQuery:(GCSearchQuery*)query previousQuery:(GCSearchQuery*)previousQuery error:(NSError**)error {
+  if (!_reader) {
+    return [self _performSearchUsingBlock:^id(GCCommitDatabase* reader) {
+      return [reader _filterCommitIDs:commitIDs withQuery:query previousQuery:previousQuery error:error];
+    }
+                                    error:error];
+  }
+  BOOL success = NO;
+  NSMutableIndexSet* indexes = [NSMutableIndexSet indexSet];
+  NSMutableIndexSet* matchingIDs = [NSMutableIndexSet indexSet];
+  NSMutableArray* arguments = [NSMutableArray array];
+  NSString* sql = _CompileSearchFilter(query, previousQuery, arguments);
+  const sqlite3_int64* ids = commitIDs.bytes;
+  NSUInteger count = commitIDs.length / sizeof(sqlite3_int64);
+  if ((sql == nil) || (count == 0)) {
+    [indexes addIndexesInRange:NSMakeRange(0, count)];
+    return indexes;
+  }
+  sqlite3_stmt* statement = [self _statementForSearchSQL:sql error:error];
+  if (statement == NULL) {
+    return nil;
+  }
+
+  sqlite3_int64 minID = INT64_MAX;
+  sqlite3_int64 maxID = INT64_MIN;
+  for (NSUInteger i = 0; i < count; ++i) {
+    minID = MIN(minID, ids[i]);
+    maxID = MAX(maxID, ids[i]);
+  }
+  CALL_SQLITE_FUNCTION_GOTO(cleanup, sqlite3_bind_int64, statement, 1, minID);
+  CALL_SQLITE_FUNCTION_GOTO(cleanup, sqlite3_bind_int64, statement, 2, maxID);
+  if (![self _bindSearchArguments:arguments toStatement:statement error:error]) {
+    goto cleanup;
+  }
+  while (1) {
+    int result = sqlite3_step(statement);
+    if (result != SQLITE_ROW) {
+      CHECK_SQLITE_FUNCTION_CALL(goto cleanup, result, == SQLITE_DONE);
+      break;
+    }
+    [matchingIDs addIndex:(NSUInteger)sqlite3_column_int64(statement, 0)];
+  }
+  for (NSUInteger i = 0; i < count; ++i) {
+    if ([matchingIDs containsIndex:(NSUInteger)ids[i]]) {
+      [indexes addIndex:i];
+    }
+  }
+  success = YES;
+
+cleanup:
+  sqlite3_reset(statement);
+  return success ? indexes : nil;
+}
+
+- (GCCommitDatabaseSearchSession*)searchSession {
+  return [self searchSessionUsingHistory:nil];
+}
+
+- (GCCommitDatabaseSearchSession*)searchSessionUsingHistory:(GCHistory*)history {
+  return [[[GCCommitDatabaseSearchSession alloc] initWithDatabase:self history:history] autorelease];
 }
 
 #if __CHECK_CONSISTENCY__
@@ -1219,7 +2618,7 @@ cleanup:
     sqlite3_stmt* statement2;
     if (sqlite3_prepare_v2(_database, "SELECT COUNT(*) FROM " kRelationsTableName " WHERE parent=?1", -1, &statement2, NULL) == SQLITE_OK) {
       sqlite3_stmt* statement3;
-      if (sqlite3_prepare_v2(_database, "SELECT 1 FROM " kTipsTableName " WHERE `commit`=?1", -1, &statement3, NULL) == SQLITE_OK) {
+      if (sqlite3_prepare_v2(_database, "SELECT COUNT(*) FROM " kTipsTableName " WHERE `commit`=?1", -1, &statement3, NULL) == SQLITE_OK) {
         while (1) {
           int result = sqlite3_step(statement1);
           if (result != SQLITE_ROW) {
@@ -1238,12 +2637,11 @@ cleanup:
           sqlite3_reset(statement2);
 
           sqlite3_bind_int64(statement3, 1, commitID);
-          result = sqlite3_step(statement3);
-          if (result == SQLITE_ROW) {
-            count += 1;
-          } else {
-            XLOG_DEBUG_CHECK(result == SQLITE_DONE);
+          if (sqlite3_step(statement3) != SQLITE_ROW) {
+            XLOG_DEBUG_UNREACHABLE();
+            break;
           }
+          count += sqlite3_column_int(statement3, 0);  // Tips of all repositories sharing the database
           sqlite3_reset(statement3);
 
           XLOG_DEBUG_CHECK(count == retainCount);
@@ -1260,6 +2658,12 @@ cleanup:
 
 #if DEBUG
 
++ (NSData*)extractUniqueWordsFromLines:(NSData*)lines {
+  NSMutableData* words = [NSMutableData data];
+  _ExtractUniqueWordsFromLines(lines, words);
+  return words;
+}
+
 - (NSUInteger)_countRowsForTable:(const char*)table {
   NSUInteger count = NSNotFound;
   sqlite3_stmt* statement;
@@ -1296,6 +2700,21 @@ cleanup:
   return count;
 }
 
+- (NSArray*)listIndexedDiffs {
+  NSMutableArray* array = nil;
+  sqlite3_stmt* statement;
+  if (sqlite3_prepare_v2(_database, "SELECT sha1, added, deleted FROM " kFTSDiffsTableName " JOIN " kCommitsTableName " ON " kCommitsTableName "._id_=" kFTSDiffsTableName ".rowid ORDER BY " kFTSDiffsTableName ".rowid", -1, &statement, NULL) == SQLITE_OK) {
+    array = [NSMutableArray array];
+    while (sqlite3_step(statement) == SQLITE_ROW) {
+      [array addObject:@[ GCGitOIDToSHA1(sqlite3_column_blob(statement, 0)),
+                          [NSData dataWithBytes:sqlite3_column_blob(statement, 1) length:sqlite3_column_bytes(statement, 1)],
+                          [NSData dataWithBytes:sqlite3_column_blob(statement, 2) length:sqlite3_column_bytes(statement, 2)] ]];
+    }
+    sqlite3_finalize(statement);
+  }
+  return array;
+}
+
 #endif
 
 - (NSString*)description {
@@ -1303,3 +2722,281 @@ cleanup:
 }
 
 @end
+
+@implementation GCCommitDatabaseSearchSession {
+  GCHistory* _history;
+  GCSearchQuery* _query;  // Of the last search
+  NSMutableData* _commitIDs;  // Results of the last search
+  NSMutableArray* _commits;
+  CFMutableDictionaryRef _lookup;  // Maps commit IDs to commits or NSNull if missing from the history
+}
+
+- (instancetype)initWithDatabase:(GCCommitDatabase*)database history:(GCHistory*)history {
+  if ((self = [super init])) {
+    _database = [database retain];
+    _history = [history retain];
+    _commitIDs = [[NSMutableData alloc] init];
+    _commits = [[NSMutableArray alloc] init];
+    _lookup = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, NULL, &kCFTypeDictionaryValueCallBacks);
+  }
+  return self;
+}
+
+- (void)dealloc {
+  CFRelease(_lookup);
+  [_commits release];
+  [_commitIDs release];
+  [_query release];
+  [_history release];
+  [_database release];
+
+  [super dealloc];
+}
+
+// Refining searches keep the order of the previous results which is the same as the one of a full search
+- (NSArray*)findCommitsMatching:(NSString*)match error:(NSError**)error {
+  GCSearchQuery* query = [[[GCSearchQuery alloc] initWithString:match matchLastTermAsPrefix:_matchesLastTermAsPrefix] autorelease];
+  NSMutableData* commitIDs = [NSMutableData data];
+  NSMutableArray* commits = [NSMutableArray array];
+  if (!query.empty) {
+    if (_query && (_commits.count <= kMaxRefinedSearchResults) && [query isRefinementOfQuery:_query]) {
+      NSIndexSet* indexes = [_database _filterCommitIDs:_commitIDs withQuery:query previousQuery:_query error:error];
+      if (indexes == nil) {
+        return nil;
+      }
+      const sqlite3_int64* ids = _commitIDs.bytes;
+      [indexes enumerateIndexesUsingBlock:^(NSUInteger index, BOOL* stop) {
+        [commitIDs appendBytes:&ids[index] length:sizeof(sqlite3_int64)];
+        [commits addObject:_commits[index]];
+      }];
+    } else {
+      NSMutableData* ids = [NSMutableData data];
+      NSMutableData* oids = [NSMutableData data];
+      if (![_database _findCommitIDs:ids oids:oids matchingQuery:query error:error]) {
+        return nil;
+      }
+      if (CFDictionaryGetCount(_lookup) > kMaxMemoizedSearchCommits) {
+        CFDictionaryRemoveAllValues(_lookup);
+      }
+      NSUInteger count = ids.length / sizeof(sqlite3_int64);
+      for (NSUInteger i = 0; i < count; ++i) {
+        sqlite3_int64 commitID = ((const sqlite3_int64*)ids.bytes)[i];
+        id commit = (id)CFDictionaryGetValue(_lookup, (const void*)(intptr_t)commitID);
+        if (commit == nil) {
+          NSUInteger oldCount = commits.count;
+          if (![_database _addCommitWithOID:&((const git_oid*)oids.bytes)[i] toResults:commits usingHistory:_history error:error]) {
+            return nil;
+          }
+          commit = commits.count > oldCount ? commits.lastObject : [NSNull null];
+          CFDictionarySetValue(_lookup, (const void*)(intptr_t)commitID, commit);
+          if (commit == [NSNull null]) {
+            continue;
+          }
+        } else if (commit == [NSNull null]) {
+          continue;
+        } else {
+          [commits addObject:commit];
+        }
+        [commitIDs appendBytes:&commitID length:sizeof(sqlite3_int64)];
+      }
+    }
+  }
+
+  [_query release];
+  _query = query.empty ? nil : [query retain];
+  [_commitIDs setData:commitIDs];
+  [_commits setArray:commits];
+  return commits;
+}
+
+@end
+
+typedef NS_ENUM(int, DiffJobState) {
+  kDiffJobState_Pending = 0,
+  kDiffJobState_Running,
+  kDiffJobState_Done,
+  kDiffJobState_Taken
+};
+
+typedef struct {
+  git_oid oid;
+  DiffJobState state;
+  DiffResult result;
+  BOOL hasChanges;
+  NSData* addedWords;
+  NSData* deletedWords;
+  NSData* paths;
+} DiffJob;
+
+@implementation GCDiffPipeline {
+  NSString* _path;
+  DiffJob* _jobs;
+  NSUInteger _count;
+  CFMutableDictionaryRef _lookup;  // Maps OIDs to their job index + 1
+  pthread_mutex_t _mutex;
+  pthread_cond_t _condition;
+  dispatch_group_t _group;
+  NSUInteger _nextJob;
+  NSUInteger _readyCount;  // Number of computed diffs not taken yet
+  NSUInteger _maxReadyCount;
+  BOOL _finished;
+}
+
+- (instancetype)initWithRepositoryPath:(NSString*)path commitOIDs:(const git_oid*)oids count:(NSUInteger)count workerCount:(NSUInteger)workerCount {
+  if ((self = [super init])) {
+    _path = [path copy];
+    _count = count;
+    _jobs = calloc(count, sizeof(DiffJob));
+    CFDictionaryKeyCallBacks callbacks = {0, NULL, NULL, NULL, GCOIDEqualCallBack, GCOIDHashCallBack};
+    _lookup = CFDictionaryCreateMutable(kCFAllocatorDefault, count, &callbacks, NULL);
+    for (NSUInteger i = 0; i < count; ++i) {
+      git_oid_cpy(&_jobs[i].oid, &oids[i]);
+      CFDictionarySetValue(_lookup, &_jobs[i].oid, (const void*)(i + 1));  // Use the git_oid stored in the job itself as the key, so no need to copy it
+    }
+    pthread_mutex_init(&_mutex, NULL);
+    pthread_cond_init(&_condition, NULL);
+    _maxReadyCount = workerCount * kDiffWindowPerWorker;
+
+    _group = dispatch_group_create();
+    for (NSUInteger i = 0; i < workerCount; ++i) {
+      dispatch_group_async(_group, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        [self _runWorker];
+      });
+    }
+  }
+  return self;
+}
+
+- (void)dealloc {
+  XLOG_DEBUG_CHECK(_finished);
+  for (NSUInteger i = 0; i < _count; ++i) {
+    [_jobs[i].addedWords release];
+    [_jobs[i].deletedWords release];
+    [_jobs[i].paths release];
+  }
+  dispatch_release(_group);
+  pthread_cond_destroy(&_condition);
+  pthread_mutex_destroy(&_mutex);
+  CFRelease(_lookup);
+  free(_jobs);
+  [_path release];
+
+  [super dealloc];
+}
+
+- (void)_runWorker {
+  git_repository* repository;
+  int status = git_repository_open(&repository, _path.fileSystemRepresentation);  // libgit2 repositories cannot be shared across threads
+  if (status != GIT_OK) {
+    LOG_LIBGIT2_ERROR(status);
+    return;  // Jobs will be computed by the writer instead
+  }
+  NSMutableData* addedLines = [[NSMutableData alloc] initWithCapacity:(64 * 1024)];
+  NSMutableData* deletedLines = [[NSMutableData alloc] initWithCapacity:(64 * 1024)];
+  NSMutableData* addedWords = [[NSMutableData alloc] initWithCapacity:(32 * 1024)];
+  NSMutableData* deletedWords = [[NSMutableData alloc] initWithCapacity:(32 * 1024)];
+  NSMutableData* paths = [[NSMutableData alloc] initWithCapacity:1024];
+  while (1) {
+    pthread_mutex_lock(&_mutex);
+    while (!_finished && (_readyCount >= _maxReadyCount)) {  // Don't get too far ahead of the writer to bound memory usage
+      pthread_cond_wait(&_condition, &_mutex);
+    }
+    while ((_nextJob < _count) && (_jobs[_nextJob].state != kDiffJobState_Pending)) {  // Skip jobs the writer already took over
+      ++_nextJob;
+    }
+    if (_finished || (_nextJob == _count)) {
+      pthread_mutex_unlock(&_mutex);
+      break;
+    }
+    DiffJob* job = &_jobs[_nextJob++];
+    job->state = kDiffJobState_Running;
+    pthread_mutex_unlock(&_mutex);
+
+    DiffResult result = kDiffResult_Failed;
+    BOOL hasChanges = NO;
+    git_commit* commit;
+    status = git_commit_lookup(&commit, repository, &job->oid);
+    if (status == GIT_OK) {
+      git_commit* parent = NULL;
+      if (git_commit_parentcount(commit)) {
+        status = git_commit_parent(&parent, commit, 0);
+      }
+      if ((status == GIT_OK) && _ComputeDiffWords(repository, commit, parent, addedLines, deletedLines, addedWords, deletedWords, paths, &hasChanges)) {
+        result = kDiffResult_Success;
+      }
+      git_commit_free(parent);
+      git_commit_free(commit);
+    }
+
+    pthread_mutex_lock(&_mutex);
+    job->state = kDiffJobState_Done;
+    job->result = result;
+    job->hasChanges = hasChanges;
+    if (hasChanges) {
+      job->addedWords = [addedWords copy];
+      job->deletedWords = [deletedWords copy];
+    }
+    if (result == kDiffResult_Success) {
+      job->paths = [paths copy];
+    }
+    _readyCount += 1;
+    pthread_cond_broadcast(&_condition);
+    pthread_mutex_unlock(&_mutex);
+  }
+  [paths release];
+  [deletedWords release];
+  [addedWords release];
+  [deletedLines release];
+  [addedLines release];
+  git_repository_free(repository);
+}
+
+- (DiffResult)takeDiffForCommit:(const git_oid*)oid addedWords:(NSMutableData*)addedWords deletedWords:(NSMutableData*)deletedWords paths:(NSMutableData*)paths hasChanges:(BOOL*)hasChanges {
+  DiffResult result = kDiffResult_NotQueued;
+  pthread_mutex_lock(&_mutex);
+  NSUInteger index = (NSUInteger)CFDictionaryGetValue(_lookup, oid);
+  if (index) {
+    DiffJob* job = &_jobs[index - 1];
+    if (job->state == kDiffJobState_Pending) {  // Don't wait for a worker to pick up the job
+      job->state = kDiffJobState_Taken;
+    } else {
+      while (job->state == kDiffJobState_Running) {
+        pthread_cond_wait(&_condition, &_mutex);
+      }
+      if (job->state == kDiffJobState_Done) {
+        result = job->result;
+        *hasChanges = job->hasChanges;
+        if (job->hasChanges) {
+          [addedWords setData:job->addedWords];
+          [deletedWords setData:job->deletedWords];
+          [job->addedWords release];
+          job->addedWords = nil;
+          [job->deletedWords release];
+          job->deletedWords = nil;
+        }
+        if (job->paths) {
+          [paths setData:job->paths];
+          [job->paths release];
+          job->paths = nil;
+        } else {
+          paths.length = 0;
+        }
+        job->state = kDiffJobState_Taken;
+        _readyCount -= 1;
+        pthread_cond_broadcast(&_condition);
+      }
+    }
+  }
+  pthread_mutex_unlock(&_mutex);
+  return result;
+}
+
+- (void)finish {
+  pthread_mutex_lock(&_mutex);
+  _finished = YES;
+  pthread_cond_broadcast(&_condition);
+  pthread_mutex_unlock(&_mutex);
+  dispatch_group_wait(_group, DISPATCH_TIME_FOREVER);
+}
+
+@end
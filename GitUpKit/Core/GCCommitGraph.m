@@ -0,0 +1,266 @@
+//  Copyright (C) 2015-2019 Pierre-Olivier Latour <info@pol-online.net>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#if !__has_feature(objc_arc)
+#error This file requires ARC
+#endif
+
+#import "GCPrivate.h"
+
+// See https://git-scm.com/docs/commit-graph-format
+#define kSignature 0x43475048  // "CGPH"
+#define kVersion 1
+#define kHashVersion 1  // SHA-1
+#define kHashLength 20
+#define kDataEntryLength (kHashLength + 16)
+
+#define kChunkID_OIDFanout 0x4f494446  // "OIDF"
+#define kChunkID_OIDLookup 0x4f49444c  // "OIDL"
+#define kChunkID_CommitData 0x43444154  // "CDAT"
+#define kChunkID_ExtraEdges 0x45444745  // "EDGE"
+
+#define kParentNone 0x70000000
+#define kParentExtraEdgesFlag 0x80000000
+#define kParentLastEdgeFlag 0x80000000
+#define kParentMask 0x7FFFFFFF
+
+typedef struct {
+  const unsigned char* fanout;
+  const unsigned char* oids;
+  const unsigned char* data;
+  const unsigned char* edges;  // May be NULL
+  uint32_t edgeCount;
+  uint32_t count;
+  uint32_t base;  // Position of the first commit of this layer in the entire chain
+} Layer;
+
+static inline uint32_t _ReadUInt32(const unsigned char* bytes) {
+  uint32_t value;
+  memcpy(&value, bytes, sizeof(uint32_t));
+  return CFSwapInt32BigToHost(value);
+}
+
+static inline uint64_t _ReadUInt64(const unsigned char* bytes) {
+  uint64_t value;
+  memcpy(&value, bytes, sizeof(uint64_t));
+  return CFSwapInt64BigToHost(value);
+}
+
+// Returns NO if the file is not a valid commit-graph file
+static BOOL _ParseLayer(NSData* data, uint32_t expectedBaseCount, Layer* layer) {
+  const unsigned char* bytes = data.bytes;
+  NSUInteger length = data.length;
+  if ((length < 8 + kHashLength) || (_ReadUInt32(bytes) != kSignature) || (bytes[4] != kVersion) || (bytes[5] != kHashVersion) || (bytes[7] != expectedBaseCount)) {
+    return NO;
+  }
+  NSUInteger chunkCount = bytes[6];
+  if (length < 8 + (chunkCount + 1) * 12 + kHashLength) {
+    return NO;
+  }
+  bzero(layer, sizeof(Layer));
+  uint64_t fanoutLength = 0;
+  uint64_t oidsLength = 0;
+  uint64_t dataLength = 0;
+  uint64_t edgesLength = 0;
+  for (NSUInteger i = 0; i < chunkCount; ++i) {
+    const unsigned char* entry = bytes + 8 + i * 12;
+    uint32_t chunkID = _ReadUInt32(entry);
+    uint64_t offset = _ReadUInt64(entry + 4);
+    uint64_t nextOffset = _ReadUInt64(entry + 12 + 4);
+    if ((offset > nextOffset) || (nextOffset > length - kHashLength)) {
+      return NO;
+    }
+    switch (chunkID) {
+      case kChunkID_OIDFanout:
+        layer->fanout = bytes + offset;
+        fanoutLength = nextOffset - offset;
+        break;
+
+      case kChunkID_OIDLookup:
+        layer->oids = bytes + offset;
+        oidsLength = nextOffset - offset;
+        break;
+
+      case kChunkID_CommitData:
+        layer->data = bytes + offset;
+        dataLength = nextOffset - offset;
+        break;
+
+      case kChunkID_ExtraEdges:
+        layer->edges = bytes + offset;
+        edgesLength = nextOffset - offset;
+        break;
+    }
+  }
+  if (!layer->fanout || (fanoutLength != 256 * 4) || !layer->oids || !layer->data) {
+    return NO;
+  }
+  layer->count = _ReadUInt32(layer->fanout + 255 * 4);
+  layer->edgeCount = (uint32_t)(edgesLength / 4);
+  return (oidsLength == (uint64_t)layer->count * kHashLength) && (dataLength == (uint64_t)layer->count * kDataEntryLength);
+}
+
+@implementation GCCommitGraph {
+  NSMutableArray* _files;
+  Layer* _layers;
+  NSUInteger _layerCount;
+}
+
+- (instancetype)initWithRepository:(GCRepository*)repository {
+  if ((self = [super init])) {
+    // Git doesn't use commit-graph files in shallow repositories as parents would be inconsistent
+    const char* commonPath = git_repository_commondir(repository.private);
+    if ((commonPath == NULL) || git_repository_is_shallow(repository.private)) {
+      return nil;
+    }
+    NSString* infoPath = [[NSString stringWithUTF8String:commonPath] stringByAppendingPathComponent:@"objects/info"];
+    _files = [[NSMutableArray alloc] init];
+
+    // Load either the single commit-graph file or the split commit-graph chain (base layer first)
+    NSData* data = [NSData dataWithContentsOfFile:[infoPath stringByAppendingPathComponent:@"commit-graph"] options:NSDataReadingMappedIfSafe error:NULL];
+    if (data) {
+      [_files addObject:data];
+    } else {
+      NSString* chainPath = [infoPath stringByAppendingPathComponent:@"commit-graphs"];
+      NSString* chain = [NSString stringWithContentsOfFile:[chainPath stringByAppendingPathComponent:@"commit-graph-chain"] encoding:NSASCIIStringEncoding error:NULL];
+      for (NSString* line in [chain componentsSeparatedByCharactersInSet:[NSCharacterSet newlineCharacterSet]]) {
+        if (line.length == 0) {
+          continue;
+        }
+        data = [NSData dataWithContentsOfFile:[chainPath stringByAppendingPathComponent:[NSString stringWithFormat:@"graph-%@.graph", line]] options:NSDataReadingMappedIfSafe error:NULL];
+        if (data == nil) {
+          XLOG_WARNING(@"Missing commit-graph layer \"%@\" in \"%@\"", line, repository.repositoryPath);
+          return nil;
+        }
+        [_files addObject:data];
+      }
+    }
+    if (_files.count == 0) {
+      return nil;
+    }
+
+    _layers = calloc(_files.count, sizeof(Layer));
+    for (NSData* file in _files) {
+      Layer* layer = &_layers[_layerCount];
+      if (!_ParseLayer(file, (uint32_t)_layerCount, layer)) {
+        XLOG_WARNING(@"Ignoring invalid commit-graph file in \"%@\"", repository.repositoryPath);
+        return nil;
+      }
+      layer->base = (uint32_t)_count;
+      _count += layer->count;
+      _layerCount += 1;
+    }
+  }
+  return self;
+}
+
+- (void)dealloc {
+  free(_layers);
+}
+
+static inline const Layer* _LayerForPosition(const Layer* layers, NSUInteger count, uint32_t position) {
+  for (NSUInteger i = count; i > 0; --i) {
+    const Layer* layer = &layers[i - 1];
+    if (position >= layer->base) {
+      return position - layer->base < layer->count ? layer : NULL;
+    }
+  }
+  return NULL;
+}
+
+- (BOOL)findOID:(const git_oid*)oid position:(uint32_t*)position {
+  for (NSUInteger i = 0; i < _layerCount; ++i) {
+    const Layer* layer = &_layers[i];
+    unsigned char first = oid->id[0];
+    uint32_t low = first ? _ReadUInt32(layer->fanout + (first - 1) * 4) : 0;
+    uint32_t high = MIN(_ReadUInt32(layer->fanout + first * 4), layer->count);
+    while (low < high) {
+      uint32_t middle = low + (high - low) / 2;
+      int result = memcmp(oid->id, layer->oids + (size_t)middle * kHashLength, kHashLength);
+      if (result == 0) {
+        *position = layer->base + middle;
+        return YES;
+      }
+      if (result < 0) {
+        high = middle;
+      } else {
+        low = middle + 1;
+      }
+    }
+  }
+  return NO;
+}
+
+- (const git_oid*)OIDAtPosition:(uint32_t)position {
+  const Layer* layer = _LayerForPosition(_layers, _layerCount, position);
+  return layer ? (const git_oid*)(layer->oids + (size_t)(position - layer->base) * kHashLength) : NULL;
+}
+
+- (git_time_t)timeAtPosition:(uint32_t)position {
+  const Layer* layer = _LayerForPosition(_layers, _layerCount, position);
+  XLOG_DEBUG_CHECK(layer);
+  const unsigned char* entry = layer->data + (size_t)(position - layer->base) * kDataEntryLength;
+  return (git_time_t)(((uint64_t)(_ReadUInt32(entry + kHashLength + 8) & 0x3) << 32) | _ReadUInt32(entry + kHashLength + 12));
+}
+
+- (uint32_t)generationAtPosition:(uint32_t)position {
+  const Layer* layer = _LayerForPosition(_layers, _layerCount, position);
+  XLOG_DEBUG_CHECK(layer);
+  const unsigned char* entry = layer->data + (size_t)(position - layer->base) * kDataEntryLength;
+  return _ReadUInt32(entry + kHashLength + 8) >> 2;
+}
+
+- (BOOL)getParentPositions:(uint32_t*)positions count:(NSUInteger*)count maximum:(NSUInteger)maximum atPosition:(uint32_t)position {
+  const Layer* layer = _LayerForPosition(_layers, _layerCount, position);
+  if (layer == NULL) {
+    return NO;
+  }
+  const unsigned char* entry = layer->data + (size_t)(position - layer->base) * kDataEntryLength;
+  uint32_t parent1 = _ReadUInt32(entry + kHashLength);
+  uint32_t parent2 = _ReadUInt32(entry + kHashLength + 4);
+  NSUInteger index = 0;
+  if (parent1 != kParentNone) {
+    if ((parent1 >= _count) || (index == maximum)) {
+      return NO;
+    }
+    positions[index++] = parent1;
+    if (parent2 != kParentNone) {
+      if (parent2 & kParentExtraEdgesFlag) {
+        for (uint32_t edge = parent2 & kParentMask; 1; ++edge) {
+          if ((edge >= layer->edgeCount) || (index == maximum)) {
+            return NO;
+          }
+          uint32_t value = _ReadUInt32(layer->edges + (size_t)edge * 4);
+          if ((value & kParentMask) >= _count) {
+            return NO;
+          }
+          positions[index++] = value & kParentMask;
+          if (value & kParentLastEdgeFlag) {
+            break;
+          }
+        }
+      } else {
+        if ((parent2 >= _count) || (index == maximum)) {
+          return NO;
+        }
+        positions[index++] = parent2;
+      }
+    }
+  }
+  *count = index;
+  return YES;
+}
+
+@end
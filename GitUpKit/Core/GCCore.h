@@ -38,6 +38,7 @@
 #import <GitUpKit/GCRepository+Config.h>
 #import <GitUpKit/GCRepository+HEAD.h>
 #import <GitUpKit/GCRepository+Mock.h>
+#import <GitUpKit/GCRepository+Pickaxe.h>
 #import <GitUpKit/GCRepository+Reflog.h>
 #import <GitUpKit/GCRepository+Reset.h>
 #import <GitUpKit/GCRepository+Status.h>
@@ -234,4 +234,40 @@
   XCTAssertEqualObjects(delta.canonicalPath, @"hello_world.txt");
 }
 
+- (void)testDiffChangeSets {
+  GCDiff* diff1 = [self.repository diffWorkingDirectoryWithRepositoryIndex:nil options:kGCDiffOption_IncludeUntracked maxInterHunkLines:0 maxContextLines:0 error:NULL];
+  XCTAssertNotNil(diff1);
+  XCTAssertTrue([[GCDiffChangeSet alloc] initWithDiff:diff1 toDiff:diff1].empty);
+
+  // Check inserted deltas
+  [self updateFileAtPath:@"a.txt" withString:@"a\n"];
+  [self updateFileAtPath:@"b.txt" withString:@"b\n"];
+  [self updateFileAtPath:@"hello_world.txt" withString:@"Goodbye World!\n"];
+  GCDiff* diff2 = [self.repository diffWorkingDirectoryWithRepositoryIndex:nil options:kGCDiffOption_IncludeUntracked maxInterHunkLines:0 maxContextLines:0 error:NULL];
+  GCDiffChangeSet* changes = [[GCDiffChangeSet alloc] initWithDiff:diff1 toDiff:diff2];
+  XCTAssertFalse(changes.empty);
+  XCTAssertEqualObjects([changes.insertedDeltas.allKeys sortedArrayUsingSelector:@selector(compare:)], (@[ @"a.txt", @"b.txt", @"hello_world.txt" ]));
+  XCTAssertEqual(changes.removedDeltas.count, 0);
+  XCTAssertEqual(changes.modifiedDeltas.count, 0);
+
+  // Check removed and modified deltas
+  [self updateFileAtPath:@"a.txt" withString:@"aaa\n"];
+  [self deleteFileAtPath:@"b.txt"];
+  GCDiff* diff3 = [self.repository diffWorkingDirectoryWithRepositoryIndex:nil options:kGCDiffOption_IncludeUntracked maxInterHunkLines:0 maxContextLines:0 error:NULL];
+  changes = [[GCDiffChangeSet alloc] initWithDiff:diff2 toDiff:diff3];
+  XCTAssertEqual(changes.insertedDeltas.count, 0);
+  XCTAssertEqualObjects(changes.removedDeltas.allKeys, @[ @"b.txt" ]);
+  XCTAssertEqualObjects(changes.modifiedDeltas.allKeys, @[ @"a.txt" ]);
+
+  // Check mapping changes onto delta arrays
+  NSIndexSet* removedIndexes;
+  NSIndexSet* insertedIndexes;
+  NSIndexSet* modifiedIndexes;
+  XCTAssertTrue([changes getRemovedIndexes:&removedIndexes insertedIndexes:&insertedIndexes modifiedIndexes:&modifiedIndexes fromDeltas:diff2.deltas toDeltas:diff3.deltas]);
+  XCTAssertEqualObjects(removedIndexes, [NSIndexSet indexSetWithIndex:[[diff2.deltas valueForKey:@"canonicalPath"] indexOfObject:@"b.txt"]]);
+  XCTAssertEqual(insertedIndexes.count, 0);
+  XCTAssertEqualObjects(modifiedIndexes, [NSIndexSet indexSetWithIndex:[[diff3.deltas valueForKey:@"canonicalPath"] indexOfObject:@"a.txt"]]);
+  XCTAssertFalse([changes getRemovedIndexes:&removedIndexes insertedIndexes:&insertedIndexes modifiedIndexes:&modifiedIndexes fromDeltas:diff2.deltas toDeltas:[[diff3.deltas reverseObjectEnumerator] allObjects]]);
+}
+
 @end
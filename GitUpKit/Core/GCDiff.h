@@ -117,6 +117,21 @@ typedef void (^GCDiffEndHunkHandler)(void);
 - (BOOL)isEqualToDiff:(GCDiff*)diff;
 @end
 
+@interface GCDiffChangeSet : NSObject
+@property(nonatomic, readonly) GCDiff* fromDiff;  // May be nil
+@property(nonatomic, readonly) GCDiff* toDiff;  // May be nil
+@property(nonatomic, readonly) NSDictionary* insertedDeltas;  // Deltas from "toDiff" whose canonical path is not in "fromDiff" keyed by canonical path
+@property(nonatomic, readonly) NSDictionary* removedDeltas;  // Deltas from "fromDiff" whose canonical path is not in "toDiff" keyed by canonical path
+@property(nonatomic, readonly) NSDictionary* modifiedDeltas;  // Deltas from "toDiff" which are not equal to the ones from "fromDiff" with the same canonical path keyed by canonical path
+@property(nonatomic, readonly, getter=isEmpty) BOOL empty;
+- (instancetype)initWithDiff:(GCDiff*)fromDiff toDiff:(GCDiff*)toDiff;
+- (BOOL)getRemovedIndexes:(NSIndexSet**)removedIndexes  // Indexes in "fromDeltas"
+          insertedIndexes:(NSIndexSet**)insertedIndexes  // Indexes in "toDeltas"
+          modifiedIndexes:(NSIndexSet**)modifiedIndexes  // Indexes in "toDeltas"
+               fromDeltas:(NSArray*)fromDeltas
+                 toDeltas:(NSArray*)toDeltas;  // Maps the changes onto arrays of deltas from the diffs e.g. sorted differently - Returns NO if the unchanged deltas are not in the same order in both arrays
+@end
+
 @interface GCDiffPatch : NSObject
 @property(nonatomic, readonly, getter=isEmpty) BOOL empty;
 - (void)enumerateUsingBeginHunkHandler:(GCDiffBeginHunkHandler)beginHunkHandler
@@ -310,6 +310,7 @@ static inline BOOL _EqualDeltas(const git_diff_delta* delta1, const git_diff_del
   NSMutableArray* _deltas;
   BOOL _modified;
   BOOL _changed;
+  NSArray* _parts;  // Diffs owning the deltas of a composite diff
 }
 
 - (instancetype)initWithRepository:(GCRepository*)repository
@@ -329,6 +330,81 @@ static inline BOOL _EqualDeltas(const git_diff_delta* delta1, const git_diff_del
   return self;
 }
 
+// Must match git_diff_delta__cmp()
+static NSComparisonResult _CompareDeltas(const git_diff_delta* delta1, const git_diff_delta* delta2, BOOL icase) {
+  const char* path1 = delta1->old_file.path && (delta1->status != GIT_DELTA_ADDED) && (delta1->status != GIT_DELTA_RENAMED) && (delta1->status != GIT_DELTA_COPIED) ? delta1->old_file.path : delta1->new_file.path;
+  const char* path2 = delta2->old_file.path && (delta2->status != GIT_DELTA_ADDED) && (delta2->status != GIT_DELTA_RENAMED) && (delta2->status != GIT_DELTA_COPIED) ? delta2->old_file.path : delta2->new_file.path;
+  int result = icase ? strcasecmp(path1, path2) : strcmp(path1, path2);
+  if (result == 0) {
+    result = (int)delta1->status - (int)delta2->status;
+  }
+  return result < 0 ? NSOrderedAscending : (result > 0 ? NSOrderedDescending : NSOrderedSame);
+}
+
+static BOOL _FilePathMatchesPaths(const char* path, NSSet* files, NSArray* directories) {
+  if (path == NULL) {
+    return NO;
+  }
+  if ([files containsObject:GCFileSystemPathFromGitPath(path)]) {
+    return YES;
+  }
+  for (NSString* directory in directories) {
+    const char* prefix = GCGitPathFromFileSystemPath(directory);
+    if (!strncmp(path, prefix, strlen(prefix))) {
+      return YES;
+    }
+  }
+  return NO;
+}
+
+- (instancetype)initWithDiff:(GCDiff*)diff replacingDeltasMatchingFilePaths:(NSArray*)paths withDiff:(GCDiff*)scopedDiff {
+  XLOG_DEBUG_CHECK((scopedDiff.private != NULL) && (scopedDiff.type == diff.type) && (scopedDiff.options == diff.options));
+  if ((self = [super init])) {
+    _repository = diff.repository;
+    _type = diff.type;
+    _options = diff.options;
+    _maxInterHunkLines = diff.maxInterHunkLines;
+    _maxContextLines = diff.maxContextLines;
+
+    NSMutableSet* files = [[NSMutableSet alloc] init];
+    NSMutableArray* directories = [[NSMutableArray alloc] init];
+    for (NSString* path in paths) {
+      if ([path hasSuffix:@"/"]) {
+        [directories addObject:path];
+      } else {
+        [files addObject:path];
+      }
+    }
+    NSMutableArray* parts = [[NSMutableArray alloc] initWithObjects:scopedDiff, nil];  // Don't use a set as -[GCDiff isEqual:] compares contents
+    _deltas = [[NSMutableArray alloc] init];
+    for (GCDiffDelta* delta in diff.deltas) {
+      if (!_FilePathMatchesPaths(delta.private->old_file.path, files, directories) && !_FilePathMatchesPaths(delta.private->new_file.path, files, directories)) {
+        [_deltas addObject:delta];
+        if ([parts indexOfObjectIdenticalTo:delta.diff] == NSNotFound) {
+          [parts addObject:delta.diff];
+        }
+      }
+    }
+    [_deltas addObjectsFromArray:scopedDiff.deltas];
+    _parts = parts;
+
+    BOOL icase = git_diff_is_sorted_icase(scopedDiff.private);
+    [_deltas sortWithOptions:NSSortStable
+             usingComparator:^NSComparisonResult(GCDiffDelta* delta1, GCDiffDelta* delta2) {
+               return _CompareDeltas(delta1.private, delta2.private, icase);
+             }];
+    for (GCDiffDelta* delta in _deltas) {
+      if (delta.change != kGCFileDiffChange_Unmodified) {
+        _modified = YES;
+        if (delta.change != kGCFileDiffChange_Untracked) {
+          _changed = YES;
+        }
+      }
+    }
+  }
+  return self;
+}
+
 - (void)dealloc {
   git_diff_free(_private);
 }
@@ -397,6 +473,14 @@ static inline BOOL _EqualDeltas(const git_diff_delta* delta1, const git_diff_del
 
 - (GCFileDiffChange)changeForFile:(NSString*)path {
   const char* cPath = GCGitPathFromFileSystemPath(path);
+  if (_parts) {
+    for (GCDiffDelta* delta in _deltas) {
+      if (delta.private->new_file.path && !strcmp(cPath, delta.private->new_file.path)) {
+        return delta.change;
+      }
+    }
+    return NSNotFound;
+  }
   for (size_t i = 0, count = git_diff_num_deltas(_private); i < count; ++i) {
     const git_diff_delta* delta = git_diff_get_delta(_private, i);
     if (delta->new_file.path && !strcmp(cPath, delta->new_file.path)) {
@@ -409,7 +493,7 @@ static inline BOOL _EqualDeltas(const git_diff_delta* delta1, const git_diff_del
 #endif
 
 - (NSString*)description {
-  NSMutableString* string = [NSMutableString stringWithFormat:@"[%@] %lu deltas", self.class, git_diff_num_deltas(_private)];
+  NSMutableString* string = [NSMutableString stringWithFormat:@"[%@] %lu deltas", self.class, _parts ? _deltas.count : git_diff_num_deltas(_private)];
   for (GCDiffDelta* delta in _deltas) {
     [string appendString:@"\n  "];
     [string appendString:delta.description];
@@ -435,8 +519,30 @@ static inline BOOL _EqualDiffs(git_diff* diff1, git_diff* diff2) {
   return YES;
 }
 
+// Composite diffs have no underlying git_diff so they are compared using their deltas
+static inline BOOL _EqualDeltaArrays(NSArray* deltas1, NSArray* deltas2) {
+  if (deltas1.count != deltas2.count) {
+    return NO;
+  }
+  for (NSUInteger i = 0, count = deltas1.count; i < count; ++i) {
+    if (!_EqualDeltas([(GCDiffDelta*)deltas1[i] private], [(GCDiffDelta*)deltas2[i] private])) {
+      return NO;
+    }
+  }
+  return YES;
+}
+
 - (BOOL)isEqualToDiff:(GCDiff*)diff {
-  return (self == diff) || ((_options == diff->_options) && _EqualDiffs(_private, diff->_private));
+  if (self == diff) {
+    return YES;
+  }
+  if (_options != diff->_options) {
+    return NO;
+  }
+  if (_parts || diff->_parts) {
+    return _EqualDeltaArrays(self.deltas, diff.deltas);
+  }
+  return _EqualDiffs(_private, diff->_private);
 }
 
 - (BOOL)isEqual:(id)object {
@@ -448,13 +554,133 @@ static inline BOOL _EqualDiffs(git_diff* diff1, git_diff* diff2) {
 
 @end
 
+@implementation GCDiffChangeSet
+
+- (instancetype)initWithDiff:(GCDiff*)fromDiff toDiff:(GCDiff*)toDiff {
+  if ((self = [super init])) {
+    _fromDiff = fromDiff;
+    _toDiff = toDiff;
+    NSMutableDictionary* fromDeltas = [[NSMutableDictionary alloc] initWithCapacity:fromDiff.deltas.count];
+    for (GCDiffDelta* delta in fromDiff.deltas) {
+      fromDeltas[delta.canonicalPath] = delta;
+    }
+    NSMutableDictionary* insertedDeltas = [[NSMutableDictionary alloc] init];
+    NSMutableDictionary* modifiedDeltas = [[NSMutableDictionary alloc] init];
+    for (GCDiffDelta* delta in toDiff.deltas) {
+      NSString* path = delta.canonicalPath;
+      GCDiffDelta* fromDelta = fromDeltas[path];
+      if (fromDelta) {
+        if (![fromDelta isEqualToDelta:delta]) {
+          modifiedDeltas[path] = delta;
+        }
+        [fromDeltas removeObjectForKey:path];
+      } else {
+        insertedDeltas[path] = delta;
+      }
+    }
+    _insertedDeltas = insertedDeltas;
+    _removedDeltas = fromDeltas;
+    _modifiedDeltas = modifiedDeltas;
+  }
+  return self;
+}
+
+- (BOOL)isEmpty {
+  return !_insertedDeltas.count && !_removedDeltas.count && !_modifiedDeltas.count;
+}
+
+- (BOOL)getRemovedIndexes:(NSIndexSet**)removedIndexes
+          insertedIndexes:(NSIndexSet**)insertedIndexes
+          modifiedIndexes:(NSIndexSet**)modifiedIndexes
+               fromDeltas:(NSArray*)fromDeltas
+                 toDeltas:(NSArray*)toDeltas {
+  NSMutableIndexSet* removed = [[NSMutableIndexSet alloc] init];
+  NSMutableArray* keptPaths = [[NSMutableArray alloc] initWithCapacity:fromDeltas.count];
+  [fromDeltas enumerateObjectsUsingBlock:^(GCDiffDelta* delta, NSUInteger index, BOOL* stop) {
+    NSString* path = delta.canonicalPath;
+    if (_removedDeltas[path]) {
+      [removed addIndex:index];
+    } else {
+      [keptPaths addObject:path];
+    }
+  }];
+  NSMutableIndexSet* inserted = [[NSMutableIndexSet alloc] init];
+  NSMutableIndexSet* modified = [[NSMutableIndexSet alloc] init];
+  NSUInteger keptIndex = 0;
+  for (NSUInteger index = 0, count = toDeltas.count; index < count; ++index) {
+    NSString* path = [(GCDiffDelta*)toDeltas[index] canonicalPath];
+    if (_insertedDeltas[path]) {
+      [inserted addIndex:index];
+      continue;
+    }
+    if ((keptIndex == keptPaths.count) || ![keptPaths[keptIndex] isEqualToString:path]) {
+      return NO;
+    }
+    keptIndex += 1;
+    if (_modifiedDeltas[path]) {
+      [modified addIndex:index];
+    }
+  }
+  if (keptIndex != keptPaths.count) {
+    return NO;
+  }
+  *removedIndexes = removed;
+  *insertedIndexes = inserted;
+  *modifiedIndexes = modified;
+  return YES;
+}
+
+- (NSString*)description {
+  return [NSString stringWithFormat:@"[%@] %lu inserted, %lu removed, %lu modified", self.class, (unsigned long)_insertedDeltas.count, (unsigned long)_removedDeltas.count, (unsigned long)_modifiedDeltas.count];
+}
+
+@end
+
+// Diffs the tracked files without letting libgit2 scan the working directory for untracked files and merges the diff of the untracked files already found
+// The result is the same as a single diff since the untracked files diff keeps the options (including the ones that affect patches) and renames are found afterwards
+static int _DiffIndexToWorkdir(git_diff** outDiff, git_repository* repository, git_index* index, git_diff_options* diffOptions, NSArray* untrackedFiles) {
+  if (untrackedFiles == nil) {
+    return git_diff_index_to_workdir(outDiff, repository, index, diffOptions);
+  }
+  git_diff_options trackedOptions = *diffOptions;
+  trackedOptions.flags &= ~(GIT_DIFF_INCLUDE_UNTRACKED | GIT_DIFF_RECURSE_UNTRACKED_DIRS | GIT_DIFF_SHOW_UNTRACKED_CONTENT);
+  if (untrackedFiles.count == 0) {
+    return git_diff_index_to_workdir(outDiff, repository, index, &trackedOptions);
+  }
+
+  // Make sure filePaths live until the end of scope
+  const char** filePaths = malloc(untrackedFiles.count * sizeof(const char*));
+  for (NSUInteger i = 0; i < untrackedFiles.count; ++i) {
+    filePaths[i] = GCGitPathFromFileSystemPath(untrackedFiles[i]);
+  }
+  git_diff_options untrackedOptions = *diffOptions;
+  untrackedOptions.flags |= GIT_DIFF_DISABLE_PATHSPEC_MATCH;
+  untrackedOptions.pathspec.count = untrackedFiles.count;
+  untrackedOptions.pathspec.strings = (char**)filePaths;
+  git_diff* trackedDiff = NULL;
+  int status = git_diff_index_to_workdir(outDiff, repository, index, &untrackedOptions);
+  if (status == GIT_OK) {
+    status = git_diff_index_to_workdir(&trackedDiff, repository, index, &trackedOptions);
+    if (status == GIT_OK) {
+      status = git_diff_merge(*outDiff, trackedDiff);
+    }
+    if (status != GIT_OK) {
+      git_diff_free(*outDiff);
+      *outDiff = NULL;
+    }
+  }
+  git_diff_free(trackedDiff);
+  free(filePaths);
+  return status;
+}
+
 @implementation GCRepository (GCDiff)
 
 // GIT_DIFF_SKIP_BINARY_CHECK only matters if creating patches from the diff either with git_diff_foreach() if passing non-NULL hunk or line callbacks or with git_patch_from_diff()
 // For libgit2, which mirrors Core Git, a file is binary if non-empty and it contains a NUL byte in the first 8000 bytes
 // However the GIT_DIFF_FLAG_BINARY flag will NOT be set on old_file.flags / new_file.flags / delta.flags unless a patch is generated
 - (GCDiff*)_diffWithType:(GCDiffType)type
-             filePattern:(NSString*)filePattern
+            filePatterns:(NSArray*)filePatterns
                  options:(GCDiffOptions)options
        maxInterHunkLines:(NSUInteger)maxInterHunkLines
          maxContextLines:(NSUInteger)maxContextLines
@@ -463,8 +689,11 @@ static inline BOOL _EqualDiffs(git_diff* diff1, git_diff* diff2) {
   GCDiff* gcDiff = nil;
   git_diff* diff = NULL;
 
-  // Make sure filePath lives until the end of scope
-  const char* filePath = GCGitPathFromFileSystemPath(filePattern);
+  // Make sure filePaths live until the end of scope
+  const char** filePaths = filePatterns.count ? malloc(filePatterns.count * sizeof(const char*)) : NULL;
+  for (NSUInteger i = 0; i < filePatterns.count; ++i) {
+    filePaths[i] = GCGitPathFromFileSystemPath(filePatterns[i]);
+  }
 
   git_diff_options diffOptions = GIT_DIFF_OPTIONS_INIT;
   if (options & kGCDiffOption_IncludeUnmodified) {
@@ -488,16 +717,23 @@ static inline BOOL _EqualDiffs(git_diff* diff1, git_diff* diff2) {
   if (options & kGCDiffOption_IgnoreAllSpaces) {
     diffOptions.flags |= GIT_DIFF_IGNORE_WHITESPACE;
   }
-  if (filePattern) {
-    diffOptions.pathspec.count = 1;
-    diffOptions.pathspec.strings = (char**)&filePath;
+  if (filePatterns.count) {
+    diffOptions.pathspec.count = filePatterns.count;
+    diffOptions.pathspec.strings = (char**)filePaths;
 
     static NSCharacterSet* set = nil;
     if (set == nil) {
       set = [NSCharacterSet characterSetWithCharactersInString:@"?*[]"];
     }
-    if ([filePattern rangeOfCharacterFromSet:set].location == NSNotFound) {
-      diffOptions.flags |= GIT_DIFF_DISABLE_PATHSPEC_MATCH;
+    BOOL literal = YES;
+    for (NSString* filePattern in filePatterns) {
+      if ([filePattern rangeOfCharacterFromSet:set].location != NSNotFound) {
+        literal = NO;
+        break;
+      }
+    }
+    if (literal) {
+      diffOptions.flags |= GIT_DIFF_DISABLE_PATHSPEC_MATCH;  // This also lets libgit2 skip directories that cannot match
     }
   }
   diffOptions.ignore_submodules = GIT_SUBMODULE_IGNORE_NONE;  // If unset, libgit2 will fall back to "diff.ignoresubmodules" from the config or GIT_SUBMODULE_IGNORE_DEFAULT if absent, which itself stands for GIT_SUBMODULE_IGNORE_NONE
@@ -528,9 +764,19 @@ static inline BOOL _EqualDiffs(git_diff* diff1, git_diff* diff2) {
 
 cleanup:
   git_diff_free(diff);
+  free(filePaths);
   return gcDiff;
 }
 
+// Leaves "untrackedFiles" nil if the cache cannot be used
+- (BOOL)_findUntrackedFiles:(NSArray**)untrackedFiles usingCache:(GCUntrackedCache*)cache index:(GCIndex*)index filePatterns:(NSArray*)filePatterns options:(GCDiffOptions)options error:(NSError**)error {
+  if (cache && !filePatterns.count && (options & kGCDiffOption_IncludeUntracked) && !(options & kGCDiffOption_IncludeIgnored)) {
+    *untrackedFiles = [cache findUntrackedFilesInRepository:self usingIndex:index error:error];
+    return (*untrackedFiles != nil);
+  }
+  return YES;
+}
+
 - (GCDiff*)diffWorkingDirectoryWithCommit:(GCCommit*)commit
                                usingIndex:(GCIndex*)index
                               filePattern:(NSString*)filePattern
@@ -538,18 +784,33 @@ cleanup:
                         maxInterHunkLines:(NSUInteger)maxInterHunkLines
                           maxContextLines:(NSUInteger)maxContextLines
                                     error:(NSError**)error {
+  return [self diffWorkingDirectoryWithCommit:commit usingIndex:index filePatterns:(filePattern ? @[ filePattern ] : nil) untrackedCache:nil options:options maxInterHunkLines:maxInterHunkLines maxContextLines:maxContextLines error:error];
+}
+
+- (GCDiff*)diffWorkingDirectoryWithCommit:(GCCommit*)commit
+                               usingIndex:(GCIndex*)index
+                             filePatterns:(NSArray*)filePatterns
+                           untrackedCache:(GCUntrackedCache*)cache
+                                  options:(GCDiffOptions)options
+                        maxInterHunkLines:(NSUInteger)maxInterHunkLines
+                          maxContextLines:(NSUInteger)maxContextLines
+                                    error:(NSError**)error {
   if (index == nil) {
     index = [self readRepositoryIndex:error];
     if (index == nil) {
       return nil;
     }
   }
+  NSArray* untrackedFiles = nil;
+  if (![self _findUntrackedFiles:&untrackedFiles usingCache:cache index:index filePatterns:filePatterns options:options error:error]) {
+    return nil;
+  }
   git_tree* tree = NULL;
   if (commit) {
     CALL_LIBGIT2_FUNCTION_RETURN(nil, git_commit_tree, &tree, commit.private);
   }
   GCDiff* diff = [self _diffWithType:kGCDiffType_WorkingDirectoryWithCommit
-                         filePattern:filePattern
+                        filePatterns:filePatterns
                              options:options
                    maxInterHunkLines:maxInterHunkLines
                      maxContextLines:maxContextLines
@@ -559,7 +820,7 @@ cleanup:
                                  if (status == GIT_OK) {
                                    git_diff* diff2;
                                    diffOptions->flags |= GIT_DIFF_UPDATE_INDEX;
-                                   status = git_diff_index_to_workdir(&diff2, self.private, index.private, diffOptions);
+                                   status = _DiffIndexToWorkdir(&diff2, self.private, index.private, diffOptions, untrackedFiles);
                                    if (status == GIT_OK) {
                                      status = git_diff_merge(*outDiff, diff2);
                                      if (status != GIT_OK) {
@@ -582,21 +843,35 @@ cleanup:
                        maxInterHunkLines:(NSUInteger)maxInterHunkLines
                          maxContextLines:(NSUInteger)maxContextLines
                                    error:(NSError**)error {
+  return [self diffWorkingDirectoryWithIndex:index filePatterns:(filePattern ? @[ filePattern ] : nil) untrackedCache:nil options:options maxInterHunkLines:maxInterHunkLines maxContextLines:maxContextLines error:error];
+}
+
+- (GCDiff*)diffWorkingDirectoryWithIndex:(GCIndex*)index
+                            filePatterns:(NSArray*)filePatterns
+                          untrackedCache:(GCUntrackedCache*)cache
+                                 options:(GCDiffOptions)options
+                       maxInterHunkLines:(NSUInteger)maxInterHunkLines
+                         maxContextLines:(NSUInteger)maxContextLines
+                                   error:(NSError**)error {
   if (index == nil) {
     index = [self readRepositoryIndex:error];
     if (index == nil) {
       return nil;
     }
   }
+  NSArray* untrackedFiles = nil;
+  if (![self _findUntrackedFiles:&untrackedFiles usingCache:cache index:index filePatterns:filePatterns options:options error:error]) {
+    return nil;
+  }
   return [self _diffWithType:kGCDiffType_WorkingDirectoryWithIndex
-                 filePattern:filePattern
+                filePatterns:filePatterns
                      options:options
            maxInterHunkLines:maxInterHunkLines
              maxContextLines:maxContextLines
                        error:error
                        block:^int(git_diff** outDiff, git_diff_options* diffOptions) {
                          diffOptions->flags |= GIT_DIFF_UPDATE_INDEX;
-                         return git_diff_index_to_workdir(outDiff, self.private, index.private, diffOptions);
+                         return _DiffIndexToWorkdir(outDiff, self.private, index.private, diffOptions, untrackedFiles);
                        }];
 }
 
@@ -618,7 +893,7 @@ cleanup:
     CALL_LIBGIT2_FUNCTION_RETURN(nil, git_commit_tree, &tree, commit.private);
   }
   GCDiff* diff = [self _diffWithType:kGCDiffType_IndexWithCommit
-                         filePattern:filePattern
+                        filePatterns:(filePattern ? @[ filePattern ] : nil)
                              options:options
                    maxInterHunkLines:maxInterHunkLines
                      maxContextLines:maxContextLines
@@ -648,7 +923,7 @@ cleanup:
     git_tree_free(oldTree);
   }
   GCDiff* diff = [self _diffWithType:kGCDiffType_CommitWithCommit
-                         filePattern:filePattern
+                        filePatterns:(filePattern ? @[ filePattern ] : nil)
                              options:options
                    maxInterHunkLines:maxInterHunkLines
                      maxContextLines:maxContextLines
@@ -669,7 +944,7 @@ cleanup:
       maxContextLines:(NSUInteger)maxContextLines
                 error:(NSError**)error {
   return [self _diffWithType:kGCDiffType_IndexWithIndex
-                 filePattern:filePattern
+                filePatterns:(filePattern ? @[ filePattern ] : nil)
                      options:options
            maxInterHunkLines:maxInterHunkLines
              maxContextLines:maxContextLines
@@ -0,0 +1,205 @@
+//  Copyright (C) 2015-2019 Pierre-Olivier Latour <info@pol-online.net>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#if !__has_feature(objc_arc)
+#error This file requires ARC
+#endif
+
+#import <fcntl.h>
+
+#import "GCTestCase.h"
+
+@interface GCManualLiveRepository : GCLiveRepository
+@end
+
+@implementation GCManualLiveRepository
+
++ (GCFileSystemWatcherBackend)fileSystemWatcherBackend {
+  return kGCFileSystemWatcherBackend_Manual;
+}
+
+@end
+
+@interface GCFileSystemWatcherRecorder : NSObject <GCFileSystemWatcherDelegate, GCLiveRepositoryDelegate>
+@property(nonatomic, readonly) NSMutableArray* changes;
+@property(nonatomic) NSUInteger workingDirectoryChangeCount;
+@end
+
+@implementation GCFileSystemWatcherRecorder
+
+- (instancetype)init {
+  if ((self = [super init])) {
+    _changes = [[NSMutableArray alloc] init];
+  }
+  return self;
+}
+
+- (void)fileSystemWatcher:(GCFileSystemWatcher*)watcher didReceiveChangesAtPaths:(NSArray*)paths rescanPaths:(NSArray*)rescanPaths {
+  [_changes addObject:@[ paths, rescanPaths ]];
+}
+
+- (void)repositoryWorkingDirectoryDidChange:(GCRepository*)repository {
+  _workingDirectoryChangeCount += 1;
+}
+
+@end
+
+@implementation GCEmptyRepositoryTests (GCFileSystemWatcher)
+
+- (void)testFileSystemWatcher {
+  GCFileSystemWatcherRecorder* recorder = [[GCFileSystemWatcherRecorder alloc] init];
+  GCFileSystemWatcher* watcher = [[GCFileSystemWatcher alloc] initWithPath:self.repository.workingDirectoryPath backend:kGCFileSystemWatcherBackend_Manual latency:0.0];
+  XCTAssertNotNil(watcher);
+  XCTAssertTrue([watcher.path hasSuffix:@"/"]);
+  watcher.delegate = recorder;
+
+  // Check changes are coalesced per path
+  [watcher injectChangeAtPath:@"/b/" mustRescan:NO];
+  [watcher injectChangeAtPath:@"/a/" mustRescan:NO];
+  [watcher injectChangeAtPath:@"/b/" mustRescan:NO];
+  XCTAssertEqual(recorder.changes.count, 0);
+  [watcher flush];
+  XCTAssertEqualObjects(recorder.changes.lastObject, (@[ @[ @"/a/", @"/b/" ], @[] ]));
+  [watcher flush];
+  XCTAssertEqual(recorder.changes.count, 1);
+
+  // Check rescans
+  [watcher injectChangeAtPath:@"/a/" mustRescan:NO];
+  [watcher injectChangeAtPath:@"/c" mustRescan:YES];
+  [watcher flush];
+  XCTAssertEqualObjects(recorder.changes.lastObject, (@[ @[ @"/a/" ], @[ @"/c" ] ]));
+
+  // Check too many changes are collapsed into a rescan
+  watcher.maximumPendingPaths = 2;
+  for (NSUInteger i = 0; i < 10; ++i) {
+    [watcher injectChangeAtPath:[NSString stringWithFormat:@"/%lu/", (unsigned long)i] mustRescan:NO];
+  }
+  [watcher flush];
+  XCTAssertEqualObjects(recorder.changes.lastObject, (@[ @[], @[ watcher.path ] ]));
+  [watcher injectChangeAtPath:@"/a/" mustRescan:NO];
+  [watcher flush];
+  XCTAssertEqualObjects(recorder.changes.lastObject, (@[ @[ @"/a/" ], @[] ]));
+
+  // Check invalidating drops pending changes
+  [watcher injectChangeAtPath:@"/a/" mustRescan:NO];
+  [watcher invalidate];
+  [watcher flush];
+  XCTAssertEqual(recorder.changes.count, 4);
+
+  // Check live repository only processes relevant changes
+  GCManualLiveRepository* repository = [[GCManualLiveRepository alloc] initWithExistingLocalRepository:self.repository.workingDirectoryPath error:NULL];
+  XCTAssertNotNil(repository);
+  repository.delegate = recorder;
+  XCTAssertEqual(repository.gitDirectoryWatcher.backend, kGCFileSystemWatcherBackend_Manual);
+  NSString* gitDirectoryPath = repository.gitDirectoryWatcher.path;
+  [repository.workingDirectoryWatcher injectChangeAtPath:[gitDirectoryPath stringByAppendingPathComponent:@"objects/"] mustRescan:NO];
+  [repository.workingDirectoryWatcher flush];
+  [[NSRunLoop mainRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:1.0]];
+  XCTAssertEqual(recorder.workingDirectoryChangeCount, 0);
+  [repository.workingDirectoryWatcher injectChangeAtPath:repository.workingDirectoryWatcher.path mustRescan:NO];
+  [repository.workingDirectoryWatcher flush];
+  [[NSRunLoop mainRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:1.0]];
+  XCTAssertEqual(recorder.workingDirectoryChangeCount, 1);
+}
+
+#if defined(__linux__)
+
+- (void)testFileSystemWatcher_Inotify {
+  NSString* path = self.repository.workingDirectoryPath;
+  XCTAssertTrue([[NSFileManager defaultManager] createDirectoryAtPath:[path stringByAppendingPathComponent:@"excluded"] withIntermediateDirectories:NO attributes:nil error:NULL]);
+  XCTAssertTrue([[NSFileManager defaultManager] createDirectoryAtPath:[path stringByAppendingPathComponent:@"burst"] withIntermediateDirectories:NO attributes:nil error:NULL]);
+  GCFileSystemWatcherRecorder* recorder = [[GCFileSystemWatcherRecorder alloc] init];
+  GCFileSystemWatcher* watcher = [[GCFileSystemWatcher alloc] initWithPath:path
+                                                                   backend:kGCFileSystemWatcherBackend_Inotify
+                                                                   latency:0.0
+                                                           directoryFilter:^BOOL(NSString* directoryPath) {
+                                                             return ![directoryPath hasSuffix:@"/.git/"] && ![directoryPath hasSuffix:@"/excluded/"];
+                                                           }];
+  XCTAssertNotNil(watcher);
+  XCTAssertFalse(watcher.degraded);
+  watcher.delegate = recorder;
+
+  // Check changes are reported for the directories containing them
+  [self updateFileAtPath:@"burst/hello_world.txt" withString:@"Hello World!\n"];
+  [[NSRunLoop mainRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.5]];
+  XCTAssertEqualObjects(recorder.changes.lastObject, (@[ @[ [watcher.path stringByAppendingString:@"burst/"] ], @[] ]));
+  [recorder.changes removeAllObjects];
+
+  // Check excluded directories are not watched
+  [self updateFileAtPath:@"excluded/hello_world.txt" withString:@"Hello World!\n"];
+  XCTAssertTrue([@"Test\n" writeToFile:[self.repository.repositoryPath stringByAppendingPathComponent:@"description"] atomically:YES encoding:NSUTF8StringEncoding error:NULL]);
+  [[NSRunLoop mainRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.5]];
+  XCTAssertEqual(recorder.changes.count, 0);
+
+  // Check overflowing the event queue reports a rescan and watches the directories created in the meantime
+  NSString* limit = [NSString stringWithContentsOfFile:@"/proc/sys/fs/inotify/max_queued_events" encoding:NSUTF8StringEncoding error:NULL];
+  XCTAssertNotNil(limit);
+  for (NSInteger i = 0, count = limit.integerValue; i <= count; ++i) {  // Events are only read once the run loop runs again
+    int fd = creat([watcher.path stringByAppendingFormat:@"burst/%li", (long)i].fileSystemRepresentation, 0644);
+    XCTAssertGreaterThanOrEqual(fd, 0);
+    close(fd);
+  }
+  XCTAssertTrue([[NSFileManager defaultManager] createDirectoryAtPath:[path stringByAppendingPathComponent:@"created/subdirectory"] withIntermediateDirectories:YES attributes:nil error:NULL]);
+  [[NSRunLoop mainRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:1.0]];
+  BOOL rescanned = NO;
+  for (NSArray* change in recorder.changes) {
+    rescanned = rescanned || [change[1] containsObject:watcher.path];
+  }
+  XCTAssertTrue(rescanned);
+  XCTAssertFalse(watcher.degraded);
+  [recorder.changes removeAllObjects];
+  [self updateFileAtPath:@"created/subdirectory/hello_world.txt" withString:@"Hello World!\n"];
+  [[NSRunLoop mainRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.5]];
+  XCTAssertEqualObjects(recorder.changes.lastObject, (@[ @[ [watcher.path stringByAppendingString:@"created/subdirectory/"] ], @[] ]));
+
+  [watcher invalidate];
+}
+
+#endif
+
+- (void)testLiveRepositoryUpdateScheduling {
+  XCTAssertNotNil([self makeCommitWithUpdatedFileAtPath:@"hello_world.txt" string:@"Hello World!\n" message:@"Initial commit"]);
+  GCFileSystemWatcherRecorder* recorder = [[GCFileSystemWatcherRecorder alloc] init];
+  GCManualLiveRepository* repository = [[GCManualLiveRepository alloc] initWithExistingLocalRepository:self.repository.workingDirectoryPath error:NULL];
+  XCTAssertNotNil(repository);
+  repository.delegate = recorder;
+  repository.stashesEnabled = YES;
+  XCTAssertEqual(repository.stashes.count, 0);
+  NSString* gitDirectoryPath = repository.gitDirectoryWatcher.path;
+
+  // Check stashes are not reloaded for unrelated reference changes
+  [self updateFileAtPath:@"hello_world.txt" withString:@"Bonjour Monde!\n"];
+  XCTAssertNotNil([self.repository saveStashWithMessage:@"Stash" keepIndex:NO includeUntracked:NO error:NULL]);
+  [repository.gitDirectoryWatcher injectChangeAtPath:[gitDirectoryPath stringByAppendingPathComponent:@"refs/heads/"] mustRescan:NO];
+  [repository.gitDirectoryWatcher flush];
+  [[NSRunLoop mainRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:1.0]];
+  XCTAssertEqual(repository.stashes.count, 0);
+
+  // Check stashes are reloaded when the stash reflog changes
+  [repository.gitDirectoryWatcher injectChangeAtPath:[gitDirectoryPath stringByAppendingPathComponent:@"logs/refs/"] mustRescan:NO];
+  [repository.gitDirectoryWatcher flush];
+  [[NSRunLoop mainRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:1.0]];
+  XCTAssertEqual(repository.stashes.count, 1);
+
+  // Check explicit notifications cancel the queued updates they supersede
+  [repository.workingDirectoryWatcher injectChangeAtPath:repository.workingDirectoryWatcher.path mustRescan:NO];
+  [repository.workingDirectoryWatcher flush];
+  [repository notifyWorkingDirectoryChanged];
+  XCTAssertEqual(recorder.workingDirectoryChangeCount, 1);
+  [[NSRunLoop mainRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:1.0]];
+  XCTAssertEqual(recorder.workingDirectoryChangeCount, 1);
+}
+
+@end
@@ -0,0 +1,432 @@
+//  Copyright (C) 2015-2019 Pierre-Olivier Latour <info@pol-online.net>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#if !__has_feature(objc_arc)
+#error This file requires ARC
+#endif
+
+#import <dirent.h>
+#import <sys/stat.h>
+#if defined(__linux__)
+#import <sys/inotify.h>
+#endif
+
+#import "GCPrivate.h"
+
+#define kDefaultMaximumPendingPaths 1000
+
+#if defined(__linux__)
+#define kInotifyMask (IN_ATTRIB | IN_CREATE | IN_DELETE | IN_DELETE_SELF | IN_MODIFY | IN_MOVED_FROM | IN_MOVED_TO | IN_DONT_FOLLOW | IN_EXCL_UNLINK | IN_ONLYDIR)
+#define kInotifyBufferSize (64 * 1024)
+#define kInotifyDegradedRescanInterval 10.0
+#endif
+
+static inline NSString* _DirectoryPath(NSString* path) {
+  return [path hasSuffix:@"/"] ? path : [path stringByAppendingString:@"/"];
+}
+
+@implementation GCFileSystemWatcher {
+  NSMutableSet* _pendingPaths;
+  NSMutableSet* _pendingRescanPaths;
+  BOOL _collapsed;
+  CFRunLoopTimerRef _flushTimer;  // Can't use a NSTimer because of retain-cycle
+#if !TARGET_OS_IPHONE && !defined(__linux__)
+  FSEventStreamRef _stream;
+#endif
+#if defined(__linux__)
+  int _inotifyFD;
+  dispatch_source_t _inotifySource;
+  NSMutableDictionary* _watchedDirectories;  // Watch descriptor -> directory path with trailing slash
+  dispatch_source_t _degradedRescanSource;
+#endif
+}
+
+static void _TimerCallBack(CFRunLoopTimerRef timer, void* info) {
+  @autoreleasepool {
+    [(__bridge GCFileSystemWatcher*)info flush];
+  }
+}
+
+#if !TARGET_OS_IPHONE && !defined(__linux__)
+
+static void _StreamCallback(ConstFSEventStreamRef streamRef, void* clientCallBackInfo, size_t numEvents, void* eventPaths,
+                            const FSEventStreamEventFlags eventFlags[], const FSEventStreamEventId eventIds[]) {
+  @autoreleasepool {
+    GCFileSystemWatcher* watcher = (__bridge GCFileSystemWatcher*)clientCallBackInfo;
+    for (size_t i = 0; i < numEvents; ++i) {
+      NSString* path = [NSString stringWithUTF8String:((const char**)eventPaths)[i]];
+      if (path) {
+        [watcher injectChangeAtPath:path mustRescan:(eventFlags[i] & kFSEventStreamEventFlagMustScanSubDirs ? YES : NO)];  // Documentation says "eventFlags" should be 0x0 for regular events but that's not the case on OS X 10.10 at least
+      }
+    }
+    [watcher flush];  // FSEvents already coalesces events over the latency interval
+  }
+}
+
+- (BOOL)_startFSEvents {
+  FSEventStreamContext context = {0, (__bridge void*)self, NULL, NULL, NULL};
+  _stream = FSEventStreamCreate(kCFAllocatorDefault, _StreamCallback, &context,
+                                (__bridge CFArrayRef) @[ _path ], kFSEventStreamEventIdSinceNow,
+                                _latency, kFSEventStreamCreateFlagIgnoreSelf);  // This opens the path
+  if (_stream == NULL) {
+    XLOG_ERROR(@"Failed creating event stream at \"%@\"", _path);
+    return NO;
+  }
+  FSEventStreamScheduleWithRunLoop(_stream, CFRunLoopGetMain(), kCFRunLoopCommonModes);
+  if (!FSEventStreamStart(_stream)) {
+    XLOG_ERROR(@"Failed starting event stream at \"%@\"", _path);
+    return NO;
+  }
+  return YES;
+}
+
+- (void)_stopFSEvents {
+  if (_stream) {
+    FSEventStreamStop(_stream);
+    FSEventStreamInvalidate(_stream);
+    FSEventStreamRelease(_stream);
+    _stream = NULL;
+  }
+}
+
+#endif
+
+#if defined(__linux__)
+
+// Adds watches to a directory and all its subdirectories accepted by the directory filter since inotify is not recursive
+// Adding a watch to an already watched directory returns its existing watch descriptor so this can be used to resynchronize the watches
+// Returns NO if some directories could not be watched because of the watch limit
+- (BOOL)_addWatchesAtPath:(NSString*)rootPath reportChanges:(BOOL)report visitedWatches:(NSMutableSet*)visitedWatches {
+  BOOL success = YES;
+  NSMutableArray* stack = [NSMutableArray arrayWithObject:_DirectoryPath(rootPath)];
+  while (stack.count) {
+    NSString* path = stack.lastObject;
+    [stack removeLastObject];
+    if (_directoryFilter && ![path isEqualToString:_path] && !_directoryFilter(path)) {
+      continue;
+    }
+    int wd = inotify_add_watch(_inotifyFD, path.fileSystemRepresentation, kInotifyMask);
+    if (wd < 0) {
+      if (errno == ENOSPC) {  // Exceeded "/proc/sys/fs/inotify/max_user_watches" but keep going as already watched directories still need to be visited
+        if (report) {
+          [self injectChangeAtPath:path mustRescan:YES];
+        }
+        success = NO;
+      } else if ((errno != ENOENT) && (errno != ENOTDIR)) {  // Directory may have been deleted or replaced in the meantime
+        XLOG_ERROR(@"Failed adding inotify watch at \"%@\": %s", path, strerror(errno));
+      }
+      continue;
+    }
+    _watchedDirectories[@(wd)] = path;  // Also updates the path of directories moved while events were dropped
+    [visitedWatches addObject:@(wd)];
+    if (report) {
+      [self injectChangeAtPath:path mustRescan:NO];  // Files may have been created before the watch was added
+    }
+
+    DIR* directory = opendir(path.fileSystemRepresentation);
+    if (directory == NULL) {
+      continue;
+    }
+    struct dirent* entry;
+    while ((entry = readdir(directory))) {
+      if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, "..")) {
+        continue;
+      }
+      NSString* name = [[NSFileManager defaultManager] stringWithFileSystemRepresentation:entry->d_name length:strlen(entry->d_name)];
+      if (name == nil) {  // Names that are not valid in the file system encoding cannot be represented as paths
+        XLOG_WARNING(@"Skipping directory entry with invalid name in \"%@\"", path);
+        continue;
+      }
+      NSString* subPath = [path stringByAppendingString:name];
+      BOOL isDirectory = (entry->d_type == DT_DIR);
+      if (entry->d_type == DT_UNKNOWN) {  // Some file systems don't fill "d_type"
+        struct stat info;
+        isDirectory = !lstat(subPath.fileSystemRepresentation, &info) && S_ISDIR(info.st_mode);
+      }
+      if (isDirectory) {
+        [stack addObject:[subPath stringByAppendingString:@"/"]];
+      }
+    }
+    closedir(directory);
+  }
+  return success;
+}
+
+- (void)_removeWatchesAtPath:(NSString*)rootPath {
+  for (NSNumber* wd in _watchedDirectories.allKeys) {
+    if ([_watchedDirectories[wd] hasPrefix:rootPath]) {
+      inotify_rm_watch(_inotifyFD, wd.intValue);  // Watch descriptor is removed from the dictionary right away as IN_IGNORED is received later
+      [_watchedDirectories removeObjectForKey:wd];
+    }
+  }
+}
+
+// Directories that cannot be watched never report changes so keep rescanning periodically until the watches can be added
+- (void)_setInotifyDegraded:(BOOL)degraded {
+  if (degraded && !_degradedRescanSource) {
+    XLOG_WARNING(@"Reached inotify watch limit while watching \"%@\" (rescanning every %.0f seconds)", _path, kInotifyDegradedRescanInterval);
+    __weak GCFileSystemWatcher* weakSelf = self;
+    _degradedRescanSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, dispatch_get_main_queue());
+    dispatch_source_set_timer(_degradedRescanSource, dispatch_time(DISPATCH_TIME_NOW, (int64_t)(kInotifyDegradedRescanInterval * NSEC_PER_SEC)), (uint64_t)(kInotifyDegradedRescanInterval * NSEC_PER_SEC), NSEC_PER_SEC);
+    dispatch_source_set_event_handler(_degradedRescanSource, ^{
+      @autoreleasepool {
+        GCFileSystemWatcher* strongSelf = weakSelf;
+        if (strongSelf && (strongSelf->_inotifyFD >= 0)) {  // Watcher may have been invalidated after the timer fired
+          [strongSelf _synchronizeInotifyWatches];
+          [strongSelf injectChangeAtPath:strongSelf->_path mustRescan:YES];
+        }
+      }
+    });
+    dispatch_resume(_degradedRescanSource);
+  } else if (!degraded && _degradedRescanSource) {
+    XLOG_VERBOSE(@"Recovered from inotify watch limit while watching \"%@\"", _path);
+    dispatch_source_cancel(_degradedRescanSource);
+    _degradedRescanSource = nil;
+  }
+  _degraded = degraded;
+}
+
+// Walks the watched path again to add the watches for directories whose events were dropped and remove the ones for directories now gone or excluded
+- (void)_synchronizeInotifyWatches {
+  NSMutableSet* visitedWatches = [[NSMutableSet alloc] init];
+  BOOL success = [self _addWatchesAtPath:_path reportChanges:NO visitedWatches:visitedWatches];
+  for (NSNumber* wd in _watchedDirectories.allKeys) {
+    if (![visitedWatches containsObject:wd]) {
+      inotify_rm_watch(_inotifyFD, wd.intValue);
+      [_watchedDirectories removeObjectForKey:wd];
+    }
+  }
+  [self _setInotifyDegraded:!success];
+}
+
+- (void)_readInotifyEvents {
+  char buffer[kInotifyBufferSize] __attribute__((aligned(__alignof__(struct inotify_event))));
+  BOOL overflowed = NO;
+  while (1) {
+    ssize_t length = read(_inotifyFD, buffer, sizeof(buffer));
+    if (length <= 0) {
+      if ((length < 0) && (errno != EAGAIN) && (errno != EINTR)) {
+        XLOG_ERROR(@"Failed reading inotify events for \"%@\": %s", _path, strerror(errno));
+      }
+      break;
+    }
+    for (char* ptr = buffer; ptr < buffer + length;) {
+      const struct inotify_event* event = (const struct inotify_event*)ptr;
+      ptr += sizeof(struct inotify_event) + event->len;
+
+      if (event->mask & IN_Q_OVERFLOW) {
+        XLOG_WARNING(@"Inotify event queue overflowed while watching \"%@\"", _path);
+        [self injectChangeAtPath:_path mustRescan:YES];
+        overflowed = YES;  // Directories created in the meantime are not watched yet
+        continue;
+      }
+      NSString* directoryPath = _watchedDirectories[@(event->wd)];
+      if (directoryPath == nil) {  // Stale event for a removed watch
+        continue;
+      }
+      if (event->mask & IN_IGNORED) {  // Directory was deleted or unmounted
+        [_watchedDirectories removeObjectForKey:@(event->wd)];
+        continue;
+      }
+      NSString* name = event->len ? [[NSFileManager defaultManager] stringWithFileSystemRepresentation:event->name length:strlen(event->name)] : nil;  // Name is NUL padded
+      if (name && (event->mask & IN_ISDIR)) {
+        NSString* subPath = [directoryPath stringByAppendingFormat:@"%@/", name];
+        if (event->mask & IN_MOVED_FROM) {
+          [self _removeWatchesAtPath:subPath];
+        } else if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+          if (![self _addWatchesAtPath:subPath reportChanges:YES visitedWatches:nil]) {
+            [self _setInotifyDegraded:YES];
+          }
+        }
+      }
+      [self injectChangeAtPath:directoryPath mustRescan:NO];  // Report the parent directory like FSEvents does
+    }
+  }
+  if (overflowed) {
+    [self _synchronizeInotifyWatches];
+  }
+}
+
+- (BOOL)_startInotify {
+  _inotifyFD = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (_inotifyFD < 0) {
+    XLOG_ERROR(@"Failed creating inotify instance for \"%@\": %s", _path, strerror(errno));
+    return NO;
+  }
+  _watchedDirectories = [[NSMutableDictionary alloc] init];
+  BOOL success = [self _addWatchesAtPath:_path reportChanges:NO visitedWatches:nil];
+  if (_watchedDirectories.count == 0) {
+    XLOG_ERROR(@"Failed watching \"%@\"", _path);
+    return NO;
+  }
+  [self _setInotifyDegraded:!success];
+
+  int fd = _inotifyFD;
+  __weak GCFileSystemWatcher* weakSelf = self;
+  _inotifySource = dispatch_source_create(DISPATCH_SOURCE_TYPE_READ, fd, 0, dispatch_get_main_queue());
+  dispatch_source_set_event_handler(_inotifySource, ^{
+    @autoreleasepool {
+      [weakSelf _readInotifyEvents];
+    }
+  });
+  dispatch_source_set_cancel_handler(_inotifySource, ^{
+    close(fd);
+  });
+  dispatch_resume(_inotifySource);
+  return YES;
+}
+
+- (void)_stopInotify {
+  [self _setInotifyDegraded:NO];
+  if (_inotifySource) {
+    dispatch_source_cancel(_inotifySource);  // This closes the file descriptor
+    _inotifySource = nil;
+  } else if (_inotifyFD >= 0) {
+    close(_inotifyFD);
+  }
+  _inotifyFD = -1;
+  _watchedDirectories = nil;
+}
+
+#endif
+
+- (instancetype)initWithPath:(NSString*)path backend:(GCFileSystemWatcherBackend)backend latency:(CFTimeInterval)latency {
+  return [self initWithPath:path backend:backend latency:latency directoryFilter:nil];
+}
+
+- (instancetype)initWithPath:(NSString*)path backend:(GCFileSystemWatcherBackend)backend latency:(CFTimeInterval)latency directoryFilter:(BOOL (^)(NSString* path))filter {
+  if ((self = [super init])) {
+    _path = _DirectoryPath(path);
+    _latency = latency;
+    _directoryFilter = [filter copy];
+    _maximumPendingPaths = kDefaultMaximumPendingPaths;
+    _pendingPaths = [[NSMutableSet alloc] init];
+    _pendingRescanPaths = [[NSMutableSet alloc] init];
+#if defined(__linux__)
+    _inotifyFD = -1;
+#endif
+
+    if (backend == kGCFileSystemWatcherBackend_Default) {
+#if defined(__linux__)
+      backend = kGCFileSystemWatcherBackend_Inotify;
+#else
+      backend = kGCFileSystemWatcherBackend_FSEvents;
+#endif
+    }
+    _backend = backend;
+
+    if (_backend != kGCFileSystemWatcherBackend_Manual) {
+      CFRunLoopTimerContext context = {0, (__bridge void*)self, NULL, NULL, NULL};
+      _flushTimer = CFRunLoopTimerCreate(kCFAllocatorDefault, HUGE_VALF, HUGE_VALF, 0, 0, _TimerCallBack, &context);
+      CFRunLoopAddTimer(CFRunLoopGetMain(), _flushTimer, kCFRunLoopCommonModes);
+    }
+
+    switch (_backend) {
+      case kGCFileSystemWatcherBackend_Default:
+        XLOG_DEBUG_UNREACHABLE();
+        return nil;
+
+      case kGCFileSystemWatcherBackend_FSEvents:
+#if !TARGET_OS_IPHONE && !defined(__linux__)
+        if (![self _startFSEvents]) {
+          return nil;
+        }
+        break;
+#else
+        XLOG_ERROR(@"FSEvents is not available on this platform");
+        return nil;
+#endif
+
+      case kGCFileSystemWatcherBackend_Inotify:
+#if defined(__linux__)
+        if (![self _startInotify]) {
+          return nil;
+        }
+        break;
+#else
+        XLOG_ERROR(@"Inotify is not available on this platform");
+        return nil;
+#endif
+
+      case kGCFileSystemWatcherBackend_Manual:
+        break;
+    }
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [self invalidate];
+}
+
+- (void)invalidate {
+#if !TARGET_OS_IPHONE && !defined(__linux__)
+  [self _stopFSEvents];
+#endif
+#if defined(__linux__)
+  [self _stopInotify];
+#endif
+  if (_flushTimer) {
+    CFRunLoopTimerInvalidate(_flushTimer);
+    CFRelease(_flushTimer);
+    _flushTimer = NULL;
+  }
+  [_pendingPaths removeAllObjects];
+  [_pendingRescanPaths removeAllObjects];
+  _collapsed = NO;
+}
+
+- (void)reloadDirectoryFilter {
+#if defined(__linux__)
+  if (_inotifyFD >= 0) {
+    [self _synchronizeInotifyWatches];
+  }
+#endif
+}
+
+- (void)injectChangeAtPath:(NSString*)path mustRescan:(BOOL)rescan {
+  if (!_pendingPaths.count && !_pendingRescanPaths.count && _flushTimer) {
+    CFRunLoopTimerSetNextFireDate(_flushTimer, CFAbsoluteTimeGetCurrent() + _latency);  // Don't postpone delivery on subsequent changes so a continuous stream of changes is still delivered periodically
+  }
+  if (rescan) {
+    [_pendingRescanPaths addObject:path];
+  } else if (!_collapsed) {
+    if (_pendingPaths.count < _maximumPendingPaths) {
+      [_pendingPaths addObject:path];
+    } else {
+      XLOG_VERBOSE(@"Collapsing more than %lu pending changes into a rescan of \"%@\"", (unsigned long)_maximumPendingPaths, _path);
+      [_pendingPaths removeAllObjects];
+      [_pendingRescanPaths addObject:_path];
+      _collapsed = YES;
+    }
+  }
+}
+
+- (void)flush {
+  if (_flushTimer) {
+    CFRunLoopTimerSetNextFireDate(_flushTimer, HUGE_VALF);
+  }
+  if (!_pendingPaths.count && !_pendingRescanPaths.count) {
+    return;
+  }
+  NSArray* paths = [_pendingPaths.allObjects sortedArrayUsingSelector:@selector(compare:)];
+  NSArray* rescanPaths = [_pendingRescanPaths.allObjects sortedArrayUsingSelector:@selector(compare:)];
+  [_pendingPaths removeAllObjects];
+  [_pendingRescanPaths removeAllObjects];
+  _collapsed = NO;
+  [_delegate fileSystemWatcher:self didReceiveChangesAtPaths:paths rescanPaths:rescanPaths];
+}
+
+@end
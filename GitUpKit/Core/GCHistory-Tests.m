@@ -193,6 +193,16 @@
   XCTAssertEqualObjects([[history historyCommitForCommit:commit3] parents], @[ commit1 ]);
   XCTAssertEqualObjects([[history historyCommitForCommit:commit3] children], @[]);
   XCTAssertEqualObjects([history historyLocalBranchForLocalBranch:topicBranch], topicBranch);
+  for (GCHistoryCommit* commit in history.allCommits) {
+    XCTAssertEqual(commit.parentCount, commit.parents.count);
+    for (NSUInteger i = 0; i < commit.parentCount; ++i) {
+      XCTAssertEqual([commit parentAtIndex:i], commit.parents[i]);
+    }
+    XCTAssertEqual(commit.childCount, commit.children.count);
+    for (NSUInteger i = 0; i < commit.childCount; ++i) {
+      XCTAssertEqual([commit childAtIndex:i], commit.children[i]);
+    }
+  }
 
   // Check reloading history without changes
   XCTAssertTrue([self.repository reloadHistory:history referencesDidChange:&referencesDidChange addedCommits:&addedCommits removedCommits:&removedCommits error:NULL]);
@@ -468,6 +478,38 @@
   NSArray* commits2 = [self.repository lookupCommitsForFile:@"lines2.txt" followRenames:YES error:NULL];
   NSArray* array2 = @[ commit6, commit4, commit3, commit1 ];
   XCTAssertEqualObjects(commits2, array2);
+
+  // Check file history using a changed-path index
+  NSString* path = [self.repository.repositoryPath stringByAppendingPathComponent:@"changed-paths.index"];
+  GCChangedPathIndex* index1 = [[GCChangedPathIndex alloc] initWithPath:path];
+  XCTAssertTrue([index1 updateWithRepository:self.repository error:NULL]);
+  XCTAssertGreaterThan(index1.count, 0);
+  XCTAssertEqualObjects([self.repository lookupCommitsForFile:@"lines2.txt" followRenames:NO changedPathIndex:index1 error:NULL], array1);
+  XCTAssertEqualObjects([self.repository lookupCommitsForFile:@"lines2.txt" followRenames:YES changedPathIndex:index1 error:NULL], array2);
+  XCTAssertTrue([index1 writeIfNeeded:NULL]);
+
+  // Check file history using a changed-path index reloaded from disk and missing new commits
+  GCCommit* commit7 = [self makeCommitWithUpdatedFileAtPath:@"lines2.txt" string:@"Reset\n" message:@"4) Modified"];
+  GCChangedPathIndex* index2 = [[GCChangedPathIndex alloc] initWithPath:path];
+  XCTAssertEqual(index2.count, index1.count);
+  NSArray* array3 = @[ commit7, commit6, commit4, commit3, commit1 ];
+  XCTAssertEqualObjects([self.repository lookupCommitsForFile:@"lines2.txt" followRenames:YES changedPathIndex:index2 error:NULL], array3);
+  XCTAssertEqual(index2.count, index1.count);  // Queries don't compute filters
+
+  // Check updating the changed-path index only computes filters for new commits and only writes them if needed
+  XCTAssertTrue([index2 updateWithRepository:self.repository error:NULL]);
+  XCTAssertEqual(index2.count, index1.count + 1);
+  XCTAssertTrue([index2 writeIfNeeded:NULL]);
+  XCTAssertTrue([[NSFileManager defaultManager] removeItemAtPath:path error:NULL]);
+  XCTAssertTrue([index2 updateWithRepository:self.repository error:NULL]);
+  XCTAssertTrue([index2 writeIfNeeded:NULL]);
+  XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:path]);
+  GCCommit* commit8 = [self makeCommitWithUpdatedFileAtPath:@"hello_world.txt" string:@"Hola Mundo!\n" message:@"Spanish"];
+  XCTAssertTrue([index2 commit:commit8.private mayHaveChangedPath:"lines2.txt"]);
+  XCTAssertTrue([index2 updateWithRepository:self.repository error:NULL]);
+  XCTAssertTrue([index2 writeIfNeeded:NULL]);
+  XCTAssertFalse([[[GCChangedPathIndex alloc] initWithPath:path] commit:commit8.private mayHaveChangedPath:"lines2.txt"]);
+  XCTAssertTrue([[[GCChangedPathIndex alloc] initWithPath:path] commit:commit8.private mayHaveChangedPath:"hello_world.txt"]);
 }
 
 @end
@@ -480,4 +522,614 @@
   XCTAssertTrue(history.empty);
 }
 
+static NSString* _LinearNotation(NSString* prefix, NSUInteger count, NSString* firstParent, NSString* branch) {  // "prefix" cannot contain digits
+  NSMutableString* notation = [NSMutableString stringWithFormat:@"%@0%@", prefix, firstParent ? [NSString stringWithFormat:@"(%@)", firstParent] : @""];
+  for (NSUInteger i = 1; i < count; ++i) {
+    [notation appendFormat:@" %@%lu", prefix, (unsigned long)i];
+  }
+  if (branch) {
+    [notation appendFormat:@"<%@>", branch];
+  }
+  [notation appendString:@"\n"];
+  return notation;
+}
+
+- (void)assertHistory:(GCHistory*)history isEqualToHistory:(GCHistory*)otherHistory {
+  XCTAssertEqualObjects(history.allCommits, otherHistory.allCommits);
+  XCTAssertEqualObjects(history.rootCommits, otherHistory.rootCommits);
+  XCTAssertEqualObjects([NSSet setWithArray:history.leafCommits], [NSSet setWithArray:otherHistory.leafCommits]);
+  XCTAssertEqualObjects(history.HEADCommit, otherHistory.HEADCommit);
+  for (NSUInteger i = 0, count = MIN(history.allCommits.count, otherHistory.allCommits.count); i < count; ++i) {
+    GCHistoryCommit* commit = history.allCommits[i];
+    GCHistoryCommit* otherCommit = otherHistory.allCommits[i];
+    XCTAssertEqualObjects(commit.parents, otherCommit.parents);
+    XCTAssertEqualObjects([NSSet setWithArray:commit.children], [NSSet setWithArray:otherCommit.children]);
+    XCTAssertEqual(commit.timeIntervalSinceReferenceDate, otherCommit.timeIntervalSinceReferenceDate);
+    XCTAssertEqualObjects(commit.date, otherCommit.date);
+  }
+}
+
+- (void)testHistory_InitialOrder {
+  // Create commit history where walking from the tips doesn't return commits in chronological order
+  NSArray* commits = [self.repository createMockCommitHierarchyFromNotation:@"0 1(0) 2(0) 3(1)<a> 4(2) 5(3) 6(4)<b> 7(5)<master>" force:NO error:NULL];
+  XCTAssertNotNil(commits);
+  NSArray* commitsTime = [[commits reverseObjectEnumerator] allObjects];
+  [self runGitCLTWithRepository:self.repository command:@"commit-graph", @"write", @"--reachable", nil];
+
+  // Check freshly loaded histories are fully sorted newest first with and without commit-graph
+  for (NSNumber* useCommitGraph in @[ @NO, @YES ]) {
+    GCHistory* history = [self.repository loadHistoryUsingSorting:kGCHistorySorting_ReverseChronological useCommitGraph:useCommitGraph.boolValue error:NULL];
+    XCTAssertNotNil(history);
+    XCTAssertEqualObjects(history.allCommits, commitsTime);
+    for (NSUInteger i = 1; i < history.allCommits.count; ++i) {
+      XCTAssertGreaterThanOrEqual([(GCHistoryCommit*)history.allCommits[i - 1] timeIntervalSinceReferenceDate], [(GCHistoryCommit*)history.allCommits[i] timeIntervalSinceReferenceDate]);
+    }
+  }
+}
+
+- (void)testHistory_CommitGraph {
+  // Create commit history with merges and an octopus merge
+  NSMutableString* notation = [NSMutableString string];
+  [notation appendString:_LinearNotation(@"m", 500, nil, nil)];
+  [notation appendString:_LinearNotation(@"t", 200, @"m100", @"topic")];
+  [notation appendString:@"x(m499,t199)<master> o(m10,m20,m30,t10)<octopus>\n"];
+  XCTAssertNotNil([self.repository createMockCommitHierarchyFromNotation:notation force:NO error:NULL]);
+
+  // Write split commit-graph with 2 layers and create commits missing from it
+  [self runGitCLTWithRepository:self.repository command:@"commit-graph", @"write", @"--reachable", @"--split", nil];
+  for (NSUInteger i = 0; i < 20; ++i) {
+    XCTAssertNotNil([self makeCommitWithUpdatedFileAtPath:@"file.txt" string:[NSString stringWithFormat:@"%lu\n", (unsigned long)i] message:@"layer"]);
+  }
+  [self runGitCLTWithRepository:self.repository command:@"commit-graph", @"write", @"--reachable", @"--split", nil];
+  for (NSUInteger i = 0; i < 5; ++i) {
+    XCTAssertNotNil([self makeCommitWithUpdatedFileAtPath:@"file.txt" string:[NSString stringWithFormat:@"%lu\n", (unsigned long)(100 + i)] message:@"unindexed"]);
+  }
+  NSString* chain = [NSString stringWithContentsOfFile:[self.repository.repositoryPath stringByAppendingPathComponent:@"objects/info/commit-graphs/commit-graph-chain"] encoding:NSASCIIStringEncoding error:NULL];
+  XCTAssertEqual([[chain stringByTrimmingCharactersInSet:[NSCharacterSet newlineCharacterSet]] componentsSeparatedByString:@"\n"].count, 2);
+
+  // Check history loaded from the commit-graph chain matches history loaded from the object database
+  GCHistory* history1 = [self.repository loadHistoryUsingSorting:kGCHistorySorting_ReverseChronological useCommitGraph:NO error:NULL];
+  XCTAssertNotNil(history1);
+  XCTAssertEqual(history1.allCommits.count, 500 + 200 + 2 + 20 + 5);
+  GCHistory* history2 = [self.repository loadHistoryUsingSorting:kGCHistorySorting_ReverseChronological useCommitGraph:YES error:NULL];
+  XCTAssertNotNil(history2);
+  [self assertHistory:history2 isEqualToHistory:history1];
+
+  // Check history loaded from a single commit-graph file
+  [self runGitCLTWithRepository:self.repository command:@"commit-graph", @"write", @"--reachable", nil];
+  XCTAssertTrue([[NSFileManager defaultManager] fileExistsAtPath:[self.repository.repositoryPath stringByAppendingPathComponent:@"objects/info/commit-graph"]]);
+  GCHistory* history3 = [self.repository loadHistoryUsingSorting:kGCHistorySorting_ReverseChronological useCommitGraph:YES error:NULL];
+  XCTAssertNotNil(history3);
+  [self assertHistory:history3 isEqualToHistory:history1];
+
+  // Check reloading history
+  XCTAssertNotNil([self makeCommitWithUpdatedFileAtPath:@"file.txt" string:@"reload\n" message:@"reload"]);
+  NSArray* addedCommits;
+  NSArray* removedCommits;
+  XCTAssertTrue([self.repository reloadHistory:history3 referencesDidChange:NULL addedCommits:&addedCommits removedCommits:&removedCommits error:NULL]);
+  XCTAssertEqual(addedCommits.count, 1);
+  XCTAssertEqual(removedCommits.count, 0);
+  XCTAssertTrue([self.repository reloadHistory:history1 referencesDidChange:NULL addedCommits:NULL removedCommits:NULL error:NULL]);
+  [self assertHistory:history3 isEqualToHistory:history1];
+}
+
+- (void)testHistory_Relations {
+  // Create commit history with a topic branch
+  NSMutableString* notation = [NSMutableString string];
+  [notation appendString:_LinearNotation(@"m", 50, nil, @"master")];
+  [notation appendString:_LinearNotation(@"t", 20, @"m10", @"topic")];
+  XCTAssertNotNil([self.repository createMockCommitHierarchyFromNotation:notation force:YES error:NULL]);
+  GCHistory* history = [self.repository loadHistoryUsingSorting:kGCHistorySorting_ReverseChronological error:NULL];
+  XCTAssertNotNil(history);
+  XCTAssertEqual(history.allCommits.count, 70);
+  GCHistoryCommit* forkCommit = [history historyLocalBranchWithName:@"master"].tipCommit;
+  for (NSUInteger i = 0; i < 39; ++i) {  // Walk back to "m10"
+    forkCommit = forkCommit.parents.firstObject;
+  }
+  XCTAssertEqual(forkCommit.children.count, 2);
+  GCHistoryCommit* topicCommit = [history historyLocalBranchWithName:@"topic"].tipCommit;
+  XCTAssertNotNil(topicCommit);
+
+  // Delete topic branch and check orphan commits are detached from the history
+  XCTAssertTrue([self.repository deleteLocalBranch:[self.repository findLocalBranchWithName:@"topic" error:NULL] error:NULL]);
+  NSArray* removedCommits;
+  XCTAssertTrue([self.repository reloadHistory:history referencesDidChange:NULL addedCommits:NULL removedCommits:&removedCommits error:NULL]);
+  XCTAssertEqual(removedCommits.count, 20);
+  XCTAssertTrue([removedCommits containsObject:topicCommit]);
+  XCTAssertEqual(topicCommit.parents.count, 0);
+  XCTAssertEqual(topicCommit.children.count, 0);
+  XCTAssertEqual(forkCommit.children.count, 1);
+  XCTAssertEqual(history.allCommits.count, 50);
+  XCTAssertEqual(history.leafCommits.count, 1);
+
+  // Check history matches a freshly loaded one
+  XCTAssertNotNil([self makeCommitWithUpdatedFileAtPath:@"file.txt" string:@"relations\n" message:@"relations"]);
+  XCTAssertTrue([self.repository reloadHistory:history referencesDidChange:NULL addedCommits:NULL removedCommits:NULL error:NULL]);
+  [self assertHistory:history isEqualToHistory:[self.repository loadHistoryUsingSorting:kGCHistorySorting_ReverseChronological error:NULL]];
+}
+
+- (void)_createLargeHistoryWithCommitGraph {
+  NSMutableString* notation = [NSMutableString string];
+  [notation appendString:_LinearNotation(@"m", 5000, nil, @"master")];
+  for (NSUInteger i = 0; i < 10; ++i) {
+    [notation appendString:_LinearNotation([NSString stringWithFormat:@"b%c", (char)('a' + i)], 100, [NSString stringWithFormat:@"m%lu", (unsigned long)(i * 500)], [NSString stringWithFormat:@"branch%lu", (unsigned long)i])];
+  }
+  XCTAssertNotNil([self.repository createMockCommitHierarchyFromNotation:notation force:YES error:NULL]);
+  [self runGitCLTWithRepository:self.repository command:@"commit-graph", @"write", @"--reachable", nil];
+}
+
+- (void)testHistory_LoadPerformance_CommitGraph {
+  [self _createLargeHistoryWithCommitGraph];
+  [self measureBlock:^{
+    XCTAssertNotNil([self.repository loadHistoryUsingSorting:kGCHistorySorting_ReverseChronological useCommitGraph:YES error:NULL]);
+  }];
+}
+
+- (void)testHistory_LoadPerformance_ObjectDatabase {
+  [self _createLargeHistoryWithCommitGraph];
+  [self measureBlock:^{
+    XCTAssertNotNil([self.repository loadHistoryUsingSorting:kGCHistorySorting_ReverseChronological useCommitGraph:NO error:NULL]);
+  }];
+}
+
+- (void)testHistory_WalkPerformance {
+  [self _createLargeHistoryWithCommitGraph];
+  GCHistory* history = [self.repository loadHistoryUsingSorting:kGCHistorySorting_ReverseChronological error:NULL];
+  XCTAssertNotNil(history);
+  [self measureBlock:^{
+    __block NSUInteger count = 0;
+    [history walkAllCommitsFromLeavesUsingBlock:^(GCHistoryCommit* commit, BOOL* stop) {
+      count += 1;
+    }];
+    XCTAssertEqual(count, history.allCommits.count);
+  }];
+}
+
+- (void)testHistory_Cache {
+  // Create commit history and cache it
+  NSMutableString* notation = [NSMutableString string];
+  [notation appendString:_LinearNotation(@"m", 50, nil, @"master")];
+  [notation appendString:_LinearNotation(@"t", 20, @"m10", @"topic")];
+  [notation appendString:_LinearNotation(@"f", 10, @"m20", @"feature")];
+  XCTAssertNotNil([self.repository createMockCommitHierarchyFromNotation:notation force:YES error:NULL]);
+  NSString* path = [self.repository.repositoryPath stringByAppendingPathComponent:@"history.cache"];
+  GCHistory* history1 = [self.repository loadHistoryFromCacheAtPath:path usingSorting:kGCHistorySorting_ReverseChronological error:NULL];  // Cache doesn't exist yet
+  XCTAssertNotNil(history1);
+  XCTAssertTrue([self.repository writeHistory:history1 toCacheAtPath:path error:NULL]);
+
+  // Check history loaded from unchanged cache
+  GCHistory* history2 = [self.repository loadHistoryFromCacheAtPath:path usingSorting:kGCHistorySorting_ReverseChronological error:NULL];
+  XCTAssertNotNil(history2);
+  [self assertHistory:history2 isEqualToHistory:history1];
+  XCTAssertEqualObjects(history2.HEADCommit.message, history1.HEADCommit.message);
+
+  // Check history loaded from outdated cache
+  XCTAssertTrue([self.repository deleteLocalBranch:[self.repository findLocalBranchWithName:@"topic" error:NULL] error:NULL]);
+  XCTAssertNotNil([self makeCommitWithUpdatedFileAtPath:@"file.txt" string:@"cache\n" message:@"cache"]);
+  GCHistory* history3 = [self.repository loadHistoryFromCacheAtPath:path usingSorting:kGCHistorySorting_ReverseChronological error:NULL];
+  XCTAssertNotNil(history3);
+  XCTAssertEqual(history3.allCommits.count, 50 + 10 + 1);
+  [self assertHistory:history3 isEqualToHistory:[self.repository loadHistoryUsingSorting:kGCHistorySorting_ReverseChronological error:NULL]];
+  XCTAssertNotNil([history3 historyLocalBranchWithName:@"feature"].tipCommit);
+  XCTAssertNil([history3 historyLocalBranchWithName:@"topic"]);
+
+  // Check writing cache in background and skipping the write if the history didn't change
+  __block NSUInteger writeCount = 0;
+  [self.repository writeHistoryInBackground:history3
+                              toCacheAtPath:path
+                                 completion:^(BOOL success, NSError* error) {
+                                   XCTAssertTrue(success);
+                                   writeCount += 1;
+                                 }];
+  while (writeCount < 1) {
+    [[NSRunLoop mainRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+  }
+  [self assertHistory:[self.repository loadHistoryFromCacheAtPath:path usingSorting:kGCHistorySorting_ReverseChronological error:NULL] isEqualToHistory:history3];
+  XCTAssertTrue([[NSFileManager defaultManager] removeItemAtPath:path error:NULL]);
+  [self.repository writeHistoryInBackground:history3
+                              toCacheAtPath:path
+                                 completion:^(BOOL success, NSError* error) {
+                                   XCTAssertTrue(success);
+                                   writeCount += 1;
+                                 }];
+  while (writeCount < 2) {
+    [[NSRunLoop mainRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+  }
+  XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:path]);
+
+  // Check invalid cache is ignored
+  XCTAssertTrue([[NSData dataWithBytes:"invalid" length:7] writeToFile:path atomically:YES]);
+  GCHistory* history4 = [self.repository loadHistoryFromCacheAtPath:path usingSorting:kGCHistorySorting_ReverseChronological error:NULL];
+  XCTAssertNotNil(history4);
+  [self assertHistory:history4 isEqualToHistory:history3];
+
+  // Check cache written by another repository is ignored
+  NSString* otherPath = [NSTemporaryDirectory() stringByAppendingPathComponent:[[NSProcessInfo processInfo] globallyUniqueString]];
+  GCRepository* otherRepository = [self createLocalRepositoryAtPath:otherPath bare:NO];
+  XCTAssertNotNil(otherRepository);
+  XCTAssertTrue([self.repository writeHistory:history4 toCacheAtPath:path error:NULL]);
+  GCHistory* history5 = [otherRepository loadHistoryFromCacheAtPath:path usingSorting:kGCHistorySorting_ReverseChronological error:NULL];
+  XCTAssertNotNil(history5);
+  XCTAssertTrue(history5.empty);
+  [self destroyLocalRepository:otherRepository];
+
+  // Check commits missing from the repository don't crash accessors
+  GCHistoryCommit* commit = [history4.HEADCommit.parents firstObject];
+  XCTAssertNotNil(commit);
+  NSString* objectPath = [[self.repository.repositoryPath stringByAppendingPathComponent:@"objects"] stringByAppendingPathComponent:[NSString stringWithFormat:@"%@/%@", [commit.SHA1 substringToIndex:2], [commit.SHA1 substringFromIndex:2]]];
+  XCTAssertTrue([[NSFileManager defaultManager] removeItemAtPath:objectPath error:NULL]);
+  GCRepository* repository = [[GCRepository alloc] initWithExistingLocalRepository:self.repository.repositoryPath error:NULL];  // Commits loaded by this repository are still in its object cache
+  XCTAssertNotNil(repository);
+  GCHistory* history6 = [repository loadHistoryFromCacheAtPath:path usingSorting:kGCHistorySorting_ReverseChronological error:NULL];
+  XCTAssertNotNil(history6);
+  GCHistoryCommit* missingCommit = [history6 historyCommitWithSHA1:commit.SHA1];
+  XCTAssertNotNil(missingCommit);
+  XCTAssertEqualObjects(missingCommit.message, @"");
+  XCTAssertEqualObjects(missingCommit.authorName, @"");
+  XCTAssertNil(missingCommit.treeSHA1);
+  XCTAssertNil([repository lookupParentsForCommit:missingCommit error:NULL]);
+}
+
+- (void)testHistory_LoadPerformance_Cache {
+  [self _createLargeHistoryWithCommitGraph];
+  NSString* path = [self.repository.repositoryPath stringByAppendingPathComponent:@"history.cache"];
+  GCHistory* history = [self.repository loadHistoryUsingSorting:kGCHistorySorting_ReverseChronological error:NULL];
+  XCTAssertTrue([self.repository writeHistory:history toCacheAtPath:path error:NULL]);
+  [self measureBlock:^{
+    XCTAssertNotNil([self.repository loadHistoryFromCacheAtPath:path usingSorting:kGCHistorySorting_ReverseChronological error:NULL]);
+  }];
+}
+
+- (void)testHistory_RemovalPerformance {
+  NSMutableString* notation = [NSMutableString string];
+  [notation appendString:_LinearNotation(@"m", 10000, nil, @"master")];
+  [notation appendString:_LinearNotation(@"t", 5000, @"m100", @"topic")];
+  XCTAssertNotNil([self.repository createMockCommitHierarchyFromNotation:notation force:YES error:NULL]);
+  GCLocalBranch* branch = [self.repository findLocalBranchWithName:@"topic" error:NULL];
+  GCCommit* tipCommit = [self.repository lookupTipCommitForBranch:branch error:NULL];
+  XCTAssertNotNil(tipCommit);
+
+  [self measureMetrics:[self.class defaultPerformanceMetrics]
+      automaticallyStartMeasuring:NO
+                         forBlock:^{
+                           GCHistory* history = [self.repository loadHistoryUsingSorting:kGCHistorySorting_ReverseChronological error:NULL];
+                           XCTAssertTrue([self.repository deleteLocalBranch:[self.repository findLocalBranchWithName:@"topic" error:NULL] error:NULL]);
+                           NSArray* addedCommits;
+                           NSArray* removedCommits;
+                           [self startMeasuring];
+                           XCTAssertTrue([self.repository reloadHistory:history referencesDidChange:NULL addedCommits:&addedCommits removedCommits:&removedCommits error:NULL]);
+                           [self stopMeasuring];
+                           XCTAssertEqual(addedCommits.count, 0);
+                           XCTAssertEqual(removedCommits.count, 5000);
+                           XCTAssertEqual(history.allCommits.count, 10000);
+                           XCTAssertNotNil([self.repository createLocalBranchFromCommit:tipCommit withName:@"topic" force:NO error:NULL]);
+                         }];
+}
+
+- (void)testHistory_Ancestry {
+  // Create commit history with merges and unrelated roots
+  NSMutableString* notation = [NSMutableString string];
+  [notation appendString:_LinearNotation(@"m", 20, nil, nil)];
+  [notation appendString:_LinearNotation(@"a", 8, @"m5", nil)];
+  [notation appendString:_LinearNotation(@"b", 6, @"a3", nil)];
+  [notation appendString:@"x(m19,a7)<master> y(b5,m12)<topic> z(x,y)<merge>\n"];
+  [notation appendString:_LinearNotation(@"u", 3, nil, @"unrelated")];
+  XCTAssertNotNil([self.repository createMockCommitHierarchyFromNotation:notation force:YES error:NULL]);
+  GCHistory* history = [self.repository loadHistoryUsingSorting:kGCHistorySorting_ReverseChronological error:NULL];
+  XCTAssertNotNil(history);
+
+  // Compare with libgit2 for all pairs of commits
+  NSArray* commits = history.allCommits;
+  for (GCHistoryCommit* commit1 in commits) {
+    for (GCHistoryCommit* commit2 in commits) {
+      GCCommitRelation relation = [self.repository findRelationOfCommit:commit1 relativeToCommit:commit2 error:NULL];
+      XCTAssertEqual([history findRelationOfCommit:commit1 relativeToCommit:commit2], relation);
+      XCTAssertEqual([history isCommit:commit1 ancestorOfCommit:commit2], relation == kGCCommitRelation_Ancestor);
+      GCHistoryCommit* mergeBase = [history findMergeBaseForCommit:commit1 andCommit:commit2];
+      if (relation == kGCCommitRelation_Unrelated) {
+        XCTAssertNil(mergeBase);
+      } else {
+        XCTAssertNotNil(mergeBase);
+        XCTAssertTrue((mergeBase == commit1) || [history isCommit:mergeBase ancestorOfCommit:commit1]);
+        XCTAssertTrue((mergeBase == commit2) || [history isCommit:mergeBase ancestorOfCommit:commit2]);
+      }
+    }
+  }
+
+  // Check ahead / behind counts
+  GCHistoryCommit* master = [history historyLocalBranchWithName:@"master"].tipCommit;
+  GCHistoryCommit* topic = [history historyLocalBranchWithName:@"topic"].tipCommit;
+  GCHistoryCommit* merge = [history historyLocalBranchWithName:@"merge"].tipCommit;
+  GCHistoryCommit* unrelated = [history historyLocalBranchWithName:@"unrelated"].tipCommit;
+  NSUInteger ahead;
+  NSUInteger behind;
+  [history countAheadCommits:&ahead behindCommits:&behind ofCommit:master relativeToCommit:topic];
+  XCTAssertEqual(ahead, 1 + 7 + 4);  // x, m13-m19 and a4-a7
+  XCTAssertEqual(behind, 1 + 6);  // y and b0-b5
+  [history countAheadCommits:&ahead behindCommits:&behind ofCommit:merge relativeToCommit:master];
+  XCTAssertEqual(ahead, 1 + 1 + 6);
+  XCTAssertEqual(behind, 0);
+  [history countAheadCommits:&ahead behindCommits:&behind ofCommit:unrelated relativeToCommit:master];
+  XCTAssertEqual(ahead, 3);
+  XCTAssertEqual(behind, 20 + 8 + 1);
+  XCTAssertEqual([history countAncestorCommitsFromCommit:merge toCommit:master], 1 + 1 + 6);
+}
+
+- (void)testHistory_BranchAheadBehind {
+  // Create commit history with branches tracking each other
+  NSMutableString* notation = [NSMutableString string];
+  [notation appendString:_LinearNotation(@"m", 30, nil, @"master")];
+  for (NSUInteger i = 0; i < 8; ++i) {
+    [notation appendString:_LinearNotation([NSString stringWithFormat:@"b%c", (char)('a' + i)], 5 + i, [NSString stringWithFormat:@"m%lu", (unsigned long)(3 * i)], [NSString stringWithFormat:@"branch%c", (char)('a' + i)])];
+  }
+  [notation appendString:@"x(bg4,bh2)<mixed>\n"];
+  XCTAssertNotNil([self.repository createMockCommitHierarchyFromNotation:notation force:YES error:NULL]);
+  GCLocalBranch* master = [self.repository findLocalBranchWithName:@"master" error:NULL];
+  for (NSUInteger i = 0; i < 8; ++i) {
+    GCLocalBranch* branch = [self.repository findLocalBranchWithName:[NSString stringWithFormat:@"branch%c", (char)('a' + i)] error:NULL];
+    GCLocalBranch* upstream = i % 2 ? master : [self.repository findLocalBranchWithName:[NSString stringWithFormat:@"branch%c", (char)('a' + i + 1)] error:NULL];
+    XCTAssertTrue([self.repository setUpstream:upstream forLocalBranch:branch error:NULL]);
+  }
+  XCTAssertTrue([self.repository setUpstream:[self.repository findLocalBranchWithName:@"branchb" error:NULL] forLocalBranch:[self.repository findLocalBranchWithName:@"mixed" error:NULL] error:NULL]);
+  GCHistory* history = [self.repository loadHistoryUsingSorting:kGCHistorySorting_ReverseChronological error:NULL];
+  XCTAssertNotNil(history);
+
+  // Check batched counts match individual ones
+  for (GCHistoryLocalBranch* branch in history.localBranches) {
+    NSUInteger ahead1;
+    NSUInteger behind1;
+    [history countAheadCommits:&ahead1 behindCommits:&behind1 forLocalBranch:branch];
+    if (branch.upstream) {
+      NSUInteger ahead2;
+      NSUInteger behind2;
+      [history countAheadCommits:&ahead2 behindCommits:&behind2 ofCommit:branch.tipCommit relativeToCommit:[(GCHistoryLocalBranch*)branch.upstream tipCommit]];
+      XCTAssertEqual(ahead1, ahead2, @"%@", branch.name);
+      XCTAssertEqual(behind1, behind2, @"%@", branch.name);
+    } else {
+      XCTAssertEqual(ahead1, NSNotFound);
+      XCTAssertEqual(behind1, NSNotFound);
+    }
+  }
+  NSUInteger ahead;
+  NSUInteger behind;
+  [history countAheadCommits:&ahead behindCommits:&behind forLocalBranch:[history historyLocalBranchWithName:@"branchb"]];
+  XCTAssertEqual(ahead, 6);
+  XCTAssertEqual(behind, 30 - 4);
+
+  // Check counts are updated after reloading history
+  XCTAssertNotNil([self makeCommitWithUpdatedFileAtPath:@"file.txt" string:@"ahead\n" message:@"ahead"]);
+  XCTAssertTrue([self.repository reloadHistory:history referencesDidChange:NULL addedCommits:NULL removedCommits:NULL error:NULL]);
+  [history countAheadCommits:&ahead behindCommits:&behind forLocalBranch:[history historyLocalBranchWithName:@"branchb"]];
+  XCTAssertEqual(ahead, 6);
+  XCTAssertEqual(behind, 30 - 4 + 1);
+}
+
+- (void)testHistory_Window {
+  // Create commit history with a merged topic branch and a branch pointing to an old commit
+  NSMutableString* notation = [NSMutableString string];
+  [notation appendString:_LinearNotation(@"m", 100, nil, nil)];
+  [notation appendString:_LinearNotation(@"t", 3, @"m10", @"topic")];
+  [notation appendString:@"x(m99,t2)<master>\n"];
+  NSArray* commits = [self.repository createMockCommitHierarchyFromNotation:notation force:NO error:NULL];
+  XCTAssertEqual(commits.count, 104);
+  XCTAssertNotNil([self.repository createLocalBranchFromCommit:commits[5] withName:@"old" force:NO error:NULL]);
+  GCHistory* fullHistory = [self.repository loadHistoryUsingSorting:kGCHistorySorting_ReverseChronological error:NULL];
+  XCTAssertNotNil(fullHistory);
+  XCTAssertFalse(fullHistory.windowed);
+  XCTAssertTrue(fullHistory.complete);
+
+  for (NSUInteger i = 0; i < 2; ++i) {
+    if (i == 1) {
+      [self runGitCLTWithRepository:self.repository command:@"commit-graph", @"write", @"--reachable", nil];
+    }
+
+    // Load newest commits and check boundary
+    GCHistory* history = [self.repository loadHistoryUsingSorting:kGCHistorySorting_ReverseChronological maximumCommits:20 sinceDate:nil error:NULL];
+    XCTAssertNotNil(history);
+    XCTAssertTrue(history.windowed);
+    XCTAssertFalse(history.complete);
+    XCTAssertEqual(history.allCommits.count, 20);
+    XCTAssertEqual(history.localBranches.count, 3);
+    XCTAssertEqual(history.rootCommits.count, 0);
+    GCHistoryCommit* oldCommit = [history historyCommitForCommit:commits[5]];
+    XCTAssertNotNil(oldCommit);
+    XCTAssertTrue(oldCommit.boundary);
+    XCTAssertFalse(oldCommit.root);
+    XCTAssertTrue(oldCommit.leaf);
+    XCTAssertEqual(oldCommit.parents.count, 0);
+    XCTAssertEqualObjects([NSSet setWithArray:history.leafCommits], ([NSSet setWithObjects:history.HEADCommit, oldCommit, nil]));
+    XCTAssertTrue([history historyCommitForCommit:commits[100]].boundary);  // "t0" is missing its parent "m10"
+    XCTAssertNil([history historyCommitForCommit:commits[10]]);
+    XCTAssertFalse([self.repository writeHistory:history toCacheAtPath:[self.repository.repositoryPath stringByAppendingPathComponent:@"history.cache"] error:NULL]);
+
+    // Extend window partially
+    NSArray* addedCommits;
+    XCTAssertTrue([self.repository extendHistory:history byCommits:10 addedCommits:&addedCommits removedCommits:NULL error:NULL]);
+    XCTAssertEqual(addedCommits.count, 10);
+    XCTAssertEqual(history.allCommits.count, 30);
+    XCTAssertFalse(history.complete);
+    XCTAssertEqual(history.rootCommits.count, 0);
+
+    // Reload with a new commit
+    GCCommit* newCommit = [self makeCommitWithUpdatedFileAtPath:@"file.txt" string:[NSString stringWithFormat:@"%lu\n", (unsigned long)i] message:@"new"];
+    XCTAssertNotNil(newCommit);
+    XCTAssertTrue([self.repository reloadHistory:history referencesDidChange:NULL addedCommits:&addedCommits removedCommits:NULL error:NULL]);
+    XCTAssertEqualObjects(addedCommits, @[ newCommit ]);
+    XCTAssertEqual(history.allCommits.count, 31);
+    XCTAssertFalse(history.complete);
+
+    // Extend window to the entire history and compare with a regular history
+    XCTAssertTrue([self.repository extendHistory:history byCommits:1000 addedCommits:&addedCommits removedCommits:NULL error:NULL]);
+    XCTAssertTrue(history.complete);
+    XCTAssertFalse(oldCommit.boundary);
+    XCTAssertFalse(oldCommit.leaf);
+
+    // Check extending a complete history still reloads references
+    GCCommit* lastCommit = [self makeCommitWithUpdatedFileAtPath:@"file.txt" string:[NSString stringWithFormat:@"last %lu\n", (unsigned long)i] message:@"last"];
+    XCTAssertNotNil(lastCommit);
+    XCTAssertTrue([self.repository extendHistory:history byCommits:10 addedCommits:&addedCommits removedCommits:NULL error:NULL]);
+    XCTAssertEqualObjects(addedCommits, @[ lastCommit ]);
+    XCTAssertTrue([self.repository reloadHistory:fullHistory referencesDidChange:NULL addedCommits:NULL removedCommits:NULL error:NULL]);
+    [self assertHistory:history isEqualToHistory:fullHistory];
+    XCTAssertEqualObjects(history.rootCommits, @[ [history historyCommitForCommit:commits[0]] ]);
+  }
+
+  // Load commits since a date
+  GCHistory* history = [self.repository loadHistoryUsingSorting:kGCHistorySorting_None maximumCommits:0 sinceDate:[NSDate dateWithTimeIntervalSince1970:(NSTimeIntervalSince1970 + 50)] error:NULL];
+  XCTAssertNotNil(history);
+  XCTAssertFalse(history.complete);
+  XCTAssertNil([history historyCommitForCommit:commits[49]]);
+  XCTAssertNotNil([history historyCommitForCommit:commits[50]]);
+  XCTAssertNotNil([history historyCommitForCommit:commits[5]]);
+}
+
+- (void)testHistory_WindowAncestry {
+  // Create commit history with a long topic branch newer than the master branch it is merged into
+  NSMutableString* notation = [NSMutableString string];
+  [notation appendString:_LinearNotation(@"m", 100, nil, nil)];
+  [notation appendString:_LinearNotation(@"t", 40, @"m10", @"topic")];
+  [notation appendString:@"x(m99,t39)<master>\n"];
+  NSArray* commits = [self.repository createMockCommitHierarchyFromNotation:notation force:NO error:NULL];
+  XCTAssertEqual(commits.count, 141);
+  GCHistory* fullHistory = [self.repository loadHistoryUsingSorting:kGCHistorySorting_ReverseChronological error:NULL];
+  XCTAssertNotNil(fullHistory);
+
+  // Load newest commits which only contain part of the topic branch
+  GCHistory* history = [self.repository loadHistoryUsingSorting:kGCHistorySorting_ReverseChronological maximumCommits:20 sinceDate:nil error:NULL];
+  XCTAssertNotNil(history);
+  XCTAssertNil([history historyCommitForCommit:commits[99]]);
+  XCTAssertTrue([history isCommit:[history historyCommitForCommit:commits[139]] ancestorOfCommit:history.HEADCommit]);
+
+  // Extend window to the entire history and check ancestry queries match a regular history now that the levels of the old commits have changed
+  XCTAssertTrue([self.repository extendHistory:history byCommits:1000 addedCommits:NULL removedCommits:NULL error:NULL]);
+  XCTAssertTrue(history.complete);
+  for (NSNumber* index in @[ @0, @10, @50, @99, @100, @120, @139 ]) {
+    GCCommit* commit = commits[index.unsignedIntegerValue];
+    XCTAssertTrue([history isCommit:[history historyCommitForCommit:commit] ancestorOfCommit:history.HEADCommit]);
+    XCTAssertEqual([history countAncestorCommitsFromCommit:history.HEADCommit toCommit:[history historyCommitForCommit:commit]],
+                   [fullHistory countAncestorCommitsFromCommit:fullHistory.HEADCommit toCommit:[fullHistory historyCommitForCommit:commit]]);
+  }
+  XCTAssertEqualObjects([history findMergeBaseForCommit:[history historyCommitForCommit:commits[99]] andCommit:[history historyCommitForCommit:commits[139]]], commits[10]);
+  XCTAssertFalse([history isCommit:[history historyCommitForCommit:commits[120]] ancestorOfCommit:[history historyCommitForCommit:commits[99]]]);
+}
+
+- (void)testHistory_Sorting {
+  // Create commit history and check initial sorting
+  NSMutableString* notation = [NSMutableString string];
+  [notation appendString:_LinearNotation(@"m", 200, nil, @"master")];
+  [notation appendString:_LinearNotation(@"t", 50, @"m10", @"topic")];
+  [notation appendString:_LinearNotation(@"f", 20, @"m150", @"feature")];
+  XCTAssertNotNil([self.repository createMockCommitHierarchyFromNotation:notation force:YES error:NULL]);
+  GCHistory* history = [self.repository loadHistoryUsingSorting:kGCHistorySorting_ReverseChronological error:NULL];
+  XCTAssertNotNil(history);
+  XCTAssertEqualObjects(history.allCommits, [history.allCommits sortedArrayUsingSelector:@selector(reverseTimeCompare:)]);
+
+  // Check sorting after adding commits with identical times
+  for (NSUInteger i = 0; i < 5; ++i) {
+    XCTAssertNotNil([self makeCommitWithUpdatedFileAtPath:@"file.txt" string:[NSString stringWithFormat:@"%lu\n", (unsigned long)i] message:@"new"]);
+  }
+  NSArray* addedCommits;
+  XCTAssertTrue([self.repository reloadHistory:history referencesDidChange:NULL addedCommits:&addedCommits removedCommits:NULL error:NULL]);
+  XCTAssertEqual(addedCommits.count, 5);
+  XCTAssertEqual(history.allCommits.count, 275);
+  XCTAssertEqualObjects(history.allCommits, [history.allCommits sortedArrayUsingSelector:@selector(reverseTimeCompare:)]);
+
+  // Check sorting after adding an unrelated commit as old as the root and removing commits
+  GCHistoryLocalBranch* topic = [history historyLocalBranchWithName:@"topic"];
+  XCTAssertNotNil([self.repository createMockCommitHierarchyFromNotation:@"y<other>\n" force:NO error:NULL]);
+  XCTAssertTrue([self.repository reloadHistory:history referencesDidChange:NULL addedCommits:&addedCommits removedCommits:NULL error:NULL]);
+  XCTAssertEqual(addedCommits.count, 1);
+  XCTAssertEqualObjects(history.allCommits, [history.allCommits sortedArrayUsingSelector:@selector(reverseTimeCompare:)]);
+  XCTAssertTrue([self.repository deleteLocalBranch:topic error:NULL]);
+  XCTAssertTrue([self.repository reloadHistory:history referencesDidChange:NULL addedCommits:NULL removedCommits:NULL error:NULL]);
+  XCTAssertEqual(history.allCommits.count, 276 - 50);
+  XCTAssertEqualObjects(history.allCommits, [history.allCommits sortedArrayUsingSelector:@selector(reverseTimeCompare:)]);
+}
+
+
+- (void)testHistory_Prefetch {
+  // Create commit history
+  NSMutableString* notation = [NSMutableString string];
+  [notation appendString:_LinearNotation(@"m", 100, nil, @"master")];
+  [notation appendString:_LinearNotation(@"t", 20, @"m10", @"topic")];
+  XCTAssertNotNil([self.repository createMockCommitHierarchyFromNotation:notation force:YES error:NULL]);
+  GCHistory* history1 = [self.repository loadHistoryUsingSorting:kGCHistorySorting_ReverseChronological error:NULL];
+  XCTAssertNotNil(history1);
+  GCHistory* history2 = [self.repository loadHistoryUsingSorting:kGCHistorySorting_ReverseChronological error:NULL];
+  XCTAssertNotNil(history2);
+  NSMutableData* oids = [NSMutableData data];
+  for (GCHistoryCommit* commit in history1.leafCommits) {
+    [oids appendBytes:commit.OID length:sizeof(git_oid)];
+  }
+
+  // Check prefetch only contains new commits
+  for (NSUInteger i = 0; i < 5; ++i) {
+    XCTAssertNotNil([self makeCommitWithUpdatedFileAtPath:@"file.txt" string:[NSString stringWithFormat:@"%lu\n", (unsigned long)i] message:@"new"]);
+  }
+  XCTAssertNotNil([self.repository createMockCommitHierarchyFromNotation:@"z<other>\n" force:NO error:NULL]);
+  GCHistoryPrefetch* prefetch = [self.repository prefetchCommitsExcludingAncestorsOfOIDs:oids cancelBlock:NULL error:NULL];
+  XCTAssertNotNil(prefetch);
+  XCTAssertEqual(prefetch.count, 6);
+  XCTAssertNil([self.repository prefetchCommitsExcludingAncestorsOfOIDs:[NSData data]
+                                                            cancelBlock:^BOOL {
+                                                              return YES;
+                                                            }
+                                                                  error:NULL]);
+
+  // Check reloading from a stale prefetch matches a regular reload
+  XCTAssertNotNil([self makeCommitWithUpdatedFileAtPath:@"file.txt" string:@"stale\n" message:@"stale"]);
+  NSArray* addedCommits;
+  XCTAssertTrue([self.repository reloadHistory:history1 usingPrefetch:prefetch referencesDidChange:NULL addedCommits:&addedCommits removedCommits:NULL error:NULL]);
+  XCTAssertEqual(addedCommits.count, 7);
+  XCTAssertTrue([self.repository reloadHistory:history2 referencesDidChange:NULL addedCommits:NULL removedCommits:NULL error:NULL]);
+  [self assertHistory:history1 isEqualToHistory:history2];
+  XCTAssertEqualObjects(history1.allCommits, [history1.allCommits sortedArrayUsingSelector:@selector(reverseTimeCompare:)]);
+}
+
+- (void)testHistory_Handover {
+  // Create commit history
+  NSMutableString* notation = [NSMutableString string];
+  [notation appendString:_LinearNotation(@"m", 50, nil, @"master")];
+  [notation appendString:_LinearNotation(@"t", 10, @"m10", @"topic")];
+  XCTAssertNotNil([self.repository createMockCommitHierarchyFromNotation:notation force:YES error:NULL]);
+  GCHistory* history1 = [self.repository loadHistoryUsingSorting:kGCHistorySorting_ReverseChronological error:NULL];
+  XCTAssertNotNil(history1);
+  NSData* data = [self.repository serializeHistory:history1 error:NULL];
+  XCTAssertNotNil(data);
+
+  // Reload a copy of the history on a private repository
+  XCTAssertNotNil([self makeCommitWithUpdatedFileAtPath:@"file.txt" string:@"new\n" message:@"new"]);
+  XCTAssertTrue([self.repository deleteLocalBranch:[self.repository findLocalBranchWithName:@"topic" error:NULL] error:NULL]);
+  GCRepository* repository = [[GCRepository alloc] initWithExistingLocalRepository:self.repository.repositoryPath error:NULL];
+  XCTAssertNotNil(repository);
+  GCHistory* history2 = [repository loadHistoryFromSerializedHistory:data usingSorting:kGCHistorySorting_ReverseChronological error:NULL];
+  XCTAssertNotNil(history2);
+  BOOL referencesDidChange;
+  NSArray* addedCommits;
+  NSArray* removedCommits;
+  XCTAssertTrue([repository reloadHistory:history2 referencesDidChange:&referencesDidChange addedCommits:&addedCommits removedCommits:&removedCommits error:NULL]);
+  XCTAssertTrue(referencesDidChange);
+  XCTAssertEqual(addedCommits.count, 1);
+  XCTAssertEqual(removedCommits.count, 10);
+  for (GCHistoryCommit* commit in removedCommits) {
+    XCTAssertFalse(commit.root);
+    XCTAssertFalse(commit.leaf);
+    XCTAssertEqual(commit.parentCount, 0);
+  }
+
+  // Check the copy matches a regular reload once handed over
+  XCTAssertTrue([self.repository adoptHistory:history2 removedCommits:removedCommits error:NULL]);
+  XCTAssertTrue([self.repository reloadHistory:history1 referencesDidChange:NULL addedCommits:NULL removedCommits:NULL error:NULL]);
+  [self assertHistory:history2 isEqualToHistory:history1];
+  XCTAssertNotNil(history2.HEADCommit.message);  // Loads the commit from the live repository
+
+  // Check handover fails if references moved since
+  GCHistory* history3 = [repository loadHistoryFromSerializedHistory:[self.repository serializeHistory:history1 error:NULL] usingSorting:kGCHistorySorting_ReverseChronological error:NULL];
+  XCTAssertNotNil(history3);
+  XCTAssertNotNil([self makeCommitWithUpdatedFileAtPath:@"file.txt" string:@"newer\n" message:@"newer"]);
+  XCTAssertTrue([repository reloadHistory:history3 referencesDidChange:NULL addedCommits:NULL removedCommits:NULL error:NULL]);
+  XCTAssertNotNil([self makeCommitWithUpdatedFileAtPath:@"file.txt" string:@"newest\n" message:@"newest"]);
+  XCTAssertFalse([self.repository adoptHistory:history3 removedCommits:nil error:NULL]);
+}
+
 @end
@@ -14,6 +14,7 @@
 //  along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #import <GitUpKit/GCRepository.h>
+#import <GitUpKit/GCRepository+Bare.h>
 #import <GitUpKit/GCCommit.h>
 #import <GitUpKit/GCTag.h>
 #import <GitUpKit/GCBranch.h>
@@ -27,14 +28,19 @@ typedef NS_ENUM(NSUInteger, GCHistorySorting) {
 
 @interface GCHistoryCommit : GCCommit
 @property(nonatomic, readonly) NSUInteger autoIncrementID;  // Uniquely increasing ID for each GCHistoryCommit instantiated for a GCHistory (can be used for LUTs)
-@property(nonatomic, readonly) NSArray* parents;  // Sorting is defined by hierarchy
-@property(nonatomic, readonly) NSArray* children;  // Sorting is arbitrary and not guaranteed to be stable
+@property(nonatomic, readonly) NSArray* parents;  // Sorting is defined by hierarchy - Returns a new array on each call
+@property(nonatomic, readonly) NSArray* children;  // Sorting is arbitrary and not guaranteed to be stable - Returns a new array on each call
+@property(nonatomic, readonly) NSUInteger parentCount;  // Use with -parentAtIndex: instead of -parents in loops to avoid allocating an array on every call
+@property(nonatomic, readonly) NSUInteger childCount;  // Use with -childAtIndex: instead of -children in loops to avoid allocating an array on every call
 @property(nonatomic, readonly) NSArray* localBranches;
 @property(nonatomic, readonly) NSArray* remoteBranches;
 @property(nonatomic, readonly) NSArray* tags;
-@property(nonatomic, readonly, getter=isRoot) BOOL root;
-@property(nonatomic, readonly, getter=isLeaf) BOOL leaf;
+@property(nonatomic, readonly, getter=isRoot) BOOL root;  // Always NO for commits removed from the history
+@property(nonatomic, readonly, getter=isLeaf) BOOL leaf;  // Always NO for commits removed from the history
+@property(nonatomic, readonly, getter=isBoundary) BOOL boundary;  // YES if some parents are outside the window of a windowed history (the commit is then never a root)
 @property(nonatomic, readonly) BOOL hasReferences;
+- (GCHistoryCommit*)parentAtIndex:(NSUInteger)index;
+- (GCHistoryCommit*)childAtIndex:(NSUInteger)index;
 @end
 
 @interface GCHistoryTag : GCTag
@@ -65,6 +71,8 @@ typedef NS_ENUM(NSUInteger, GCHistorySorting) {
 @property(nonatomic, readonly) NSArray* localBranches;  // Always sorted alphabetically
 @property(nonatomic, readonly) NSArray* remoteBranches;  // Always sorted alphabetically
 @property(nonatomic, readonly) NSUInteger nextAutoIncrementID;  // See @autoIncrementID on GCHistoryCommit
+@property(nonatomic, readonly, getter=isWindowed) BOOL windowed;  // See -loadHistoryUsingSorting:maximumCommits:sinceDate:error:
+@property(nonatomic, readonly, getter=isComplete) BOOL complete;  // NO if the history is windowed and commits older than the window remain to be loaded
 - (GCHistoryCommit*)historyCommitWithSHA1:(NSString*)sha1;
 - (GCHistoryCommit*)historyCommitForCommit:(GCCommit*)commit;
 - (GCHistoryLocalBranch*)historyLocalBranchForLocalBranch:(GCLocalBranch*)branch;
@@ -73,6 +81,13 @@ typedef NS_ENUM(NSUInteger, GCHistorySorting) {
 - (GCHistoryRemoteBranch*)historyRemoteBranchWithName:(NSString*)name;
 
 - (NSUInteger)countAncestorCommitsFromCommit:(GCHistoryCommit*)fromCommit toCommit:(GCHistoryCommit*)toCommit;  // Returns NSNotFound if "toCommit" is not an ancestor of "fromCommit"
+
+- (BOOL)isCommit:(GCHistoryCommit*)commit ancestorOfCommit:(GCHistoryCommit*)descendantCommit;  // Returns NO if both commits are the same
+- (GCHistoryCommit*)findMergeBaseForCommit:(GCHistoryCommit*)commit1 andCommit:(GCHistoryCommit*)commit2;  // Returns nil if the commits are unrelated
+- (GCCommitRelation)findRelationOfCommit:(GCHistoryCommit*)ofCommit relativeToCommit:(GCHistoryCommit*)toCommit;  // In-memory equivalent of -[GCRepository findRelationOfCommit:relativeToCommit:error:]
+- (void)countAheadCommits:(NSUInteger*)ahead behindCommits:(NSUInteger*)behind ofCommit:(GCHistoryCommit*)commit relativeToCommit:(GCHistoryCommit*)otherCommit;  // git rev-list --left-right --count {commit}...{otherCommit}
+- (void)countAheadCommits:(NSUInteger*)ahead behindCommits:(NSUInteger*)behind ofCommits:(NSArray*)commits relativeToCommits:(NSArray*)otherCommits;  // Computes all pairs in a single walk - "ahead" and "behind" must have room for one count per pair
+- (void)countAheadCommits:(NSUInteger*)ahead behindCommits:(NSUInteger*)behind forLocalBranch:(GCHistoryLocalBranch*)branch;  // Relative to the branch upstream or NSNotFound if none - Counts for all branches are computed together and cached until the history changes
 @end
 
 @interface GCHistoryWalker : NSObject
@@ -94,7 +109,13 @@ typedef NS_ENUM(NSUInteger, GCHistorySorting) {
 - (GCHistory*)loadHistoryUsingSorting:(GCHistorySorting)sorting error:(NSError**)error;  // git log {--all}
 - (BOOL)reloadHistory:(GCHistory*)history referencesDidChange:(BOOL*)referencesDidChange addedCommits:(NSArray**)addedCommits removedCommits:(NSArray**)removedCommits error:(NSError**)error;
 
+- (GCHistory*)loadHistoryUsingSorting:(GCHistorySorting)sorting maximumCommits:(NSUInteger)maximumCommits sinceDate:(NSDate*)date error:(NSError**)error;  // Only loads the newest commits by committer date up to "maximumCommits" and / or back to "date" (pass 0 or nil for no limit) but always loads the commits references point to - Reloading only adds new commits down to the oldest ones already loaded
+- (BOOL)extendHistory:(GCHistory*)history byCommits:(NSUInteger)count addedCommits:(NSArray**)addedCommits removedCommits:(NSArray**)removedCommits error:(NSError**)error;  // Loads the next "count" older commits of a windowed history (only reloads references if the history is complete) - Removed commits are only the ones orphaned by references that changed since the last reload
+
 - (GCHistory*)loadHistoryFromSnapshot:(GCSnapshot*)snapshot usingSorting:(GCHistorySorting)sorting error:(NSError**)error;
 
+- (GCHistory*)loadHistoryFromCacheAtPath:(NSString*)path usingSorting:(GCHistorySorting)sorting error:(NSError**)error;  // The cache is a serialized copy of the commit graph which is read entirely on load and saves walking the object database - Only walks commits reachable from references that changed since the cache was written (falls back to a full load if the cache is missing, invalid, from a different format version or was written by another repository)
+- (BOOL)writeHistory:(GCHistory*)history toCacheAtPath:(NSString*)path error:(NSError**)error;  // Does nothing if the cache is already up-to-date
+
 - (NSArray*)lookupCommitsForFile:(NSString*)path followRenames:(BOOL)follow error:(NSError**)error;  // git log {--follow} -p {file}
 @end
@@ -29,21 +29,100 @@
 #define SET_COMMIT_SKIPPED(c) COMMIT_STATE(c) = -iteration
 #define COMMIT_WAS_JUST_SKIPPED(c) (COMMIT_STATE(c) == -iteration)
 
+#define kMaxCommitGraphParents 16  // Commits with more parents are loaded from the object database
+
+#define kCacheMagic 0x43484347  // "GCHC"
+#define kCacheVersion 2
+
+// All integers in the cache are little-endian
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  unsigned char repositoryID[CC_MD5_DIGEST_LENGTH];  // MD5 of the repository path
+  uint32_t commitCount;
+  uint32_t parentCount;
+  uint32_t tipCount;
+  unsigned char md5[CC_MD5_DIGEST_LENGTH];
+  uint32_t reserved;  // Keeps the times that follow 8-byte aligned
+} GCHistoryCacheHeader;
+
+typedef struct {
+  NSUInteger commitID;
+  git_oid oid;  // OID of the parent (which might not be in the history)
+  git_time_t time;  // Committer time of the parent or of the commit if the parent was not looked up (the commit-graph was not available)
+  NSUInteger generation;  // Generation of the parent from the commit-graph or 0 if unknown
+} GCHistoryBoundaryParent;
+
 static const void* _associatedObjectCommitKey = &_associatedObjectCommitKey;
 static const void* _associatedObjectAnnotationKey = &_associatedObjectAnnotationKey;
 static const void* _associatedObjectUpstreamNameKey = &_associatedObjectUpstreamNameKey;
 
 @interface GCHistoryCommit () {
 @public
-  NSUInteger generation;
+  GCHistory* _history;  // NOT RETAINED - Reset to nil when the commit is removed from the history
 }
 @end
 
+// Compact storage for the commit DAG indexed by autoIncrementID
+@interface GCHistory () {
+@public
+  NSUInteger _capacity;
+  GCHistoryCommit** _table;  // NULL for commits not in the history anymore (commits are NOT RETAINED)
+  git_oid* _oids;
+  git_time_t* _times;
+  NSUInteger* _generations;  // Used to mark commits during reload
+  NSUInteger* _levels;  // Topological level i.e. 1 for root commits and 1 + the maximum level of the parents otherwise (0 until computed) - Boundary commits are seeded from the generations of their parents outside the window which are only known from the commit-graph, so without one levels are only consistent within the window
+  uint8_t* _flags;  // Scratch space for ancestry queries (always reset to 0 after use)
+  NSUInteger* _parentOffsets;  // CSR offsets into "_parentIDs" (capacity + 1 entries)
+  GCItemList _parentIDs;  // Append-only until compacted
+  NSUInteger* _childOffsets;  // CSR offsets into "_childIDs" (capacity + 1 entries)
+  NSUInteger* _childIDs;  // Rebuilt from parents after each reload
+  BOOL _windowed;
+  NSUInteger _windowSize;  // Maximum number of commits generated by the initial load
+  git_time_t _horizon;  // Only used when windowed - Reachable commits newer than this are loaded (approximate in the presence of clock skew)
+  GCItemList _boundaryParents;  // All parents in order of each commit with parents outside the window (grouped by commit in autoIncrementID order)
+  NSMutableIndexSet* _boundaryIDs;  // Commits with parents outside the window
+  NSMutableIndexSet* _relinkedIDs;  // Boundary commits linked to parents loaded since the levels were last updated
+}
+@end
+
+static inline NSUInteger _ParentIDs(GCHistory* history, NSUInteger commitID, const NSUInteger** ids) {
+  NSUInteger start = history->_parentOffsets[commitID];
+  *ids = (const NSUInteger*)history->_parentIDs.items + start;
+  return history->_parentOffsets[commitID + 1] - start;
+}
+
+static inline NSUInteger _ChildIDs(GCHistory* history, NSUInteger commitID, const NSUInteger** ids) {
+  NSUInteger start = history->_childOffsets[commitID];
+  *ids = history->_childIDs + start;
+  return history->_childOffsets[commitID + 1] - start;
+}
+
+static inline NSUInteger _RelationIDs(GCHistory* history, NSUInteger commitID, BOOL parents, const NSUInteger** ids) {
+  return parents ? _ParentIDs(history, commitID, ids) : _ChildIDs(history, commitID, ids);
+}
+
+static NSArray* _CommitsFromIDs(GCHistory* history, const NSUInteger* ids, NSUInteger count) {
+  if (count == 0) {
+    return [NSArray array];
+  }
+  GCHistoryCommit* stackBuffer[16];
+  GCHistoryCommit** buffer = count <= 16 ? stackBuffer : malloc(count * sizeof(GCHistoryCommit*));
+  for (NSUInteger i = 0; i < count; ++i) {
+    buffer[i] = history->_table[ids[i]];
+    XLOG_DEBUG_CHECK(buffer[i]);
+  }
+  NSArray* array = [NSArray arrayWithObjects:buffer count:count];
+  if (buffer != stackBuffer) {
+    free(buffer);
+  }
+  return array;
+}
+
 @implementation GCHistoryCommit {
 @public
   NSUInteger _autoIncrementID;
-  CFMutableArrayRef _parents;
-  CFMutableArrayRef _children;
+  git_oid _oid;
   CFMutableArrayRef _localBranches;
   CFMutableArrayRef _remoteBranches;
   CFMutableArrayRef _tags;
@@ -52,8 +131,16 @@ static const void* _associatedObjectUpstreamNameKey = &_associatedObjectUpstream
 - (instancetype)initWithRepository:(GCRepository*)repository commit:(git_commit*)commit autoIncrementID:(NSUInteger)autoIncrementID {
   if ((self = [super initWithRepository:repository commit:commit])) {
     _autoIncrementID = autoIncrementID;
-    _parents = CFArrayCreateMutable(kCFAllocatorDefault, 0, NULL);
-    _children = CFArrayCreateMutable(kCFAllocatorDefault, 0, NULL);
+    git_oid_cpy(&_oid, git_commit_id(commit));
+  }
+  return self;
+}
+
+// The git_commit is only loaded on demand for commits coming from the commit-graph
+- (instancetype)initWithRepository:(GCRepository*)repository OID:(const git_oid*)oid autoIncrementID:(NSUInteger)autoIncrementID {
+  if ((self = [super initWithRepository:repository commit:NULL])) {
+    _autoIncrementID = autoIncrementID;
+    git_oid_cpy(&_oid, oid);
   }
   return self;
 }
@@ -68,56 +155,141 @@ static const void* _associatedObjectUpstreamNameKey = &_associatedObjectUpstream
   if (_tags) {
     CFRelease(_tags);
   }
-  CFRelease(_children);
-  CFRelease(_parents);
 
   [super dealloc];
 }
 
-- (NSArray*)parents {
-  return (NSArray*)_parents;
+- (git_commit*)private {
+  if (_private == NULL) {
+    git_commit* commit;
+    int status = git_commit_lookup(&commit, self.repository.private, &_oid);
+    if (status == GIT_OK) {
+      if (!__sync_bool_compare_and_swap(&_private, NULL, (git_object*)commit)) {  // Another thread may have loaded the commit in the meantime
+        git_commit_free(commit);
+      }
+    } else {
+      LOG_LIBGIT2_ERROR(status);
+    }
+  }
+  return (git_commit*)_private;
 }
 
-- (NSArray*)children {
-  return (NSArray*)_children;
+- (const git_oid*)OID {
+  return &_oid;
 }
 
-- (NSArray*)localBranches {
-  return (NSArray*)_localBranches;
+// The git_commit is loaded again on demand from the new repository
+- (void)rebindToRepository:(GCRepository*)repository {
+  git_object_free(_private);
+  _private = NULL;
+  [super rebindToRepository:repository];
 }
 
-- (NSArray*)remoteBranches {
-  return (NSArray*)_remoteBranches;
+static inline git_time_t _CommitTime(GCHistoryCommit* commit) {
+  if (commit->_history) {
+    return commit->_history->_times[commit->_autoIncrementID];
+  }
+  git_commit* gitCommit = commit.private;
+  return gitCommit ? git_commit_time(gitCommit) : 0;  // The commit may have gone missing from the repository
 }
 
-- (NSArray*)tags {
-  return (NSArray*)_tags;
+- (NSTimeInterval)timeIntervalSinceReferenceDate {
+  return _CommitTime(self) - NSTimeIntervalSince1970;
 }
 
-- (void)addParent:(GCHistoryCommit*)commit {
-  CFArrayAppendValue(_parents, (const void*)commit);
+static inline NSComparisonResult _TimeCompare(GCHistoryCommit* commit1, GCHistoryCommit* commit2) {
+  XLOG_DEBUG_CHECK(commit1 != commit2);
+  git_time_t time1 = _CommitTime(commit1);
+  git_time_t time2 = _CommitTime(commit2);
+  if (time1 < time2) {
+    return NSOrderedAscending;
+  } else if (time1 > time2) {
+    return NSOrderedDescending;
+  }
+  return git_oid_cmp(&commit1->_oid, &commit2->_oid);  // Ensure stable ordering
 }
 
-- (void)removeParent:(GCHistoryCommit*)commit {
-  CFIndex index = CFArrayGetFirstIndexOfValue(_parents, CFRangeMake(0, CFArrayGetCount(_parents)), (const void*)commit);
-  if (index != kCFNotFound) {
-    CFArrayRemoveValueAtIndex(_parents, index);
-  } else {
-    XLOG_DEBUG_UNREACHABLE();
+// Only valid for commits in the history passed as context
+static NSInteger _ReverseTimeCompareFunction(id object1, id object2, void* context) {
+  GCHistory* history = (GCHistory*)context;
+  NSUInteger id1 = ((GCHistoryCommit*)object1)->_autoIncrementID;
+  NSUInteger id2 = ((GCHistoryCommit*)object2)->_autoIncrementID;
+  git_time_t time1 = history->_times[id1];
+  git_time_t time2 = history->_times[id2];
+  if (time1 > time2) {
+    return NSOrderedAscending;
+  } else if (time1 < time2) {
+    return NSOrderedDescending;
   }
+  return git_oid_cmp(&history->_oids[id2], &history->_oids[id1]);  // Ensure stable ordering
 }
 
-- (void)addChild:(GCHistoryCommit*)commit {
-  CFArrayAppendValue(_children, (const void*)commit);
+- (NSComparisonResult)timeCompare:(GCCommit*)commit {
+  if ([commit isKindOfClass:[GCHistoryCommit class]]) {
+    return _TimeCompare(self, (GCHistoryCommit*)commit);
+  }
+  return [super timeCompare:commit];
 }
 
-- (void)removeChild:(GCHistoryCommit*)commit {
-  CFIndex index = CFArrayGetFirstIndexOfValue(_children, CFRangeMake(0, CFArrayGetCount(_children)), (const void*)commit);
-  if (index != kCFNotFound) {
-    CFArrayRemoveValueAtIndex(_children, index);
-  } else {
-    XLOG_DEBUG_UNREACHABLE();
+- (NSComparisonResult)reverseTimeCompare:(GCCommit*)commit {
+  if ([commit isKindOfClass:[GCHistoryCommit class]]) {
+    return _TimeCompare((GCHistoryCommit*)commit, self);
+  }
+  return [super reverseTimeCompare:commit];
+}
+
+- (NSArray*)parents {
+  if (_history == nil) {
+    return [NSArray array];
+  }
+  const NSUInteger* ids;
+  NSUInteger count = _ParentIDs(_history, _autoIncrementID, &ids);
+  return _CommitsFromIDs(_history, ids, count);
+}
+
+- (NSArray*)children {
+  if (_history == nil) {
+    return [NSArray array];
   }
+  const NSUInteger* ids;
+  NSUInteger count = _ChildIDs(_history, _autoIncrementID, &ids);
+  return _CommitsFromIDs(_history, ids, count);
+}
+
+- (NSUInteger)parentCount {
+  const NSUInteger* ids;
+  return _history ? _ParentIDs(_history, _autoIncrementID, &ids) : 0;
+}
+
+- (GCHistoryCommit*)parentAtIndex:(NSUInteger)index {
+  const NSUInteger* ids;
+  NSUInteger count = _history ? _ParentIDs(_history, _autoIncrementID, &ids) : 0;
+  XLOG_DEBUG_CHECK(index < count);
+  return index < count ? _history->_table[ids[index]] : nil;
+}
+
+- (NSUInteger)childCount {
+  const NSUInteger* ids;
+  return _history ? _ChildIDs(_history, _autoIncrementID, &ids) : 0;
+}
+
+- (GCHistoryCommit*)childAtIndex:(NSUInteger)index {
+  const NSUInteger* ids;
+  NSUInteger count = _history ? _ChildIDs(_history, _autoIncrementID, &ids) : 0;
+  XLOG_DEBUG_CHECK(index < count);
+  return index < count ? _history->_table[ids[index]] : nil;
+}
+
+- (NSArray*)localBranches {
+  return (NSArray*)_localBranches;
+}
+
+- (NSArray*)remoteBranches {
+  return (NSArray*)_remoteBranches;
+}
+
+- (NSArray*)tags {
+  return (NSArray*)_tags;
 }
 
 - (void)addLocalBranch:(GCHistoryLocalBranch*)branch {
@@ -156,12 +328,19 @@ static const void* _associatedObjectUpstreamNameKey = &_associatedObjectUpstream
   }
 }
 
+// Removed commits have no relations left but are neither roots nor leaves of any history
 - (BOOL)isRoot {
-  return CFArrayGetCount(_parents) ? NO : YES;
+  const NSUInteger* ids;
+  return _history ? ((_ParentIDs(_history, _autoIncrementID, &ids) == 0) && ![_history->_boundaryIDs containsIndex:_autoIncrementID]) : NO;
 }
 
 - (BOOL)isLeaf {
-  return CFArrayGetCount(_children) ? NO : YES;
+  const NSUInteger* ids;
+  return _history ? (_ChildIDs(_history, _autoIncrementID, &ids) == 0) : NO;
+}
+
+- (BOOL)isBoundary {
+  return _history ? [_history->_boundaryIDs containsIndex:_autoIncrementID] : NO;
 }
 
 - (BOOL)hasReferences {
@@ -214,10 +393,13 @@ static const void* _associatedObjectUpstreamNameKey = &_associatedObjectUpstream
 @property(nonatomic, weak) GCHistoryCommit* HEADCommit;
 @property(nonatomic, weak) GCHistoryLocalBranch* HEADBranch;
 @property(nonatomic, strong) NSData* md5;
+@property(nonatomic, strong) NSData* cacheMD5;  // MD5 of the references at the time the cache was last read or written
 @end
 
 @implementation GCHistory {
   GCSearchIndex* _searchIndex;
+  NSUInteger* _branchCounts;  // Ahead and behind counts for each local branch
+  NSUInteger _branchCountsGeneration;  // Generation of the history when the counts were computed
 }
 
 - (instancetype)initWithRepository:(GCRepository*)repository sorting:(GCHistorySorting)sorting {
@@ -229,16 +411,51 @@ static const void* _associatedObjectUpstreamNameKey = &_associatedObjectUpstream
     _leaves = [[NSMutableArray alloc] init];
     CFDictionaryKeyCallBacks callbacks = {0, NULL, NULL, NULL, GCOIDEqualCallBack, GCOIDHashCallBack};
     _lookup = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, &callbacks, NULL);
+
+    _capacity = 4096;
+    _table = calloc(_capacity, sizeof(GCHistoryCommit*));
+    _oids = malloc(_capacity * sizeof(git_oid));
+    _times = malloc(_capacity * sizeof(git_time_t));
+    _generations = calloc(_capacity, sizeof(NSUInteger));
+    _levels = calloc(_capacity, sizeof(NSUInteger));
+    _flags = calloc(_capacity, sizeof(uint8_t));
+    _parentOffsets = calloc(_capacity + 1, sizeof(NSUInteger));
+    _childOffsets = calloc(_capacity + 1, sizeof(NSUInteger));
+    GC_LIST_INITIALIZE(_parentIDs, _capacity, NSUInteger);
+    GC_LIST_INITIALIZE(_boundaryParents, 64, GCHistoryBoundaryParent);
+    _boundaryIDs = [[NSMutableIndexSet alloc] init];
+    _relinkedIDs = [[NSMutableIndexSet alloc] init];
   }
   return self;
 }
 
 - (void)dealloc {
+  for (NSUInteger i = 0; i < _nextAutoIncrementID; ++i) {
+    if (_table[i]) {
+      _table[i]->_history = nil;  // Commits might outlive the history
+    }
+  }
+  [_relinkedIDs release];
+  [_boundaryIDs release];
+  GC_LIST_FREE(_boundaryParents);
+  free(_childIDs);
+  GC_LIST_FREE(_parentIDs);
+  free(_childOffsets);
+  free(_parentOffsets);
+  free(_branchCounts);
+  free(_flags);
+  free(_levels);
+  free(_generations);
+  free(_times);
+  free(_oids);
+  free(_table);
+
   [_tags release];
   [_localBranches release];
   [_remoteBranches release];
   [_tips release];
   [_md5 release];
+  [_cacheMD5 release];
 
   CFRelease(_lookup);
   [_leaves release];
@@ -248,6 +465,619 @@ static const void* _associatedObjectUpstreamNameKey = &_associatedObjectUpstream
   [super dealloc];
 }
 
+#pragma mark - Storage
+
+- (void)_addCommit:(GCHistoryCommit*)commit time:(git_time_t)time {
+  NSUInteger commitID = commit->_autoIncrementID;
+  if (commitID >= _capacity) {
+    NSUInteger oldCapacity = _capacity;
+    while (commitID >= _capacity) {
+      _capacity *= 2;
+    }
+    _table = realloc(_table, _capacity * sizeof(GCHistoryCommit*));
+    bzero(&_table[oldCapacity], (_capacity - oldCapacity) * sizeof(GCHistoryCommit*));
+    _oids = realloc(_oids, _capacity * sizeof(git_oid));
+    _times = realloc(_times, _capacity * sizeof(git_time_t));
+    _generations = realloc(_generations, _capacity * sizeof(NSUInteger));
+    bzero(&_generations[oldCapacity], (_capacity - oldCapacity) * sizeof(NSUInteger));
+    _levels = realloc(_levels, _capacity * sizeof(NSUInteger));
+    _flags = realloc(_flags, _capacity * sizeof(uint8_t));
+    bzero(&_flags[oldCapacity], (_capacity - oldCapacity) * sizeof(uint8_t));
+    _parentOffsets = realloc(_parentOffsets, (_capacity + 1) * sizeof(NSUInteger));
+    _childOffsets = realloc(_childOffsets, (_capacity + 1) * sizeof(NSUInteger));
+  }
+  _table[commitID] = commit;
+  git_oid_cpy(&_oids[commitID], &commit->_oid);
+  _times[commitID] = time;
+  _generations[commitID] = 0;
+  _levels[commitID] = 0;
+  commit->_history = self;
+}
+
+// Commits must be passed in autoIncrementID order and "offsets" contains the start of the parents of each commit in "parentOIDs"
+// If "parentTimes" and "parentGenerations" are not NULL, parents not in the history are outside the window and recorded so they can be linked once loaded
+- (void)_addParentsForCommits:(NSArray*)commits parentOIDs:(GCItemList*)parentOIDs parentTimes:(GCItemList*)parentTimes parentGenerations:(GCItemList*)parentGenerations offsets:(GCItemList*)offsets {
+  for (NSUInteger i = 0, count = commits.count; i < count; ++i) {
+    GCHistoryCommit* commit = commits[i];
+    NSUInteger commitID = commit->_autoIncrementID;
+    XLOG_DEBUG_CHECK(_table[commitID] == commit);
+    size_t start = ((size_t*)offsets->items)[i];
+    size_t end = i + 1 < count ? ((size_t*)offsets->items)[i + 1] : parentOIDs->count;
+    BOOL missing = NO;
+    _parentOffsets[commitID] = GC_LIST_COUNT(_parentIDs);
+    for (size_t j = start; j < end; ++j) {
+      GCHistoryCommit* parent = (GCHistoryCommit*)CFDictionaryGetValue(_lookup, (const git_oid*)parentOIDs->items + j);
+      if (parent) {  // We can't distinguish between a commit missing from the Git database and one that was hidden explicitly
+        GC_LIST_APPEND(_parentIDs, &parent->_autoIncrementID);
+      } else {
+        missing = YES;
+      }
+    }
+    _parentOffsets[commitID + 1] = GC_LIST_COUNT(_parentIDs);
+    if (missing && parentTimes) {
+      for (size_t j = start; j < end; ++j) {
+        GCHistoryBoundaryParent boundaryParent = {commitID, *((const git_oid*)parentOIDs->items + j), ((git_time_t*)parentTimes->items)[j], ((NSUInteger*)parentGenerations->items)[j]};
+        GC_LIST_APPEND(_boundaryParents, &boundaryParent);
+      }
+      [_boundaryIDs addIndex:commitID];
+    }
+  }
+}
+
+- (void)_removeCommit:(GCHistoryCommit*)commit {
+  XLOG_DEBUG_CHECK(_table[commit->_autoIncrementID] == commit);
+  _table[commit->_autoIncrementID] = NULL;
+  commit->_history = nil;
+}
+
+// Parents outside the window are only looked up once they are generated so the ones missing from the Git database are forgotten then,
+// which is the same as when not windowed
+- (void)_forgetBoundaryParents:(GCItemList*)oids {
+  if (oids->count == 0) {
+    return;
+  }
+  CFSetCallBacks callbacks = {0, NULL, NULL, NULL, GCOIDEqualCallBack, GCOIDHashCallBack};
+  CFMutableSetRef set = CFSetCreateMutable(kCFAllocatorDefault, oids->count, &callbacks);
+  for (size_t i = 0; i < oids->count; ++i) {
+    CFSetAddValue(set, (const git_oid*)oids->items + i);
+  }
+  GCItemList boundaryParents;
+  GC_LIST_INITIALIZE(boundaryParents, GC_LIST_COUNT(_boundaryParents), GCHistoryBoundaryParent);
+  GCHistoryBoundaryParent* boundaryParent;
+  GC_LIST_FOR_LOOP_POINTER(_boundaryParents, boundaryParent) {
+    if (!CFSetContainsValue(set, &boundaryParent->oid)) {
+      GC_LIST_APPEND(boundaryParents, boundaryParent);
+    }
+  }
+  NSMutableIndexSet* boundaryIDs = [[NSMutableIndexSet alloc] init];
+  GC_LIST_FOR_LOOP_POINTER(boundaryParents, boundaryParent) {
+    [boundaryIDs addIndex:boundaryParent->commitID];
+  }
+  [_boundaryIDs removeAllIndexes];
+  [_boundaryIDs addIndexes:boundaryIDs];  // Commits with remaining parents all in the history are unlinked from the boundary by -_updateBoundary
+  [boundaryIDs release];
+  GC_LIST_SWAP(_boundaryParents, boundaryParents);
+  GC_LIST_FREE(boundaryParents);
+  CFRelease(set);
+}
+
+// Link boundary commits to their parents loaded since and forget the ones removed from the history
+// This requires rebuilding the parents as the ranges of these commits grow
+- (void)_updateBoundary {
+  BOOL changed = NO;
+  GCHistoryBoundaryParent* boundaryParent;
+  GC_LIST_FOR_LOOP_POINTER(_boundaryParents, boundaryParent) {
+    if ((_table[boundaryParent->commitID] == NULL) || CFDictionaryContainsKey(_lookup, &boundaryParent->oid)) {
+      changed = YES;
+      break;
+    }
+  }
+  if (!changed) {
+    return;
+  }
+
+  NSUInteger count = _nextAutoIncrementID;
+  GCItemList parentIDs;
+  GCItemList boundaryParents;
+  GC_LIST_INITIALIZE(parentIDs, GC_LIST_COUNT(_parentIDs) + 64, NSUInteger);
+  GC_LIST_INITIALIZE(boundaryParents, GC_LIST_COUNT(_boundaryParents), GCHistoryBoundaryParent);
+  const GCHistoryBoundaryParent* boundary = _boundaryParents.items;
+  const GCHistoryBoundaryParent* boundaryEnd = boundary + GC_LIST_COUNT(_boundaryParents);
+  for (NSUInteger i = 0; i < count; ++i) {
+    NSUInteger start = _parentOffsets[i];
+    NSUInteger end = _parentOffsets[i + 1];
+    _parentOffsets[i] = GC_LIST_COUNT(parentIDs);
+    if ((boundary < boundaryEnd) && (boundary->commitID == i)) {
+      const GCHistoryBoundaryParent* groupStart = boundary;
+      BOOL missing = NO;
+      while ((boundary < boundaryEnd) && (boundary->commitID == i)) {
+        if (_table[i]) {
+          GCHistoryCommit* parent = (GCHistoryCommit*)CFDictionaryGetValue(_lookup, &boundary->oid);
+          if (parent) {
+            GC_LIST_APPEND(parentIDs, &parent->_autoIncrementID);
+          } else {
+            missing = YES;
+          }
+        }
+        ++boundary;
+      }
+      if (_table[i] && (GC_LIST_COUNT(parentIDs) - _parentOffsets[i] != end - start)) {
+        [_relinkedIDs addIndex:i];
+      }
+      if (missing) {
+        for (const GCHistoryBoundaryParent* groupParent = groupStart; groupParent < boundary; ++groupParent) {
+          GC_LIST_APPEND(boundaryParents, groupParent);
+        }
+      } else {
+        [_boundaryIDs removeIndex:i];
+      }
+    } else if (_table[i]) {
+      for (NSUInteger j = start; j < end; ++j) {
+        GC_LIST_APPEND(parentIDs, &((NSUInteger*)_parentIDs.items)[j]);
+      }
+    }
+  }
+  XLOG_DEBUG_CHECK(boundary == boundaryEnd);
+  _parentOffsets[count] = GC_LIST_COUNT(parentIDs);
+  GC_LIST_SWAP(_parentIDs, parentIDs);
+  GC_LIST_SWAP(_boundaryParents, boundaryParents);
+  GC_LIST_FREE(boundaryParents);
+  GC_LIST_FREE(parentIDs);
+}
+
+// Rebuild children from the parents of the commits still in the history, compacting parents if needed
+- (void)_updateRelations {
+  NSUInteger count = _nextAutoIncrementID;
+  NSUInteger* parentIDs = _parentIDs.items;
+  bzero(_childOffsets, (count + 1) * sizeof(NSUInteger));
+  for (NSUInteger i = 0; i < count; ++i) {
+    if (_table[i]) {
+      for (NSUInteger j = _parentOffsets[i], end = _parentOffsets[i + 1]; j < end; ++j) {
+        XLOG_DEBUG_CHECK(_table[parentIDs[j]]);
+        _childOffsets[parentIDs[j] + 1] += 1;
+      }
+    }
+  }
+  for (NSUInteger i = 1; i <= count; ++i) {
+    _childOffsets[i] += _childOffsets[i - 1];
+  }
+  NSUInteger total = _childOffsets[count];
+  _childIDs = realloc(_childIDs, MAX(total, 1) * sizeof(NSUInteger));
+  for (NSUInteger i = 0; i < count; ++i) {
+    if (_table[i]) {
+      for (NSUInteger j = _parentOffsets[i], end = _parentOffsets[i + 1]; j < end; ++j) {
+        _childIDs[_childOffsets[parentIDs[j]]++] = i;
+      }
+    }
+  }
+  for (NSUInteger i = count; i > 0; --i) {
+    _childOffsets[i] = _childOffsets[i - 1];
+  }
+  _childOffsets[0] = 0;
+
+  if (GC_LIST_COUNT(_parentIDs) > 2 * total + 4096) {
+    NSUInteger position = 0;
+    for (NSUInteger i = 0; i < count; ++i) {
+      NSUInteger start = _parentOffsets[i];
+      NSUInteger end = _parentOffsets[i + 1];
+      _parentOffsets[i] = position;
+      if (_table[i]) {
+        memmove(&parentIDs[position], &parentIDs[start], (end - start) * sizeof(NSUInteger));
+        position += end - start;
+      }
+    }
+    _parentOffsets[count] = position;
+    GC_LIST_TRUNCATE(_parentIDs, position);
+  }
+
+  [self _updateLevels];
+}
+
+// Levels of existing commits only change when boundary commits get linked to their parents so only these commits, their descendants and new commits need to be processed
+- (void)_updateLevels {
+  GCItemList stack;
+  GC_LIST_INITIALIZE(stack, 256, NSUInteger);
+
+  // Invalidate levels of relinked commits and their descendants (new commits have no level yet so the walk stops there)
+  NSUInteger index = _relinkedIDs.firstIndex;
+  while (index != NSNotFound) {
+    if (_table[index] && _levels[index]) {
+      _levels[index] = 0;
+      GC_LIST_APPEND(stack, &index);
+    }
+    index = [_relinkedIDs indexGreaterThanIndex:index];
+  }
+  [_relinkedIDs removeAllIndexes];
+  while (GC_LIST_COUNT(stack)) {
+    NSUInteger commitID = ((NSUInteger*)stack.items)[GC_LIST_COUNT(stack) - 1];
+    GC_LIST_TRUNCATE(stack, GC_LIST_COUNT(stack) - 1);
+    const NSUInteger* childIDs;
+    for (NSUInteger j = 0, count = _ChildIDs(self, commitID, &childIDs); j < count; ++j) {
+      if (_levels[childIDs[j]]) {
+        _levels[childIDs[j]] = 0;
+        GC_LIST_APPEND(stack, &childIDs[j]);
+      }
+    }
+  }
+
+  // Seed boundary commits from the generations of their parents outside the window
+  NSUInteger* seeds = NULL;
+  if (GC_LIST_COUNT(_boundaryParents)) {
+    seeds = calloc(_nextAutoIncrementID, sizeof(NSUInteger));
+    GCHistoryBoundaryParent* boundaryParent;
+    GC_LIST_FOR_LOOP_POINTER(_boundaryParents, boundaryParent) {
+      if (boundaryParent->generation && !CFDictionaryContainsKey(_lookup, &boundaryParent->oid)) {
+        seeds[boundaryParent->commitID] = MAX(seeds[boundaryParent->commitID], boundaryParent->generation + 1);
+      }
+    }
+  }
+
+  for (NSUInteger i = 0; i < _nextAutoIncrementID; ++i) {
+    if (!_table[i] || _levels[i]) {
+      continue;
+    }
+    GC_LIST_APPEND(stack, &i);
+    while (GC_LIST_COUNT(stack)) {
+      NSUInteger commitID = ((NSUInteger*)stack.items)[GC_LIST_COUNT(stack) - 1];
+      if (_levels[commitID]) {  // Commit might have been pushed several times
+        GC_LIST_TRUNCATE(stack, GC_LIST_COUNT(stack) - 1);
+        continue;
+      }
+      const NSUInteger* parentIDs;
+      NSUInteger level = seeds ? MAX(seeds[commitID], 1) : 1;
+      BOOL ready = YES;
+      for (NSUInteger j = 0, count = _ParentIDs(self, commitID, &parentIDs); j < count; ++j) {
+        NSUInteger parentLevel = _levels[parentIDs[j]];
+        if (parentLevel == 0) {
+          GC_LIST_APPEND(stack, &parentIDs[j]);
+          ready = NO;
+        } else {
+          level = MAX(level, parentLevel + 1);
+        }
+      }
+      if (ready) {
+        _levels[commitID] = level;
+        GC_LIST_TRUNCATE(stack, GC_LIST_COUNT(stack) - 1);
+      }
+    }
+  }
+  free(seeds);
+  GC_LIST_FREE(stack);
+}
+
+typedef struct {
+  uint64_t key;
+  GCHistoryCommit* commit;
+} GCHistorySortItem;
+
+// LSD radix sort on raw committer times (newest first) followed by ordering commits with identical times by OID like _ReverseTimeCompareFunction()
+static void _SortCommitsByReverseTime(GCHistory* history, GCHistoryCommit** commits, NSUInteger count) {
+  if (count < 2) {
+    return;
+  }
+  GCHistorySortItem* buffer = malloc(2 * count * sizeof(GCHistorySortItem));
+  GCHistorySortItem* items = buffer;
+  GCHistorySortItem* temp = buffer + count;
+  for (NSUInteger i = 0; i < count; ++i) {
+    uint64_t time = (uint64_t)history->_times[commits[i]->_autoIncrementID] ^ 0x8000000000000000ULL;  // Map signed times to unsigned keys preserving order
+    items[i].key = ~time;  // Newest first
+    items[i].commit = commits[i];
+  }
+  for (unsigned int shift = 0; shift < 64; shift += 8) {
+    size_t offsets[256] = {0};
+    for (NSUInteger i = 0; i < count; ++i) {
+      offsets[(items[i].key >> shift) & 0xFF] += 1;
+    }
+    if (offsets[(items[0].key >> shift) & 0xFF] == count) {
+      continue;  // All keys share the same digit which is the case for the high bytes of most timestamps
+    }
+    size_t total = 0;
+    for (unsigned int i = 0; i < 256; ++i) {
+      size_t digitCount = offsets[i];
+      offsets[i] = total;
+      total += digitCount;
+    }
+    for (NSUInteger i = 0; i < count; ++i) {
+      temp[offsets[(items[i].key >> shift) & 0xFF]++] = items[i];
+    }
+    GCHistorySortItem* swap = items;
+    items = temp;
+    temp = swap;
+  }
+  for (NSUInteger i = 0; i < count;) {
+    NSUInteger end = i + 1;
+    while ((end < count) && (items[end].key == items[i].key)) {
+      ++end;
+    }
+    for (NSUInteger j = i + 1; j < end; ++j) {  // Runs of identical times are short so insertion sort is fine
+      GCHistorySortItem item = items[j];
+      NSUInteger k = j;
+      while ((k > i) && (git_oid_cmp(&items[k - 1].commit->_oid, &item.commit->_oid) < 0)) {
+        items[k] = items[k - 1];
+        --k;
+      }
+      items[k] = item;
+    }
+    i = end;
+  }
+  for (NSUInteger i = 0; i < count; ++i) {
+    commits[i] = items[i].commit;
+  }
+  free(buffer);
+}
+
+// Commits before "index" must already be sorted so only the commits after need to be sorted before merging both
+- (void)_sortCommitsFromIndex:(NSUInteger)index {
+  XLOG_DEBUG_CHECK(_sorting == kGCHistorySorting_ReverseChronological);
+  NSUInteger count = _commits.count;
+  if (index >= count) {
+    return;
+  }
+  GCHistoryCommit** buffer = malloc(2 * count * sizeof(GCHistoryCommit*));
+  [_commits getObjects:buffer range:NSMakeRange(0, count)];
+  _SortCommitsByReverseTime(self, buffer + index, count - index);
+
+  // Find where the new commits start being interleaved with the old ones (typically at the start for new commits or at the end for older ones)
+  NSUInteger start = index;
+  if ((index > 0) && (_ReverseTimeCompareFunction(buffer[index - 1], buffer[index], self) == NSOrderedDescending)) {
+    NSUInteger low = 0;
+    NSUInteger high = index - 1;
+    while (low < high) {
+      NSUInteger middle = (low + high) / 2;
+      if (_ReverseTimeCompareFunction(buffer[middle], buffer[index], self) == NSOrderedDescending) {
+        high = middle;
+      } else {
+        low = middle + 1;
+      }
+    }
+    start = low;
+
+    // Merge both sorted ranges
+    GCHistoryCommit** merged = buffer + count;
+    NSUInteger i = start;
+    NSUInteger j = index;
+    NSUInteger k = start;
+    while ((i < index) && (j < count)) {
+      merged[k++] = _ReverseTimeCompareFunction(buffer[j], buffer[i], self) == NSOrderedAscending ? buffer[j++] : buffer[i++];
+    }
+    while (i < index) {
+      merged[k++] = buffer[i++];
+    }
+    while (j < count) {
+      merged[k++] = buffer[j++];
+    }
+    memcpy(&buffer[start], &merged[start], (count - start) * sizeof(GCHistoryCommit*));
+  }
+  [_commits replaceObjectsInRange:NSMakeRange(start, count - start) withObjects:&buffer[start] count:(count - start)];
+  free(buffer);
+}
+
+#pragma mark - Cache
+
+// The cache is a serialized copy of the commit graph and not a graph that can be used in place: loading it validates it, then copies it into
+// newly created commits and the parent arrays - It only saves walking the commits from the object database
+// Layout: header, times, parent offsets, parent indexes, tip indexes and OIDs (commits are stored in history order and indexed by position)
+// The repository ID prevents loading a cache copied from another repository, in which case the OIDs would not exist or have different parents
+static void _GetCacheRepositoryID(GCRepository* repository, unsigned char* repositoryID) {
+  const char* path = repository.repositoryPath.fileSystemRepresentation;
+  CC_MD5(path, (CC_LONG)strlen(path), repositoryID);
+}
+
+- (BOOL)_deserializeCacheFromData:(NSData*)data {
+  XLOG_DEBUG_CHECK(_commits.count == 0);
+  const unsigned char* bytes = data.bytes;
+  NSUInteger length = data.length;
+  if (length < sizeof(GCHistoryCacheHeader)) {
+    return NO;
+  }
+  const GCHistoryCacheHeader* header = (const GCHistoryCacheHeader*)bytes;
+  if ((CFSwapInt32LittleToHost(header->magic) != kCacheMagic) || (CFSwapInt32LittleToHost(header->version) != kCacheVersion)) {
+    return NO;
+  }
+  unsigned char repositoryID[CC_MD5_DIGEST_LENGTH];
+  _GetCacheRepositoryID(_repository, repositoryID);
+  if (memcmp(header->repositoryID, repositoryID, CC_MD5_DIGEST_LENGTH)) {
+    return NO;
+  }
+  NSUInteger count = CFSwapInt32LittleToHost(header->commitCount);
+  NSUInteger parentCount = CFSwapInt32LittleToHost(header->parentCount);
+  NSUInteger tipCount = CFSwapInt32LittleToHost(header->tipCount);
+  uint64_t expectedLength = sizeof(GCHistoryCacheHeader) + (uint64_t)count * sizeof(int64_t) + ((uint64_t)count + 1 + parentCount + tipCount) * sizeof(uint32_t) + (uint64_t)count * sizeof(git_oid);
+  if (length != expectedLength) {
+    return NO;
+  }
+  const int64_t* times = (const int64_t*)(bytes + sizeof(GCHistoryCacheHeader));
+  const uint32_t* parentOffsets = (const uint32_t*)(times + count);
+  const uint32_t* parentIndexes = parentOffsets + count + 1;
+  const uint32_t* tipIndexes = parentIndexes + parentCount;
+  const git_oid* oids = (const git_oid*)(tipIndexes + tipCount);
+
+  // Validate topology before using it
+  if ((CFSwapInt32LittleToHost(parentOffsets[0]) != 0) || (CFSwapInt32LittleToHost(parentOffsets[count]) != parentCount)) {
+    return NO;
+  }
+  for (NSUInteger i = 0; i < count; ++i) {
+    if (CFSwapInt32LittleToHost(parentOffsets[i]) > CFSwapInt32LittleToHost(parentOffsets[i + 1])) {
+      return NO;
+    }
+  }
+  for (NSUInteger i = 0; i < parentCount; ++i) {
+    if (CFSwapInt32LittleToHost(parentIndexes[i]) >= count) {
+      return NO;
+    }
+  }
+  for (NSUInteger i = 0; i < tipCount; ++i) {
+    if (CFSwapInt32LittleToHost(tipIndexes[i]) >= count) {
+      return NO;
+    }
+  }
+
+  // Create commits using their position in the cache as autoIncrementID
+  for (NSUInteger i = 0; i < count; ++i) {
+    if (CFDictionaryContainsKey(_lookup, &oids[i])) {
+      return NO;
+    }
+    GCHistoryCommit* commit = [[GCHistoryCommit alloc] initWithRepository:_repository OID:&oids[i] autoIncrementID:i];
+    [_commits addObject:commit];
+    [commit release];
+    [self _addCommit:commit time:(git_time_t)CFSwapInt64LittleToHost(times[i])];
+    CFDictionarySetValue(_lookup, &commit->_oid, (const void*)commit);  // Use the git_oid stored in the commit itself as the key, so no need to copy it
+  }
+  for (NSUInteger i = 0; i <= count; ++i) {
+    _parentOffsets[i] = CFSwapInt32LittleToHost(parentOffsets[i]);
+  }
+  for (NSUInteger i = 0; i < parentCount; ++i) {
+    NSUInteger parentID = CFSwapInt32LittleToHost(parentIndexes[i]);
+    GC_LIST_APPEND(_parentIDs, &parentID);
+  }
+  NSMutableSet* tips = [[NSMutableSet alloc] initWithCapacity:tipCount];
+  for (NSUInteger i = 0; i < tipCount; ++i) {
+    [tips addObject:_table[CFSwapInt32LittleToHost(tipIndexes[i])]];
+  }
+  self.tips = tips;
+  [tips release];
+
+  _nextAutoIncrementID = count;
+  _nextGeneration = 1;  // Generation 0 is used by all commits loaded from the cache
+  if (_sorting == kGCHistorySorting_ReverseChronological) {
+    [self _sortCommitsFromIndex:0];  // The cache might have been written from a history using a different sorting
+  }
+  self.cacheMD5 = [NSData dataWithBytes:header->md5 length:CC_MD5_DIGEST_LENGTH];
+  return YES;
+}
+
+- (NSData*)_serializeCacheData {
+  NSUInteger count = _commits.count;
+  if (_windowed || (count >= UINT32_MAX)) {
+    return nil;
+  }
+  uint32_t* indexes = malloc(MAX(_nextAutoIncrementID, 1) * sizeof(uint32_t));  // Maps autoIncrementIDs to positions in the cache
+  NSUInteger parentCount = 0;
+  for (NSUInteger i = 0; i < count; ++i) {
+    GCHistoryCommit* commit = _commits[i];
+    const NSUInteger* parentIDs;
+    indexes[commit->_autoIncrementID] = (uint32_t)i;
+    parentCount += _ParentIDs(self, commit->_autoIncrementID, &parentIDs);
+  }
+  GCItemList tipIndexes;
+  GC_LIST_INITIALIZE(tipIndexes, 64, uint32_t);
+  for (GCCommit* tip in _tips) {
+    GCHistoryCommit* commit = (GCHistoryCommit*)CFDictionaryGetValue(_lookup, tip.OID);
+    if (commit) {
+      GC_LIST_APPEND(tipIndexes, &indexes[commit->_autoIncrementID]);
+    }
+  }
+
+  NSUInteger tipCount = GC_LIST_COUNT(tipIndexes);
+  NSMutableData* data = [NSMutableData dataWithLength:(sizeof(GCHistoryCacheHeader) + count * sizeof(int64_t) + (count + 1 + parentCount + tipCount) * sizeof(uint32_t) + count * sizeof(git_oid))];
+  GCHistoryCacheHeader* header = data.mutableBytes;
+  header->magic = CFSwapInt32HostToLittle(kCacheMagic);
+  header->version = CFSwapInt32HostToLittle(kCacheVersion);
+  _GetCacheRepositoryID(_repository, header->repositoryID);
+  header->commitCount = CFSwapInt32HostToLittle((uint32_t)count);
+  header->parentCount = CFSwapInt32HostToLittle((uint32_t)parentCount);
+  header->tipCount = CFSwapInt32HostToLittle((uint32_t)tipCount);
+  XLOG_DEBUG_CHECK(_md5.length == CC_MD5_DIGEST_LENGTH);
+  [_md5 getBytes:header->md5 length:CC_MD5_DIGEST_LENGTH];
+  int64_t* times = (int64_t*)(header + 1);
+  uint32_t* parentOffsets = (uint32_t*)(times + count);
+  uint32_t* parentIndexes = parentOffsets + count + 1;
+  uint32_t* tips = parentIndexes + parentCount;
+  git_oid* oids = (git_oid*)(tips + tipCount);
+  NSUInteger offset = 0;
+  for (NSUInteger i = 0; i < count; ++i) {
+    GCHistoryCommit* commit = _commits[i];
+    NSUInteger commitID = commit->_autoIncrementID;
+    const NSUInteger* parentIDs;
+    times[i] = (int64_t)CFSwapInt64HostToLittle((uint64_t)_times[commitID]);
+    git_oid_cpy(&oids[i], &commit->_oid);
+    parentOffsets[i] = CFSwapInt32HostToLittle((uint32_t)offset);
+    for (NSUInteger j = 0, parentIDCount = _ParentIDs(self, commitID, &parentIDs); j < parentIDCount; ++j) {
+      parentIndexes[offset++] = CFSwapInt32HostToLittle(indexes[parentIDs[j]]);
+    }
+  }
+  parentOffsets[count] = CFSwapInt32HostToLittle((uint32_t)offset);
+  for (NSUInteger i = 0; i < tipCount; ++i) {
+    tips[i] = CFSwapInt32HostToLittle(*(uint32_t*)GC_LIST_ITEM_POINTER(tipIndexes, i));
+  }
+
+  GC_LIST_FREE(tipIndexes);
+  free(indexes);
+  return data;
+}
+
+#pragma mark - Handover
+
+// References and tag annotations are looked up again as their libgit2 counterparts depend on the repository which is not the case of commits
+// Everything is looked up before modifying the history so it is left untouched if a reference moved since the history was reloaded
+- (BOOL)_rebindToRepository:(GCRepository*)repository removedCommits:(NSArray*)removedCommits error:(NSError**)error {
+  BOOL success = NO;
+  NSMutableArray* references = [[NSMutableArray alloc] init];
+  [references addObjectsFromArray:_tags];
+  [references addObjectsFromArray:_localBranches];
+  [references addObjectsFromArray:_remoteBranches];
+  NSUInteger referenceCount = references.count;
+  git_reference** newReferences = calloc(MAX(referenceCount, 1), sizeof(git_reference*));
+  NSMutableArray* newAnnotations = [[NSMutableArray alloc] initWithCapacity:_tags.count];
+  for (NSUInteger i = 0; i < referenceCount; ++i) {
+    git_reference* reference = [(GCReference*)references[i] private];
+    CALL_LIBGIT2_FUNCTION_GOTO(cleanup, git_reference_lookup, &newReferences[i], repository.private, git_reference_name(reference));
+    if ((git_reference_type(newReferences[i]) != GIT_REF_OID) || !git_oid_equal(git_reference_target(newReferences[i]), git_reference_target(reference))) {
+      GC_SET_GENERIC_ERROR(@"Reference \"%s\" changed during history update", git_reference_name(reference));
+      goto cleanup;
+    }
+  }
+  for (GCHistoryTag* tag in _tags) {
+    if (tag.annotation) {
+      git_tag* newTag;
+      CALL_LIBGIT2_FUNCTION_GOTO(cleanup, git_tag_lookup, &newTag, repository.private, git_tag_id(tag.annotation.private));
+      GCTagAnnotation* annotation = [[GCTagAnnotation alloc] initWithRepository:repository tag:newTag];
+      [newAnnotations addObject:annotation];
+      [annotation release];
+    } else {
+      [newAnnotations addObject:[NSNull null]];
+    }
+  }
+
+  for (NSUInteger i = 0; i < referenceCount; ++i) {
+    GCReference* reference = references[i];
+    [reference updateReference:newReferences[i]];
+    [reference rebindToRepository:repository];
+    newReferences[i] = NULL;
+  }
+  for (NSUInteger i = 0, count = _tags.count; i < count; ++i) {
+    if (newAnnotations[i] != [NSNull null]) {
+      [(GCHistoryTag*)_tags[i] setAnnotation:newAnnotations[i]];
+    }
+  }
+  for (NSUInteger i = 0; i < _nextAutoIncrementID; ++i) {
+    [_table[i] rebindToRepository:repository];
+  }
+  for (GCHistoryCommit* commit in removedCommits) {
+    [commit rebindToRepository:repository];
+  }
+  NSMutableSet* tips = [[NSMutableSet alloc] initWithCapacity:_tips.count];  // Tips found while reloading hold a git_commit from the previous repository
+  for (GCCommit* tip in _tips) {
+    GCHistoryCommit* commit = (GCHistoryCommit*)CFDictionaryGetValue(_lookup, tip.OID);
+    if (commit) {
+      [tips addObject:commit];
+    }
+  }
+  self.tips = tips;
+  [tips release];
+  _repository = repository;
+  success = YES;
+
+cleanup:
+  for (NSUInteger i = 0; i < referenceCount; ++i) {
+    git_reference_free(newReferences[i]);
+  }
+  free(newReferences);
+  [newAnnotations release];
+  [references release];
+  return success;
+}
+
 #pragma mark - Accessors
 
 - (BOOL)isEmpty {
@@ -270,6 +1100,14 @@ static const void* _associatedObjectUpstreamNameKey = &_associatedObjectUpstream
   return _HEADBranch ? NO : YES;
 }
 
+- (BOOL)isWindowed {
+  return _windowed;
+}
+
+- (BOOL)isComplete {
+  return _boundaryIDs.count == 0;
+}
+
 #pragma mark - Utilities
 
 - (GCHistoryCommit*)historyCommitForOID:(const git_oid*)oid {
@@ -286,7 +1124,7 @@ static const void* _associatedObjectUpstreamNameKey = &_associatedObjectUpstream
 }
 
 - (GCHistoryCommit*)historyCommitForCommit:(GCCommit*)commit {
-  return [self historyCommitForOID:git_commit_id(commit.private)];
+  return [self historyCommitForOID:commit.OID];
 }
 
 - (GCHistoryLocalBranch*)historyLocalBranchForLocalBranch:(GCLocalBranch*)branch {
@@ -325,47 +1163,414 @@ static const void* _associatedObjectUpstreamNameKey = &_associatedObjectUpstream
   return nil;
 }
 
-#pragma mark - Misc
+#pragma mark - Ancestry
 
-- (NSUInteger)countAncestorCommitsFromCommit:(GCHistoryCommit*)fromCommit toCommit:(GCHistoryCommit*)toCommit {
-  if (![fromCommit isEqualToCommit:toCommit]) {
-    __block NSUInteger counter = 1;
-    BOOL* states = calloc(_nextAutoIncrementID, sizeof(BOOL));
+#define kFlag_Commit1 (1 << 0)
+#define kFlag_Commit2 (1 << 1)
+#define kFlag_Both (kFlag_Commit1 | kFlag_Commit2)
+#define kFlag_Queued (1 << 2)
 
-    COMMIT_STATE(toCommit) = YES;
-    GCHistoryWalker* walker = [self walkerForAncestorsOfCommits:@[ fromCommit ]];
-    while (1) {
-      NSUInteger oldCounter = counter;
-      if (![walker iterateWithCommitBlock:^(GCHistoryCommit* commit, BOOL* stop) {
-            if (!COMMIT_STATE(commit)) {
-              BOOL skip = NO;
-              CFArrayRef children = commit->_children;
-              for (CFIndex i = 0, count = CFArrayGetCount(children); i < count; ++i) {
-                GCHistoryCommit* childCommit = CFArrayGetValueAtIndex(children, i);
-                if (COMMIT_STATE(childCommit)) {
-                  skip = YES;
-                  break;
-                }
-              }
-              if (skip) {
-                COMMIT_STATE(commit) = YES;
-              } else {
-                ++counter;
-              }
-            }
-          }] ||
-          (counter == oldCounter)) {
+static inline BOOL _HeapHigher(const NSUInteger* levels, NSUInteger commitID1, NSUInteger commitID2) {
+  return (levels[commitID1] > levels[commitID2]) || ((levels[commitID1] == levels[commitID2]) && (commitID1 > commitID2));
+}
+
+static void _HeapPush(const NSUInteger* levels, GCItemList* heap, NSUInteger commitID) {
+  __GCItemListAppend(heap, &commitID);
+  NSUInteger* items = heap->items;
+  for (size_t i = heap->count - 1; i > 0;) {
+    size_t parent = (i - 1) / 2;
+    if (!_HeapHigher(levels, items[i], items[parent])) {
+      break;
+    }
+    NSUInteger temp = items[i];
+    items[i] = items[parent];
+    items[parent] = temp;
+    i = parent;
+  }
+}
+
+static NSUInteger _HeapPop(const NSUInteger* levels, GCItemList* heap) {
+  NSUInteger* items = heap->items;
+  NSUInteger top = items[0];
+  heap->count -= 1;
+  items[0] = items[heap->count];
+  for (size_t i = 0;;) {
+    size_t left = 2 * i + 1;
+    size_t right = left + 1;
+    size_t highest = i;
+    if ((left < heap->count) && _HeapHigher(levels, items[left], items[highest])) {
+      highest = left;
+    }
+    if ((right < heap->count) && _HeapHigher(levels, items[right], items[highest])) {
+      highest = right;
+    }
+    if (highest == i) {
+      break;
+    }
+    NSUInteger temp = items[i];
+    items[i] = items[highest];
+    items[highest] = temp;
+    i = highest;
+  }
+  return top;
+}
+
+// Walks the ancestors of both commits by decreasing level so that children are always visited before their parents
+// The walk stops as soon as only common ancestors remain in the queue or at the first common ancestor if "stopAtMergeBase" is YES (which is then a best merge base)
+- (NSUInteger)_walkAncestryOfCommitID:(NSUInteger)commitID1 andCommitID:(NSUInteger)commitID2 stopAtMergeBase:(BOOL)stopAtMergeBase count1:(NSUInteger*)count1 count2:(NSUInteger*)count2 {
+  XLOG_DEBUG_CHECK(commitID1 != commitID2);
+  NSUInteger mergeBaseID = NSNotFound;
+  NSUInteger unique1 = 0;
+  NSUInteger unique2 = 0;
+  NSUInteger pending = 2;  // Number of queued commits not reachable from both commits
+  GCItemList heap;
+  GCItemList touched;
+  GC_LIST_INITIALIZE(heap, 256, NSUInteger);
+  GC_LIST_INITIALIZE(touched, 256, NSUInteger);
+  _flags[commitID1] = kFlag_Commit1 | kFlag_Queued;
+  _flags[commitID2] = kFlag_Commit2 | kFlag_Queued;
+  _HeapPush(_levels, &heap, commitID1);
+  _HeapPush(_levels, &heap, commitID2);
+  GC_LIST_APPEND(touched, &commitID1);
+  GC_LIST_APPEND(touched, &commitID2);
+  while (GC_LIST_COUNT(heap) && (stopAtMergeBase || pending)) {
+    NSUInteger commitID = _HeapPop(_levels, &heap);
+    uint8_t flags = _flags[commitID] & kFlag_Both;
+    if (flags == kFlag_Both) {
+      if (stopAtMergeBase) {
+        mergeBaseID = commitID;
+        break;
+      }
+    } else {
+      pending -= 1;
+      if (flags == kFlag_Commit1) {
+        unique1 += 1;
+      } else {
+        unique2 += 1;
+      }
+    }
+    const NSUInteger* parentIDs;
+    for (NSUInteger i = 0, count = _ParentIDs(self, commitID, &parentIDs); i < count; ++i) {
+      NSUInteger parentID = parentIDs[i];
+      uint8_t oldFlags = _flags[parentID];
+      uint8_t newFlags = oldFlags | flags;
+      if (!(oldFlags & kFlag_Queued)) {  // Parents have a lower level so they cannot have been dequeued already
+        _flags[parentID] = newFlags | kFlag_Queued;
+        _HeapPush(_levels, &heap, parentID);
+        GC_LIST_APPEND(touched, &parentID);
+        if ((newFlags & kFlag_Both) != kFlag_Both) {
+          pending += 1;
+        }
+      } else if (newFlags != oldFlags) {
+        _flags[parentID] = newFlags;
+        if ((newFlags & kFlag_Both) == kFlag_Both) {
+          pending -= 1;
+        }
+      }
+    }
+  }
+  for (size_t i = 0; i < GC_LIST_COUNT(touched); ++i) {
+    _flags[((NSUInteger*)touched.items)[i]] = 0;
+  }
+  GC_LIST_FREE(touched);
+  GC_LIST_FREE(heap);
+  if (count1) {
+    *count1 = unique1;
+  }
+  if (count2) {
+    *count2 = unique2;
+  }
+  return mergeBaseID;
+}
+
+- (BOOL)isCommit:(GCHistoryCommit*)commit ancestorOfCommit:(GCHistoryCommit*)descendantCommit {
+  XLOG_DEBUG_CHECK((commit->_history == self) && (descendantCommit->_history == self));
+  NSUInteger commitID = commit->_autoIncrementID;
+  NSUInteger minLevel = _levels[commitID];
+  if ((commit == descendantCommit) || (_levels[descendantCommit->_autoIncrementID] <= minLevel)) {
+    return NO;
+  }
+  BOOL found = NO;
+  GCItemList stack;
+  GCItemList touched;
+  GC_LIST_INITIALIZE(stack, 256, NSUInteger);
+  GC_LIST_INITIALIZE(touched, 256, NSUInteger);
+  GC_LIST_APPEND(stack, &descendantCommit->_autoIncrementID);
+  while (GC_LIST_COUNT(stack) && !found) {
+    NSUInteger currentID = ((NSUInteger*)stack.items)[GC_LIST_COUNT(stack) - 1];
+    GC_LIST_TRUNCATE(stack, GC_LIST_COUNT(stack) - 1);
+    const NSUInteger* parentIDs;
+    for (NSUInteger i = 0, count = _ParentIDs(self, currentID, &parentIDs); i < count; ++i) {
+      NSUInteger parentID = parentIDs[i];
+      if (parentID == commitID) {
+        found = YES;
         break;
       }
+      if ((_levels[parentID] > minLevel) && !_flags[parentID]) {  // Commits at or below the level of "commit" cannot have it as an ancestor
+        _flags[parentID] = kFlag_Queued;
+        GC_LIST_APPEND(stack, &parentID);
+        GC_LIST_APPEND(touched, &parentID);
+      }
+    }
+  }
+  for (size_t i = 0; i < GC_LIST_COUNT(touched); ++i) {
+    _flags[((NSUInteger*)touched.items)[i]] = 0;
+  }
+  GC_LIST_FREE(touched);
+  GC_LIST_FREE(stack);
+  return found;
+}
+
+- (GCHistoryCommit*)findMergeBaseForCommit:(GCHistoryCommit*)commit1 andCommit:(GCHistoryCommit*)commit2 {
+  XLOG_DEBUG_CHECK((commit1->_history == self) && (commit2->_history == self));
+  if (commit1 == commit2) {
+    return commit1;
+  }
+  NSUInteger mergeBaseID = [self _walkAncestryOfCommitID:commit1->_autoIncrementID andCommitID:commit2->_autoIncrementID stopAtMergeBase:YES count1:NULL count2:NULL];
+  return mergeBaseID != NSNotFound ? _table[mergeBaseID] : nil;
+}
+
+- (GCCommitRelation)findRelationOfCommit:(GCHistoryCommit*)ofCommit relativeToCommit:(GCHistoryCommit*)toCommit {
+  if (ofCommit == toCommit) {
+    return kGCCommitRelation_Identical;
+  }
+  GCHistoryCommit* mergeBase = [self findMergeBaseForCommit:ofCommit andCommit:toCommit];
+  if (mergeBase == nil) {
+    return kGCCommitRelation_Unrelated;
+  }
+  if (mergeBase == ofCommit) {
+    return kGCCommitRelation_Ancestor;
+  }
+  if (mergeBase == toCommit) {
+    return kGCCommitRelation_Descendant;
+  }
+  return kGCCommitRelation_Cousin;
+}
+
+- (void)countAheadCommits:(NSUInteger*)ahead behindCommits:(NSUInteger*)behind ofCommit:(GCHistoryCommit*)commit relativeToCommit:(GCHistoryCommit*)otherCommit {
+  XLOG_DEBUG_CHECK((commit->_history == self) && (otherCommit->_history == self));
+  if (commit == otherCommit) {
+    *ahead = 0;
+    *behind = 0;
+  } else {
+    [self _walkAncestryOfCommitID:commit->_autoIncrementID andCommitID:otherCommit->_autoIncrementID stopAtMergeBase:NO count1:ahead count2:behind];
+  }
+}
+
+// Multi-source version of -_walkAncestryOfCommitID:... where each commit carries a bitset of the sources it is reachable from
+// Commits that are reachable from both or neither commits of every pair are "settled" and the walk stops once only settled commits remain queued
+static inline BOOL _IsSettled(const uint64_t* bits, const NSUInteger* sources1, const NSUInteger* sources2, NSUInteger pairCount) {
+  for (NSUInteger i = 0; i < pairCount; ++i) {
+    BOOL bit1 = (bits[sources1[i] / 64] >> (sources1[i] % 64)) & 1;
+    BOOL bit2 = (bits[sources2[i] / 64] >> (sources2[i] % 64)) & 1;
+    if (bit1 != bit2) {
+      return NO;
+    }
+  }
+  return YES;
+}
+
+- (void)countAheadCommits:(NSUInteger*)ahead behindCommits:(NSUInteger*)behind ofCommits:(NSArray*)commits relativeToCommits:(NSArray*)otherCommits {
+  XLOG_DEBUG_CHECK(commits.count == otherCommits.count);
+  NSUInteger pairCount = commits.count;
+  if (pairCount == 0) {
+    return;
+  }
+
+  // Assign a bit to each distinct commit
+  NSUInteger* sources1 = malloc(pairCount * sizeof(NSUInteger));
+  NSUInteger* sources2 = malloc(pairCount * sizeof(NSUInteger));
+  CFMutableDictionaryRef sourceIndexes = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, NULL, NULL);  // Maps autoIncrementIDs + 1 to bit indexes + 1
+  GCItemList sourceIDs;
+  GC_LIST_INITIALIZE(sourceIDs, 2 * pairCount, NSUInteger);
+  for (NSUInteger i = 0; i < 2 * pairCount; ++i) {
+    GCHistoryCommit* commit = i < pairCount ? commits[i] : otherCommits[i - pairCount];
+    XLOG_DEBUG_CHECK(commit->_history == self);
+    NSUInteger commitID = commit->_autoIncrementID;
+    NSUInteger index = (NSUInteger)CFDictionaryGetValue(sourceIndexes, (const void*)(commitID + 1));
+    if (index == 0) {
+      GC_LIST_APPEND(sourceIDs, &commitID);
+      index = GC_LIST_COUNT(sourceIDs);
+      CFDictionarySetValue(sourceIndexes, (const void*)(commitID + 1), (const void*)index);
+    }
+    if (i < pairCount) {
+      sources1[i] = index - 1;
+      ahead[i] = 0;
+      behind[i] = 0;
+    } else {
+      sources2[i - pairCount] = index - 1;
+    }
+  }
+  CFRelease(sourceIndexes);
+
+  // Bitsets are allocated from a pool and recycled once their commit has been dequeued
+  NSUInteger wordCount = (GC_LIST_COUNT(sourceIDs) + 63) / 64;
+  size_t bitsetSize = wordCount * sizeof(uint64_t);
+  GCItemList pool;
+  GCItemList freeSlots;
+  GCItemList heap;
+  GC_LIST_INITIALIZE(pool, 256, uint64_t);
+  GC_LIST_INITIALIZE(freeSlots, 64, NSUInteger);
+  GC_LIST_INITIALIZE(heap, 256, NSUInteger);
+  NSUInteger* slots = malloc(_nextAutoIncrementID * sizeof(NSUInteger));  // Only valid for queued commits
+  NSUInteger pending = 0;  // Number of queued commits which are not settled
+  GCItemList touched;
+  GC_LIST_INITIALIZE(touched, 256, NSUInteger);
+
+#define BITSET(__SLOT__) ((uint64_t*)pool.items + (__SLOT__) * wordCount)
+
+  for (NSUInteger i = 0; i < GC_LIST_COUNT(sourceIDs); ++i) {
+    NSUInteger commitID = ((NSUInteger*)sourceIDs.items)[i];
+    NSUInteger slot = GC_LIST_COUNT(pool) / wordCount;
+    for (NSUInteger j = 0; j < wordCount; ++j) {
+      uint64_t zero = 0;
+      GC_LIST_APPEND(pool, &zero);
+    }
+    BITSET(slot)[i / 64] |= (uint64_t)1 << (i % 64);
+    slots[commitID] = slot;
+    _flags[commitID] = kFlag_Queued;
+    GC_LIST_APPEND(touched, &commitID);
+    _HeapPush(_levels, &heap, commitID);
+  }
+  for (NSUInteger i = 0; i < GC_LIST_COUNT(sourceIDs); ++i) {
+    if (!_IsSettled(BITSET(slots[((NSUInteger*)sourceIDs.items)[i]]), sources1, sources2, pairCount)) {
+      pending += 1;
+    }
+  }
+
+  while (GC_LIST_COUNT(heap) && pending) {
+    NSUInteger commitID = _HeapPop(_levels, &heap);
+    NSUInteger slot = slots[commitID];
+    uint64_t* bits = BITSET(slot);
+    if (!_IsSettled(bits, sources1, sources2, pairCount)) {
+      pending -= 1;
+      for (NSUInteger i = 0; i < pairCount; ++i) {
+        BOOL bit1 = (bits[sources1[i] / 64] >> (sources1[i] % 64)) & 1;
+        BOOL bit2 = (bits[sources2[i] / 64] >> (sources2[i] % 64)) & 1;
+        if (bit1 && !bit2) {
+          ahead[i] += 1;
+        } else if (bit2 && !bit1) {
+          behind[i] += 1;
+        }
+      }
     }
 
-    free(states);
-    return counter;
+    const NSUInteger* parentIDs;
+    for (NSUInteger i = 0, count = _ParentIDs(self, commitID, &parentIDs); i < count; ++i) {
+      NSUInteger parentID = parentIDs[i];
+      if (!(_flags[parentID] & kFlag_Queued)) {  // Parents have a lower level so they cannot have been dequeued already
+        NSUInteger parentSlot;
+        if (GC_LIST_COUNT(freeSlots)) {
+          parentSlot = ((NSUInteger*)freeSlots.items)[GC_LIST_COUNT(freeSlots) - 1];
+          GC_LIST_TRUNCATE(freeSlots, GC_LIST_COUNT(freeSlots) - 1);
+        } else {
+          parentSlot = GC_LIST_COUNT(pool) / wordCount;
+          for (NSUInteger j = 0; j < wordCount; ++j) {
+            uint64_t zero = 0;
+            GC_LIST_APPEND(pool, &zero);
+          }
+          bits = BITSET(slot);  // Pool might have been reallocated
+        }
+        memcpy(BITSET(parentSlot), bits, bitsetSize);
+        slots[parentID] = parentSlot;
+        _flags[parentID] = kFlag_Queued;
+        GC_LIST_APPEND(touched, &parentID);
+        _HeapPush(_levels, &heap, parentID);
+        if (!_IsSettled(bits, sources1, sources2, pairCount)) {
+          pending += 1;
+        }
+      } else {
+        uint64_t* parentBits = BITSET(slots[parentID]);
+        BOOL wasSettled = _IsSettled(parentBits, sources1, sources2, pairCount);
+        for (NSUInteger j = 0; j < wordCount; ++j) {
+          parentBits[j] |= bits[j];
+        }
+        BOOL isSettled = _IsSettled(parentBits, sources1, sources2, pairCount);
+        if (wasSettled && !isSettled) {
+          pending += 1;
+        } else if (!wasSettled && isSettled) {
+          pending -= 1;
+        }
+      }
+    }
+    bzero(BITSET(slot), bitsetSize);
+    GC_LIST_APPEND(freeSlots, &slot);
+  }
+
+#undef BITSET
+
+  for (size_t i = 0; i < GC_LIST_COUNT(touched); ++i) {
+    _flags[((NSUInteger*)touched.items)[i]] = 0;
+  }
+  GC_LIST_FREE(touched);
+  free(slots);
+  GC_LIST_FREE(heap);
+  GC_LIST_FREE(freeSlots);
+  GC_LIST_FREE(pool);
+  GC_LIST_FREE(sourceIDs);
+  free(sources2);
+  free(sources1);
+}
+
+- (void)countAheadCommits:(NSUInteger*)ahead behindCommits:(NSUInteger*)behind forLocalBranch:(GCHistoryLocalBranch*)branch {
+  if (_branchCountsGeneration != _nextGeneration) {
+    free(_branchCounts);
+    NSUInteger count = _localBranches.count;
+    _branchCounts = malloc(MAX(2 * count, 1) * sizeof(NSUInteger));
+    NSMutableArray* commits = [[NSMutableArray alloc] init];
+    NSMutableArray* otherCommits = [[NSMutableArray alloc] init];
+    for (NSUInteger i = 0; i < count; ++i) {
+      GCHistoryLocalBranch* localBranch = _localBranches[i];
+      GCHistoryCommit* tipCommit = localBranch.tipCommit;
+      GCHistoryCommit* upstreamTipCommit = [(GCHistoryLocalBranch*)localBranch.upstream tipCommit];  // Upstream can also be a GCHistoryRemoteBranch
+      if (tipCommit && upstreamTipCommit) {
+        [commits addObject:tipCommit];
+        [otherCommits addObject:upstreamTipCommit];
+      }
+    }
+    NSUInteger* counts = malloc(MAX(2 * commits.count, 1) * sizeof(NSUInteger));
+    [self countAheadCommits:counts behindCommits:(counts + commits.count) ofCommits:commits relativeToCommits:otherCommits];
+    for (NSUInteger i = 0, j = 0; i < count; ++i) {
+      GCHistoryLocalBranch* localBranch = _localBranches[i];
+      if (localBranch.tipCommit && [(GCHistoryLocalBranch*)localBranch.upstream tipCommit]) {
+        _branchCounts[2 * i] = counts[j];
+        _branchCounts[2 * i + 1] = counts[commits.count + j];
+        ++j;
+      } else {
+        _branchCounts[2 * i] = NSNotFound;
+        _branchCounts[2 * i + 1] = NSNotFound;
+      }
+    }
+    free(counts);
+    [otherCommits release];
+    [commits release];
+    _branchCountsGeneration = _nextGeneration;
+  }
+
+  NSUInteger index = [_localBranches indexOfObjectIdenticalTo:branch];
+  if (index != NSNotFound) {
+    *ahead = _branchCounts[2 * index];
+    *behind = _branchCounts[2 * index + 1];
+  } else {
+    XLOG_DEBUG_UNREACHABLE();
+    *ahead = NSNotFound;
+    *behind = NSNotFound;
+  }
+}
+
+- (NSUInteger)countAncestorCommitsFromCommit:(GCHistoryCommit*)fromCommit toCommit:(GCHistoryCommit*)toCommit {
+  if (![fromCommit isEqualToCommit:toCommit]) {
+    NSUInteger ahead;
+    NSUInteger behind;
+    [self countAheadCommits:&ahead behindCommits:&behind ofCommit:fromCommit relativeToCommit:toCommit];
+    return ahead;
   }
   XLOG_DEBUG_UNREACHABLE();
   return 0;
 }
 
+#pragma mark - Misc
+
 - (NSString*)description {
   return [NSString stringWithFormat:@"[%@] %lu commits\n HEAD Commit: %@\nHEAD Branch: %@\nRoots: %@\nLeafs:\n%@", self.class, (unsigned long)_commits.count, _HEADCommit, _HEADBranch, _roots, _leaves];
 }
@@ -464,9 +1669,9 @@ static const void* _associatedObjectUpstreamNameKey = &_associatedObjectUpstream
       BOOL ready = YES;
 
       // Check if this commit is "ready" i.e. all its children (respectively parents) have been processed (but not on the current iteration)
-      CFArrayRef relations = _followParents ? commit->_children : commit->_parents;
-      for (CFIndex j = 0, jMax = CFArrayGetCount(relations); j < jMax; ++j) {
-        GCHistoryCommit* relation = CFArrayGetValueAtIndex(relations, j);
+      const NSUInteger* relations;
+      for (NSUInteger j = 0, jMax = _RelationIDs(_history, commit->_autoIncrementID, !_followParents, &relations); j < jMax; ++j) {
+        GCHistoryCommit* relation = _history->_table[relations[j]];
         ready = COMMIT_IS_PROCESSED(relation) && !COMMIT_WAS_JUST_PROCESSED(relation);
         if (!ready) {
           break;
@@ -495,9 +1700,9 @@ static const void* _associatedObjectUpstreamNameKey = &_associatedObjectUpstream
       // If commit was processed, attempt to process its parents (respectively children)
       if (COMMIT_IS_PROCESSED(previousCommit)) {
         if (!COMMIT_WAS_JUST_PROCESSED(previousCommit)) {
-          CFArrayRef relations = _followParents ? previousCommit->_parents : previousCommit->_children;
-          for (CFIndex i = 0, iMax = CFArrayGetCount(relations); i < iMax; ++i) {
-            GCHistoryCommit* relation = CFArrayGetValueAtIndex(relations, i);
+          const NSUInteger* relations;
+          for (NSUInteger i = 0, iMax = _RelationIDs(_history, previousCommit->_autoIncrementID, _followParents, &relations); i < iMax; ++i) {
+            GCHistoryCommit* relation = _history->_table[relations[i]];
             if (!COMMIT_WAS_JUST_PROCESSED(relation) && !COMMIT_WAS_JUST_SKIPPED(relation)) {
               XLOG_DEBUG_CHECK(!GC_POINTER_LIST_CONTAINS(row, relation));
               if (!commitBlock(relation)) {
@@ -535,7 +1740,7 @@ static const void* _associatedObjectUpstreamNameKey = &_associatedObjectUpstream
       // Find newest (respectively oldest) skipped commit(s)
       git_time_t boundaryTime = _followParents ? LONG_LONG_MIN : LONG_LONG_MAX;
       GC_POINTER_LIST_FOR_LOOP(row, GCHistoryCommit*, timeCommit) {
-        git_time_t time = git_commit_time(timeCommit.private);
+        git_time_t time = _history->_times[timeCommit->_autoIncrementID];
         if (time == boundaryTime) {
           GC_POINTER_LIST_APPEND(candidates, timeCommit);
         } else if ((_followParents && (time > boundaryTime)) || (!_followParents && (time < boundaryTime))) {
@@ -552,9 +1757,14 @@ static const void* _associatedObjectUpstreamNameKey = &_associatedObjectUpstream
           BOOL isParent = NO;
           GC_POINTER_LIST_FOR_LOOP(candidates, GCHistoryCommit*, candidate2) {
             if (candidate2 != candidate1) {
-              CFArrayRef relations = _followParents ? candidate2->_parents : candidate2->_children;
-              if (CFArrayContainsValue(relations, CFRangeMake(0, CFArrayGetCount(relations)), candidate1)) {
-                isParent = YES;
+              const NSUInteger* relations;
+              for (NSUInteger i = 0, iMax = _RelationIDs(_history, candidate2->_autoIncrementID, _followParents, &relations); i < iMax; ++i) {
+                if (relations[i] == candidate1->_autoIncrementID) {
+                  isParent = YES;
+                  break;
+                }
+              }
+              if (isParent) {
                 break;
               }
             }
@@ -629,15 +1839,87 @@ static const void* _associatedObjectUpstreamNameKey = &_associatedObjectUpstream
   while ([walker iterateWithCommitBlock:block]) {
     ;
   }
-  [walker release];
+  [walker release];
+}
+
+- (GCHistoryWalker*)walkerForAncestorsOfCommits:(NSArray*)commits {
+  return [[[GCHistoryWalker alloc] initWithHistory:self commits:commits followParents:YES entireHistory:NO] autorelease];
+}
+
+- (GCHistoryWalker*)walkerForDescendantsOfCommits:(NSArray*)commits {
+  return [[[GCHistoryWalker alloc] initWithHistory:self commits:commits followParents:NO entireHistory:NO] autorelease];
+}
+
+@end
+
+@implementation GCHistoryPrefetch {
+  GCItemList _oids;
+  GCItemList _times;
+  GCItemList _offsets;  // Offset in "_parents" list for each commit plus a final end offset
+  GCItemList _parents;
+  CFMutableDictionaryRef _lookup;  // Maps OIDs to their index + 1
+}
+
+- (instancetype)init {
+  if ((self = [super init])) {
+    GC_LIST_INITIALIZE(_oids, 1024, git_oid);
+    GC_LIST_INITIALIZE(_times, 1024, git_time_t);
+    GC_LIST_INITIALIZE(_offsets, 1024, size_t);
+    GC_LIST_INITIALIZE(_parents, 1024, git_oid);
+  }
+  return self;
+}
+
+- (void)dealloc {
+  if (_lookup) {
+    CFRelease(_lookup);
+  }
+  GC_LIST_FREE(_parents);
+  GC_LIST_FREE(_offsets);
+  GC_LIST_FREE(_times);
+  GC_LIST_FREE(_oids);
+
+  [super dealloc];
+}
+
+- (NSUInteger)count {
+  return GC_LIST_COUNT(_oids);
+}
+
+- (void)_addCommit:(git_commit*)commit {
+  size_t offset = GC_LIST_COUNT(_parents);
+  git_time_t time = git_commit_time(commit);
+  GC_LIST_APPEND(_oids, git_commit_id(commit));
+  GC_LIST_APPEND(_times, &time);
+  GC_LIST_APPEND(_offsets, &offset);
+  for (unsigned int i = 0, count = git_commit_parentcount(commit); i < count; ++i) {
+    GC_LIST_APPEND(_parents, git_commit_parent_id(commit, i));
+  }
 }
 
-- (GCHistoryWalker*)walkerForAncestorsOfCommits:(NSArray*)commits {
-  return [[[GCHistoryWalker alloc] initWithHistory:self commits:commits followParents:YES entireHistory:NO] autorelease];
+// Must be called once all commits have been added since the keys point inside the "_oids" list
+- (void)_buildLookup {
+  size_t offset = GC_LIST_COUNT(_parents);
+  GC_LIST_APPEND(_offsets, &offset);
+  CFDictionaryKeyCallBacks callbacks = {0, NULL, NULL, NULL, GCOIDEqualCallBack, GCOIDHashCallBack};
+  _lookup = CFDictionaryCreateMutable(kCFAllocatorDefault, GC_LIST_COUNT(_oids), &callbacks, NULL);
+  for (NSUInteger i = 0, count = GC_LIST_COUNT(_oids); i < count; ++i) {
+    CFDictionarySetValue(_lookup, GC_LIST_ITEM_POINTER(_oids, i), (const void*)(i + 1));
+  }
 }
 
-- (GCHistoryWalker*)walkerForDescendantsOfCommits:(NSArray*)commits {
-  return [[[GCHistoryWalker alloc] initWithHistory:self commits:commits followParents:NO entireHistory:NO] autorelease];
+- (BOOL)findOID:(const git_oid*)oid time:(git_time_t*)time parentOIDs:(const git_oid**)parentOIDs parentCount:(NSUInteger*)parentCount {
+  NSUInteger index = (NSUInteger)CFDictionaryGetValue(_lookup, oid);
+  if (index == 0) {
+    return NO;
+  }
+  index -= 1;
+  size_t start = *(size_t*)GC_LIST_ITEM_POINTER(_offsets, index);
+  size_t end = *(size_t*)GC_LIST_ITEM_POINTER(_offsets, index + 1);
+  *time = *(git_time_t*)GC_LIST_ITEM_POINTER(_times, index);
+  *parentOIDs = end > start ? GC_LIST_ITEM_POINTER(_parents, start) : NULL;
+  *parentCount = end - start;
+  return YES;
 }
 
 @end
@@ -646,48 +1928,316 @@ static const void* _associatedObjectUpstreamNameKey = &_associatedObjectUpstream
 
 #pragma mark - Repository
 
-- (void)_walkAncestorsFromCommit:(GCHistoryCommit*)commit usingBlock:(BOOL (^)(GCHistoryCommit* commit, GCHistoryCommit* childCommit))block {
-  GC_POINTER_LIST_ALLOCATE(parentsCommits, 32);
-  GC_POINTER_LIST_ALLOCATE(childrenCommits, 32);
-  GC_POINTER_LIST_APPEND(parentsCommits, commit);
-  GC_POINTER_LIST_APPEND(childrenCommits, NULL);
-  while (1) {
-    size_t count = GC_POINTER_LIST_COUNT(parentsCommits);
-    XLOG_DEBUG_CHECK(GC_POINTER_LIST_COUNT(childrenCommits) == count);
-    if (count == 0) {
-      break;
+static void _WalkAncestors(GCHistory* history, NSUInteger commitID, BOOL (^block)(NSUInteger commitID)) {
+  GCItemList stack;
+  GC_LIST_INITIALIZE(stack, 32, NSUInteger);
+  GC_LIST_APPEND(stack, &commitID);
+  while (GC_LIST_COUNT(stack)) {
+    NSUInteger currentID = ((NSUInteger*)stack.items)[GC_LIST_COUNT(stack) - 1];
+    GC_LIST_TRUNCATE(stack, GC_LIST_COUNT(stack) - 1);
+    if (block(currentID)) {
+      const NSUInteger* parentIDs;
+      for (NSUInteger i = _ParentIDs(history, currentID, &parentIDs); i > 0; --i) {  // Visit first parents first
+        GC_LIST_APPEND(stack, &parentIDs[i - 1]);
+      }
     }
-    GCHistoryCommit* parentCommit = GC_POINTER_LIST_POP(parentsCommits);
-    GCHistoryCommit* childCommit = GC_POINTER_LIST_POP(childrenCommits);
-    while (1) {
-      if (!block(parentCommit, childCommit)) {
-        break;
+  }
+  GC_LIST_FREE(stack);
+}
+
+// When using the commit-graph or a prefetch, this is equivalent to walking with git_revwalk and hiding commits already in the history but avoids loading the commits they contain
+- (BOOL)_generateCommits:(NSMutableArray*)commits
+                 fromTips:(NSArray*)tips
+               forHistory:(GCHistory*)history
+            usingPrefetch:(GCHistoryPrefetch*)prefetch
+         usingCommitGraph:(GCCommitGraph*)graph
+      nextAutoIncrementID:(NSUInteger*)nextAutoIncrementID
+                    error:(NSError**)error {
+  XLOG_DEBUG_CHECK(commits.count == 0);
+  BOOL success = NO;
+  CFMutableDictionaryRef lookup = history.lookup;
+  git_revwalk* walker = NULL;
+  uint32_t positions[kMaxCommitGraphParents];
+  GCItemList stack;
+  GCItemList parents;
+  GCItemList offsets;
+  GC_LIST_INITIALIZE(stack, 256, git_oid);
+  GC_LIST_INITIALIZE(parents, 4096, git_oid);  // Parents of each generated commit in order
+  GC_LIST_INITIALIZE(offsets, 4096, size_t);  // Offset in "parents" list for each generated commit
+
+  if (graph || prefetch) {
+    for (GCCommit* tip in tips) {
+      GC_LIST_APPEND(stack, git_commit_id(tip.private));
+    }
+    while (GC_LIST_COUNT(stack)) {
+      git_oid oid = *(git_oid*)GC_LIST_ITEM_POINTER(stack, GC_LIST_COUNT(stack) - 1);
+      GC_LIST_TRUNCATE(stack, GC_LIST_COUNT(stack) - 1);
+      if (CFDictionaryContainsKey(lookup, &oid)) {
+        continue;
       }
-      CFArrayRef grandParents = parentCommit->_parents;
-      CFIndex grandCount = CFArrayGetCount(grandParents);
-      if (grandCount) {
-        childCommit = parentCommit;
-        parentCommit = CFArrayGetValueAtIndex(grandParents, 0);
-        for (CFIndex i = 1; i < grandCount; ++i) {
-          GC_POINTER_LIST_APPEND(parentsCommits, (GCHistoryCommit*)CFArrayGetValueAtIndex(grandParents, i));
-          GC_POINTER_LIST_APPEND(childrenCommits, childCommit);
+
+      GCHistoryCommit* commit;
+      git_time_t time;
+      size_t offset = GC_LIST_COUNT(parents);
+      uint32_t position;
+      NSUInteger count;
+      const git_oid* prefetchParents;
+      if ([prefetch findOID:&oid time:&time parentOIDs:&prefetchParents parentCount:&count]) {
+        commit = [[GCHistoryCommit alloc] initWithRepository:self OID:&oid autoIncrementID:(*nextAutoIncrementID)++];
+        for (NSUInteger i = 0; i < count; ++i) {
+          GC_LIST_APPEND(parents, &prefetchParents[i]);
+        }
+      } else if (graph && [graph findOID:&oid position:&position] && [graph getParentPositions:positions count:&count maximum:kMaxCommitGraphParents atPosition:position]) {
+        commit = [[GCHistoryCommit alloc] initWithRepository:self OID:&oid autoIncrementID:(*nextAutoIncrementID)++];
+        time = [graph timeAtPosition:position];
+        for (NSUInteger i = 0; i < count; ++i) {
+          GC_LIST_APPEND(parents, [graph OIDAtPosition:positions[i]]);
         }
       } else {
+        git_commit* walkCommit;
+        CALL_LIBGIT2_FUNCTION_GOTO(cleanup, git_commit_lookup, &walkCommit, self.private, &oid);
+        commit = [[GCHistoryCommit alloc] initWithRepository:self commit:walkCommit autoIncrementID:(*nextAutoIncrementID)++];
+        time = git_commit_time(walkCommit);
+        for (unsigned int i = 0, parentCount = git_commit_parentcount(walkCommit); i < parentCount; ++i) {
+          GC_LIST_APPEND(parents, git_commit_parent_id(walkCommit, i));
+        }
+      }
+      [commits addObject:commit];
+      [commit release];
+      [history _addCommit:commit time:time];
+      CFDictionarySetValue(lookup, &commit->_oid, (const void*)commit);  // Use the git_oid stored in the commit itself as the key, so no need to copy it
+      GC_LIST_APPEND(offsets, &offset);
+
+      // Visit first parents first
+      for (size_t i = GC_LIST_COUNT(parents); i > offset; --i) {
+        const git_oid* parentOID = GC_LIST_ITEM_POINTER(parents, i - 1);
+        if (!CFDictionaryContainsKey(lookup, parentOID)) {
+          GC_LIST_APPEND(stack, parentOID);
+        }
+      }
+    }
+  } else {
+    CALL_LIBGIT2_FUNCTION_GOTO(cleanup, git_revwalk_new, &walker, self.private);
+    git_revwalk_sorting(walker, GIT_SORT_NONE);
+    git_revwalk_add_hide_block(walker, ^int(const git_oid* commit_id) {
+      return CFDictionaryContainsKey(lookup, commit_id);
+    });
+    for (GCCommit* tip in tips) {
+      CALL_LIBGIT2_FUNCTION_GOTO(cleanup, git_revwalk_push, walker, git_commit_id(tip.private));
+    }
+    while (1) {
+      git_oid oid;
+      int status = git_revwalk_next(&oid, walker);
+      if (status == GIT_ITEROVER) {
+        break;
+      }
+      CHECK_LIBGIT2_FUNCTION_CALL(goto cleanup, status, == GIT_OK);
+      git_commit* walkCommit;
+      CALL_LIBGIT2_FUNCTION_GOTO(cleanup, git_commit_lookup, &walkCommit, self.private, &oid);
+      GCHistoryCommit* commit = [[GCHistoryCommit alloc] initWithRepository:self commit:walkCommit autoIncrementID:(*nextAutoIncrementID)++];
+      size_t offset = GC_LIST_COUNT(parents);
+      for (unsigned int i = 0, count = git_commit_parentcount(walkCommit); i < count; ++i) {
+        GC_LIST_APPEND(parents, git_commit_parent_id(walkCommit, i));
+      }
+      [commits addObject:commit];
+      [commit release];
+      [history _addCommit:commit time:git_commit_time(walkCommit)];
+      CFDictionarySetValue(lookup, &commit->_oid, (const void*)commit);  // Use the git_oid stored in the commit itself as the key, so no need to copy it
+      GC_LIST_APPEND(offsets, &offset);
+    }
+  }
+
+  // Add parent relations to commits (child relations are computed once the history is updated)
+  [history _addParentsForCommits:commits parentOIDs:&parents parentTimes:NULL parentGenerations:NULL offsets:&offsets];
+  success = YES;
+
+cleanup:
+  git_revwalk_free(walker);
+  GC_LIST_FREE(offsets);
+  GC_LIST_FREE(parents);
+  GC_LIST_FREE(stack);
+  return success;
+}
+
+typedef struct {
+  git_oid oid;
+  git_time_t time;
+} GCHistoryPendingCommit;
+
+static void _PendingHeapPush(GCItemList* heap, const git_oid* oid, git_time_t time) {
+  GCHistoryPendingCommit pending = {*oid, time};
+  __GCItemListAppend(heap, &pending);
+  GCHistoryPendingCommit* items = heap->items;
+  for (size_t i = heap->count - 1; i > 0;) {
+    size_t parent = (i - 1) / 2;
+    if (items[i].time <= items[parent].time) {
+      break;
+    }
+    GCHistoryPendingCommit temp = items[i];
+    items[i] = items[parent];
+    items[parent] = temp;
+    i = parent;
+  }
+}
+
+static GCHistoryPendingCommit _PendingHeapPop(GCItemList* heap) {
+  GCHistoryPendingCommit* items = heap->items;
+  GCHistoryPendingCommit top = items[0];
+  heap->count -= 1;
+  items[0] = items[heap->count];
+  for (size_t i = 0;;) {
+    size_t left = 2 * i + 1;
+    size_t right = left + 1;
+    size_t newest = i;
+    if ((left < heap->count) && (items[left].time > items[newest].time)) {
+      newest = left;
+    }
+    if ((right < heap->count) && (items[right].time > items[newest].time)) {
+      newest = right;
+    }
+    if (newest == i) {
+      break;
+    }
+    GCHistoryPendingCommit temp = items[i];
+    items[i] = items[newest];
+    items[newest] = temp;
+    i = newest;
+  }
+  return top;
+}
+
+// Generates commits newest first by committer time from "tips" (which are always generated) and from the parents outside the window of the history
+// The walk stops once "maximumCount" commits have been generated or once all remaining commits are older than "horizon" which is then updated to the newest one of them
+- (BOOL)_generateWindowedCommits:(NSMutableArray*)commits
+                        fromTips:(NSArray*)tips
+                      forHistory:(GCHistory*)history
+                usingCommitGraph:(GCCommitGraph*)graph
+             nextAutoIncrementID:(NSUInteger*)nextAutoIncrementID
+                    maximumCount:(NSUInteger)maximumCount
+                         horizon:(git_time_t*)horizon
+                           error:(NSError**)error {
+  XLOG_DEBUG_CHECK(commits.count == 0);
+  BOOL success = NO;
+  CFMutableDictionaryRef lookup = history.lookup;
+  uint32_t positions[kMaxCommitGraphParents];
+  NSUInteger tipIndex = 0;
+  git_time_t oldestTime = *horizon;
+  GCItemList heap;
+  GCItemList parents;
+  GCItemList parentTimes;
+  GCItemList parentGenerations;
+  GCItemList offsets;
+  GCItemList missingOIDs;
+  GC_LIST_INITIALIZE(heap, 256, GCHistoryPendingCommit);
+  GC_LIST_INITIALIZE(parents, 4096, git_oid);  // Parents of each generated commit in order
+  GC_LIST_INITIALIZE(parentTimes, 4096, git_time_t);  // Committer time of each parent in "parents"
+  GC_LIST_INITIALIZE(parentGenerations, 4096, NSUInteger);  // Commit-graph generation of each parent in "parents" or 0 if unknown
+  GC_LIST_INITIALIZE(offsets, 4096, size_t);  // Offset in "parents" list for each generated commit
+  GC_LIST_INITIALIZE(missingOIDs, 16, git_oid);  // Parents outside the window missing from the Git database
+
+  const GCHistoryBoundaryParent* boundaryParents = history->_boundaryParents.items;
+  for (size_t i = 0, count = GC_LIST_COUNT(history->_boundaryParents); i < count; ++i) {
+    if (!CFDictionaryContainsKey(lookup, &boundaryParents[i].oid)) {
+      _PendingHeapPush(&heap, &boundaryParents[i].oid, boundaryParents[i].time);
+    }
+  }
+  while (1) {
+    git_oid oid;
+    BOOL isTip = tipIndex < tips.count;
+    if (isTip) {
+      git_oid_cpy(&oid, git_commit_id(((GCCommit*)tips[tipIndex++]).private));
+    } else {
+      if (!GC_LIST_COUNT(heap) || (commits.count >= maximumCount) || (((GCHistoryPendingCommit*)heap.items)[0].time < *horizon)) {
         break;
       }
+      oid = _PendingHeapPop(&heap).oid;
+    }
+    if (CFDictionaryContainsKey(lookup, &oid)) {
+      continue;
+    }
+
+    GCHistoryCommit* commit;
+    git_time_t time;
+    size_t offset = GC_LIST_COUNT(parents);
+    uint32_t position;
+    NSUInteger count;
+    if ([graph findOID:&oid position:&position] && [graph getParentPositions:positions count:&count maximum:kMaxCommitGraphParents atPosition:position]) {
+      commit = [[GCHistoryCommit alloc] initWithRepository:self OID:&oid autoIncrementID:(*nextAutoIncrementID)++];
+      time = [graph timeAtPosition:position];
+      for (NSUInteger i = 0; i < count; ++i) {
+        git_time_t parentTime = [graph timeAtPosition:positions[i]];
+        NSUInteger parentGeneration = [graph generationAtPosition:positions[i]];
+        GC_LIST_APPEND(parents, [graph OIDAtPosition:positions[i]]);
+        GC_LIST_APPEND(parentTimes, &parentTime);
+        GC_LIST_APPEND(parentGenerations, &parentGeneration);
+      }
+    } else {
+      git_commit* walkCommit;
+      int status = git_commit_lookup(&walkCommit, self.private, &oid);
+      if ((status == GIT_ENOTFOUND) && !isTip) {
+        GC_LIST_APPEND(missingOIDs, &oid);
+        continue;
+      }
+      CHECK_LIBGIT2_FUNCTION_CALL(goto cleanup, status, == GIT_OK);
+      commit = [[GCHistoryCommit alloc] initWithRepository:self commit:walkCommit autoIncrementID:(*nextAutoIncrementID)++];
+      time = git_commit_time(walkCommit);
+      for (unsigned int i = 0, parentCount = git_commit_parentcount(walkCommit); i < parentCount; ++i) {
+        const git_oid* parentOID = git_commit_parent_id(walkCommit, i);
+        GCHistoryCommit* parent = (GCHistoryCommit*)CFDictionaryGetValue(lookup, parentOID);
+        git_time_t parentTime = parent ? history->_times[parent->_autoIncrementID] : time;  // Parents are almost always older so use the commit time instead of looking them up only to queue them
+        NSUInteger parentGeneration = 0;
+        GC_LIST_APPEND(parents, parentOID);
+        GC_LIST_APPEND(parentTimes, &parentTime);
+        GC_LIST_APPEND(parentGenerations, &parentGeneration);
+      }
     }
+    [commits addObject:commit];
+    [commit release];
+    [history _addCommit:commit time:time];
+    CFDictionarySetValue(lookup, &commit->_oid, (const void*)commit);  // Use the git_oid stored in the commit itself as the key, so no need to copy it
+    GC_LIST_APPEND(offsets, &offset);
+    if (!isTip) {
+      oldestTime = MIN(oldestTime, time);
+    }
+
+    for (size_t i = offset; i < GC_LIST_COUNT(parents); ++i) {
+      const git_oid* parentOID = GC_LIST_ITEM_POINTER(parents, i);
+      if (!CFDictionaryContainsKey(lookup, parentOID)) {
+        _PendingHeapPush(&heap, parentOID, ((git_time_t*)parentTimes.items)[i]);
+      }
+    }
+  }
+
+  // Add parent relations to commits and record the ones outside the window
+  [history _addParentsForCommits:commits parentOIDs:&parents parentTimes:&parentTimes parentGenerations:&parentGenerations offsets:&offsets];
+  [history _forgetBoundaryParents:&missingOIDs];
+
+  // Move the horizon to the newest commit left outside the window
+  while (GC_LIST_COUNT(heap) && CFDictionaryContainsKey(lookup, &((GCHistoryPendingCommit*)heap.items)[0].oid)) {
+    _PendingHeapPop(&heap);
   }
-  GC_POINTER_LIST_FREE(parentsCommits);
-  GC_POINTER_LIST_FREE(childrenCommits);
+  *horizon = GC_LIST_COUNT(heap) ? ((GCHistoryPendingCommit*)heap.items)[0].time + 1 : oldestTime;
+  success = YES;
+
+cleanup:
+  GC_LIST_FREE(missingOIDs);
+  GC_LIST_FREE(offsets);
+  GC_LIST_FREE(parentGenerations);
+  GC_LIST_FREE(parentTimes);
+  GC_LIST_FREE(parents);
+  GC_LIST_FREE(heap);
+  return success;
 }
 
 - (BOOL)_reloadHistory:(GCHistory*)history
           usingSnapshot:(GCSnapshot*)snapshot
+               prefetch:(GCHistoryPrefetch*)prefetch
+         useCommitGraph:(BOOL)useCommitGraph
     referencesDidChange:(BOOL*)outReferencesDidChange
            addedCommits:(NSArray**)outAddedCommits
          removedCommits:(NSArray**)outRemovedCommits
                   error:(NSError**)error {
-  XLOG_DEBUG_CHECK([NSThread isMainThread]);  // This could work from any thread but it really shouldn't happen in practice
+  // Histories can be reloaded from any thread as long as it has exclusive access to both the history and the repository
   BOOL success = NO;
   NSUInteger nextAutoIncrementID = history.nextAutoIncrementID;
   NSUInteger generation = history.nextGeneration;
@@ -699,7 +2249,8 @@ static const void* _associatedObjectUpstreamNameKey = &_associatedObjectUpstream
   NSMutableArray* tags = [[NSMutableArray alloc] init];
   NSMutableArray* localBranches = [[NSMutableArray alloc] init];
   NSMutableArray* remoteBranches = [[NSMutableArray alloc] init];
-  git_revwalk* walker = NULL;
+  GCCommitGraph* graph = nil;
+  NSMutableArray* walkTips = nil;
   CFMutableDictionaryRef lookup = history.lookup;
   NSMutableArray* commits = historyTips ? [NSMutableArray array] : history.commits;
   NSMutableArray* roots = history.roots;
@@ -903,53 +2454,25 @@ static const void* _associatedObjectUpstreamNameKey = &_associatedObjectUpstream
     goto cleanup;
   }
 
-  // Configure commit tree walker to start from tips
-  CALL_LIBGIT2_FUNCTION_GOTO(cleanup, git_revwalk_new, &walker, self.private);
-  git_revwalk_sorting(walker, GIT_SORT_NONE);
-  git_revwalk_add_hide_block(walker, ^int(const git_oid* commit_id) {
-    return CFDictionaryContainsKey(lookup, commit_id);
-  });
-  if (historyTips) {
-    for (GCCommit* tip in tips) {
-      if (![historyTips containsObject:tip]) {
-        const git_oid* oid = git_commit_id(tip.private);
-        if (!CFDictionaryContainsKey(lookup, oid)) {
-          CALL_LIBGIT2_FUNCTION_GOTO(cleanup, git_revwalk_push, walker, oid);
-        }
-      }
-    }
-  } else {
-    for (GCCommit* tip in tips) {
-      CALL_LIBGIT2_FUNCTION_GOTO(cleanup, git_revwalk_push, walker, git_commit_id(tip.private));
+  // Find tips to walk from
+  walkTips = [[NSMutableArray alloc] init];
+  for (GCCommit* tip in tips) {
+    if (!historyTips || (![historyTips containsObject:tip] && !CFDictionaryContainsKey(lookup, git_commit_id(tip.private)))) {
+      [walkTips addObject:tip];
     }
   }
 
-  // Generate commits by walking commit tree
-  while (1) {
-    git_oid oid;
-    int status = git_revwalk_next(&oid, walker);
-    if (status == GIT_ITEROVER) {
-      break;
+  // Generate commits using the commit-graph if available or otherwise by walking the commit tree
+  graph = useCommitGraph ? [[GCCommitGraph alloc] initWithRepository:self] : nil;
+  if (history->_windowed) {
+    git_time_t horizon = history->_horizon;
+    if (![self _generateWindowedCommits:commits fromTips:walkTips forHistory:history usingCommitGraph:graph nextAutoIncrementID:&nextAutoIncrementID maximumCount:(historyTips ? NSUIntegerMax : history->_windowSize) horizon:&horizon error:error]) {
+      goto cleanup;
     }
-    CHECK_LIBGIT2_FUNCTION_CALL(goto cleanup, status, == GIT_OK);
-    git_commit* walkCommit;
-    CALL_LIBGIT2_FUNCTION_GOTO(cleanup, git_commit_lookup, &walkCommit, self.private, &oid);
-    GCHistoryCommit* commit = [[GCHistoryCommit alloc] initWithRepository:self commit:walkCommit autoIncrementID:nextAutoIncrementID++];
-    [commits addObject:commit];
-    [commit release];
-    CFDictionarySetValue(lookup, git_commit_id(walkCommit), (const void*)commit);  // Use the git_oid stored in the object itself (and retained by GCHistoryCommit) as the key, so no need to copy it
-  }
-
-  // Add parent / child relations to commits
-  for (GCHistoryCommit* commit in commits) {
-    git_commit* walkCommit = commit.private;
-    for (unsigned int i = 0, count = git_commit_parentcount(walkCommit); i < count; ++i) {
-      const git_oid* parentOID = git_commit_parent_id(walkCommit, i);
-      GCHistoryCommit* parent = (GCHistoryCommit*)CFDictionaryGetValue(lookup, parentOID);
-      if (parent) {  // We can't distinguish between a commit missing from the Git database and one that was hidden explicitly
-        [commit addParent:parent];
-        [parent addChild:commit];  // TODO: Find a way to make this ordering deterministic
-      }
+    history->_horizon = historyTips ? MIN(history->_horizon, horizon) : horizon;
+  } else {
+    if (![self _generateCommits:commits fromTips:walkTips forHistory:history usingPrefetch:prefetch usingCommitGraph:graph nextAutoIncrementID:&nextAutoIncrementID error:error]) {
+      goto cleanup;
     }
   }
 
@@ -975,55 +2498,65 @@ static const void* _associatedObjectUpstreamNameKey = &_associatedObjectUpstream
 
   // Find and remove orphan commits from old history
   if (historyTips) {
+    NSUInteger* generations = history->_generations;
+    GCHistoryCommit** table = history->_table;
+
     // Update generation for all commits reachable from new tips
     for (GCCommit* tip in tips) {
       GCHistoryCommit* tipCommit = (GCHistoryCommit*)CFDictionaryGetValue(lookup, git_commit_id(tip.private));
       XLOG_DEBUG_CHECK(tipCommit);
-      [self _walkAncestorsFromCommit:tipCommit
-                          usingBlock:^BOOL(GCHistoryCommit* commit, GCHistoryCommit* previousCommit) {
-                            if (commit->generation == generation) {
-                              return NO;
-                            }
-                            commit->generation = generation;
-                            return YES;
-                          }];
+      _WalkAncestors(history, tipCommit->_autoIncrementID, ^BOOL(NSUInteger commitID) {
+        if (generations[commitID] == generation) {
+          return NO;
+        }
+        generations[commitID] = generation;
+        return YES;
+      });
     }
 
     // Scan all commits reachable from old tips and check if still reachable from new tips
-    removedCommits = [[NSMutableArray alloc] init];  // Make sure to retain removed commits as they can be accessed several times through the scan
+    removedCommits = [[NSMutableArray alloc] init];  // Make sure to retain removed commits as they are detached from the history
     for (GCCommit* tip in historyTips) {
-      GCHistoryCommit* tipCommit = (GCHistoryCommit*)CFDictionaryGetValue(lookup, git_commit_id(tip.private));
+      GCHistoryCommit* tipCommit = (GCHistoryCommit*)CFDictionaryGetValue(lookup, tip.OID);  // Tips loaded from the cache don't have their git_commit loaded
       if (tipCommit == nil) {
         continue;  // Commit might have already been removed
       }
-      [self _walkAncestorsFromCommit:tipCommit
-                          usingBlock:^BOOL(GCHistoryCommit* commit, GCHistoryCommit* childCommit) {
-                            if (commit->generation == generation) {
-                              if (childCommit) {
-                                [childCommit removeParent:commit];
-                                [commit removeChild:childCommit];
-                              }
-                              return NO;
-                            }
-                            if (CFDictionaryContainsKey(lookup, git_commit_id(commit.private))) {  // Using -indexOfObjectIdenticalTo: on a large array can be quite slow so make sure the commit is in there first
-                              NSUInteger index = [commits indexOfObjectIdenticalTo:commit];  // Pointer comparison is enough here, no need for -isEqual
-                              if (index != NSNotFound) {
-                                [removedCommits addObject:commit];
-                                CFDictionaryRemoveValue(lookup, git_commit_id(commit.private));
-                                [commits removeObjectAtIndex:index];  // Should be a bit faster than calling -removeObjectIdenticalTo: since it will stop on the first (and unique) match
-                                XLOG_DEBUG_CHECK(![commits containsObject:commit]);
-                              } else {
-                                XLOG_DEBUG_UNREACHABLE();
-                              }
-                            }
-                            return YES;
-                          }];
-    }
-  }
-
-  // Sort commits
+      _WalkAncestors(history, tipCommit->_autoIncrementID, ^BOOL(NSUInteger commitID) {
+        GCHistoryCommit* commit = table[commitID];
+        if ((commit == nil) || (generations[commitID] == generation)) {  // Commit was already removed or is still reachable
+          return NO;
+        }
+        [removedCommits addObject:commit];
+        CFDictionaryRemoveValue(lookup, &commit->_oid);
+        [history _removeCommit:commit];  // Parents are still reachable through the relations of detached commits
+        return YES;
+      });
+    }
+
+    // Compact commits in a single pass instead of searching for each removed commit
+    if (removedCommits.count) {
+      NSMutableIndexSet* indexes = [[NSMutableIndexSet alloc] init];
+      NSUInteger index = 0;
+      for (GCHistoryCommit* commit in commits) {
+        if (table[commit->_autoIncrementID] == NULL) {
+          [indexes addIndex:index];
+        }
+        ++index;
+      }
+      XLOG_DEBUG_CHECK(indexes.count == removedCommits.count);
+      [commits removeObjectsAtIndexes:indexes];
+      [indexes release];
+    }
+  }
+
+  // Rebuild child relations now that the set of commits is final
+  history.nextAutoIncrementID = nextAutoIncrementID;
+  [history _updateBoundary];
+  [history _updateRelations];
+
+  // Sort commits (on reload, only new commits need to be sorted as the others are already in order)
   if (history.sorting == kGCHistorySorting_ReverseChronological) {
-    [commits sortUsingSelector:@selector(reverseTimeCompare:)];  // Newest first
+    [history _sortCommitsFromIndex:(historyTips ? commits.count - addedCommits.count : 0)];  // Newest first
   } else {
     XLOG_DEBUG_CHECK(history.sorting == kGCHistorySorting_None);
   }
@@ -1121,7 +2654,6 @@ static const void* _associatedObjectUpstreamNameKey = &_associatedObjectUpstream
   }
 
   // Finish saving state in history
-  history.nextAutoIncrementID = nextAutoIncrementID;
   history.nextGeneration = generation + 1;
   history.tags = tags;
   history.localBranches = localBranches;
@@ -1156,12 +2688,12 @@ static const void* _associatedObjectUpstreamNameKey = &_associatedObjectUpstream
   // Check history consistency
   XLOG_DEBUG_CHECK((NSUInteger)CFDictionaryGetCount(lookup) == commits.count);
   for (GCHistoryCommit* commit in commits) {
-    XLOG_DEBUG_CHECK(CFDictionaryContainsKey(lookup, git_commit_id(commit.private)));
-    for (GCHistoryCommit* parent in commit.parents) {
-      XLOG_DEBUG_CHECK(CFDictionaryContainsKey(lookup, git_commit_id(parent.private)));
+    XLOG_DEBUG_CHECK(CFDictionaryContainsKey(lookup, &commit->_oid));
+    for (NSUInteger i = 0, count = commit.parentCount; i < count; ++i) {
+      XLOG_DEBUG_CHECK(CFDictionaryContainsKey(lookup, &[commit parentAtIndex:i]->_oid));
     }
-    for (GCHistoryCommit* child in commit.children) {
-      XLOG_DEBUG_CHECK(CFDictionaryContainsKey(lookup, git_commit_id(child.private)));
+    for (NSUInteger i = 0, count = commit.childCount; i < count; ++i) {
+      XLOG_DEBUG_CHECK(CFDictionaryContainsKey(lookup, &[commit childAtIndex:i]->_oid));
     }
     for (GCHistoryLocalBranch* branch in commit.localBranches) {
       XLOG_DEBUG_CHECK(branch.tipCommit == commit);
@@ -1181,28 +2713,271 @@ cleanup:
   [tags release];
   [localBranches release];
   [remoteBranches release];
-  git_revwalk_free(walker);
+  [walkTips release];
+  [graph release];
   git_reference_free(headReference);
   return success;
 }
 
 - (GCHistory*)loadHistoryUsingSorting:(GCHistorySorting)sorting error:(NSError**)error {
   GCHistory* history = [[[GCHistory alloc] initWithRepository:self sorting:sorting] autorelease];
-  return [self _reloadHistory:history usingSnapshot:nil referencesDidChange:NULL addedCommits:NULL removedCommits:NULL error:error] ? history : nil;
+  return [self _reloadHistory:history usingSnapshot:nil prefetch:nil useCommitGraph:YES referencesDidChange:NULL addedCommits:NULL removedCommits:NULL error:error] ? history : nil;
 }
 
 - (BOOL)reloadHistory:(GCHistory*)history referencesDidChange:(BOOL*)referencesDidChange addedCommits:(NSArray**)addedCommits removedCommits:(NSArray**)removedCommits error:(NSError**)error {
-  return [self _reloadHistory:history usingSnapshot:nil referencesDidChange:referencesDidChange addedCommits:addedCommits removedCommits:removedCommits error:error];
+  return [self _reloadHistory:history usingSnapshot:nil prefetch:nil useCommitGraph:YES referencesDidChange:referencesDidChange addedCommits:addedCommits removedCommits:removedCommits error:error];
+}
+
+- (GCHistoryPrefetch*)prefetchCommitsExcludingAncestorsOfOIDs:(NSData*)oids cancelBlock:(BOOL (^)(void))cancelBlock error:(NSError**)error {
+  GCHistoryPrefetch* prefetch = nil;
+  GCHistoryPrefetch* result = [[GCHistoryPrefetch alloc] init];
+  git_revwalk* walker = NULL;
+  NSUInteger count = 0;
+
+  CALL_LIBGIT2_FUNCTION_GOTO(cleanup, git_revwalk_new, &walker, self.private);
+  git_revwalk_sorting(walker, GIT_SORT_NONE);
+  int status = git_revwalk_push_head(walker);
+  if ((status != GIT_OK) && (status != GIT_EUNBORNBRANCH) && (status != GIT_ENOTFOUND)) {
+    LOG_LIBGIT2_ERROR(status);  // Don't fail because of a corrupted HEAD as the history reload will report it
+  }
+  CALL_LIBGIT2_FUNCTION_GOTO(cleanup, git_revwalk_push_glob, walker, "refs/heads/*");  // Only push references the history considers
+  CALL_LIBGIT2_FUNCTION_GOTO(cleanup, git_revwalk_push_glob, walker, "refs/remotes/*");
+  CALL_LIBGIT2_FUNCTION_GOTO(cleanup, git_revwalk_push_glob, walker, "refs/tags/*");
+  const git_oid* hiddenOIDs = oids.bytes;
+  for (NSUInteger i = 0, hiddenCount = oids.length / sizeof(git_oid); i < hiddenCount; ++i) {
+    status = git_revwalk_hide(walker, &hiddenOIDs[i]);
+    if (status != GIT_OK) {
+      LOG_LIBGIT2_ERROR(status);  // Commit may have been garbage collected since
+    }
+  }
+  while (1) {
+    git_oid oid;
+    status = git_revwalk_next(&oid, walker);
+    if (status == GIT_ITEROVER) {
+      break;
+    }
+    CHECK_LIBGIT2_FUNCTION_CALL(goto cleanup, status, == GIT_OK);
+    if ((count++ % 1024 == 0) && cancelBlock && cancelBlock()) {
+      goto cleanup;
+    }
+    git_commit* commit;
+    CALL_LIBGIT2_FUNCTION_GOTO(cleanup, git_commit_lookup, &commit, self.private, &oid);
+    [result _addCommit:commit];
+    git_commit_free(commit);
+  }
+  [result _buildLookup];
+  prefetch = [result retain];
+
+cleanup:
+  git_revwalk_free(walker);
+  [result release];
+  return [prefetch autorelease];
+}
+
+- (BOOL)reloadHistory:(GCHistory*)history usingPrefetch:(GCHistoryPrefetch*)prefetch referencesDidChange:(BOOL*)referencesDidChange addedCommits:(NSArray**)addedCommits removedCommits:(NSArray**)removedCommits error:(NSError**)error {
+  return [self _reloadHistory:history usingSnapshot:nil prefetch:(history.windowed ? nil : prefetch) useCommitGraph:YES referencesDidChange:referencesDidChange addedCommits:addedCommits removedCommits:removedCommits error:error];
+}
+
+- (GCHistory*)loadHistoryUsingSorting:(GCHistorySorting)sorting maximumCommits:(NSUInteger)maximumCommits sinceDate:(NSDate*)date error:(NSError**)error {
+  GCHistory* history = [[[GCHistory alloc] initWithRepository:self sorting:sorting] autorelease];
+  history->_windowed = YES;
+  history->_windowSize = maximumCommits ? maximumCommits : NSUIntegerMax;
+  history->_horizon = date ? (git_time_t)date.timeIntervalSince1970 : INT64_MIN;
+  return [self _reloadHistory:history usingSnapshot:nil prefetch:nil useCommitGraph:YES referencesDidChange:NULL addedCommits:NULL removedCommits:NULL error:error] ? history : nil;
+}
+
+// References are brought up-to-date first so that the MD5 and tips of the history match the commits it contains once extended
+- (BOOL)extendHistory:(GCHistory*)history byCommits:(NSUInteger)count addedCommits:(NSArray**)outAddedCommits removedCommits:(NSArray**)outRemovedCommits error:(NSError**)error {
+  XLOG_DEBUG_CHECK(history.windowed && count);
+  if (outAddedCommits) {
+    *outAddedCommits = nil;
+  }
+  if (outRemovedCommits) {
+    *outRemovedCommits = nil;
+  }
+  NSArray* reloadAddedCommits;
+  if (![self _reloadHistory:history usingSnapshot:nil prefetch:nil useCommitGraph:YES referencesDidChange:NULL addedCommits:&reloadAddedCommits removedCommits:outRemovedCommits error:error]) {
+    return NO;
+  }
+  if (history.complete) {
+    if (outAddedCommits) {
+      *outAddedCommits = reloadAddedCommits;
+    }
+    return YES;
+  }
+
+  NSMutableArray* commits = [NSMutableArray array];
+  NSUInteger nextAutoIncrementID = history.nextAutoIncrementID;
+  git_time_t horizon = INT64_MIN;
+  GCCommitGraph* graph = [[GCCommitGraph alloc] initWithRepository:self];
+  BOOL success = [self _generateWindowedCommits:commits fromTips:nil forHistory:history usingCommitGraph:graph nextAutoIncrementID:&nextAutoIncrementID maximumCount:count horizon:&horizon error:error];
+  [graph release];
+  if (!success) {
+    return NO;
+  }
+  history->_horizon = MIN(history->_horizon, horizon);
+
+  // Merge newfound commits and link them to their children
+  [history.commits addObjectsFromArray:commits];
+  history.nextAutoIncrementID = nextAutoIncrementID;
+  [history _updateBoundary];
+  [history _updateRelations];
+
+  // Sort commits (only new commits need to be sorted as the others are already in order)
+  NSMutableArray* allCommits = history.commits;
+  if (history.sorting == kGCHistorySorting_ReverseChronological) {
+    [history _sortCommitsFromIndex:(allCommits.count - commits.count)];  // Newest first
+  } else {
+    XLOG_DEBUG_CHECK(history.sorting == kGCHistorySorting_None);
+  }
+
+  // Update roots and leaves (boundary commits that got their parents loaded are not roots anymore)
+  NSMutableArray* roots = history.roots;
+  NSMutableArray* leaves = history.leaves;
+  [roots removeAllObjects];
+  [leaves removeAllObjects];
+  for (GCHistoryCommit* commit in allCommits) {
+    if (commit.root) {
+      [roots addObject:commit];
+    }
+    if (commit.leaf) {
+      [leaves addObject:commit];
+    }
+  }
+
+  history.nextGeneration += 1;  // Invalidates computations cached for the previous state of the history
+  if (outAddedCommits) {
+    *outAddedCommits = reloadAddedCommits.count ? [reloadAddedCommits arrayByAddingObjectsFromArray:commits] : commits;
+  }
+  return YES;
+}
+
+#if DEBUG
+
+- (GCHistory*)loadHistoryUsingSorting:(GCHistorySorting)sorting useCommitGraph:(BOOL)useCommitGraph error:(NSError**)error {
+  GCHistory* history = [[[GCHistory alloc] initWithRepository:self sorting:sorting] autorelease];
+  return [self _reloadHistory:history usingSnapshot:nil prefetch:nil useCommitGraph:useCommitGraph referencesDidChange:NULL addedCommits:NULL removedCommits:NULL error:error] ? history : nil;
 }
 
+#endif
+
 - (GCHistory*)loadHistoryFromSnapshot:(GCSnapshot*)snapshot usingSorting:(GCHistorySorting)sorting error:(NSError**)error {
   GCHistory* history = [[[GCHistory alloc] initWithRepository:self sorting:sorting] autorelease];
-  return [self _reloadHistory:history usingSnapshot:snapshot referencesDidChange:NULL addedCommits:NULL removedCommits:NULL error:error] ? history : nil;
+  return [self _reloadHistory:history usingSnapshot:snapshot prefetch:nil useCommitGraph:YES referencesDidChange:NULL addedCommits:NULL removedCommits:NULL error:error] ? history : nil;
+}
+
+- (GCHistory*)loadHistoryFromCacheAtPath:(NSString*)path usingSorting:(GCHistorySorting)sorting error:(NSError**)error {
+  GCHistory* history = nil;
+  NSData* data = git_repository_is_shallow(self.private) ? nil : [[NSData alloc] initWithContentsOfFile:path options:NSDataReadingMappedIfSafe error:NULL];  // Parents can change without references changing when deepening shallow repositories
+  if (data) {
+    history = [[[GCHistory alloc] initWithRepository:self sorting:sorting] autorelease];
+    if (![history _deserializeCacheFromData:data]) {
+      XLOG_WARNING(@"Ignoring invalid history cache at \"%@\"", path);
+      history = nil;
+    }
+    [data release];
+  }
+  if (history == nil) {
+    return [self loadHistoryUsingSorting:sorting error:error];
+  }
+  return [self _reloadHistory:history usingSnapshot:nil prefetch:nil useCommitGraph:YES referencesDidChange:NULL addedCommits:NULL removedCommits:NULL error:error] ? history : nil;
+}
+
+- (NSData*)_serializeHistoryForCache:(GCHistory*)history error:(NSError**)error {
+  if (history.windowed) {
+    GC_SET_GENERIC_ERROR(@"Windowed histories cannot be cached");
+    return nil;
+  }
+  NSData* data = [history _serializeCacheData];
+  if (data == nil) {
+    GC_SET_GENERIC_ERROR(@"History is too large to be cached");
+    return nil;
+  }
+  return data;
+}
+
+- (BOOL)writeHistory:(GCHistory*)history toCacheAtPath:(NSString*)path error:(NSError**)error {
+  if ([history.cacheMD5 isEqualToData:history.md5]) {
+    return YES;
+  }
+  NSData* data = [self _serializeHistoryForCache:history error:error];
+  if (data == nil) {
+    return NO;
+  }
+  if (![data writeToFile:path options:NSDataWritingAtomic error:error]) {
+    return NO;
+  }
+  history.cacheMD5 = history.md5;
+  return YES;
+}
+
+- (NSData*)serializeHistory:(GCHistory*)history error:(NSError**)error {
+  return [self _serializeHistoryForCache:history error:error];
+}
+
+- (GCHistory*)loadHistoryFromSerializedHistory:(NSData*)data usingSorting:(GCHistorySorting)sorting error:(NSError**)error {
+  GCHistory* history = [[[GCHistory alloc] initWithRepository:self sorting:sorting] autorelease];
+  if (![history _deserializeCacheFromData:data]) {
+    GC_SET_GENERIC_ERROR(@"Invalid serialized history");
+    return nil;
+  }
+  history.md5 = history.cacheMD5;  // References are the same as the serialized history so reloading only walks the commits of the ones that changed since
+  return history;
+}
+
+- (BOOL)adoptHistory:(GCHistory*)history removedCommits:(NSArray*)removedCommits error:(NSError**)error {
+  return [history _rebindToRepository:self removedCommits:removedCommits error:error];
+}
+
+// Serializing only copies the commit graph so it's done on the calling thread while writing the file is left to a serial queue so writes land in order
+// The history is not retained by the background write as it can outlive its repository
+- (void)writeHistoryInBackground:(GCHistory*)history toCacheAtPath:(NSString*)path completion:(void (^)(BOOL success, NSError* error))completion {
+  static dispatch_queue_t queue = NULL;
+  static dispatch_once_t onceToken;
+  dispatch_once(&onceToken, ^{
+    queue = dispatch_queue_create(NULL, DISPATCH_QUEUE_SERIAL);
+  });
+  if ([history.cacheMD5 isEqualToData:history.md5]) {
+    if (completion) {
+      dispatch_async(dispatch_get_main_queue(), ^{
+        completion(YES, nil);
+      });
+    }
+    return;
+  }
+  NSError* error;
+  NSData* data = [self _serializeHistoryForCache:history error:&error];
+  if (data == nil) {
+    XLOG_ERROR(@"Failed serializing history cache for \"%@\": %@", self.repositoryPath, error);
+    if (completion) {
+      dispatch_async(dispatch_get_main_queue(), ^{
+        completion(NO, error);
+      });
+    }
+    return;
+  }
+  history.cacheMD5 = history.md5;  // Don't serialize the history again until its references change even if the write fails
+  dispatch_async(queue, ^{
+    NSError* writeError;
+    BOOL success = [data writeToFile:path options:NSDataWritingAtomic error:&writeError];
+    if (!success) {
+      XLOG_ERROR(@"Failed writing history cache to \"%@\": %@", path, writeError);
+    }
+    if (completion) {
+      dispatch_async(dispatch_get_main_queue(), ^{
+        completion(success, writeError);
+      });
+    }
+  });
 }
 
 #pragma mark - File
 
 - (NSArray*)lookupCommitsForFile:(NSString*)path followRenames:(BOOL)follow error:(NSError**)error {
+  return [self lookupCommitsForFile:path followRenames:follow changedPathIndex:nil error:error];
+}
+
+- (NSArray*)lookupCommitsForFile:(NSString*)path followRenames:(BOOL)follow changedPathIndex:(GCChangedPathIndex*)index error:(NSError**)error {
   NSMutableArray* commits = nil;
   char* fileName = strdup(GCGitPathFromFileSystemPath(path));
   git_revwalk* walker = NULL;
@@ -1216,62 +2991,68 @@ cleanup:
   diffOptions.flags = GIT_DIFF_SKIP_BINARY_CHECK;  // This should not be needed since not generating patches anyway
   git_diff_find_options findOptions = GIT_DIFF_FIND_OPTIONS_INIT;
   findOptions.flags = GIT_DIFF_FIND_RENAMES;
+  BOOL isHEAD = YES;
   while (1) {
     int status = git_revwalk_next(&oid, walker);
     if (status == GIT_OK) {
       git_commit* commit;
       status = git_commit_lookup(&commit, self.private, &oid);
       if (status == GIT_OK) {
-        git_tree* tree;
-        status = git_commit_tree(&tree, commit);
-        if (status == GIT_OK) {
-          git_tree_entry* entry;
-          status = git_tree_entry_bypath(&entry, tree, fileName);
+        // The walk stops at the commit adding the file so past HEAD, commits where the file is definitely unchanged compared to all their parents
+        // also contain it and can be skipped without loading their tree
+        if (!index || isHEAD || [index commit:commit mayHaveChangedPath:fileName]) {
+          git_tree* tree;
+          status = git_commit_tree(&tree, commit);
           if (status == GIT_OK) {
-            for (unsigned int i = 0, count = git_commit_parentcount(commit); i < count; ++i) {
-              git_commit* parentCommit;
-              status = git_commit_parent(&parentCommit, commit, i);
-              if (status == GIT_OK) {
-                git_tree* parentTree;
-                status = git_commit_tree(&parentTree, parentCommit);
+            git_tree_entry* entry;
+            status = git_tree_entry_bypath(&entry, tree, fileName);
+            if (status == GIT_OK) {
+              for (unsigned int i = 0, parentCount = git_commit_parentcount(commit); i < parentCount; ++i) {
+                git_commit* parentCommit;
+                status = git_commit_parent(&parentCommit, commit, i);
                 if (status == GIT_OK) {
-                  git_diff* diff = NULL;
-                  status = git_diff_tree_to_tree(&diff, self.private, parentTree, tree, &diffOptions);
-                  if ((status == GIT_OK) && follow) {
-                    status = git_diff_find_similar(diff, &findOptions);
-                  }
+                  git_tree* parentTree;
+                  status = git_commit_tree(&parentTree, parentCommit);
                   if (status == GIT_OK) {
-                    for (size_t i2 = 0, count2 = git_diff_num_deltas(diff); i2 < count2; ++i2) {
-                      const git_diff_delta* delta = git_diff_get_delta(diff, i2);
-                      if (strcmp(delta->new_file.path, fileName) == 0) {
-                        GCCommit* newCommit = [[GCCommit alloc] initWithRepository:self commit:commit];
-                        [commits addObject:newCommit];
-                        [newCommit release];
-                        commit = NULL;
-                        if (delta->status == GIT_DELTA_RENAMED) {
-                          free(fileName);
-                          fileName = strdup(delta->old_file.path);
-                        } else if (delta->status == GIT_DELTA_ADDED) {
-                          status = GIT_ITEROVER;
-                        } else {
-                          XLOG_DEBUG_CHECK(delta->status == GIT_DELTA_MODIFIED);
+                    git_diff* diff = NULL;
+                    status = git_diff_tree_to_tree(&diff, self.private, parentTree, tree, &diffOptions);
+                    if ((status == GIT_OK) && follow) {
+                      status = git_diff_find_similar(diff, &findOptions);
+                    }
+                    if (status == GIT_OK) {
+                      for (size_t i2 = 0, count2 = git_diff_num_deltas(diff); i2 < count2; ++i2) {
+                        const git_diff_delta* delta = git_diff_get_delta(diff, i2);
+                        if (strcmp(delta->new_file.path, fileName) == 0) {
+                          GCCommit* newCommit = [[GCCommit alloc] initWithRepository:self commit:commit];
+                          [commits addObject:newCommit];
+                          [newCommit release];
+                          commit = NULL;
+                          if (delta->status == GIT_DELTA_RENAMED) {
+                            free(fileName);
+                            fileName = strdup(delta->old_file.path);
+                          } else if (delta->status == GIT_DELTA_ADDED) {
+                            status = GIT_ITEROVER;
+                          } else {
+                            XLOG_DEBUG_CHECK(delta->status == GIT_DELTA_MODIFIED);
+                          }
                         }
                       }
                     }
+                    git_diff_free(diff);
+                    git_tree_free(parentTree);
                   }
-                  git_diff_free(diff);
-                  git_tree_free(parentTree);
+                  git_commit_free(parentCommit);
                 }
-                git_commit_free(parentCommit);
               }
+              git_tree_entry_free(entry);
+            } else if (status == GIT_ENOTFOUND) {
+              status = GIT_ITEROVER;
             }
-            git_tree_entry_free(entry);
-          } else if (status == GIT_ENOTFOUND) {
-            status = GIT_ITEROVER;
+            git_tree_free(tree);
           }
-          git_tree_free(tree);
         }
         git_commit_free(commit);
+        isHEAD = NO;
       }
     }
     if (status == GIT_ITEROVER) {
@@ -218,4 +218,63 @@
   XCTAssertEqual(numberOfCommits, expectedTotalCommitCount);
 }
 
+- (void)testIncrementalStatus {
+  // Make commit
+  NSString* path = self.liveRepository.workingDirectoryPath;
+  XCTAssertTrue([[NSFileManager defaultManager] createDirectoryAtPath:[path stringByAppendingPathComponent:@"a"] withIntermediateDirectories:NO attributes:nil error:NULL]);
+  XCTAssertTrue([[NSFileManager defaultManager] createDirectoryAtPath:[path stringByAppendingPathComponent:@"b"] withIntermediateDirectories:NO attributes:nil error:NULL]);
+  [self updateFileAtPath:@"a/1.txt" withString:@"1\n"];
+  [self updateFileAtPath:@"b/2.txt" withString:@"2\n"];
+  [self updateFileAtPath:@"3.txt" withString:@"3\n"];
+  XCTAssertTrue([self.liveRepository addAllFilesToIndex:NULL]);
+  XCTAssertNotNil([self.liveRepository createCommitFromHEADWithMessage:@"Initial commit" error:NULL]);
+  [self.liveRepository setStatusMode:kGCLiveRepositoryStatusMode_Normal];
+  XCTAssertNotNil(self.liveRepository.workingDirectoryStatus.private);
+
+  // Check changes are merged into the status
+  [self updateFileAtPath:@"a/1.txt" withString:@"1 modified\n"];
+  [self updateFileAtPath:@"b/new.txt" withString:@"new\n"];
+  [self deleteFileAtPath:@"3.txt"];
+  NSArray* paths = @[ [path stringByAppendingPathComponent:@"a/"], [path stringByAppendingPathComponent:@"b/"], self.liveRepository.workingDirectoryWatcher.path ];
+  [self.liveRepository fileSystemWatcher:self.liveRepository.workingDirectoryWatcher didReceiveChangesAtPaths:paths rescanPaths:@[]];
+  [[NSRunLoop mainRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:1.0]];
+  XCTAssertNil(self.liveRepository.workingDirectoryStatus.private);
+  GCDiff* diff = [self.liveRepository diffWorkingDirectoryWithRepositoryIndex:nil options:kGCDiffOption_IncludeUntracked maxInterHunkLines:0 maxContextLines:3 error:NULL];
+  XCTAssertEqual(diff.deltas.count, 3);
+  XCTAssertTrue([self.liveRepository.workingDirectoryStatus isEqualToDiff:diff]);
+
+  // Check directories without changes leave the status untouched
+  [self updateFileAtPath:@"b/2.txt" withString:@"2 modified\n"];
+  [self.liveRepository fileSystemWatcher:self.liveRepository.workingDirectoryWatcher didReceiveChangesAtPaths:@[ [path stringByAppendingPathComponent:@"a/"] ] rescanPaths:@[]];
+  [[NSRunLoop mainRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:1.0]];
+  XCTAssertTrue([self.liveRepository.workingDirectoryStatus isEqualToDiff:diff]);
+
+  // Check rescans update the full status
+  [self.liveRepository fileSystemWatcher:self.liveRepository.workingDirectoryWatcher didReceiveChangesAtPaths:@[] rescanPaths:@[ path ]];
+  [[NSRunLoop mainRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:1.0]];
+  XCTAssertNotNil(self.liveRepository.workingDirectoryStatus.private);
+  XCTAssertEqual(self.liveRepository.workingDirectoryStatus.deltas.count, 4);
+
+  // Check unified status
+  [self.liveRepository setStatusMode:kGCLiveRepositoryStatusMode_Unified];
+  [self updateFileAtPath:@"a/1.txt" withString:@"1 modified again\n"];
+  [self.liveRepository fileSystemWatcher:self.liveRepository.workingDirectoryWatcher didReceiveChangesAtPaths:@[ [path stringByAppendingPathComponent:@"a/"] ] rescanPaths:@[]];
+  [[NSRunLoop mainRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:1.0]];
+  XCTAssertNil(self.liveRepository.unifiedStatus.private);
+  diff = [self.liveRepository diffWorkingDirectoryWithHEAD:nil options:(kGCDiffOption_IncludeUntracked | kGCDiffOption_FindRenames) maxInterHunkLines:0 maxContextLines:3 error:NULL];
+  XCTAssertTrue([self.liveRepository.unifiedStatus isEqualToDiff:diff]);
+
+  // Check ignore rules changed in a reported directory also apply to the directories not reported
+  [self updateFileAtPath:@"b/debug.log" withString:@"log\n"];
+  [self.liveRepository fileSystemWatcher:self.liveRepository.workingDirectoryWatcher didReceiveChangesAtPaths:@[ [path stringByAppendingPathComponent:@"b/"] ] rescanPaths:@[]];
+  [[NSRunLoop mainRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:1.0]];
+  XCTAssertTrue([[self.liveRepository.unifiedStatus.deltas valueForKey:@"canonicalPath"] containsObject:@"b/debug.log"]);
+  [self updateFileAtPath:@".gitignore" withString:@"*.log\n"];
+  [self.liveRepository fileSystemWatcher:self.liveRepository.workingDirectoryWatcher didReceiveChangesAtPaths:@[ self.liveRepository.workingDirectoryWatcher.path ] rescanPaths:@[]];
+  [[NSRunLoop mainRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:1.0]];
+  XCTAssertFalse([[self.liveRepository.unifiedStatus.deltas valueForKey:@"canonicalPath"] containsObject:@"b/debug.log"]);
+  diff = [self.liveRepository diffWorkingDirectoryWithHEAD:nil options:(kGCDiffOption_IncludeUntracked | kGCDiffOption_FindRenames) maxInterHunkLines:0 maxContextLines:3 error:NULL];
+  XCTAssertTrue([self.liveRepository.unifiedStatus isEqualToDiff:diff]);
+}
+
 @end
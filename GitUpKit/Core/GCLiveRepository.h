@@ -40,6 +40,13 @@ extern NSString* const GCLiveRepositoryStatusDidUpdateNotification;
 extern NSString* const GCLiveRepositorySnapshotsDidUpdateNotification;
 extern NSString* const GCLiveRepositorySearchDidUpdateNotification;
 
+extern NSString* const GCLiveRepositoryHistoryAddedCommitsKey;  // NSArray of GCHistoryCommit in the user info of GCLiveRepositoryHistoryDidUpdateNotification (might be missing)
+extern NSString* const GCLiveRepositoryHistoryRemovedCommitsKey;  // NSArray of GCHistoryCommit in the user info of GCLiveRepositoryHistoryDidUpdateNotification (might be missing)
+extern NSString* const GCLiveRepositoryStatusUnifiedChangesKey;  // GCDiffChangeSet in the user info of GCLiveRepositoryStatusDidUpdateNotification (only present in unified status mode)
+extern NSString* const GCLiveRepositoryStatusWorkingDirectoryChangesKey;  // GCDiffChangeSet in the user info of GCLiveRepositoryStatusDidUpdateNotification (only present in normal status mode)
+extern NSString* const GCLiveRepositoryStatusIndexChangesKey;  // GCDiffChangeSet in the user info of GCLiveRepositoryStatusDidUpdateNotification (only present in normal status mode)
+extern NSString* const GCLiveRepositoryStatusConflictsChangedKey;  // NSNumber boolean in the user info of GCLiveRepositoryStatusDidUpdateNotification
+
 extern NSString* const GCLiveRepositoryCommitOperationReason;
 extern NSString* const GCLiveRepositoryAmendOperationReason;
 
@@ -80,10 +87,12 @@ extern NSString* const GCLiveRepositoryAmendOperationReason;
 - (void)notifyWorkingDirectoryChanged;  // Calling this method is required when manipulating the working directory from this process as live-updates don't apply
 
 + (GCHistorySorting)historySorting;  // Default is kGCHistorySorting_None
++ (NSUInteger)historyWindowSize;  // Default is 0 i.e. load the entire history - Otherwise only this many commits are loaded initially and then on each call to -extendHistory
 @property(nonatomic, readonly) GCHistory* history;
 @property(nonatomic, readonly, getter=areHistoryUpdatesSuspended) BOOL historyUpdatesSuspended;
 - (void)suspendHistoryUpdates;  // Nestable
 - (void)resumeHistoryUpdates;  // Nestable
+- (void)extendHistory;  // Loads older commits if the history is windowed and not complete yet
 
 @property(nonatomic, getter=areSnapshotsEnabled) BOOL snapshotsEnabled;  // Default is NO - Should be enabled *after* setting delegate so any error can be received
 @property(nonatomic, getter=areAutomaticSnapshotsEnabled) BOOL automaticSnapshotsEnabled;  // Requires @snapshotsEnabled to be YES
@@ -130,6 +139,7 @@ extern NSString* const GCLiveRepositoryAmendOperationReason;
 @end
 
 @interface GCLiveRepository (Search)
+@property(nonatomic, copy) NSString* sharedSearchDatabasePath;  // Default is nil i.e. the search database is private to the repository - Use the same path for clones and worktrees of the same project so they share indexing work and disk space - Must be set before preparing search
 - (void)prepareSearchInBackground:(BOOL)indexDiffs
               withProgressHandler:(GCCommitDatabaseProgressHandler)handler  // Called from background thread!
                        completion:(void (^)(BOOL success, NSError* error))completion;
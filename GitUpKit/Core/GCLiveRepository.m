@@ -17,6 +17,7 @@
 #error This file requires ARC
 #endif
 
+#import <dirent.h>
 #import <sys/stat.h>
 #import <sys/attr.h>
 
@@ -28,8 +29,18 @@
 
 #import "XLFacilityMacros.h"
 
-#define kFSLatency 0.5
-#define kUpdateLatency 0.5
+#define kFSLatency 0.25
+
+#define kMinUpdateLatency 0.1  // Used when updates are cheap and file system events are sparse e.g. while editing a file
+#define kMaxUpdateLatency 2.0  // Used when updates are expensive or file system events keep coming in e.g. during builds
+#define kMaxUpdateDelay 5.0  // Changes are never deferred longer than this since the first pending one even if file system events keep coming in
+#define kUpdateCostLatencyFactor 2.0  // Leaves the main thread idle for at least this multiple of the measured update cost between updates
+#define kUpdateBurstEventRate 50.0  // Above this many paths changed per second, updates are deferred by the maximum latency
+#define kUpdateStatisticsWeight 0.25  // Weight of the latest sample in the moving averages
+
+#define kMaxIncrementalStatusDirectories 100  // Above this many changed directories, a full status update is performed instead
+#define kMaxIncrementalStatusFilePatterns 10000
+#define kFullStatusUpdateInterval 300.0  // Incremental status updates rely on file system events so do a full status update periodically in case some were missed
 
 #define kMaxSnapshots 100
 #define kSnapshotsFileName @"snapshots.data"
@@ -37,10 +48,16 @@
 #define kSnapshotKey_Reason @"reason"  // NSString
 #define kSnapshotKey_Argument @"argument"  // id<NSCoding>
 
-#define kAutomaticSnapshotDelay (5 - kFSLatency - kUpdateLatency)
+#define kAutomaticSnapshotDelay (5 - kFSLatency - kMinUpdateLatency)
 
 #define kCommitDatabaseFileName @"cache.db"
 
+#define kHistoryCacheFileName @"history.cache"
+#define kHistoryCacheDelay 30.0  // Coalesces cache writes while the history is updated repeatedly e.g. during a rebase
+
+#define kChangedPathIndexFileName @"changed-paths.index"
+#define kUntrackedCacheFileName @"untracked.cache"
+
 #define kMinSearchLength 2  // SQLite FTS indexes tokens down to a single characters but it's just impractical to allow that in the UI
 
 NSString* const GCLiveRepositoryDidChangeNotification = @"GCLiveRepositoryDidChangeNotification";
@@ -53,6 +70,13 @@ NSString* const GCLiveRepositoryStatusDidUpdateNotification = @"GCLiveRepository
 NSString* const GCLiveRepositorySnapshotsDidUpdateNotification = @"GCLiveRepositorySnapshotsDidUpdateNotification";
 NSString* const GCLiveRepositorySearchDidUpdateNotification = @"GCLiveRepositorySearchDidUpdateNotification";
 
+NSString* const GCLiveRepositoryHistoryAddedCommitsKey = @"addedCommits";
+NSString* const GCLiveRepositoryHistoryRemovedCommitsKey = @"removedCommits";
+NSString* const GCLiveRepositoryStatusUnifiedChangesKey = @"unifiedChanges";
+NSString* const GCLiveRepositoryStatusWorkingDirectoryChangesKey = @"workingDirectoryChanges";
+NSString* const GCLiveRepositoryStatusIndexChangesKey = @"indexChanges";
+NSString* const GCLiveRepositoryStatusConflictsChangedKey = @"conflictsChanged";
+
 NSString* const GCLiveRepositoryCommitOperationReason = @"commit";
 NSString* const GCLiveRepositoryAmendOperationReason = @"amend";
 
@@ -60,16 +84,34 @@ NSString* const GCLiveRepositoryAmendOperationReason = @"amend";
 static _Atomic int32_t _allocatedCount = ATOMIC_VAR_INIT(0);
 #endif
 
+typedef struct {
+  CFAbsoluteTime lastEventTime;
+  double eventRate;  // Moving average of the changed paths per second reported by the file system watcher
+  CFTimeInterval cost;  // Moving average of the time spent on the main thread by the update
+} GCLiveRepositoryUpdateStatistics;
+
 @implementation GCLiveRepository {
   int _gitDirectory;
-  FSEventStreamRef _gitDirectoryStream;
   BOOL _gitDirectoryChanged;
-  FSEventStreamRef _workingDirectoryStream;
   BOOL _workingDirectoryChanged;
+  BOOL _stashesChanged;
+  CFAbsoluteTime _updatePendingTime;  // Time of the first change not processed yet or 0.0 if none
+  GCLiveRepositoryUpdateStatistics _statusUpdateStatistics;  // For working directory changes
+  GCLiveRepositoryUpdateStatistics _repositoryUpdateStatistics;  // For git directory changes
+  NSMutableSet* _changedDirectories;  // Working directory relative paths with a trailing slash (empty for the root) of the directories changed since the last status update - Nil if a full status update is required
+  CFAbsoluteTime _lastFullStatusUpdateTime;
+  CFAbsoluteTime _lastStatusUpdateTime;  // Start time of the last successful status update
+  GCUntrackedCache* _untrackedCache;
+  dispatch_queue_t _statusQueue;  // Serial queue where the file patterns of incremental status updates are computed
+  GCRepository* _statusRepository;  // Only accessed on the status queue
+  NSUInteger _statusUpdateID;  // Incremented on each status update so incremental updates in flight can detect they have been superseded
+  NSSet* _inFlightStatusDirectories;  // Directories of the incremental status update in flight if any
   CFRunLoopTimerRef _updateTimer;  // Can't use a NSTimer because of retain-cycle
   GCRepositoryState _state;
   NSInteger _historyUpdatesSuspended;
   BOOL _historyUpdatePending;
+  _Atomic(NSUInteger) _historyUpdateID;  // Incremented on each history update so background updates in flight can detect they have been superseded
+  CFRunLoopTimerRef _historyCacheTimer;  // Only created if the history can be cached
 
   NSMutableArray* _snapshots;
   CFRunLoopTimerRef _snapshotsTimer;
@@ -78,8 +120,12 @@ static _Atomic int32_t _allocatedCount = ATOMIC_VAR_INIT(0);
 
   GCCommitDatabase* _database;
   BOOL _databaseIndexesDiffs;
+  NSString* _sharedSearchDatabasePath;
   BOOL _updatingDatabase;
   BOOL _databaseUpdatePending;
+  BOOL _databaseUpToDate;  // NO while commits in the history may be missing from the database
+  GCCommitDatabaseSearchSession* _searchSession;  // Discarded whenever the history or the database is updated
+  GCChangedPathIndex* _changedPathIndex;
 
   NSString* _undoActionName;
 }
@@ -108,11 +154,18 @@ static _Atomic int32_t _allocatedCount = ATOMIC_VAR_INIT(0);
 
 - (void)_timer:(CFRunLoopTimerRef)timer {
   if (timer == _updateTimer) {
-    [self _notifyWorkingDirectoryChanged:_workingDirectoryChanged gitDirectoryChanged:_gitDirectoryChanged];
+    BOOL workingDirectoryChanged = _workingDirectoryChanged;
+    BOOL gitDirectoryChanged = _gitDirectoryChanged;
+    BOOL stashesChanged = _stashesChanged;
     _workingDirectoryChanged = NO;
     _gitDirectoryChanged = NO;
+    _stashesChanged = NO;
+    _updatePendingTime = 0.0;
+    [self _notifyWorkingDirectoryChanged:workingDirectoryChanged gitDirectoryChanged:gitDirectoryChanged stashesChanged:stashesChanged updateHistoryInBackground:YES];
   } else if (timer == _snapshotsTimer) {
     [self _saveAutomaticSnapshotIfPending];
+  } else if (timer == _historyCacheTimer) {
+    [self _writeHistoryCache];
   } else {
     XLOG_DEBUG_UNREACHABLE();
   }
@@ -124,79 +177,190 @@ static void _TimerCallBack(CFRunLoopTimerRef timer, void* info) {
   }
 }
 
-- (void)_stream:(ConstFSEventStreamRef)stream didReceiveEvents:(size_t)numEvents withPaths:(void*)eventPaths flags:(const FSEventStreamEventFlags*)eventFlags {
-  for (size_t i = 0; i < numEvents; ++i) {
-    const char* path = ((const char**)eventPaths)[i];
-    if (eventFlags[i] & kFSEventStreamEventFlagMustScanSubDirs) {
-      XLOG_WARNING(@"Ignoring event stream request to rescan \"%s\"", path);  // Note that this directory path can be missing the trailing slash
+static void _RecordUpdateEvents(GCLiveRepositoryUpdateStatistics* statistics, NSUInteger count, CFAbsoluteTime time) {
+  CFTimeInterval interval = time - statistics->lastEventTime;
+  double rate = (double)count / MAX(interval, kFSLatency);  // The file system watchers never report changes more often than this
+  if (interval > kMaxUpdateDelay) {
+    statistics->eventRate = rate;  // Start over after a quiet period
+  } else {
+    statistics->eventRate = kUpdateStatisticsWeight * rate + (1.0 - kUpdateStatisticsWeight) * statistics->eventRate;
+  }
+  statistics->lastEventTime = time;
+}
 
-    } else {  // Documentation says "eventFlags" should be 0x0 for regular events but that's not the case on OS X 10.10 at least
+static void _RecordUpdateCost(GCLiveRepositoryUpdateStatistics* statistics, CFTimeInterval cost) {
+  if (statistics->cost > 0.0) {
+    statistics->cost = kUpdateStatisticsWeight * cost + (1.0 - kUpdateStatisticsWeight) * statistics->cost;
+  } else {
+    statistics->cost = cost;
+  }
+}
 
-      const char* gitDirectoryPath = git_repository_path(self.private);
-      size_t length = strlen(gitDirectoryPath);
-      XLOG_DEBUG_CHECK(gitDirectoryPath[length - 1] == '/');
-      if (stream == _gitDirectoryStream) {
-        if (!strncmp(path, gitDirectoryPath, length)) {
-          const char* subPath = &path[length];
-          if (!subPath[0] || !strncmp(subPath, "refs/", 5) || !strncmp(subPath, "logs/", 5)) {  // We only care about ".git/", ".git/refs/*" and ".git/logs/*"
-            XLOG_DEBUG(@"Processed file system event for '%s'", path);
-            _gitDirectoryChanged = YES;
-            CFRunLoopTimerSetNextFireDate(_updateTimer, CFAbsoluteTimeGetCurrent() + kUpdateLatency);
-          } else {
-            XLOG_DEBUG(@"Dropped file system event for '%s'", path);
+static CFTimeInterval _UpdateLatency(const GCLiveRepositoryUpdateStatistics* statistics) {
+  if (statistics->eventRate >= kUpdateBurstEventRate) {
+    return kMaxUpdateLatency;
+  }
+  return MIN(MAX(kUpdateCostLatencyFactor * statistics->cost, kMinUpdateLatency), kMaxUpdateLatency);
+}
+
+// The stash list is the reflog of "refs/stash" and changes may be reported at directory granularity so also match the directories directly containing
+// these files, but not their ancestors like ".git/logs/" which changes on every reflog write
+static BOOL _IsStashPath(const char* subPath) {
+  static const char* paths[] = {"refs/stash", "logs/refs/stash", "refs/", "logs/refs/"};
+  for (size_t i = 0; i < sizeof(paths) / sizeof(paths[0]); ++i) {
+    if (!strcmp(subPath, paths[i])) {
+      return YES;
+    }
+  }
+  return NO;
+}
+
+- (void)fileSystemWatcher:(GCFileSystemWatcher*)watcher didReceiveChangesAtPaths:(NSArray*)paths rescanPaths:(NSArray*)rescanPaths {
+  const char* gitDirectoryPath = git_repository_path(self.private);
+  size_t length = strlen(gitDirectoryPath);
+  XLOG_DEBUG_CHECK(gitDirectoryPath[length - 1] == '/');
+  BOOL changed = NO;
+  NSUInteger eventCount = 0;
+  for (NSString* rescanPath in rescanPaths) {  // Note that this directory path can be missing the trailing slash
+    XLOG_VERBOSE(@"Processing file system request to rescan \"%@\"", rescanPath);
+    if (watcher == _gitDirectoryWatcher) {
+      _gitDirectoryChanged = YES;
+      _stashesChanged = YES;
+    } else {
+      _workingDirectoryChanged = YES;
+      _changedDirectories = nil;
+      [self _resetUntrackedCacheToken];
+    }
+    changed = YES;
+    eventCount += kMaxIncrementalStatusDirectories;  // Dropped events means a lot of changes
+  }
+  for (NSString* changedPath in paths) {
+    const char* path = changedPath.UTF8String;  // Don't use -fileSystemRepresentation which could strip the trailing slash of directory paths
+    if (watcher == _gitDirectoryWatcher) {
+      if (!strncmp(path, gitDirectoryPath, length)) {
+        const char* subPath = &path[length];
+        if (!strncmp(subPath, "info/", 5)) {  // ".git/info/exclude" can change which files are untracked anywhere in the working directory
+          XLOG_DEBUG(@"Processed file system event for '%s'", path);
+          _workingDirectoryChanged = YES;
+          _changedDirectories = nil;
+          [_workingDirectoryWatcher reloadDirectoryFilter];
+          changed = YES;
+          eventCount += 1;
+        } else if (!subPath[0] || !strncmp(subPath, "refs/", 5) || !strncmp(subPath, "logs/", 5)) {  // We only care about ".git/", ".git/refs/*" and ".git/logs/*"
+          XLOG_DEBUG(@"Processed file system event for '%s'", path);
+          _gitDirectoryChanged = YES;
+          if (_IsStashPath(subPath)) {
+            _stashesChanged = YES;
           }
+          changed = YES;
+          eventCount += 1;
         } else {
-          XLOG_DEBUG_UNREACHABLE();
+          XLOG_DEBUG(@"Dropped file system event for '%s'", path);
         }
       } else {
-        if (strncmp(path, gitDirectoryPath, length)) {  // Make sure change is not inside ".git" directory if itself inside workdir
-          int ignored = 0;
-          int status = git_ignore_path_is_ignored(&ignored, self.private, path);  // Make sure path is not ignored
-          if (status != GIT_OK) {
-            LOG_LIBGIT2_ERROR(status);
-          }
-          if (!ignored) {
-            XLOG_DEBUG(@"Processed file system event for '%s'", path);
-            _workingDirectoryChanged = YES;
-            CFRunLoopTimerSetNextFireDate(_updateTimer, CFAbsoluteTimeGetCurrent() + kUpdateLatency);
-          } else {
-            XLOG_DEBUG(@"Dropped file system event for '%s'", path);
-          }
+        XLOG_DEBUG_UNREACHABLE();
+      }
+    } else {
+      if (strncmp(path, gitDirectoryPath, length)) {  // Make sure change is not inside ".git" directory if itself inside workdir
+        int ignored = 0;
+        int status = git_ignore_path_is_ignored(&ignored, self.private, path);  // Make sure path is not ignored
+        if (status != GIT_OK) {
+          LOG_LIBGIT2_ERROR(status);
+        }
+        if (!ignored) {
+          XLOG_DEBUG(@"Processed file system event for '%s'", path);
+          _workingDirectoryChanged = YES;
+          changed = YES;
+          eventCount += 1;
+          [self _addChangedDirectory:changedPath];
+        } else {
+          XLOG_DEBUG(@"Dropped file system event for '%s'", path);
         }
       }
     }
   }
+  if (changed) {
+    CFAbsoluteTime time = CFAbsoluteTimeGetCurrent();
+    _RecordUpdateEvents(watcher == _gitDirectoryWatcher ? &_repositoryUpdateStatistics : &_statusUpdateStatistics, eventCount, time);
+    [self _scheduleUpdateAtTime:time];  // Only reschedule once per change set
+  }
 }
 
-static void _StreamCallback(ConstFSEventStreamRef streamRef, void* clientCallBackInfo, size_t numEvents, void* eventPaths,
-                            const FSEventStreamEventFlags eventFlags[], const FSEventStreamEventId eventIds[]) {
-  @autoreleasepool {
-    [(__bridge GCLiveRepository*)clientCallBackInfo _stream:streamRef didReceiveEvents:numEvents withPaths:eventPaths flags:eventFlags];
+// Working directory only changes just need a status update so they use their own shorter latency instead of waiting for the state, history and stashes ones
+- (void)_scheduleUpdateAtTime:(CFAbsoluteTime)time {
+  if (_updatePendingTime <= 0.0) {
+    _updatePendingTime = time;
+  }
+  CFTimeInterval latency = 0.0;
+  if (_workingDirectoryChanged) {
+    latency = _UpdateLatency(&_statusUpdateStatistics);
+  }
+  if (_gitDirectoryChanged) {
+    latency = MAX(latency, _UpdateLatency(&_repositoryUpdateStatistics));
   }
+  CFRunLoopTimerSetNextFireDate(_updateTimer, MIN(time + latency, _updatePendingTime + kMaxUpdateDelay));
 }
 
-- (void)_reloadWorkingDirectoryStream {
-  if (_workingDirectoryStream) {
-    FSEventStreamStop(_workingDirectoryStream);
-    FSEventStreamInvalidate(_workingDirectoryStream);
-    FSEventStreamRelease(_workingDirectoryStream);
-    _workingDirectoryStream = NULL;
+// Explicit notifications supersede the changes queued so far from the file system watchers
+- (void)_cancelPendingUpdatesForWorkingDirectory:(BOOL)workingDirectory gitDirectory:(BOOL)gitDirectory {
+  if (workingDirectory) {
+    _workingDirectoryChanged = NO;
+  }
+  if (gitDirectory) {
+    _gitDirectoryChanged = NO;
+    _stashesChanged = NO;
+  }
+  if (!_workingDirectoryChanged && !_gitDirectoryChanged) {
+    _updatePendingTime = 0.0;
+    CFRunLoopTimerSetNextFireDate(_updateTimer, HUGE_VALF);
   }
+}
+
+- (void)_addChangedDirectory:(NSString*)path {
+  NSString* workingDirectoryPath = _workingDirectoryWatcher.path;
+  if (![path hasPrefix:workingDirectoryPath]) {  // Paths can also use a different form e.g. "/private/var" instead of "/var"
+    _changedDirectories = nil;
+    [self _resetUntrackedCacheToken];
+    return;
+  }
+  NSString* directory = [path substringFromIndex:workingDirectoryPath.length];
+  if (directory.length && ![directory hasSuffix:@"/"]) {
+    directory = [directory stringByAppendingString:@"/"];
+  }
+  [_untrackedCache invalidateDirectory:directory];
+  if (_changedDirectories.count >= kMaxIncrementalStatusDirectories) {
+    _changedDirectories = nil;
+  } else {
+    [_changedDirectories addObject:directory];
+  }
+}
+
++ (GCFileSystemWatcherBackend)fileSystemWatcherBackend {
+  return kGCFileSystemWatcherBackend_Default;
+}
+
+- (void)_reloadWorkingDirectoryWatcher {
+  [_workingDirectoryWatcher invalidate];
+  _workingDirectoryWatcher = nil;
   NSString* path = self.workingDirectoryPath;  // nil for bare repositories
   if (path) {
-    FSEventStreamContext streamContext = {0, (__bridge void*)self, NULL, NULL, NULL};
-    _workingDirectoryStream = FSEventStreamCreate(kCFAllocatorDefault, _StreamCallback, &streamContext,
-                                                  (__bridge CFArrayRef) @[ path ], kFSEventStreamEventIdSinceNow,
-                                                  kFSLatency, kFSEventStreamCreateFlagIgnoreSelf);  // This opens the path
-    if (_workingDirectoryStream) {
-      FSEventStreamScheduleWithRunLoop(_workingDirectoryStream, CFRunLoopGetMain(), kCFRunLoopCommonModes);
-      if (!FSEventStreamStart(_workingDirectoryStream)) {
-        XLOG_ERROR(@"Failed starting event stream at \"%@\"", path);
-      }
-    } else {
-      XLOG_ERROR(@"Failed creating event stream at \"%@\"", path);
-    }
+    __weak GCLiveRepository* weakSelf = self;
+    const char* gitDirectoryPath = git_repository_path(self.private);
+    _workingDirectoryWatcher = [[GCFileSystemWatcher alloc] initWithPath:path
+                                                                 backend:[self.class fileSystemWatcherBackend]
+                                                                 latency:kFSLatency
+                                                         directoryFilter:^BOOL(NSString* directoryPath) {  // Don't spend watches on the ".git" directory or ignored directories whose changes are dropped anyway
+                                                           GCLiveRepository* strongSelf = weakSelf;
+                                                           const char* fileSystemPath = directoryPath.UTF8String;
+                                                           if (!strncmp(fileSystemPath, gitDirectoryPath, strlen(gitDirectoryPath))) {
+                                                             return NO;
+                                                           }
+                                                           int ignored = 0;
+                                                           return strongSelf && (git_ignore_path_is_ignored(&ignored, strongSelf.private, fileSystemPath) == GIT_OK) && !ignored;
+                                                         }];
+    _workingDirectoryWatcher.delegate = self;
   }
+  [self _resetUntrackedCacheToken];
 }
 
 - (instancetype)initWithRepository:(git_repository*)repository error:(NSError**)error {
@@ -204,15 +368,23 @@ static void _StreamCallback(ConstFSEventStreamRef streamRef, void* clientCallBac
     _diffWhitespaceMode = kGCLiveRepositoryDiffWhitespaceMode_Normal;
     _diffMaxInterHunkLines = 0;
     _diffMaxContextLines = 3;
+    _statusQueue = dispatch_queue_create("GCLiveRepository.status", DISPATCH_QUEUE_SERIAL);
 
     _state = [super state];
 
     CFAbsoluteTime time = CFAbsoluteTimeGetCurrent();
-    _history = [self loadHistoryUsingSorting:[self.class historySorting] error:error];
+    NSUInteger windowSize = [self.class historyWindowSize];
+    NSString* cachePath = windowSize ? nil : [self.privateAppDirectoryPath stringByAppendingPathComponent:kHistoryCacheFileName];  // Windowed histories cannot be cached
+    if (windowSize) {
+      _history = [self loadHistoryUsingSorting:[self.class historySorting] maximumCommits:windowSize sinceDate:nil error:error];
+    } else {
+      _history = cachePath ? [self loadHistoryFromCacheAtPath:cachePath usingSorting:[self.class historySorting] error:error] : [self loadHistoryUsingSorting:[self.class historySorting] error:error];
+    }
     if (_history == nil) {
       return nil;
     }
     XLOG_VERBOSE(@"History loaded for \"%@\" (%lu commits scanned in %.3f seconds)", self.repositoryPath, _history.allCommits.count, CFAbsoluteTimeGetCurrent() - time);
+    [self _writeHistoryCache];
 
     NSString* path = self.repositoryPath;
     _gitDirectory = open(path.fileSystemRepresentation, O_RDONLY);  // Don't use O_EVTONLY as we do want to prevent unmounting the volume that contains the directory
@@ -221,38 +393,28 @@ static void _StreamCallback(ConstFSEventStreamRef streamRef, void* clientCallBac
     CFRunLoopTimerContext context = {0, (__bridge void*)self, NULL, NULL, NULL};
     _updateTimer = CFRunLoopTimerCreate(kCFAllocatorDefault, HUGE_VALF, HUGE_VALF, 0, 0, _TimerCallBack, &context);
     CFRunLoopAddTimer(CFRunLoopGetMain(), _updateTimer, kCFRunLoopCommonModes);
-
-    FSEventStreamContext streamContext = {0, (__bridge void*)self, NULL, NULL, NULL};
-    _gitDirectoryStream = FSEventStreamCreate(kCFAllocatorDefault, _StreamCallback, &streamContext,
-                                              (__bridge CFArrayRef) @[ path ], kFSEventStreamEventIdSinceNow,
-                                              kFSLatency, kFSEventStreamCreateFlagIgnoreSelf);  // This opens the path
-    if (_gitDirectoryStream == NULL) {
-      XLOG_ERROR(@"Failed creating event stream at \"%@\"", path);
-      return nil;
+    if (cachePath) {
+      _historyCacheTimer = CFRunLoopTimerCreate(kCFAllocatorDefault, HUGE_VALF, HUGE_VALF, 0, 0, _TimerCallBack, &context);
+      CFRunLoopAddTimer(CFRunLoopGetMain(), _historyCacheTimer, kCFRunLoopCommonModes);
     }
-    FSEventStreamScheduleWithRunLoop(_gitDirectoryStream, CFRunLoopGetMain(), kCFRunLoopCommonModes);
-    if (!FSEventStreamStart(_gitDirectoryStream)) {
-      XLOG_ERROR(@"Failed starting event stream at \"%@\"", path);
+
+    _gitDirectoryWatcher = [[GCFileSystemWatcher alloc] initWithPath:path backend:[self.class fileSystemWatcherBackend] latency:kFSLatency];
+    if (_gitDirectoryWatcher == nil) {
       return nil;
     }
+    _gitDirectoryWatcher.delegate = self;
 
-    [self _reloadWorkingDirectoryStream];
+    [self _reloadWorkingDirectoryWatcher];
   }
   return self;
 }
 
+// The history cache is not written from here as serializing a large history would block whatever thread releases the repository
+// and it's not worth it: the cache is written shortly after each history update and reloading only walks the commits that changed since
 - (void)dealloc {
   [_undoManager removeAllActionsWithTarget:self];
-  if (_workingDirectoryStream) {
-    FSEventStreamStop(_workingDirectoryStream);
-    FSEventStreamInvalidate(_workingDirectoryStream);
-    FSEventStreamRelease(_workingDirectoryStream);
-  }
-  if (_gitDirectoryStream) {
-    FSEventStreamStop(_gitDirectoryStream);
-    FSEventStreamInvalidate(_gitDirectoryStream);
-    FSEventStreamRelease(_gitDirectoryStream);
-  }
+  [_workingDirectoryWatcher invalidate];
+  [_gitDirectoryWatcher invalidate];
   if (_snapshotsTimer) {
     CFRunLoopTimerInvalidate(_snapshotsTimer);
     CFRelease(_snapshotsTimer);
@@ -261,6 +423,10 @@ static void _StreamCallback(ConstFSEventStreamRef streamRef, void* clientCallBac
     CFRunLoopTimerInvalidate(_updateTimer);
     CFRelease(_updateTimer);
   }
+  if (_historyCacheTimer) {
+    CFRunLoopTimerInvalidate(_historyCacheTimer);
+    CFRelease(_historyCacheTimer);
+  }
   if (_gitDirectory >= 0) {
     close(_gitDirectory);
   }
@@ -269,10 +435,16 @@ static void _StreamCallback(ConstFSEventStreamRef streamRef, void* clientCallBac
 #endif
 }
 
-- (void)_notifyWorkingDirectoryChanged:(BOOL)workingDirectoryChanged gitDirectoryChanged:(BOOL)gitDirectoryChanged {
+- (void)_notifyWorkingDirectoryChanged:(BOOL)workingDirectoryChanged gitDirectoryChanged:(BOOL)gitDirectoryChanged stashesChanged:(BOOL)stashesChanged updateHistoryInBackground:(BOOL)inBackground {
   if (workingDirectoryChanged) {
     if (_statusMode != kGCLiveRepositoryStatusMode_Disabled) {
-      [self _updateStatus:YES];
+      CFAbsoluteTime time = CFAbsoluteTimeGetCurrent();
+      if (gitDirectoryChanged) {
+        [self _updateStatus:YES];
+      } else {
+        [self _updateStatus:YES inDirectories:_changedDirectories];
+      }
+      _RecordUpdateCost(&_statusUpdateStatistics, CFAbsoluteTimeGetCurrent() - time);
     }
 
     if ([self.delegate respondsToSelector:@selector(repositoryWorkingDirectoryDidChange:)]) {
@@ -281,18 +453,22 @@ static void _StreamCallback(ConstFSEventStreamRef streamRef, void* clientCallBac
     [[NSNotificationCenter defaultCenter] postNotificationName:GCLiveRepositoryWorkingDirectoryDidChangeNotification object:self];
   }
   if (gitDirectoryChanged) {
+    CFAbsoluteTime time = CFAbsoluteTimeGetCurrent();
     [self _updateState];
     if (_historyUpdatesSuspended > 0) {
       _historyUpdatePending = YES;
+    } else if (inBackground && !_history.windowed) {
+      [self _updateHistoryInBackground];
     } else {
       [self _updateHistory];
     }
-    if (_stashesEnabled) {
+    if (_stashesEnabled && stashesChanged) {
       [self _updateStashes:YES];
     }
     if ((_statusMode != kGCLiveRepositoryStatusMode_Disabled) && !workingDirectoryChanged) {  // Don't update status twice!
       [self _updateStatus:YES];
     }
+    _RecordUpdateCost(&_repositoryUpdateStatistics, CFAbsoluteTimeGetCurrent() - time);
 
     if ([self.delegate respondsToSelector:@selector(repositoryDidChange:)]) {
       [self.delegate repositoryDidChange:self];
@@ -302,11 +478,15 @@ static void _StreamCallback(ConstFSEventStreamRef streamRef, void* clientCallBac
 }
 
 - (void)notifyRepositoryChanged {
-  [self _notifyWorkingDirectoryChanged:NO gitDirectoryChanged:YES];
+  [self _cancelPendingUpdatesForWorkingDirectory:NO gitDirectory:YES];
+  [self _notifyWorkingDirectoryChanged:NO gitDirectoryChanged:YES stashesChanged:YES updateHistoryInBackground:NO];  // Callers expect the history to be up-to-date on return
 }
 
 - (void)notifyWorkingDirectoryChanged {
-  [self _notifyWorkingDirectoryChanged:YES gitDirectoryChanged:NO];
+  _changedDirectories = nil;  // Changes are unknown
+  [self _resetUntrackedCacheToken];
+  [self _cancelPendingUpdatesForWorkingDirectory:YES gitDirectory:NO];
+  [self _notifyWorkingDirectoryChanged:YES gitDirectoryChanged:NO stashesChanged:NO updateHistoryInBackground:NO];
 }
 
 #pragma mark - Diffs
@@ -376,6 +556,10 @@ static void _StreamCallback(ConstFSEventStreamRef streamRef, void* clientCallBac
   return kGCHistorySorting_None;
 }
 
++ (NSUInteger)historyWindowSize {
+  return 0;
+}
+
 - (BOOL)areHistoryUpdatesSuspended {
   return _historyUpdatesSuspended > 0;
 }
@@ -395,28 +579,150 @@ static void _StreamCallback(ConstFSEventStreamRef streamRef, void* clientCallBac
   }
 }
 
+- (void)_writeHistoryCache {
+  if (_history.windowed) {
+    return;
+  }
+  NSString* path = [self.privateAppDirectoryPath stringByAppendingPathComponent:kHistoryCacheFileName];
+  if (path) {
+    [self writeHistoryInBackground:_history toCacheAtPath:path completion:NULL];  // Does nothing if the references didn't change since the cache was loaded or written
+  }
+}
+
+- (void)_didReloadHistoryWithAddedCommits:(NSArray*)addedCommits removedCommits:(NSArray*)removedCommits startTime:(CFAbsoluteTime)time {
+  XLOG_VERBOSE(@"History updated for \"%@\" (%lu commits added and %lu removed in %.3f seconds)", self.repositoryPath, addedCommits.count, removedCommits.count, CFAbsoluteTimeGetCurrent() - time);
+  _searchSession = nil;
+
+  if (_historyCacheTimer) {
+    CFRunLoopTimerSetNextFireDate(_historyCacheTimer, CFAbsoluteTimeGetCurrent() + kHistoryCacheDelay);
+  }
+
+  if (_snapshotsTimer) {
+    CFRunLoopTimerSetNextFireDate(_snapshotsTimer, CFAbsoluteTimeGetCurrent() + kAutomaticSnapshotDelay);
+    _snapshotPending = YES;
+  }
+
+  if ([self.delegate respondsToSelector:@selector(repositoryDidUpdateHistory:)]) {
+    [self.delegate repositoryDidUpdateHistory:self];
+  }
+  NSMutableDictionary* userInfo = [[NSMutableDictionary alloc] init];
+  if (addedCommits) {
+    [userInfo setObject:addedCommits forKey:GCLiveRepositoryHistoryAddedCommitsKey];
+  }
+  if (removedCommits) {
+    [userInfo setObject:removedCommits forKey:GCLiveRepositoryHistoryRemovedCommitsKey];
+  }
+  [[NSNotificationCenter defaultCenter] postNotificationName:GCLiveRepositoryHistoryDidUpdateNotification object:self userInfo:userInfo];
+
+  if (_database) {
+    [self _updateSearch];
+  } else if (_updatingDatabase) {  // Initial update from -prepareSearchInBackground:withProgressHandler:completion: may have missed the new commits
+    _databaseUpdatePending = YES;
+  }
+}
+
 - (void)_updateHistory {
+  atomic_fetch_add(&_historyUpdateID, 1);  // Supersedes any background update in flight
   NSError* error;
   BOOL referencesDidChange;
+  NSArray* addedCommits;
+  NSArray* removedCommits;
   CFAbsoluteTime time = CFAbsoluteTimeGetCurrent();
-  if ([self reloadHistory:_history referencesDidChange:&referencesDidChange addedCommits:NULL removedCommits:NULL error:&error]) {
+  if ([self reloadHistory:_history referencesDidChange:&referencesDidChange addedCommits:&addedCommits removedCommits:&removedCommits error:&error]) {
     if (referencesDidChange) {
-      XLOG_VERBOSE(@"History updated for \"%@\" (%lu commits scanned in %.3f seconds)", self.repositoryPath, _history.allCommits.count, CFAbsoluteTimeGetCurrent() - time);
+      [self _didReloadHistoryWithAddedCommits:addedCommits removedCommits:removedCommits startTime:time];
+    }
+  } else {
+    if ([self.delegate respondsToSelector:@selector(repository:historyUpdateDidFailWithError:)]) {
+      [self.delegate repository:self historyUpdateDidFailWithError:error];
+    }
+  }
+}
 
-      if (_snapshotsTimer) {
-        CFRunLoopTimerSetNextFireDate(_snapshotsTimer, CFAbsoluteTimeGetCurrent() + kAutomaticSnapshotDelay);
-        _snapshotPending = YES;
+// The whole reload i.e. walking the new commits, removing orphans, sorting and rebuilding relations is done in the background on a private repository and a copy
+// of the history, which then replaces the current history on the main thread in a single assignment so observers never see a partially updated history
+// Only copying the commit graph and looking up the references again in the live repository happen on the main thread
+- (void)_updateHistoryInBackground {
+  if (_history.windowed) {  // Windowed histories cannot be copied
+    [self _updateHistory];
+    return;
+  }
+  NSError* error;
+  NSData* graph = [self serializeHistory:_history error:&error];
+  if (graph == nil) {
+    XLOG_ERROR(@"Failed copying history for \"%@\": %@", self.repositoryPath, error);
+    [self _updateHistory];
+    return;
+  }
+  NSUInteger updateID = atomic_fetch_add(&_historyUpdateID, 1) + 1;
+  NSMutableData* tipOIDs = [[NSMutableData alloc] init];  // Ancestors of the leaves are exactly the commits already in the history
+  for (GCHistoryCommit* commit in _history.leafCommits) {
+    [tipOIDs appendBytes:commit.OID length:sizeof(git_oid)];
+  }
+  GCHistorySorting sorting = _history.sorting;
+  CFAbsoluteTime time = CFAbsoluteTimeGetCurrent();
+  BOOL (^cancelBlock)(void) = ^BOOL {
+    return atomic_load(&self->_historyUpdateID) != updateID;
+  };
+  dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+    NSError* updateError;
+    BOOL referencesDidChange = NO;
+    NSArray* addedCommits = nil;
+    NSArray* removedCommits = nil;
+    GCRepository* repository = cancelBlock() ? nil : [[GCRepository alloc] initWithExistingLocalRepository:self.repositoryPath error:&updateError];  // We cannot use self because we access the repo on a background thread
+    GCHistory* history = [repository loadHistoryFromSerializedHistory:graph usingSorting:sorting error:&updateError];
+    GCHistoryPrefetch* prefetch = history ? [repository prefetchCommitsExcludingAncestorsOfOIDs:tipOIDs cancelBlock:cancelBlock error:&updateError] : nil;
+    if (history && !prefetch && !cancelBlock()) {
+      XLOG_ERROR(@"Failed prefetching history for \"%@\": %@", self.repositoryPath, updateError);  // Not fatal as reloading the history will load the missing commits
+    }
+    BOOL success = history && !cancelBlock() && [repository reloadHistory:history usingPrefetch:prefetch referencesDidChange:&referencesDidChange addedCommits:&addedCommits removedCommits:&removedCommits error:&updateError];
+    dispatch_async(dispatch_get_main_queue(), ^{
+      if (cancelBlock()) {
+        XLOG_VERBOSE(@"Discarding superseded history update for \"%@\"", self.repositoryPath);
+        return;
       }
-
-      if ([self.delegate respondsToSelector:@selector(repositoryDidUpdateHistory:)]) {
-        [self.delegate repositoryDidUpdateHistory:self];
+      if (_historyUpdatesSuspended > 0) {  // Updates were suspended while reloading
+        _historyUpdatePending = YES;
+        return;
       }
-      [[NSNotificationCenter defaultCenter] postNotificationName:GCLiveRepositoryHistoryDidUpdateNotification object:self];
-
-      if (_database) {
-        [self _updateSearch];
+      if (!success) {
+        if ([self.delegate respondsToSelector:@selector(repository:historyUpdateDidFailWithError:)]) {
+          [self.delegate repository:self historyUpdateDidFailWithError:updateError];
+        }
+        return;
+      }
+      if (!referencesDidChange) {
+        return;
       }
+      NSError* adoptError;
+      if (![self adoptHistory:history removedCommits:removedCommits error:&adoptError]) {  // The private repository is still open as the block retains it
+        XLOG_VERBOSE(@"Reloading history for \"%@\" on the main thread: %@", self.repositoryPath, adoptError);  // References moved since so the new history is already out of date
+        [self _updateHistory];
+        return;
+      }
+      _history = history;
+      [self _didReloadHistoryWithAddedCommits:addedCommits removedCommits:removedCommits startTime:time];
+    });
+  });
+}
+
+- (void)extendHistory {
+  if (!_history.windowed || _history.complete || _historyUpdatesSuspended) {
+    return;
+  }
+  NSError* error;
+  NSArray* addedCommits;
+  NSArray* removedCommits;
+  CFAbsoluteTime time = CFAbsoluteTimeGetCurrent();
+  atomic_fetch_add(&_historyUpdateID, 1);  // References are reloaded as well which supersedes any background update in flight
+  if ([self extendHistory:_history byCommits:[self.class historyWindowSize] addedCommits:&addedCommits removedCommits:&removedCommits error:&error]) {
+    XLOG_VERBOSE(@"History extended for \"%@\" (%lu commits loaded in %.3f seconds)", self.repositoryPath, addedCommits.count, CFAbsoluteTimeGetCurrent() - time);
+    _searchSession = nil;
+
+    if ([self.delegate respondsToSelector:@selector(repositoryDidUpdateHistory:)]) {
+      [self.delegate repositoryDidUpdateHistory:self];
     }
+    [[NSNotificationCenter defaultCenter] postNotificationName:GCLiveRepositoryHistoryDidUpdateNotification object:self userInfo:@{GCLiveRepositoryHistoryAddedCommitsKey : addedCommits ?: @[], GCLiveRepositoryHistoryRemovedCommitsKey : removedCommits ?: @[]}];
   } else {
     if ([self.delegate respondsToSelector:@selector(repository:historyUpdateDidFailWithError:)]) {
       [self.delegate repository:self historyUpdateDidFailWithError:error];
@@ -424,24 +730,48 @@ static void _StreamCallback(ConstFSEventStreamRef streamRef, void* clientCallBac
   }
 }
 
+- (NSString*)_databasePath {
+  return _sharedSearchDatabasePath ?: [self.privateAppDirectoryPath stringByAppendingPathComponent:kCommitDatabaseFileName];
+}
+
+- (GCCommitDatabaseOptions)_databaseOptions {
+  return (_databaseIndexesDiffs ? kGCCommitDatabaseOptions_IndexDiffs : 0) | (_sharedSearchDatabasePath ? kGCCommitDatabaseOptions_Shared : 0);
+}
+
 - (void)_updateDatabaseInBackgroundWithProgressHandler:(GCCommitDatabaseProgressHandler)handler
                                             completion:(void (^)(BOOL success, NSError* error))completion {
   XLOG_DEBUG_CHECK(!_updatingDatabase);
-  NSString* path = [self.privateAppDirectoryPath stringByAppendingPathComponent:kCommitDatabaseFileName];
+  NSString* path = [self _databasePath];
+  GCCommitDatabaseOptions options = [self _databaseOptions];
+  BOOL updateChangedPathIndex = !(options & kGCCommitDatabaseOptions_IndexDiffs);  // File history searches use the changed-path index instead of the database in that case
+  NSString* appDirectoryPath = self.privateAppDirectoryPath;
+  NSString* changedPathIndexPath = appDirectoryPath ? [appDirectoryPath stringByAppendingPathComponent:kChangedPathIndexFileName] : nil;
   _updatingDatabase = YES;
   dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), ^{
     NSError* error;
     GCRepository* repository = [[GCRepository alloc] initWithExistingLocalRepository:self.repositoryPath error:&error];  // We cannot use self because we access the repo on a background thread
     GCCommitDatabase* database = repository ? [[GCCommitDatabase alloc] initWithRepository:repository
                                                                               databasePath:path
-                                                                                   options:(_databaseIndexesDiffs ? kGCCommitDatabaseOptions_IndexDiffs : 0)
-                                                                                   error:&error]
+                                                                                   options:options
+                                                                                     error:&error]
                                             : nil;
     BOOL success = [database updateWithProgressHandler:handler error:&error];
     database = nil;  // Release and close immediately
+    GCChangedPathIndex* changedPathIndex = nil;
+    if (success && updateChangedPathIndex) {
+      NSError* indexError;
+      changedPathIndex = [[GCChangedPathIndex alloc] initWithPath:changedPathIndexPath];
+      if (![changedPathIndex updateWithRepository:repository error:&indexError] || ![changedPathIndex writeIfNeeded:&indexError]) {
+        XLOG_ERROR(@"Failed updating changed-path index for \"%@\": %@", self.repositoryPath, indexError);  // Not fatal as commits missing from the index are checked directly
+      }
+    }
+    repository = nil;
     dispatch_async(dispatch_get_main_queue(), ^{
       XLOG_DEBUG_CHECK(_updatingDatabase);
       _updatingDatabase = NO;
+      if (changedPathIndex) {
+        _changedPathIndex = changedPathIndex;  // Handed over to the main thread which only queries it
+      }
       completion(success, error);
     });
   });
@@ -449,12 +779,15 @@ static void _StreamCallback(ConstFSEventStreamRef streamRef, void* clientCallBac
 
 - (void)_updateSearch {
   XLOG_DEBUG_CHECK(_database);
+  _databaseUpToDate = NO;
   if (_updatingDatabase) {
     _databaseUpdatePending = YES;
   } else {
     [self _updateDatabaseInBackgroundWithProgressHandler:NULL
                                               completion:^(BOOL success, NSError* error) {
                                                 if (success) {
+                                                  _databaseUpToDate = YES;
+                                                  _searchSession = nil;
                                                   if ([self.delegate respondsToSelector:@selector(repositoryDidUpdateSearch:)]) {
                                                     [self.delegate repositoryDidUpdateSearch:self];
                                                   }
@@ -616,6 +949,8 @@ static void _StreamCallback(ConstFSEventStreamRef streamRef, void* clientCallBac
     if (_statusMode != kGCLiveRepositoryStatusMode_Disabled) {
       [self _updateStatus:NO];
     } else {
+      _statusUpdateID += 1;  // Discards any incremental update in flight
+      _inFlightStatusDirectories = nil;
       _unifiedStatus = nil;
       _indexStatus = nil;
       _indexConflicts = nil;
@@ -624,7 +959,297 @@ static void _StreamCallback(ConstFSEventStreamRef streamRef, void* clientCallBac
   }
 }
 
+// Returns the literal Git paths of all the files whose status could have changed in these directories, relying on file system events being reported for
+// the directories containing the changes - Subdirectories that are not both in the index and on disk are included recursively as they were added, deleted or renamed
+// Ignore and attributes files also apply to the subdirectories which may not have changed so they require a full status update
+// Changes are detected from the change time of the files as the directories containing them are reported but not which files changed
+// These run on the status queue so they must only use the repository, index and deltas passed in
+static BOOL _RuleFilesChangedInDirectory(NSString* workingDirectoryPath, NSString* directory, time_t lastUpdateTime, git_index* index, NSArray* deltas) {
+  for (NSString* name in @[ @".gitignore", @".gitattributes" ]) {
+    NSString* path = [directory stringByAppendingString:name];
+    struct stat info;
+    if (!lstat([workingDirectoryPath stringByAppendingString:path].fileSystemRepresentation, &info)) {
+      if (info.st_ctime >= lastUpdateTime) {
+        return YES;
+      }
+    } else {
+      const char* gitPath = GCGitPathFromFileSystemPath(path);
+      BOOL existed = git_index_get_bypath(index, gitPath, 0) != NULL;
+      for (GCDiffDelta* delta in deltas) {
+        if (!strcmp(delta.private->new_file.path, gitPath)) {
+          existed = (delta.change != kGCFileDiffChange_Deleted);  // Already reported as deleted
+          break;
+        }
+      }
+      if (existed) {
+        return YES;
+      }
+    }
+  }
+  return NO;
+}
+
+static NSArray* _StatusFilePatternsForDirectories(GCRepository* repository, NSString* workingDirectoryPath, NSSet* directories, time_t lastUpdateTime, GCIndex* index, NSArray* deltas, BOOL* rulesChanged) {
+  static NSCharacterSet* set = nil;
+  static dispatch_once_t onceToken;
+  dispatch_once(&onceToken, ^{
+    set = [NSCharacterSet characterSetWithCharactersInString:@"?*[]"];
+  });
+  if ([[NSFileManager defaultManager] fileExistsAtPath:[workingDirectoryPath stringByAppendingPathComponent:@".gitmodules"]]) {  // Changes inside submodules are not reported for the directories containing them
+    return nil;
+  }
+  NSMutableSet* patterns = [[NSMutableSet alloc] init];
+  for (NSString* directory in directories) {
+    if (_RuleFilesChangedInDirectory(workingDirectoryPath, directory, lastUpdateTime, index.private, deltas)) {
+      XLOG_DEBUG(@"Ignore or attributes files changed in \"%@\"", directory);
+      *rulesChanged = YES;  // Directories may not be ignored anymore or be ignored now
+      return nil;
+    }
+    const char* prefix = GCGitPathFromFileSystemPath(directory);
+    size_t prefixLength = strlen(prefix);
+    NSMutableSet* indexDirectories = [[NSMutableSet alloc] init];
+    NSMutableSet* diskDirectories = [[NSMutableSet alloc] init];
+    NSMutableSet* deltaDirectories = [[NSMutableSet alloc] init];
+    void (^addPath)(const char*, NSMutableSet*) = ^(const char* path, NSMutableSet* childDirectories) {
+      if (path && !strncmp(path, prefix, prefixLength)) {
+        const char* separator = strchr(&path[prefixLength], '/');
+        NSString* string = separator ? [[NSString alloc] initWithBytes:path length:(separator - path + 1) encoding:NSUTF8StringEncoding] : GCFileSystemPathFromGitPath(path);
+        if (string) {
+          [(separator ? childDirectories : patterns) addObject:string];
+        }
+      }
+    };
+
+    // Scan index
+    git_index* gitIndex = index.private;
+    BOOL icase = git_index_caps(gitIndex) & GIT_INDEX_CAPABILITY_IGNORE_CASE ? YES : NO;  // Entries are sorted case-insensitively in that case
+    size_t position = 0;
+    if (prefixLength && (git_index_find_prefix(&position, gitIndex, prefix) != GIT_OK)) {
+      position = git_index_entrycount(gitIndex);
+    }
+    for (size_t count = git_index_entrycount(gitIndex); position < count; ++position) {
+      const git_index_entry* entry = git_index_get_byindex(gitIndex, position);
+      if (icase ? strncasecmp(entry->path, prefix, prefixLength) : strncmp(entry->path, prefix, prefixLength)) {
+        break;
+      }
+      addPath(entry->path, indexDirectories);
+    }
+
+    // Scan deltas
+    for (GCDiffDelta* delta in deltas) {
+      addPath(delta.private->old_file.path, deltaDirectories);
+      addPath(delta.private->new_file.path, deltaDirectories);
+    }
+
+    // Scan disk
+    DIR* dir = opendir([workingDirectoryPath stringByAppendingString:directory].fileSystemRepresentation);
+    if (dir) {
+      struct dirent* entry;
+      while ((entry = readdir(dir))) {
+        if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, "..") || (!prefixLength && !strcmp(entry->d_name, ".git"))) {
+          continue;
+        }
+        NSString* name = [NSString stringWithUTF8String:entry->d_name];
+        if (name == nil) {
+          closedir(dir);
+          return nil;
+        }
+        NSString* path = [directory stringByAppendingString:name];
+        BOOL isDirectory = (entry->d_type == DT_DIR);
+        if (entry->d_type == DT_UNKNOWN) {
+          struct stat info;
+          isDirectory = !lstat([workingDirectoryPath stringByAppendingString:path].fileSystemRepresentation, &info) && S_ISDIR(info.st_mode);
+        }
+        if (isDirectory) {
+          [diskDirectories addObject:[path stringByAppendingString:@"/"]];
+        } else {
+          [patterns addObject:path];
+        }
+      }
+      closedir(dir);
+    }
+
+    // Recurse into subdirectories that changed (ignored ones are only needed to clear the deltas they still contain)
+    NSMutableSet* otherDirectories = [[NSMutableSet alloc] initWithSet:deltaDirectories];
+    [otherDirectories unionSet:indexDirectories];
+    [otherDirectories unionSet:diskDirectories];
+    [indexDirectories intersectSet:diskDirectories];
+    [otherDirectories minusSet:indexDirectories];
+    for (NSString* path in otherDirectories) {
+      int ignored = 0;
+      if ((git_ignore_path_is_ignored(&ignored, repository.private, GCGitPathFromFileSystemPath(path)) == GIT_OK) && ignored && [diskDirectories containsObject:path] && ![deltaDirectories containsObject:path]) {
+        continue;
+      }
+      [patterns addObject:path];
+    }
+
+    if (patterns.count > kMaxIncrementalStatusFilePatterns) {
+      return nil;
+    }
+  }
+  for (NSString* pattern in patterns) {
+    if ([pattern rangeOfCharacterFromSet:set].location != NSNotFound) {  // Patterns must be matched literally
+      return nil;
+    }
+  }
+  return patterns.allObjects;
+}
+
+- (BOOL)_canUpdateStatusIncrementally {
+  BOOL unified = (_statusMode == kGCLiveRepositoryStatusMode_Unified);
+  GCDiff* status = unified ? _unifiedStatus : _workingDirectoryStatus;
+  return status && (unified || _indexStatus) && _indexConflicts && (CFAbsoluteTimeGetCurrent() <= _lastFullStatusUpdateTime + kFullStatusUpdateInterval);
+}
+
+// Returns NO if the status cannot be updated incrementally and a full status update is required
+- (BOOL)_updateStatusWithFilePatterns:(NSArray*)patterns unifiedDiff:(GCDiff**)unifiedDiff workingDirectoryDiff:(GCDiff**)workdirDiff {
+  if (![self _canUpdateStatusIncrementally]) {
+    return NO;
+  }
+  if (patterns.count == 0) {
+    *unifiedDiff = _unifiedStatus;
+    *workdirDiff = _workingDirectoryStatus;
+    return YES;
+  }
+  BOOL unified = (_statusMode == kGCLiveRepositoryStatusMode_Unified);
+  GCDiff* status = unified ? _unifiedStatus : _workingDirectoryStatus;
+
+  NSError* error;
+  GCIndex* index = [self readRepositoryIndex:&error];
+  if (index == nil) {
+    XLOG_ERROR(@"Failed reading index for incremental status update: %@", error);
+    return NO;
+  }
+  GCDiff* diff;
+  if (unified) {
+    GCCommit* headCommit;
+    if ([self lookupHEADCurrentCommit:&headCommit branch:NULL error:&error]) {
+      diff = [self diffWorkingDirectoryWithCommit:headCommit
+                                       usingIndex:index
+                                     filePatterns:patterns
+                                   untrackedCache:nil
+                                          options:(self.diffBaseOptions | kGCDiffOption_IncludeUntracked | kGCDiffOption_FindRenames)
+                                maxInterHunkLines:_diffMaxInterHunkLines
+                                  maxContextLines:_diffMaxContextLines
+                                            error:&error];
+    }
+  } else {
+    diff = [self diffWorkingDirectoryWithIndex:index
+                                  filePatterns:patterns
+                                untrackedCache:nil
+                                       options:(self.diffBaseOptions | kGCDiffOption_IncludeUntracked)
+                             maxInterHunkLines:_diffMaxInterHunkLines
+                               maxContextLines:_diffMaxContextLines
+                                         error:&error];
+  }
+  if (diff == nil) {
+    XLOG_ERROR(@"Failed computing incremental status update: %@", error);
+    return NO;
+  }
+  GCDiff* mergedDiff = [[GCDiff alloc] initWithDiff:status replacingDeltasMatchingFilePaths:patterns withDiff:diff];
+
+  // Rename detection can pair files inside and outside the directories so make sure results would be the same as a full status update
+  if (unified) {
+    BOOL keptSources = NO;
+    BOOL keptTargets = NO;
+    BOOL scopeSources = NO;
+    BOOL scopeTargets = NO;
+    NSHashTable* keptDeltas = [NSHashTable hashTableWithOptions:NSPointerFunctionsObjectPointerPersonality];
+    for (GCDiffDelta* delta in mergedDiff.deltas) {
+      BOOL source = (delta.change == kGCFileDiffChange_Deleted);
+      BOOL target = (delta.change == kGCFileDiffChange_Added) || (delta.change == kGCFileDiffChange_Untracked);
+      if (delta.diff == diff) {
+        scopeSources |= source;
+        scopeTargets |= target;
+      } else {
+        [keptDeltas addObject:delta];
+        keptSources |= source;
+        keptTargets |= target;
+      }
+    }
+    for (GCDiffDelta* delta in status.deltas) {
+      if (![keptDeltas containsObject:delta]) {
+        if ((delta.change == kGCFileDiffChange_Renamed) || (delta.change == kGCFileDiffChange_Copied)) {  // The other side of the pair may not be in the directories
+          return NO;
+        }
+        scopeSources |= (delta.change == kGCFileDiffChange_Deleted);
+        scopeTargets |= (delta.change == kGCFileDiffChange_Added) || (delta.change == kGCFileDiffChange_Untracked);
+      }
+    }
+    if ((scopeSources && keptTargets) || (scopeTargets && keptSources)) {
+      return NO;
+    }
+    *unifiedDiff = mergedDiff;
+  } else {
+    *workdirDiff = mergedDiff;
+  }
+  return YES;
+}
+
+- (GCUntrackedCache*)_untrackedCache {
+  if (_untrackedCache == nil) {
+    NSString* path = self.privateAppDirectoryPath;
+    _untrackedCache = [[GCUntrackedCache alloc] initWithPath:(path ? [path stringByAppendingPathComponent:kUntrackedCacheFileName] : nil)];
+    [self _resetUntrackedCacheToken];
+  }
+  return _untrackedCache;
+}
+
+// Directories changed since the cache was last used are only known for the lifetime of the watcher and as long as no file system events were dropped
+- (void)_resetUntrackedCacheToken {
+  _untrackedCache.fileSystemMonitorToken = [[NSUUID UUID] UUIDString];
+}
+
 - (void)_updateStatus:(BOOL)notify {
+  [self _updateStatus:notify inDirectories:nil];
+}
+
+// Pass the directories changed since the last status update to only diff the files they contain and merge the results into the current status
+// Scanning the directories happens on the status queue so the status is then updated asynchronously, unless a full status update is required
+- (void)_updateStatus:(BOOL)notify inDirectories:(NSSet*)directories {
+  NSUInteger updateID = ++_statusUpdateID;  // Supersedes any incremental update in flight
+  _changedDirectories = [[NSMutableSet alloc] init];
+  if (directories && _inFlightStatusDirectories) {  // The directories of the superseded update must still be scanned
+    directories = [directories setByAddingObjectsFromSet:_inFlightStatusDirectories];
+  }
+  _inFlightStatusDirectories = nil;
+  if ((directories.count == 0) || ![self _canUpdateStatusIncrementally]) {
+    [self _updateStatus:notify withFilePatterns:(directories ? @[] : nil)];
+    return;
+  }
+
+  _inFlightStatusDirectories = directories;
+  NSString* repositoryPath = self.repositoryPath;
+  NSString* workingDirectoryPath = _workingDirectoryWatcher.path;
+  time_t lastUpdateTime = (time_t)floor(_lastStatusUpdateTime + kCFAbsoluteTimeIntervalSince1970);  // File system times may only have a 1 second resolution
+  NSArray* deltas = (_statusMode == kGCLiveRepositoryStatusMode_Unified ? _unifiedStatus : _workingDirectoryStatus).deltas;
+  dispatch_async(_statusQueue, ^{
+    NSError* error;
+    if (self->_statusRepository == nil) {
+      self->_statusRepository = [[GCRepository alloc] initWithExistingLocalRepository:repositoryPath error:&error];  // We cannot use self because we access the repo on a background thread
+    }
+    GCIndex* index = [self->_statusRepository readRepositoryIndex:&error];
+    BOOL rulesChanged = NO;
+    NSArray* patterns = index ? _StatusFilePatternsForDirectories(self->_statusRepository, workingDirectoryPath, directories, lastUpdateTime, index, deltas, &rulesChanged) : nil;
+    if (index == nil) {
+      XLOG_ERROR(@"Failed reading index for incremental status update: %@", error);
+    }
+    dispatch_async(dispatch_get_main_queue(), ^{
+      if (self->_statusUpdateID != updateID) {
+        XLOG_VERBOSE(@"Discarding superseded status update for \"%@\"", self.repositoryPath);
+        return;
+      }
+      self->_inFlightStatusDirectories = nil;
+      if (rulesChanged) {
+        [self->_workingDirectoryWatcher reloadDirectoryFilter];
+      }
+      [self _updateStatus:notify withFilePatterns:patterns];
+    });
+  });
+}
+
+// Pass nil file patterns for a full status update
+- (void)_updateStatus:(BOOL)notify withFilePatterns:(NSArray*)patterns {
   BOOL success = YES;
   GCDiff* unifiedDiff = nil;
   GCDiff* indexDiff = nil;
@@ -633,34 +1258,49 @@ static void _StreamCallback(ConstFSEventStreamRef streamRef, void* clientCallBac
   NSError* error;
 
   CFAbsoluteTime time = CFAbsoluteTimeGetCurrent();
-  if (_statusMode == kGCLiveRepositoryStatusMode_Unified) {
-    unifiedDiff = [self diffWorkingDirectoryWithHEAD:nil
-                                             options:(self.diffBaseOptions | kGCDiffOption_IncludeUntracked | kGCDiffOption_FindRenames)
-                                   maxInterHunkLines:_diffMaxInterHunkLines
-                                     maxContextLines:_diffMaxContextLines
-                                               error:&error];
+  if (patterns && [self _updateStatusWithFilePatterns:patterns unifiedDiff:&unifiedDiff workingDirectoryDiff:&workdirDiff]) {
+    indexDiff = _indexStatus;
+    conflicts = _indexConflicts;  // The index has not changed
+    XLOG_DEBUG(@"Status incrementally updated for %lu file patterns", (unsigned long)patterns.count);
+  } else if (_statusMode == kGCLiveRepositoryStatusMode_Unified) {
+    _lastFullStatusUpdateTime = time;
+    GCCommit* headCommit;
+    if ([self lookupHEADCurrentCommit:&headCommit branch:NULL error:&error]) {
+      unifiedDiff = [self diffWorkingDirectoryWithCommit:headCommit
+                                              usingIndex:nil
+                                            filePatterns:nil
+                                          untrackedCache:[self _untrackedCache]
+                                                 options:(self.diffBaseOptions | kGCDiffOption_IncludeUntracked | kGCDiffOption_FindRenames)
+                                       maxInterHunkLines:_diffMaxInterHunkLines
+                                         maxContextLines:_diffMaxContextLines
+                                                   error:&error];
+    }
     if (!unifiedDiff) {
       success = NO;
     }
   } else {
     XLOG_DEBUG_CHECK(_statusMode == kGCLiveRepositoryStatusMode_Normal);
+    _lastFullStatusUpdateTime = time;
     indexDiff = [self diffRepositoryIndexWithHEAD:nil
                                           options:(self.diffBaseOptions | kGCDiffOption_FindRenames)
                                 maxInterHunkLines:_diffMaxInterHunkLines
                                   maxContextLines:_diffMaxContextLines
                                             error:&error];
     if (indexDiff) {
-      workdirDiff = [self diffWorkingDirectoryWithRepositoryIndex:nil
-                                                          options:(self.diffBaseOptions | kGCDiffOption_IncludeUntracked)
-                                                maxInterHunkLines:_diffMaxInterHunkLines
-                                                  maxContextLines:_diffMaxContextLines
-                                                            error:&error];
+      workdirDiff = [self diffWorkingDirectoryWithIndex:nil
+                                           filePatterns:nil
+                                         untrackedCache:[self _untrackedCache]
+                                                options:(self.diffBaseOptions | kGCDiffOption_IncludeUntracked)
+                                      maxInterHunkLines:_diffMaxInterHunkLines
+                                        maxContextLines:_diffMaxContextLines
+                                                  error:&error];
     }
     if (!indexDiff || !workdirDiff) {
       success = NO;
     }
   }
-  if (success) {
+  if (success && !conflicts) {  // Full status update
+    [_untrackedCache writeInBackgroundIfNeeded:NULL];
     conflicts = [self checkConflicts:&error];
     if (!conflicts) {
       success = NO;
@@ -668,7 +1308,22 @@ static void _StreamCallback(ConstFSEventStreamRef streamRef, void* clientCallBac
   }
 
   if (success) {
-    if (((_statusMode == kGCLiveRepositoryStatusMode_Unified) && ![_unifiedStatus isEqualToDiff:unifiedDiff]) || ((_statusMode != kGCLiveRepositoryStatusMode_Unified) && (![_indexStatus isEqualToDiff:indexDiff] || ![_workingDirectoryStatus isEqualToDiff:workdirDiff])) || ![_indexConflicts isEqualToDictionary:conflicts]) {
+    _lastStatusUpdateTime = time;
+    NSMutableDictionary* userInfo = [[NSMutableDictionary alloc] init];
+    BOOL changed = ![_indexConflicts isEqualToDictionary:conflicts];
+    userInfo[GCLiveRepositoryStatusConflictsChangedKey] = @(changed);
+    if (_statusMode == kGCLiveRepositoryStatusMode_Unified) {
+      GCDiffChangeSet* changes = [[GCDiffChangeSet alloc] initWithDiff:_unifiedStatus toDiff:unifiedDiff];
+      userInfo[GCLiveRepositoryStatusUnifiedChangesKey] = changes;
+      changed |= !_unifiedStatus || !changes.empty;
+    } else {
+      GCDiffChangeSet* indexChanges = [[GCDiffChangeSet alloc] initWithDiff:_indexStatus toDiff:indexDiff];
+      GCDiffChangeSet* workdirChanges = [[GCDiffChangeSet alloc] initWithDiff:_workingDirectoryStatus toDiff:workdirDiff];
+      userInfo[GCLiveRepositoryStatusIndexChangesKey] = indexChanges;
+      userInfo[GCLiveRepositoryStatusWorkingDirectoryChangesKey] = workdirChanges;
+      changed |= !_indexStatus || !_workingDirectoryStatus || !indexChanges.empty || !workdirChanges.empty;
+    }
+    if (changed) {
       XLOG_VERBOSE(@"Status updated for \"%@\" in %.3f seconds", self.repositoryPath, CFAbsoluteTimeGetCurrent() - time);
       _unifiedStatus = unifiedDiff;
       _indexStatus = indexDiff;
@@ -679,7 +1334,7 @@ static void _StreamCallback(ConstFSEventStreamRef streamRef, void* clientCallBac
         if ([self.delegate respondsToSelector:@selector(repositoryDidUpdateStatus:)]) {
           [self.delegate repositoryDidUpdateStatus:self];
         }
-        [[NSNotificationCenter defaultCenter] postNotificationName:GCLiveRepositoryStatusDidUpdateNotification object:self];
+        [[NSNotificationCenter defaultCenter] postNotificationName:GCLiveRepositoryStatusDidUpdateNotification object:self userInfo:userInfo];
       }
     } else {
       XLOG_VERBOSE(@"Status checked for \"%@\" in %.3f seconds", self.repositoryPath, CFAbsoluteTimeGetCurrent() - time);
@@ -938,6 +1593,15 @@ static void _StreamCallback(ConstFSEventStreamRef streamRef, void* clientCallBac
 
 @implementation GCLiveRepository (GCCommitDatabase)
 
+- (NSString*)sharedSearchDatabasePath {
+  return _sharedSearchDatabasePath;
+}
+
+- (void)setSharedSearchDatabasePath:(NSString*)path {
+  XLOG_DEBUG_CHECK(_database == nil);
+  _sharedSearchDatabasePath = [path copy];
+}
+
 - (void)prepareSearchInBackground:(BOOL)indexDiffs
               withProgressHandler:(GCCommitDatabaseProgressHandler)handler
                        completion:(void (^)(BOOL success, NSError* error))completion {
@@ -946,12 +1610,12 @@ static void _StreamCallback(ConstFSEventStreamRef streamRef, void* clientCallBac
     [self _updateDatabaseInBackgroundWithProgressHandler:handler
                                               completion:^(BOOL success, NSError* error) {
                                                 if (success) {
-                                                  NSString* path = [self.privateAppDirectoryPath stringByAppendingPathComponent:kCommitDatabaseFileName];
                                                   _database = [[GCCommitDatabase alloc] initWithRepository:self
-                                                                                              databasePath:path
-                                                                                                   options:((_databaseIndexesDiffs ? kGCCommitDatabaseOptions_IndexDiffs : 0) | kGCCommitDatabaseOptions_QueryOnly)
+                                                                                              databasePath:[self _databasePath]
+                                                                                                   options:([self _databaseOptions] | kGCCommitDatabaseOptions_QueryOnly)
                                                                                                      error:&error];
                                                   if (_database) {
+                                                    _databaseUpToDate = YES;
                                                     if (_databaseUpdatePending) {
                                                       [self _updateSearch];
                                                       _databaseUpdatePending = NO;
@@ -979,9 +1643,14 @@ static BOOL _MatchReference(NSString* match, NSString* name) {
 
   match = [match stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
   bool searchFileHistoryOnly = [match hasPrefix:@"/"];
-  // Search file history directly
-  if (match.length >= (kMinSearchLength + 1) && searchFileHistoryOnly) {
-    NSArray* fileCommits = [_history.repository lookupCommitsForFile:[match substringFromIndex:1] followRenames:YES error:NULL];
+  // Search file history directly - Walk the history while the database is being updated as it would miss the commits not indexed yet
+  if (match.length >= (kMinSearchLength + 1) && searchFileHistoryOnly && (_database.options & kGCCommitDatabaseOptions_IndexDiffs) && _databaseUpToDate) {
+    NSArray* fileCommits = [_database findCommitsUsingHistory:_history forFile:[match substringFromIndex:1] followRenames:YES error:NULL];  // Ignore errors
+    if (fileCommits.count > 0) {
+      [results addObjectsFromArray:fileCommits];
+    }
+  } else if (match.length >= (kMinSearchLength + 1) && searchFileHistoryOnly) {
+    NSArray* fileCommits = [_history.repository lookupCommitsForFile:[match substringFromIndex:1] followRenames:YES changedPathIndex:_changedPathIndex error:NULL];  // Index is built while updating the database unless it indexes diffs - Commits missing from the index are checked directly
     if (fileCommits.count > 0) {
       [results addObjectsFromArray:fileCommits];
     }
@@ -1033,8 +1702,12 @@ static BOOL _MatchReference(NSString* match, NSString* name) {
       }
     }
 
-    // Search commits
-    [results addObjectsFromArray:[_database findCommitsUsingHistory:_history matching:match error:NULL]];  // Ignore errors
+    // Search commits (typing more characters or terms refines the previous search)
+    if (_searchSession == nil) {
+      _searchSession = [_database searchSessionUsingHistory:_history];
+      _searchSession.matchesLastTermAsPrefix = YES;
+    }
+    [results addObjectsFromArray:[_searchSession findCommitsMatching:match error:NULL]];  // Ignore errors
   }
   return results;
 }
@@ -40,9 +40,17 @@
   return self;
 }
 
+- (void)rebindToRepository:(GCRepository*)repository {
+  _repository = repository;
+}
+
+- (const git_oid*)OID {
+  return git_object_id(_private);
+}
+
 - (NSString*)SHA1 {
   if (_sha1 == nil) {
-    _sha1 = GCGitOIDToSHA1(git_object_id(_private));
+    _sha1 = GCGitOIDToSHA1(self.OID);
   }
   return _sha1;
 }
@@ -60,13 +68,17 @@
 
 @implementation GCObject (Extensions)
 
+static inline const git_oid* _ObjectOID(GCObject* object) {
+  return object->_private ? git_object_id(object->_private) : object.OID;  // Avoid messaging in the common case
+}
+
 - (NSUInteger)hash {
-  const git_oid* oid = git_object_id(_private);
+  const git_oid* oid = _ObjectOID(self);
   return *((NSUInteger*)oid->id);  // Use the first bytes of the SHA1
 }
 
 static inline BOOL _EqualObjects(GCObject* object1, GCObject* object2) {
-  return (object1 == object2) || git_oid_equal(git_object_id(object1->_private), git_object_id(object2->_private));
+  return (object1 == object2) || git_oid_equal(_ObjectOID(object1), _ObjectOID(object2));
 }
 
 - (BOOL)isEqualToObject:(GCObject*)object {
@@ -144,6 +144,41 @@ extern int git_submodule_foreach_block(git_repository* repo, int (^block)(git_su
 - (BOOL)runWithArguments:(NSArray*)arguments stdin:(NSData*)stdin stdout:(NSData**)stdout stderr:(NSData**)stderr exitStatus:(int*)exitStatus error:(NSError**)error;  // Returns NO if "exitStatus" is NULL and executable exits with a non-zero status
 @end
 
+typedef NS_ENUM(NSUInteger, GCFileSystemWatcherBackend) {
+  kGCFileSystemWatcherBackend_Default = 0,  // FSEvents on macOS and inotify on Linux
+  kGCFileSystemWatcherBackend_FSEvents,
+  kGCFileSystemWatcherBackend_Inotify,
+  kGCFileSystemWatcherBackend_Manual  // Changes only come from -injectChangeAtPath:mustRescan: and are only delivered by -flush (for tests)
+};
+
+@class GCFileSystemWatcher;
+
+@protocol GCFileSystemWatcherDelegate <NSObject>
+- (void)fileSystemWatcher:(GCFileSystemWatcher*)watcher didReceiveChangesAtPaths:(NSArray*)paths rescanPaths:(NSArray*)rescanPaths;  // Paths are unique and sorted - Rescan paths are directories whose events were dropped and may be missing the trailing slash
+@end
+
+@interface GCFileSystemWatcher : NSObject
+@property(nonatomic, weak) id<GCFileSystemWatcherDelegate> delegate;
+@property(nonatomic, readonly) NSString* path;
+@property(nonatomic, readonly) GCFileSystemWatcherBackend backend;
+@property(nonatomic, readonly) CFTimeInterval latency;
+@property(nonatomic) NSUInteger maximumPendingPaths;  // Default is 1,000 - Pending changes beyond this many paths are collapsed into a rescan of the watched path
+@property(nonatomic, readonly, copy) BOOL (^directoryFilter)(NSString* path);
+@property(nonatomic, readonly, getter=isDegraded) BOOL degraded;  // Inotify only - YES while some directories cannot be watched because of the watch limit in which case the watched path is rescanned periodically
+- (instancetype)initWithPath:(NSString*)path backend:(GCFileSystemWatcherBackend)backend latency:(CFTimeInterval)latency;  // Changes are reported on the main thread at directory granularity (like FSEvents) at most once per "latency" interval
+- (instancetype)initWithPath:(NSString*)path backend:(GCFileSystemWatcherBackend)backend latency:(CFTimeInterval)latency directoryFilter:(BOOL (^)(NSString* path))filter;  // Inotify only - The filter is called on the main thread with subdirectory paths (with trailing slash) and returns NO to not watch them or their contents
+- (void)reloadDirectoryFilter;  // Must be called when the directory filter could return different results (inotify only)
+- (void)injectChangeAtPath:(NSString*)path mustRescan:(BOOL)rescan;  // Must be called on the main thread
+- (void)flush;  // Immediately delivers pending changes if any
+- (void)invalidate;  // Stops watching and drops pending changes
+@end
+
+@interface GCLiveRepository () <GCFileSystemWatcherDelegate>
++ (GCFileSystemWatcherBackend)fileSystemWatcherBackend;  // Default is kGCFileSystemWatcherBackend_Default
+@property(nonatomic, readonly) GCFileSystemWatcher* gitDirectoryWatcher;
+@property(nonatomic, readonly) GCFileSystemWatcher* workingDirectoryWatcher;  // Nil for bare repositories
+@end
+
 #endif
 
 @interface GCObject () {
@@ -151,7 +186,9 @@ extern int git_submodule_foreach_block(git_repository* repo, int (^block)(git_su
   git_object* _private;
 }
 @property(nonatomic, readonly) git_object* private NS_RETURNS_INNER_POINTER;
+@property(nonatomic, readonly) const git_oid* OID NS_RETURNS_INNER_POINTER;  // Subclasses can override to avoid loading the git_object
 - (instancetype)initWithRepository:(GCRepository*)repository object:(git_object*)object;
+- (void)rebindToRepository:(GCRepository*)repository;  // Only changes the repository the object belongs to - The git_object must be valid for the new repository
 @end
 
 @interface GCCommit ()
@@ -169,6 +206,7 @@ extern int git_submodule_foreach_block(git_repository* repo, int (^block)(git_su
 - (instancetype)initWithRepository:(GCRepository*)repository reference:(git_reference*)reference;
 - (void)updateReference:(git_reference*)reference;
 - (NSComparisonResult)compareWithReference:(git_reference*)reference;
+- (void)rebindToRepository:(GCRepository*)repository;  // Only changes the repository the reference belongs to - Call -updateReference: with a git_reference from the new repository
 @end
 
 @interface GCIndex ()
@@ -190,7 +228,8 @@ extern int git_submodule_foreach_block(git_repository* repo, int (^block)(git_su
 @end
 
 @interface GCDiff ()
-@property(nonatomic, readonly) git_diff* private NS_RETURNS_INNER_POINTER;
+@property(nonatomic, readonly) git_diff* private NS_RETURNS_INNER_POINTER;  // NULL for composite diffs
+- (instancetype)initWithDiff:(GCDiff*)diff replacingDeltasMatchingFilePaths:(NSArray*)paths withDiff:(GCDiff*)scopedDiff;  // Creates a composite diff - Paths are literal Git paths and directory paths with a trailing slash match recursively - "scopedDiff" must have been computed with the same paths and options
 #if DEBUG
 - (GCFileDiffChange)changeForFile:(NSString*)path;  // For unit tests only - Returns NSNotFound if file not in diff
 #endif
@@ -268,13 +307,55 @@ extern int git_submodule_foreach_block(git_repository* repo, int (^block)(git_su
 - (GCHistoryCommit*)historyCommitForOID:(const git_oid*)oid;
 @end
 
+@interface GCCommitGraph : NSObject
+@property(nonatomic, readonly) NSUInteger count;  // Total number of commits across all layers
+- (instancetype)initWithRepository:(GCRepository*)repository;  // Returns nil if there is no valid commit-graph file or chain in the repository
+- (BOOL)findOID:(const git_oid*)oid position:(uint32_t*)position;
+- (const git_oid*)OIDAtPosition:(uint32_t)position NS_RETURNS_INNER_POINTER;
+- (git_time_t)timeAtPosition:(uint32_t)position;  // Committer time
+- (uint32_t)generationAtPosition:(uint32_t)position;  // Topological level i.e. 1 for root commits
+- (BOOL)getParentPositions:(uint32_t*)positions count:(NSUInteger*)count maximum:(NSUInteger)maximum atPosition:(uint32_t)position;  // Returns NO if the graph is corrupted or if there are more than "maximum" parents
+@end
+
+@interface GCHistoryPrefetch : NSObject  // Immutable once created so it can be handed over between threads
+@property(nonatomic, readonly) NSUInteger count;
+- (BOOL)findOID:(const git_oid*)oid time:(git_time_t*)time parentOIDs:(const git_oid**)parentOIDs parentCount:(NSUInteger*)parentCount;
+@end
+
+@interface GCChangedPathIndex : NSObject
+@property(nonatomic, readonly) NSUInteger count;
+- (instancetype)initWithPath:(NSString*)path;  // Pass nil for an in-memory index - An invalid or missing file results in an empty index
+- (BOOL)updateWithRepository:(GCRepository*)repository error:(NSError**)error;  // Computes the missing filters for the commits reachable from HEAD but not from the HEADs of previous updates - This is slow so call it on a background thread with a private repository
+- (BOOL)commit:(git_commit*)commit mayHaveChangedPath:(const char*)path;  // Returns YES for commits not in the index - Never returns false negatives
+- (BOOL)writeIfNeeded:(NSError**)error;  // Only writes if filters were computed or HEAD changed since the index was loaded
+@end
+
+@interface GCUntrackedCache : NSObject
+@property(nonatomic, readonly) NSUInteger count;  // Number of cached directories
+@property(nonatomic, copy) NSString* fileSystemMonitorToken;  // Directories not passed to -invalidateDirectory: since the last lookup with the same token are trusted without checking them on disk
+#if DEBUG
+@property(nonatomic, readonly) NSUInteger scannedDirectoryCount;  // Number of directories scanned by the last lookup
+#endif
+- (instancetype)initWithPath:(NSString*)path;  // Pass nil for an in-memory cache - An invalid or missing file results in an empty cache
+- (void)invalidateDirectory:(NSString*)directory;  // Working directory relative path with a trailing slash (empty for the root)
+- (NSArray*)findUntrackedFilesInRepository:(GCRepository*)repository usingIndex:(GCIndex*)index error:(NSError**)error;  // Returns working directory relative paths of untracked files and of nested repositories (with a trailing slash) like libgit2 would - Only scans directories that changed since the last lookup
+- (void)writeInBackgroundIfNeeded:(void (^)(BOOL success, NSError* error))completion;  // Writes the cache on a serial background queue if it changed since it was last written - The completion is called on the main thread
+@end
+
 @interface GCCommitDatabase ()
-- (NSArray*)findCommitsUsingHistory:(GCHistory*)history matching:(NSString*)match error:(NSError**)error;
+@property(nonatomic) NSUInteger diffWorkerCount;  // Default is the number of active processors minus one - Pass 0 to compute diffs serially when indexing diffs
+@property(nonatomic) NSUInteger updateChunkSize;  // Default is 10,000 - Number of added commits after which an update is committed so it can resume from there if interrupted
+- (NSArray*)findCommitsUsingHistory:(GCHistory*)history matching:(NSString*)match error:(NSError**)error;  // Looking commits up in a history doesn't use the repository so searches using the same history can run from multiple threads simultaneously as long as it is not reloaded
+- (NSArray*)findCommitsUsingHistory:(GCHistory*)history forFile:(NSString*)path followRenames:(BOOL)follow error:(NSError**)error;
+- (NSArray*)fetchCommitsFromCursor:(GCCommitDatabaseSearchCursor*)cursor usingHistory:(GCHistory*)history maximumCount:(NSUInteger)count error:(NSError**)error;  // Returns GCHistoryCommit if history is not nil
+- (GCCommitDatabaseSearchSession*)searchSessionUsingHistory:(GCHistory*)history;  // Returns GCHistoryCommit if history is not nil - Sessions must also be discarded after the history is updated
 #if DEBUG
++ (NSData*)extractUniqueWordsFromLines:(NSData*)lines;  // Returns the space-separated unique words that would be indexed for these diff lines
 - (NSUInteger)countCommits;  // Returns NSNotFound on error
 - (NSUInteger)countTips;  // Returns NSNotFound on error
 - (NSUInteger)countRelations;  // Returns NSNotFound on error
 - (NSUInteger)totalCommitRetainCount;  // Returns NSNotFound on error
+- (NSArray*)listIndexedDiffs;  // Returns the SHA1 and the added and deleted words data of each indexed diff in insertion order - Returns nil on error
 #endif
 @end
 
@@ -333,6 +414,37 @@ extern int git_submodule_foreach_block(git_repository* repo, int (^block)(git_su
 #endif
 @end
 
+@interface GCRepository (GCDiff_Private)
+- (GCDiff*)diffWorkingDirectoryWithCommit:(GCCommit*)commit
+                               usingIndex:(GCIndex*)index
+                             filePatterns:(NSArray*)filePatterns  // Patterns without wildcards are matched literally which lets libgit2 skip directories that cannot match
+                           untrackedCache:(GCUntrackedCache*)cache  // Lets libgit2 only diff the untracked files found by the cache instead of scanning the whole working directory - Ignored if there are file patterns
+                                  options:(GCDiffOptions)options
+                        maxInterHunkLines:(NSUInteger)maxInterHunkLines
+                          maxContextLines:(NSUInteger)maxContextLines
+                                    error:(NSError**)error;
+- (GCDiff*)diffWorkingDirectoryWithIndex:(GCIndex*)index
+                            filePatterns:(NSArray*)filePatterns
+                          untrackedCache:(GCUntrackedCache*)cache
+                                 options:(GCDiffOptions)options
+                       maxInterHunkLines:(NSUInteger)maxInterHunkLines
+                         maxContextLines:(NSUInteger)maxContextLines
+                                   error:(NSError**)error;
+@end
+
+@interface GCRepository (GCHistory_Private)
+- (NSArray*)lookupCommitsForFile:(NSString*)path followRenames:(BOOL)follow changedPathIndex:(GCChangedPathIndex*)index error:(NSError**)error;  // Index can be nil
+- (GCHistoryPrefetch*)prefetchCommitsExcludingAncestorsOfOIDs:(NSData*)oids cancelBlock:(BOOL (^)(void))cancelBlock error:(NSError**)error;  // Can be called from any thread on a private repository - Returns nil without error if cancelled
+- (BOOL)reloadHistory:(GCHistory*)history usingPrefetch:(GCHistoryPrefetch*)prefetch referencesDidChange:(BOOL*)referencesDidChange addedCommits:(NSArray**)addedCommits removedCommits:(NSArray**)removedCommits error:(NSError**)error;  // Prefetch can be nil or stale
+- (NSData*)serializeHistory:(GCHistory*)history error:(NSError**)error;  // Copies the commit graph of a non-windowed history so it can be handed over to another thread
+- (GCHistory*)loadHistoryFromSerializedHistory:(NSData*)data usingSorting:(GCHistorySorting)sorting error:(NSError**)error;  // Can be called from any thread on a private repository - The history has the same references as the serialized one until it is reloaded
+- (BOOL)adoptHistory:(GCHistory*)history removedCommits:(NSArray*)removedCommits error:(NSError**)error;  // Hands over a history reloaded on a private repository for the same repository, which must still be open - Fails without modifying the history if its references changed since
+- (void)writeHistoryInBackground:(GCHistory*)history toCacheAtPath:(NSString*)path completion:(void (^)(BOOL success, NSError* error))completion;  // Like -writeHistory:toCacheAtPath:error: but the file is written on a background queue - Completion is optional and called on the main thread
+#if DEBUG
+- (GCHistory*)loadHistoryUsingSorting:(GCHistorySorting)sorting useCommitGraph:(BOOL)useCommitGraph error:(NSError**)error;  // For unit tests only
+#endif
+@end
+
 @interface GCRepository (HEAD_Private)
 - (git_commit*)loadHEADCommit:(git_reference**)resolvedReference error:(NSError**)error;  // "resolvedReference" is optional and will be set to NULL if HEAD is detached
 - (BOOL)loadHEADCommit:(git_commit**)commit resolvedReference:(git_reference**)resolvedReference error:(NSError**)error;  // "commit" is optional and will be set to NULL if HEAD is unborn and "resolvedReference" is optional and will be set to NULL if HEAD is unborn or detached
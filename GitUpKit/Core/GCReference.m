@@ -44,6 +44,10 @@
   _name = [NSString stringWithUTF8String:git_reference_shorthand(reference)];
 }
 
+- (void)rebindToRepository:(GCRepository*)repository {
+  _repository = repository;
+}
+
 - (BOOL)isSymbolic {
   return (git_reference_type(_private) == GIT_REF_SYMBOLIC);
 }
@@ -0,0 +1,87 @@
+//  Copyright (C) 2015-2019 Pierre-Olivier Latour <info@pol-online.net>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#if !__has_feature(objc_arc)
+#error This file requires ARC
+#endif
+
+#import "GCTestCase.h"
+
+@implementation GCEmptyRepositoryTests (GCRepository_Pickaxe)
+
+- (void)testPickaxe {
+  // Make commits
+  GCCommit* commit1 = [self makeCommitWithUpdatedFileAtPath:@"hello.c" string:@"int main() {}\n" message:@"Initial commit"];
+  GCCommit* commit2 = [self makeCommitWithUpdatedFileAtPath:@"hello.c" string:@"int main() {\n  return 0;\n}\n" message:@"Return zero"];
+  GCCommit* commit3 = [self makeCommitWithUpdatedFileAtPath:@"hello.c" string:@"int main() {\n  return 1;\n}\n" message:@"Return one"];
+  [self updateFileAtPath:@"main.c" withString:@"int main() {\n  return 1;\n}\n"];
+  XCTAssertTrue([self.repository addFileToIndex:@"main.c" error:NULL]);
+  GCCommit* commit4 = [self makeCommitWithDeletedFileAtPath:@"hello.c" message:@"Rename"];
+  GCCommit* commit5 = [self makeCommitWithUpdatedFileAtPath:@"README" string:@"return\n" message:@"Add readme"];
+  XCTAssertNotNil(commit4);
+
+  // Load history
+  GCHistory* history = [self.repository loadHistoryUsingSorting:kGCHistorySorting_ReverseChronological error:NULL];
+  XCTAssertEqual(history.allCommits.count, 5);
+  NSArray* (^expect)(NSArray*) = ^(NSArray* commits) {  // Matches are reported in history order
+    NSMutableArray* array = [NSMutableArray array];
+    for (GCHistoryCommit* commit in history.allCommits) {
+      if ([commits containsObject:commit]) {
+        [array addObject:commit];
+      }
+    }
+    return array;
+  };
+
+  // Check string mode (renamed files are paired)
+  XCTAssertEqualObjects([self.repository findCommitsInHistory:history matchingPickaxe:@"return" mode:kGCPickaxeMode_String error:NULL], expect(@[ commit2, commit5 ]));
+  XCTAssertEqualObjects([self.repository findCommitsInHistory:history matchingPickaxe:@"return 1" mode:kGCPickaxeMode_String error:NULL], expect(@[ commit3 ]));
+  XCTAssertEqualObjects([self.repository findCommitsInHistory:history matchingPickaxe:@"missing" mode:kGCPickaxeMode_String error:NULL], @[]);
+  XCTAssertNil([self.repository findCommitsInHistory:history matchingPickaxe:@"" mode:kGCPickaxeMode_String error:NULL]);
+
+  // Check regex mode
+  XCTAssertEqualObjects([self.repository findCommitsInHistory:history matchingPickaxe:@"return [0-9]" mode:kGCPickaxeMode_Regex error:NULL], expect(@[ commit2, commit3 ]));
+  XCTAssertEqualObjects([self.repository findCommitsInHistory:history matchingPickaxe:@"^int" mode:kGCPickaxeMode_Regex error:NULL], expect(@[ commit1, commit2 ]));
+  XCTAssertNil([self.repository findCommitsInHistory:history matchingPickaxe:@"[" mode:kGCPickaxeMode_Regex error:NULL]);
+
+  // Check stopping
+  __block NSUInteger count = 0;
+  XCTAssertTrue([self.repository enumerateCommitsInHistory:history
+                                           matchingPickaxe:@"return"
+                                                      mode:kGCPickaxeMode_String
+                                               cancelBlock:NULL
+                                                usingBlock:^(GCHistoryCommit* commit, BOOL* stop) {
+                                                  count += 1;
+                                                  *stop = YES;
+                                                }
+                                                     error:NULL]);
+  XCTAssertEqual(count, 1);
+
+  // Check cancelling
+  NSError* error;
+  XCTAssertFalse([self.repository enumerateCommitsInHistory:history
+                                            matchingPickaxe:@"return"
+                                                       mode:kGCPickaxeMode_String
+                                                cancelBlock:^BOOL {
+                                                  return YES;
+                                                }
+                                                 usingBlock:^(GCHistoryCommit* commit, BOOL* stop) {
+                                                   XCTFail();
+                                                 }
+                                                      error:&error]);
+  XCTAssertEqual(error.code, kGCErrorCode_UserCancelled);
+}
+
+@end
@@ -0,0 +1,34 @@
+//  Copyright (C) 2015-2019 Pierre-Olivier Latour <info@pol-online.net>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#import <GitUpKit/GCRepository.h>
+
+typedef NS_ENUM(NSUInteger, GCPickaxeMode) {
+  kGCPickaxeMode_String = 0,  // Commits changing the number of occurrences of the string in a file (git log -S {string})
+  kGCPickaxeMode_Regex  // Commits adding or deleting lines matching the POSIX extended regular expression in text files (git log -G {regex})
+};
+
+@class GCHistory, GCHistoryCommit;
+
+@interface GCRepository (Pickaxe)
+- (BOOL)enumerateCommitsInHistory:(GCHistory*)history
+                  matchingPickaxe:(NSString*)pattern
+                             mode:(GCPickaxeMode)mode
+                      cancelBlock:(BOOL (^)(void))cancelBlock
+                       usingBlock:(void (^)(GCHistoryCommit* commit, BOOL* stop))block
+                            error:(NSError**)error;  // Matches are passed in history order while commits are scanned in the background - Merge commits are never matched (like "git log" without "-m") - Returns NO with a kGCErrorCode_UserCancelled error if "cancelBlock" returns YES
+
+- (NSArray*)findCommitsInHistory:(GCHistory*)history matchingPickaxe:(NSString*)pattern mode:(GCPickaxeMode)mode error:(NSError**)error;  // Convenience method
+@end
@@ -0,0 +1,437 @@
+//  Copyright (C) 2015-2019 Pierre-Olivier Latour <info@pol-online.net>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#if __has_feature(objc_arc)
+#error This file requires MRC
+#endif
+
+#import <pthread.h>
+#import <regex.h>
+
+#import "GCPrivate.h"
+
+#define kMaxPickaxeWorkers 8
+#define kPickaxeShardSize 32  // Number of consecutive commits a worker claims at once
+#define kPickaxeCancelPollInterval 50  // Milliseconds
+
+typedef NS_ENUM(uint8_t, PickaxeResult) {
+  kPickaxeResult_Pending = 0,
+  kPickaxeResult_NoMatch,
+  kPickaxeResult_Match,
+  kPickaxeResult_Failed
+};
+
+// Shared by the workers which each scan shards of consecutive commits with their own libgit2 repository
+typedef struct {
+  GCPickaxeMode mode;
+  const char* string;
+  size_t length;
+  regex_t regex;
+  const git_oid* oids;
+  PickaxeResult* results;
+  size_t count;
+  size_t nextCommit;
+  BOOL finished;
+  pthread_mutex_t mutex;
+  pthread_cond_t condition;
+  pthread_mutex_t memoMutex;
+  CFMutableDictionaryRef memo;  // Maps blob OIDs to their scan result + 1
+} Pickaxe;
+
+static inline BOOL _MatchRegex(const regex_t* regex, const char* bytes, size_t length) {
+  regmatch_t match = {0, (regoff_t)length};  // Blob contents and diff lines are not NUL-terminated
+  return regexec(regex, bytes, 1, &match, REG_STARTEND) == 0;
+}
+
+// Returns the number of non-overlapping occurrences of the string for kGCPickaxeMode_String or 1 if any line matches the regex for kGCPickaxeMode_Regex (binary blobs never match)
+// Results are memoized per blob so unchanged blobs shared between commits are only scanned once
+static ssize_t _ScanBlob(Pickaxe* pickaxe, git_repository* repo, const git_oid* oid) {
+  if (git_oid_iszero(oid)) {
+    return 0;
+  }
+  pthread_mutex_lock(&pickaxe->memoMutex);
+  uintptr_t value = (uintptr_t)CFDictionaryGetValue(pickaxe->memo, oid);
+  pthread_mutex_unlock(&pickaxe->memoMutex);
+  if (value) {
+    return value - 1;
+  }
+
+  git_blob* blob;
+  int status = git_blob_lookup(&blob, repo, oid);
+  if (status != GIT_OK) {
+    LOG_LIBGIT2_ERROR(status);
+    return -1;
+  }
+  const char* bytes = git_blob_rawcontent(blob);
+  size_t size = (size_t)git_blob_rawsize(blob);
+  ssize_t result = 0;
+  if (pickaxe->mode == kGCPickaxeMode_String) {
+    const char* end = bytes + size;
+    while (1) {
+      const char* match = memmem(bytes, end - bytes, pickaxe->string, pickaxe->length);
+      if (match == NULL) {
+        break;
+      }
+      result += 1;
+      bytes = match + pickaxe->length;
+    }
+  } else if (!git_blob_is_binary(blob)) {
+    result = _MatchRegex(&pickaxe->regex, bytes, size) ? 1 : 0;
+  }
+  git_blob_free(blob);
+
+  pthread_mutex_lock(&pickaxe->memoMutex);
+  CFDictionarySetValue(pickaxe->memo, oid, (const void*)(uintptr_t)(result + 1));
+  pthread_mutex_unlock(&pickaxe->memoMutex);
+  return result;
+}
+
+// Returns 1 if the delta matches, 0 if it doesn't or -1 on error
+static int _MatchDelta(Pickaxe* pickaxe, git_repository* repo, const git_diff_delta* delta) {
+  if (git_oid_equal(&delta->old_file.id, &delta->new_file.id)) {  // Pure renames and mode changes
+    return 0;
+  }
+  ssize_t oldResult = _ScanBlob(pickaxe, repo, &delta->old_file.id);
+  ssize_t newResult = _ScanBlob(pickaxe, repo, &delta->new_file.id);
+  if ((oldResult < 0) || (newResult < 0)) {
+    return -1;
+  }
+  if (pickaxe->mode == kGCPickaxeMode_String) {
+    return oldResult != newResult;
+  }
+  if (!oldResult && !newResult) {  // Added and deleted lines are a subset of the lines of both blobs so there's no need to diff them
+    return 0;
+  }
+  if (git_oid_iszero(&delta->old_file.id) || git_oid_iszero(&delta->new_file.id)) {  // All lines were added or deleted
+    return 1;
+  }
+
+  int result = -1;
+  git_blob* oldBlob = NULL;
+  git_blob* newBlob = NULL;
+  git_patch* patch = NULL;
+  int status = git_blob_lookup(&oldBlob, repo, &delta->old_file.id);
+  if (status == GIT_OK) {
+    status = git_blob_lookup(&newBlob, repo, &delta->new_file.id);
+  }
+  if (status == GIT_OK) {
+    git_diff_options diffOptions = GIT_DIFF_OPTIONS_INIT;
+    diffOptions.context_lines = 0;
+    diffOptions.interhunk_lines = 0;
+    status = git_patch_from_blobs(&patch, oldBlob, NULL, newBlob, NULL, &diffOptions);  // Binary blobs produce no hunks
+  }
+  if (status == GIT_OK) {
+    result = 0;
+    for (size_t i = 0, iMax = git_patch_num_hunks(patch); (i < iMax) && !result; ++i) {
+      for (size_t j = 0, jMax = git_patch_num_lines_in_hunk(patch, i); j < jMax; ++j) {
+        const git_diff_line* line;
+        if (git_patch_get_line_in_hunk(&line, patch, i, j) != GIT_OK) {
+          XLOG_DEBUG_UNREACHABLE();
+          continue;
+        }
+        if (((line->origin == GIT_DIFF_LINE_ADDITION) || (line->origin == GIT_DIFF_LINE_DELETION)) && _MatchRegex(&pickaxe->regex, line->content, line->content_len)) {
+          result = 1;
+          break;
+        }
+      }
+    }
+  } else {
+    LOG_LIBGIT2_ERROR(status);
+  }
+  git_patch_free(patch);
+  git_blob_free(newBlob);
+  git_blob_free(oldBlob);
+  return result;
+}
+
+static inline BOOL _IsSubmoduleDelta(const git_diff_delta* delta) {
+  return (delta->old_file.mode == GIT_FILEMODE_COMMIT) || (delta->new_file.mode == GIT_FILEMODE_COMMIT);
+}
+
+// We don't use the GCDiff wrappers because we need the best possible performance
+// Commits are compared to their parent like "git log" does i.e. merge commits never match
+static PickaxeResult _MatchCommit(Pickaxe* pickaxe, git_repository* repo, const git_oid* oid) {
+  PickaxeResult result = kPickaxeResult_Failed;
+  git_commit* commit = NULL;
+  git_commit* parent = NULL;
+  git_tree* newTree = NULL;
+  git_tree* oldTree = NULL;
+  git_diff* diff = NULL;
+  BOOL hasAddedFiles = NO;
+  BOOL hasDeletedFiles = NO;
+  BOOL hasMatchingAddedOrDeletedFiles = NO;
+
+  int status = git_commit_lookup(&commit, repo, oid);
+  if (status != GIT_OK) {
+    LOG_LIBGIT2_ERROR(status);
+    goto cleanup;
+  }
+  unsigned int parentCount = git_commit_parentcount(commit);
+  if (parentCount > 1) {
+    result = kPickaxeResult_NoMatch;
+    goto cleanup;
+  }
+  status = git_commit_tree(&newTree, commit);
+  if ((status == GIT_OK) && parentCount) {
+    status = git_commit_parent(&parent, commit, 0);
+    if (status == GIT_OK) {
+      status = git_commit_tree(&oldTree, parent);
+    }
+  }
+  if (status == GIT_OK) {
+    git_diff_options diffOptions = GIT_DIFF_OPTIONS_INIT;
+    diffOptions.flags = GIT_DIFF_SKIP_BINARY_CHECK;  // Blobs are only loaded when scanned
+    diffOptions.ignore_submodules = GIT_SUBMODULE_IGNORE_ALL;
+    status = git_diff_tree_to_tree(&diff, repo, oldTree, newTree, &diffOptions);
+  }
+  if (status != GIT_OK) {
+    LOG_LIBGIT2_ERROR(status);
+    goto cleanup;
+  }
+
+  // Modified files match regardless of renames
+  for (size_t i = 0, iMax = git_diff_num_deltas(diff); i < iMax; ++i) {
+    const git_diff_delta* delta = git_diff_get_delta(diff, i);
+    if (_IsSubmoduleDelta(delta)) {
+      continue;
+    }
+    BOOL isAddedOrDeleted = NO;
+    if (delta->status == GIT_DELTA_ADDED) {
+      hasAddedFiles = YES;
+      isAddedOrDeleted = YES;
+    } else if (delta->status == GIT_DELTA_DELETED) {
+      hasDeletedFiles = YES;
+      isAddedOrDeleted = YES;
+    }
+    if (isAddedOrDeleted && hasMatchingAddedOrDeletedFiles) {
+      continue;
+    }
+    int match = _MatchDelta(pickaxe, repo, delta);
+    if (match < 0) {
+      goto cleanup;
+    }
+    if (match) {
+      if (!isAddedOrDeleted) {
+        result = kPickaxeResult_Match;
+        goto cleanup;
+      }
+      hasMatchingAddedOrDeletedFiles = YES;
+    }
+  }
+  if (!hasMatchingAddedOrDeletedFiles || !hasAddedFiles || !hasDeletedFiles) {
+    result = hasMatchingAddedOrDeletedFiles ? kPickaxeResult_Match : kPickaxeResult_NoMatch;
+    goto cleanup;
+  }
+
+  // Pairing renamed files can only turn matches into non-matches so rename detection is only run when it can change the result
+  git_diff_find_options findOptions = GIT_DIFF_FIND_OPTIONS_INIT;
+  findOptions.flags = GIT_DIFF_FIND_RENAMES;
+  status = git_diff_find_similar(diff, &findOptions);
+  if (status != GIT_OK) {
+    LOG_LIBGIT2_ERROR(status);
+    goto cleanup;
+  }
+  result = kPickaxeResult_NoMatch;
+  for (size_t i = 0, iMax = git_diff_num_deltas(diff); i < iMax; ++i) {
+    const git_diff_delta* delta = git_diff_get_delta(diff, i);
+    if (_IsSubmoduleDelta(delta) || ((delta->status != GIT_DELTA_ADDED) && (delta->status != GIT_DELTA_DELETED) && (delta->status != GIT_DELTA_RENAMED))) {
+      continue;
+    }
+    int match = _MatchDelta(pickaxe, repo, delta);
+    if (match < 0) {
+      result = kPickaxeResult_Failed;
+      break;
+    }
+    if (match) {
+      result = kPickaxeResult_Match;
+      break;
+    }
+  }
+
+cleanup:
+  git_diff_free(diff);
+  git_tree_free(oldTree);
+  git_tree_free(newTree);
+  git_commit_free(parent);
+  git_commit_free(commit);
+  return result;
+}
+
+static void _RunWorker(Pickaxe* pickaxe, git_repository* repo) {
+  PickaxeResult results[kPickaxeShardSize];
+  while (1) {
+    pthread_mutex_lock(&pickaxe->mutex);
+    if (pickaxe->finished || (pickaxe->nextCommit == pickaxe->count)) {
+      pthread_mutex_unlock(&pickaxe->mutex);
+      break;
+    }
+    size_t start = pickaxe->nextCommit;
+    size_t end = MIN(start + kPickaxeShardSize, pickaxe->count);
+    pickaxe->nextCommit = end;
+    pthread_mutex_unlock(&pickaxe->mutex);
+
+    for (size_t i = start; i < end; ++i) {
+      results[i - start] = _MatchCommit(pickaxe, repo, &pickaxe->oids[i]);
+    }
+
+    pthread_mutex_lock(&pickaxe->mutex);
+    memcpy(&pickaxe->results[start], results, (end - start) * sizeof(PickaxeResult));
+    pthread_cond_broadcast(&pickaxe->condition);
+    pthread_mutex_unlock(&pickaxe->mutex);
+  }
+}
+
+@implementation GCRepository (Pickaxe)
+
+- (BOOL)enumerateCommitsInHistory:(GCHistory*)history
+                  matchingPickaxe:(NSString*)pattern
+                             mode:(GCPickaxeMode)mode
+                      cancelBlock:(BOOL (^)(void))cancelBlock
+                       usingBlock:(void (^)(GCHistoryCommit* commit, BOOL* stop))block
+                            error:(NSError**)error {
+  BOOL success = NO;
+  NSArray* commits = history.allCommits;
+  NSUInteger count = commits.count;
+  NSUInteger workerCount = MIN(MAX([[NSProcessInfo processInfo] activeProcessorCount], (NSUInteger)1), MAX(count / kPickaxeShardSize, (NSUInteger)1));
+  workerCount = MIN(workerCount, kMaxPickaxeWorkers);
+  git_repository** repositories = calloc(workerCount, sizeof(git_repository*));
+  git_oid* oids = malloc(MAX(count, (NSUInteger)1) * sizeof(git_oid));
+  dispatch_group_t group = NULL;
+  BOOL hasRegex = NO;
+  CFDictionaryKeyCallBacks callbacks = {0, GCOIDCopyCallBack, GCFreeReleaseCallBack, NULL, GCOIDEqualCallBack, GCOIDHashCallBack};
+  Pickaxe pickaxe;
+  bzero(&pickaxe, sizeof(Pickaxe));
+  pickaxe.mode = mode;
+  pickaxe.oids = oids;
+  pickaxe.results = calloc(MAX(count, (NSUInteger)1), sizeof(PickaxeResult));
+  pickaxe.count = count;
+  pthread_mutex_init(&pickaxe.mutex, NULL);
+  pthread_cond_init(&pickaxe.condition, NULL);
+  pthread_mutex_init(&pickaxe.memoMutex, NULL);
+  pickaxe.memo = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, &callbacks, NULL);
+
+  if (mode == kGCPickaxeMode_String) {
+    pickaxe.string = pattern.UTF8String;
+    pickaxe.length = strlen(pickaxe.string);
+    if (pickaxe.length == 0) {
+      GC_SET_GENERIC_ERROR(@"Empty pickaxe string");
+      goto cleanup;
+    }
+  } else {
+    int status = regcomp(&pickaxe.regex, pattern.UTF8String, REG_EXTENDED | REG_NEWLINE | REG_NOSUB);  // Like "git grep -E" and so that "^" and "$" match at line boundaries
+    if (status) {
+      char buffer[256];
+      regerror(status, &pickaxe.regex, buffer, sizeof(buffer));
+      GC_SET_GENERIC_ERROR(@"Invalid regular expression \"%@\": %s", pattern, buffer);
+      goto cleanup;
+    }
+    hasRegex = YES;
+  }
+
+  for (NSUInteger i = 0; i < count; ++i) {
+    git_oid_cpy(&oids[i], [(GCHistoryCommit*)commits[i] OID]);
+  }
+  for (NSUInteger i = 0; i < workerCount; ++i) {
+    CALL_LIBGIT2_FUNCTION_GOTO(cleanup, git_repository_open, &repositories[i], self.repositoryPath.fileSystemRepresentation);  // libgit2 repositories cannot be shared across threads
+  }
+
+  group = dispatch_group_create();
+  Pickaxe* pickaxePtr = &pickaxe;
+  for (NSUInteger i = 0; i < workerCount; ++i) {
+    git_repository* repository = repositories[i];
+    dispatch_group_async(group, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+      _RunWorker(pickaxePtr, repository);
+    });
+  }
+
+  // Report matches in history order as soon as all preceding commits have been scanned
+  NSUInteger index = 0;
+  while (index < count) {
+    if (cancelBlock && cancelBlock()) {
+      GC_SET_USER_CANCELLED_ERROR();
+      goto cleanup;
+    }
+    pthread_mutex_lock(&pickaxe.mutex);
+    if (pickaxe.results[index] == kPickaxeResult_Pending) {
+      if (cancelBlock) {
+        struct timespec interval = {0, kPickaxeCancelPollInterval * NSEC_PER_MSEC};
+        pthread_cond_timedwait_relative_np(&pickaxe.condition, &pickaxe.mutex, &interval);
+      } else {
+        pthread_cond_wait(&pickaxe.condition, &pickaxe.mutex);
+      }
+    }
+    NSUInteger end = index;
+    while ((end < count) && (pickaxe.results[end] != kPickaxeResult_Pending)) {
+      ++end;
+    }
+    pthread_mutex_unlock(&pickaxe.mutex);
+
+    for (; index < end; ++index) {  // Results are never modified once set so they can be read outside of the lock
+      if (pickaxe.results[index] == kPickaxeResult_Failed) {
+        GC_SET_GENERIC_ERROR(@"Failed scanning commit %@", [commits[index] SHA1]);
+        goto cleanup;
+      }
+      if (pickaxe.results[index] == kPickaxeResult_Match) {
+        BOOL stop = NO;
+        block(commits[index], &stop);
+        if (stop) {
+          success = YES;
+          goto cleanup;
+        }
+      }
+    }
+  }
+  success = YES;
+
+cleanup:
+  if (group) {
+    pthread_mutex_lock(&pickaxe.mutex);
+    pickaxe.finished = YES;  // Stop workers early if cancelled or stopped
+    pthread_mutex_unlock(&pickaxe.mutex);
+    dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+    dispatch_release(group);
+  }
+  for (NSUInteger i = 0; i < workerCount; ++i) {
+    git_repository_free(repositories[i]);
+  }
+  if (hasRegex) {
+    regfree(&pickaxe.regex);
+  }
+  CFRelease(pickaxe.memo);
+  pthread_mutex_destroy(&pickaxe.memoMutex);
+  pthread_cond_destroy(&pickaxe.condition);
+  pthread_mutex_destroy(&pickaxe.mutex);
+  free(pickaxe.results);
+  free(oids);
+  free(repositories);
+  return success;
+}
+
+- (NSArray*)findCommitsInHistory:(GCHistory*)history matchingPickaxe:(NSString*)pattern mode:(GCPickaxeMode)mode error:(NSError**)error {
+  NSMutableArray* commits = [NSMutableArray array];
+  if (![self enumerateCommitsInHistory:history
+                       matchingPickaxe:pattern
+                                  mode:mode
+                           cancelBlock:NULL
+                            usingBlock:^(GCHistoryCommit* commit, BOOL* stop) {
+                              [commits addObject:commit];
+                            }
+                                 error:error]) {
+    return nil;
+  }
+  return commits;
+}
+
+@end
@@ -0,0 +1,127 @@
+//  Copyright (C) 2015-2019 Pierre-Olivier Latour <info@pol-online.net>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#if !__has_feature(objc_arc)
+#error This file requires ARC
+#endif
+
+#import "GCTestCase.h"
+
+@implementation GCEmptyRepositoryTests (GCUntrackedCache)
+
+- (void)_assertDiffUsingCache:(GCUntrackedCache*)cache {
+  GCIndex* index = [self.repository readRepositoryIndex:NULL];
+  XCTAssertNotNil(index);
+  GCDiff* diff = [self.repository diffWorkingDirectoryWithIndex:index filePatterns:nil untrackedCache:cache options:kGCDiffOption_IncludeUntracked maxInterHunkLines:0 maxContextLines:3 error:NULL];
+  XCTAssertNotNil(diff);
+  GCDiff* fullDiff = [self.repository diffWorkingDirectoryWithIndex:index filePatterns:nil untrackedCache:nil options:kGCDiffOption_IncludeUntracked maxInterHunkLines:0 maxContextLines:3 error:NULL];
+  XCTAssertTrue([diff isEqualToDiff:fullDiff]);
+}
+
+- (void)testUntrackedCache {
+  NSString* path = self.repository.workingDirectoryPath;
+  NSString* cachePath = [NSTemporaryDirectory() stringByAppendingPathComponent:[[NSUUID UUID] UUIDString]];  // Must be outside of the working directory
+  GCUntrackedCache* cache = [[GCUntrackedCache alloc] initWithPath:cachePath];
+  XCTAssertEqual(cache.count, 0);
+
+  // Make commit
+  XCTAssertTrue([[NSFileManager defaultManager] createDirectoryAtPath:[path stringByAppendingPathComponent:@"a/b"] withIntermediateDirectories:YES attributes:nil error:NULL]);
+  XCTAssertTrue([[NSFileManager defaultManager] createDirectoryAtPath:[path stringByAppendingPathComponent:@"c/.git"] withIntermediateDirectories:YES attributes:nil error:NULL]);
+  [self updateFileAtPath:@"a/file.txt" withString:@"file\n"];
+  [self updateFileAtPath:@".gitignore" withString:@"*.tmp\n"];
+  XCTAssertNotNil([self makeCommitWithUpdatedFileAtPath:@"readme.txt" string:@"readme\n" message:@"Initial commit"]);
+  [self updateFileAtPath:@"a/b/untracked.txt" withString:@"untracked\n"];
+  [self updateFileAtPath:@"a/ignored.tmp" withString:@"ignored\n"];
+  [self updateFileAtPath:@"untracked.txt" withString:@"untracked\n"];
+
+  // Check untracked files are found like libgit2 does including nested repositories
+  GCIndex* index = [self.repository readRepositoryIndex:NULL];
+  NSArray* files = [cache findUntrackedFilesInRepository:self.repository usingIndex:index error:NULL];
+  NSArray* expectedFiles = @[ @".gitignore", @"a/b/untracked.txt", @"a/file.txt", @"c/", @"untracked.txt" ];
+  XCTAssertEqualObjects([files sortedArrayUsingSelector:@selector(compare:)], expectedFiles);
+  [self _assertDiffUsingCache:cache];
+  __block BOOL written = NO;
+  [cache writeInBackgroundIfNeeded:^(BOOL success, NSError* error) {
+    XCTAssertTrue(success);
+    written = YES;
+  }];
+  while (!written) {
+    [[NSRunLoop mainRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+  }
+  XCTAssertTrue([[NSFileManager defaultManager] fileExistsAtPath:cachePath]);
+
+  // Check unchanged directories are not scanned again once past the racy interval
+  sleep(1);
+  cache = [[GCUntrackedCache alloc] initWithPath:cachePath];
+  XCTAssertGreaterThan(cache.count, 0);
+  [self _assertDiffUsingCache:cache];
+  files = [cache findUntrackedFilesInRepository:self.repository usingIndex:index error:NULL];
+  XCTAssertEqualObjects([files sortedArrayUsingSelector:@selector(compare:)], expectedFiles);
+#if DEBUG
+  XCTAssertEqual(cache.scannedDirectoryCount, 0);
+#endif
+
+  // Check rescanning racy directories that didn't change doesn't write the cache again
+  XCTAssertTrue([[NSFileManager defaultManager] removeItemAtPath:cachePath error:NULL]);
+  written = NO;
+  [cache writeInBackgroundIfNeeded:^(BOOL success, NSError* error) {
+    XCTAssertTrue(success);
+    written = YES;
+  }];
+  while (!written) {
+    [[NSRunLoop mainRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+  }
+  XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:cachePath]);
+
+  // Check adding and deleting untracked files
+  [self updateFileAtPath:@"a/b/new.txt" withString:@"new\n"];
+  [self deleteFileAtPath:@"untracked.txt"];
+  [self _assertDiffUsingCache:cache];
+
+  // Check editing ignore rules
+  [self updateFileAtPath:@".gitignore" withString:@"*.txt\n"];
+  [self _assertDiffUsingCache:cache];
+  [self updateFileAtPath:@"a/.gitignore" withString:@"!*.txt\n"];
+  [self _assertDiffUsingCache:cache];
+  [self deleteFileAtPath:@".gitignore"];
+  [self deleteFileAtPath:@"a/.gitignore"];
+  [self _assertDiffUsingCache:cache];
+
+  // Check staging files
+  index = [self.repository readRepositoryIndex:NULL];
+  XCTAssertTrue([self.repository addFileInWorkingDirectory:@"a/b/new.txt" toIndex:index error:NULL]);
+  XCTAssertTrue([self.repository writeRepositoryIndex:index error:NULL]);
+  [self _assertDiffUsingCache:cache];
+  files = [cache findUntrackedFilesInRepository:self.repository usingIndex:[self.repository readRepositoryIndex:NULL] error:NULL];
+  XCTAssertFalse([files containsObject:@"a/b/new.txt"]);
+
+  // Check file system monitor tokens let unreported directories be trusted
+  sleep(1);
+  cache.fileSystemMonitorToken = @"token";
+  [self _assertDiffUsingCache:cache];
+  [self updateFileAtPath:@"a/monitored.txt" withString:@"monitored\n"];
+  files = [cache findUntrackedFilesInRepository:self.repository usingIndex:[self.repository readRepositoryIndex:NULL] error:NULL];
+  XCTAssertFalse([files containsObject:@"a/monitored.txt"]);
+  [cache invalidateDirectory:@"a/"];
+  files = [cache findUntrackedFilesInRepository:self.repository usingIndex:[self.repository readRepositoryIndex:NULL] error:NULL];
+  XCTAssertTrue([files containsObject:@"a/monitored.txt"]);
+#if DEBUG
+  XCTAssertEqual(cache.scannedDirectoryCount, 1);
+#endif
+
+  [[NSFileManager defaultManager] removeItemAtPath:cachePath error:NULL];
+}
+
+@end
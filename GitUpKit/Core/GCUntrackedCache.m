@@ -0,0 +1,509 @@
+//  Copyright (C) 2015-2019 Pierre-Olivier Latour <info@pol-online.net>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#if !__has_feature(objc_arc)
+#error This file requires ARC
+#endif
+
+#import <dirent.h>
+#import <sys/stat.h>
+
+#import "GCPrivate.h"
+
+// Follows the approach of the untracked cache extension of Git indexes: directories whose modification time, ".gitignore" file and entries in the index
+// are unchanged since they were last scanned still contain the same untracked files
+#define kVersion 1
+#define kRacyInterval 1000000000  // Directories modified less than a second before being scanned (in nanoseconds) must be scanned again as their modification time may not change for further changes
+#define kHashOffset 0xcbf29ce484222325
+#define kHashPrime 0x100000001b3
+#define kSubmoduleHashSalt 0x9e3779b97f4a7c15
+
+#define kVersionKey @"version"
+#define kExcludeStampKey @"exclude"
+#define kIndexChecksumKey @"index"
+#define kDirectoriesKey @"directories"
+
+@interface GCUntrackedDirectory : NSObject
+@property(nonatomic) int64_t modificationTime;  // In nanoseconds - 0 if the directory must be scanned again
+@property(nonatomic) uint64_t ignoreFileStamp;  // 0 if there is no ".gitignore" file in the directory
+@property(nonatomic) uint64_t indexHash;  // Hash of the names of the index entries directly in the directory
+@property(nonatomic, strong) NSArray* files;  // Names of untracked files and nested repositories (with a trailing slash)
+@property(nonatomic, strong) NSArray* directories;  // Names of the subdirectories to visit i.e. not ignored, not submodules and not nested repositories
+@end
+
+@implementation GCUntrackedDirectory
+
+- (instancetype)initWithPropertyList:(id)plist {
+  if (![plist isKindOfClass:[NSArray class]] || ([plist count] != 5)) {
+    return nil;
+  }
+  if ((self = [super init])) {
+    _modificationTime = [plist[0] longLongValue];
+    _ignoreFileStamp = (uint64_t)[plist[1] longLongValue];
+    _indexHash = (uint64_t)[plist[2] longLongValue];
+    _files = plist[3];
+    _directories = plist[4];
+    if (![_files isKindOfClass:[NSArray class]] || ![_directories isKindOfClass:[NSArray class]]) {
+      return nil;
+    }
+  }
+  return self;
+}
+
+- (id)propertyList {
+  return @[ @(_modificationTime), @((int64_t)_ignoreFileStamp), @((int64_t)_indexHash), _files, _directories ];
+}
+
+// Ignores modification times so rescanning a racy directory that didn't change doesn't require writing the cache again
+- (BOOL)hasSameContentsAsDirectory:(GCUntrackedDirectory*)directory {
+  return (_ignoreFileStamp == directory.ignoreFileStamp) && (_indexHash == directory.indexHash) && [_files isEqualToArray:directory.files] && [_directories isEqualToArray:directory.directories];
+}
+
+@end
+
+static inline int64_t _ModificationTime(const struct stat* info) {
+#if defined(__APPLE__)
+  return (int64_t)info->st_mtimespec.tv_sec * 1000000000 + info->st_mtimespec.tv_nsec;
+#else
+  return (int64_t)info->st_mtim.tv_sec * 1000000000 + info->st_mtim.tv_nsec;
+#endif
+}
+
+static uint64_t _FileStamp(NSString* path) {
+  struct stat info;
+  if (lstat(path.fileSystemRepresentation, &info)) {
+    return 0;
+  }
+  return ((uint64_t)_ModificationTime(&info) * kHashPrime) ^ ((uint64_t)info.st_size << 32) ^ (uint64_t)info.st_ino;
+}
+
+// FNV-1a - Hashes of the names are added together so the result doesn't depend on the order of the entries
+static inline uint64_t _HashName(const char* name, size_t length, BOOL submodule) {
+  uint64_t hash = kHashOffset;
+  for (size_t i = 0; i < length; ++i) {
+    hash ^= (unsigned char)name[i];
+    hash *= kHashPrime;
+  }
+  return submodule ? hash ^ kSubmoduleHashSalt : hash;
+}
+
+static uint64_t* _AddIndexDirectory(NSMutableDictionary* hashes, const char* path, size_t length) {
+  NSString* directory = [[NSString alloc] initWithBytes:path length:length encoding:NSUTF8StringEncoding];
+  if (directory == nil) {
+    return NULL;
+  }
+  NSMutableData* data = hashes[directory];
+  if (data == nil) {
+    data = [[NSMutableData alloc] initWithLength:sizeof(uint64_t)];
+    hashes[directory] = data;
+    if (length) {  // Subdirectories are part of the hash of their parent directory
+      size_t parentLength = length - 1;
+      while (parentLength && (path[parentLength - 1] != '/')) {
+        --parentLength;
+      }
+      uint64_t* parentHash = _AddIndexDirectory(hashes, path, parentLength);
+      if (parentHash == NULL) {
+        return NULL;
+      }
+      *parentHash += _HashName(&path[parentLength], length - parentLength, NO);
+    }
+  }
+  return data.mutableBytes;
+}
+
+// Returns the hashes of the entries directly in each directory of the index (as NSData wrapping a uint64_t) keyed by directory path with a trailing slash (empty for the root)
+static NSDictionary* _HashIndex(git_index* index) {
+  NSMutableDictionary* hashes = [[NSMutableDictionary alloc] init];
+  const char* directoryPath = NULL;
+  size_t directoryLength = 0;
+  uint64_t* directoryHash = NULL;
+  for (size_t i = 0, count = git_index_entrycount(index); i < count; ++i) {
+    const git_index_entry* entry = git_index_get_byindex(index, i);
+    const char* separator = strrchr(entry->path, '/');
+    size_t length = separator ? separator - entry->path + 1 : 0;
+    if ((directoryHash == NULL) || (length != directoryLength) || strncmp(entry->path, directoryPath, length)) {
+      directoryHash = _AddIndexDirectory(hashes, entry->path, length);
+      if (directoryHash == NULL) {
+        return nil;
+      }
+      directoryPath = entry->path;
+      directoryLength = length;
+    }
+    *directoryHash += _HashName(&entry->path[length], strlen(&entry->path[length]), entry->mode == GIT_FILEMODE_COMMIT);
+  }
+  return hashes;
+}
+
+// Lists the names of the index entries directly in the directory and returns their hash which matches the one from _HashIndex()
+static uint64_t _ListIndexDirectory(git_index* index, BOOL icase, const char* prefix, NSMutableSet* files, NSMutableSet* submodules, NSMutableSet* directories) {
+  uint64_t hash = 0;
+  size_t prefixLength = strlen(prefix);
+  size_t position = 0;
+  if (prefixLength && (git_index_find_prefix(&position, index, prefix) != GIT_OK)) {
+    return 0;
+  }
+  const char* lastDirectory = NULL;
+  size_t lastDirectoryLength = 0;
+  for (size_t count = git_index_entrycount(index); position < count; ++position) {
+    const git_index_entry* entry = git_index_get_byindex(index, position);
+    if (icase ? strncasecmp(entry->path, prefix, prefixLength) : strncmp(entry->path, prefix, prefixLength)) {
+      break;
+    }
+    const char* name = &entry->path[prefixLength];
+    const char* separator = strchr(name, '/');
+    if (separator) {
+      size_t length = separator - name + 1;
+      if (lastDirectory && (length == lastDirectoryLength) && !strncmp(name, lastDirectory, length)) {  // Entries in the same subdirectory are contiguous
+        continue;
+      }
+      lastDirectory = name;
+      lastDirectoryLength = length;
+      hash += _HashName(name, length, NO);
+      NSString* string = [[NSString alloc] initWithBytes:name length:(length - 1) encoding:NSUTF8StringEncoding];
+      if (string) {
+        [directories addObject:(icase ? string.lowercaseString : string)];
+      }
+    } else {
+      BOOL submodule = (entry->mode == GIT_FILEMODE_COMMIT);
+      hash += _HashName(name, strlen(name), submodule);
+      NSString* string = GCFileSystemPathFromGitPath(name);
+      if (string) {
+        [(submodule ? submodules : files) addObject:(icase ? string.lowercaseString : string)];
+      }
+    }
+  }
+  return hash;
+}
+
+static BOOL _IsPathIgnored(git_repository* repository, NSString* path) {
+  int ignored = 0;
+  int status = git_ignore_path_is_ignored(&ignored, repository, GCGitPathFromFileSystemPath(path));
+  if (status != GIT_OK) {
+    LOG_LIBGIT2_ERROR(status);
+    return NO;
+  }
+  return ignored ? YES : NO;
+}
+
+// Covers the exclude files that apply to the whole working directory as well as the configuration which defines the global one
+static NSString* _ExcludeStamp(git_repository* repository) {
+  NSString* gitDirectoryPath = GCFileSystemPathFromGitPath(git_repository_path(repository));
+  NSMutableArray* paths = [[NSMutableArray alloc] init];
+  [paths addObject:[gitDirectoryPath stringByAppendingPathComponent:@"info/exclude"]];
+  [paths addObject:[gitDirectoryPath stringByAppendingPathComponent:@"config"]];
+  git_config* config;
+  if (git_repository_config(&config, repository) == GIT_OK) {
+    git_buf buffer = {0};
+    if (git_config_get_path(&buffer, config, "core.excludesfile") == GIT_OK) {
+      NSString* path = GCFileSystemPathFromGitPath(buffer.ptr);
+      if (path) {
+        [paths addObject:path];
+      }
+      git_buf_free(&buffer);
+    } else {
+      const char* configHome = getenv("XDG_CONFIG_HOME");
+      [paths addObject:(configHome ? [@(configHome) stringByAppendingPathComponent:@"git/ignore"] : [NSHomeDirectory() stringByAppendingPathComponent:@".config/git/ignore"])];
+    }
+    git_config_free(config);
+  }
+  NSMutableString* stamp = [[NSMutableString alloc] init];
+  for (NSString* path in paths) {
+    [stamp appendFormat:@"%@:%llu\n", path, _FileStamp(path)];
+  }
+  return stamp;
+}
+
+@implementation GCUntrackedCache {
+  NSString* _path;
+  NSString* _excludeStamp;
+  NSData* _indexChecksum;
+  NSMutableDictionary* _directories;  // Keyed by working directory relative path with a trailing slash (empty for the root)
+  NSMutableSet* _invalidatedDirectories;
+  NSString* _validatedToken;  // File system monitor token at the time the directories were last validated
+  BOOL _dirty;
+
+  git_repository* _repository;  // Only valid while finding untracked files
+  git_index* _index;
+  BOOL _icase;
+  NSString* _workingDirectoryPath;
+  NSDictionary* _indexHashes;  // Nil if the index is unchanged
+  BOOL _trusted;
+  int64_t _scanTime;
+  NSMutableSet* _visitedDirectories;
+  NSMutableArray* _untrackedFiles;
+}
+
+- (instancetype)initWithPath:(NSString*)path {
+  if ((self = [super init])) {
+    _path = [path copy];
+    _directories = [[NSMutableDictionary alloc] init];
+    _invalidatedDirectories = [[NSMutableSet alloc] init];
+    NSData* data = path ? [NSData dataWithContentsOfFile:path] : nil;
+    if (data && ![self _loadData:data]) {
+      XLOG_WARNING(@"Ignoring invalid untracked cache at \"%@\"", _path);
+      [_directories removeAllObjects];
+    }
+  }
+  return self;
+}
+
+- (BOOL)_loadData:(NSData*)data {
+  NSDictionary* plist = [NSPropertyListSerialization propertyListWithData:data options:NSPropertyListImmutable format:NULL error:NULL];
+  if (![plist isKindOfClass:[NSDictionary class]] || ([plist[kVersionKey] integerValue] != kVersion)) {
+    return NO;
+  }
+  NSString* excludeStamp = plist[kExcludeStampKey];
+  NSData* indexChecksum = plist[kIndexChecksumKey];
+  NSDictionary* directories = plist[kDirectoriesKey];
+  if (![excludeStamp isKindOfClass:[NSString class]] || ![indexChecksum isKindOfClass:[NSData class]] || ![directories isKindOfClass:[NSDictionary class]]) {
+    return NO;
+  }
+  for (NSString* directory in directories) {
+    GCUntrackedDirectory* entry = [[GCUntrackedDirectory alloc] initWithPropertyList:directories[directory]];
+    if (![directory isKindOfClass:[NSString class]] || (entry == nil)) {
+      return NO;
+    }
+    _directories[directory] = entry;
+  }
+  _excludeStamp = excludeStamp;
+  _indexChecksum = indexChecksum;
+  return YES;
+}
+
+- (NSUInteger)count {
+  return _directories.count;
+}
+
+- (void)invalidateDirectory:(NSString*)directory {
+  [_invalidatedDirectories addObject:directory];
+}
+
+- (GCUntrackedDirectory*)_scanDirectory:(NSString*)directory atPath:(NSString*)path {
+  DIR* dir = opendir(path.fileSystemRepresentation);
+  if (dir == NULL) {
+    return nil;
+  }
+  NSMutableSet* trackedFiles = [[NSMutableSet alloc] init];
+  NSMutableSet* trackedSubmodules = [[NSMutableSet alloc] init];
+  NSMutableSet* trackedDirectories = [[NSMutableSet alloc] init];
+  GCUntrackedDirectory* entry = [[GCUntrackedDirectory alloc] init];
+  entry.indexHash = _ListIndexDirectory(_index, _icase, GCGitPathFromFileSystemPath(directory), trackedFiles, trackedSubmodules, trackedDirectories);
+  NSMutableArray* files = [[NSMutableArray alloc] init];
+  NSMutableArray* directories = [[NSMutableArray alloc] init];
+  struct dirent* item;
+  while ((item = readdir(dir))) {
+    if (!strcmp(item->d_name, ".") || !strcmp(item->d_name, "..") || !strcasecmp(item->d_name, ".git")) {
+      continue;
+    }
+    NSString* name = [NSString stringWithUTF8String:item->d_name];
+    if (name == nil) {
+      continue;
+    }
+    NSString* key = _icase ? name.lowercaseString : name;
+    int type = item->d_type;
+    if (type == DT_UNKNOWN) {
+      struct stat info;
+      if (lstat([path stringByAppendingString:name].fileSystemRepresentation, &info)) {
+        continue;
+      }
+      type = S_ISDIR(info.st_mode) ? DT_DIR : (S_ISREG(info.st_mode) ? DT_REG : (S_ISLNK(info.st_mode) ? DT_LNK : DT_UNKNOWN));
+    }
+    if (type == DT_DIR) {
+      if ([trackedSubmodules containsObject:key]) {
+        continue;
+      }
+      if ([trackedDirectories containsObject:key]) {
+        [directories addObject:name];
+        continue;
+      }
+      if (_IsPathIgnored(_repository, [directory stringByAppendingFormat:@"%@/", name])) {
+        continue;
+      }
+      struct stat info;
+      if (!lstat([path stringByAppendingFormat:@"%@/.git", name].fileSystemRepresentation, &info)) {  // Like libgit2, don't recurse into nested repositories
+        [files addObject:[name stringByAppendingString:@"/"]];
+      } else {
+        [directories addObject:name];
+      }
+    } else if ((type == DT_REG) || (type == DT_LNK)) {  // Like libgit2, skip other types of files
+      if ([trackedFiles containsObject:key] || [trackedSubmodules containsObject:key] || _IsPathIgnored(_repository, [directory stringByAppendingString:name])) {
+        continue;
+      }
+      [files addObject:name];
+    }
+  }
+  closedir(dir);
+  [files sortUsingSelector:@selector(compare:)];
+  [directories sortUsingSelector:@selector(compare:)];
+  entry.files = files;
+  entry.directories = directories;
+  return entry;
+}
+
+- (void)_visitDirectory:(NSString*)directory force:(BOOL)force {
+  [_visitedDirectories addObject:directory];
+  GCUntrackedDirectory* entry = _directories[directory];
+  BOOL scan = force || (entry == nil) || (entry.modificationTime == 0) || [_invalidatedDirectories containsObject:directory];
+  if (_indexHashes) {
+    NSData* data = _indexHashes[directory];
+    if ((data ? *(const uint64_t*)data.bytes : 0) != entry.indexHash) {
+      scan = YES;
+    }
+  }
+  BOOL forceSubdirectories = force;
+  if (scan || !_trusted) {  // Directories not reported as changed by the file system monitor are trusted without checking them
+    NSString* path = [_workingDirectoryPath stringByAppendingString:directory];
+    struct stat info;
+    if (lstat(path.fileSystemRepresentation, &info) || !S_ISDIR(info.st_mode)) {
+      [_visitedDirectories removeObject:directory];
+      return;
+    }
+    int64_t modificationTime = _ModificationTime(&info);
+    uint64_t ignoreFileStamp = _FileStamp([path stringByAppendingString:@".gitignore"]);
+    if (modificationTime != entry.modificationTime) {
+      scan = YES;
+    }
+    if (ignoreFileStamp != entry.ignoreFileStamp) {  // Ignore rules apply to all subdirectories
+      scan = YES;
+      forceSubdirectories = YES;
+    }
+    if (scan) {
+      GCUntrackedDirectory* scannedEntry = [self _scanDirectory:directory atPath:path];
+      if (scannedEntry == nil) {
+        [_visitedDirectories removeObject:directory];
+        return;
+      }
+      scannedEntry.modificationTime = modificationTime + kRacyInterval > _scanTime ? 0 : modificationTime;
+      scannedEntry.ignoreFileStamp = ignoreFileStamp;
+      if ((entry == nil) || ![scannedEntry hasSameContentsAsDirectory:entry]) {
+        _dirty = YES;
+      }
+      entry = scannedEntry;
+      _directories[directory] = entry;
+#if DEBUG
+      _scannedDirectoryCount += 1;
+#endif
+    }
+  }
+  for (NSString* name in entry.files) {
+    [_untrackedFiles addObject:[directory stringByAppendingString:name]];
+  }
+  for (NSString* name in entry.directories) {
+    [self _visitDirectory:[directory stringByAppendingFormat:@"%@/", name] force:forceSubdirectories];
+  }
+}
+
+- (NSArray*)findUntrackedFilesInRepository:(GCRepository*)repository usingIndex:(GCIndex*)index error:(NSError**)error {
+  const char* workingDirectoryPath = git_repository_workdir(repository.private);
+  if (workingDirectoryPath == NULL) {
+    GC_SET_GENERIC_ERROR(@"Repository has no working directory");
+    return nil;
+  }
+  _repository = repository.private;
+  _index = index.private;
+  _icase = git_index_caps(_index) & GIT_INDEX_CAPABILITY_IGNORE_CASE ? YES : NO;
+  _workingDirectoryPath = GCFileSystemPathFromGitPath(workingDirectoryPath);
+  _trusted = _fileSystemMonitorToken && [_validatedToken isEqualToString:_fileSystemMonitorToken];
+  _visitedDirectories = [[NSMutableSet alloc] init];
+  _untrackedFiles = [[NSMutableArray alloc] init];
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  _scanTime = (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+#if DEBUG
+  _scannedDirectoryCount = 0;
+#endif
+
+  NSString* excludeStamp = _ExcludeStamp(_repository);
+  if (![excludeStamp isEqualToString:_excludeStamp]) {
+    [_directories removeAllObjects];
+    _excludeStamp = excludeStamp;
+    _dirty = YES;
+  }
+  const git_oid* checksum = git_index_checksum(_index);
+  NSData* indexChecksum = checksum && !git_oid_is_zero(checksum) ? [NSData dataWithBytes:checksum length:sizeof(git_oid)] : nil;  // In-memory indexes have no checksum
+  if ((indexChecksum == nil) || ![indexChecksum isEqualToData:_indexChecksum]) {
+    _indexHashes = _HashIndex(_index);
+    if (_indexHashes == nil) {
+      [_directories removeAllObjects];
+    }
+  }
+
+  [self _visitDirectory:@"" force:NO];
+  for (NSString* directory in _directories.allKeys) {
+    if (![_visitedDirectories containsObject:directory]) {
+      [_directories removeObjectForKey:directory];
+      _dirty = YES;
+    }
+  }
+  if ((indexChecksum || _indexChecksum) && ![indexChecksum isEqualToData:_indexChecksum]) {
+    _indexChecksum = indexChecksum;
+    _dirty = YES;
+  }
+  [_invalidatedDirectories removeAllObjects];
+  _validatedToken = _fileSystemMonitorToken;
+  NSArray* untrackedFiles = _untrackedFiles;
+
+  _repository = NULL;
+  _index = NULL;
+  _workingDirectoryPath = nil;
+  _indexHashes = nil;
+  _visitedDirectories = nil;
+  _untrackedFiles = nil;
+  return untrackedFiles;
+}
+
+// The property list is built on the calling thread as entries are replaced but never modified so serializing and writing it can happen in the background
+- (void)writeInBackgroundIfNeeded:(void (^)(BOOL success, NSError* error))completion {
+  static dispatch_queue_t queue = NULL;
+  static dispatch_once_t onceToken;
+  dispatch_once(&onceToken, ^{
+    queue = dispatch_queue_create(NULL, DISPATCH_QUEUE_SERIAL);
+  });
+  if ((_path == nil) || !_dirty) {
+    if (completion) {
+      dispatch_async(dispatch_get_main_queue(), ^{
+        completion(YES, nil);
+      });
+    }
+    return;
+  }
+  NSMutableDictionary* directories = [[NSMutableDictionary alloc] initWithCapacity:_directories.count];
+  for (NSString* directory in _directories) {
+    directories[directory] = [_directories[directory] propertyList];
+  }
+  NSDictionary* plist = @{
+    kVersionKey : @(kVersion),
+    kExcludeStampKey : _excludeStamp ?: @"",
+    kIndexChecksumKey : _indexChecksum ?: [NSData data],
+    kDirectoriesKey : directories
+  };
+  NSString* path = _path;
+  _dirty = NO;  // Don't write the cache again until it changes even if the write fails
+  dispatch_async(queue, ^{
+    NSError* error;
+    NSData* data = [NSPropertyListSerialization dataWithPropertyList:plist format:NSPropertyListBinaryFormat_v1_0 options:0 error:&error];
+    BOOL success = data && [data writeToFile:path options:NSDataWritingAtomic error:&error];
+    if (!success) {
+      XLOG_ERROR(@"Failed writing untracked cache to \"%@\": %@", path, error);
+    }
+    if (completion) {
+      dispatch_async(dispatch_get_main_queue(), ^{
+        completion(success, error);
+      });
+    }
+  });
+}
+
+@end
@@ -178,7 +178,8 @@ typedef NS_ENUM(NSUInteger, ReplayMode) {
                           NSMutableArray* parents = [[NSMutableArray alloc] init];
                           GCHistoryCommit* ancestorCommit = nil;
                           GCCommit* tipCommit = nil;
-                          for (GCHistoryCommit* parent in commit.parents) {
+                          for (NSUInteger i = 0, count = commit.parentCount; i < count; ++i) {
+                            GCHistoryCommit* parent = [commit parentAtIndex:i];
                             GCCommit* newParent = CFDictionaryGetValue(mapping, (__bridge const void*)parent);
                             if ((__bridge void*)newParent != kCFNull) {
                               if (newParent) {
@@ -184,7 +184,9 @@
     while (1) {
       // Iterate over commits from list
       GC_POINTER_LIST_FOR_LOOP(skipList, GCHistoryCommit*, commit) {
-        for (GCHistoryCommit* parent in commit.parents) {
+        for (NSUInteger i = 0, count = commit.parentCount; i < count; ++i) {
+          GCHistoryCommit* parent = [commit parentAtIndex:i];
+
           // Check if commit was already skipped
           if (COMMIT_SKIPPED(parent)) {
             continue;
@@ -200,7 +202,8 @@
             if (!(_options & kGIGraphOption_SkipStaleBranchTips) || (parent.timeIntervalSinceReferenceDate >= staleTime)) {
               if (parent.localBranches) {
                 BOOL resuscitate = YES;
-                for (GCHistoryCommit* child in parent.children) {
+                for (NSUInteger j = 0, childCount = parent.childCount; j < childCount; ++j) {
+                  GCHistoryCommit* child = [parent childAtIndex:j];
                   if (!COMMIT_SKIPPED(child)) {
                     resuscitate = NO;
                     break;
@@ -213,7 +216,8 @@
               }
               if (parent.remoteBranches && !(_options & kGIGraphOption_SkipStandaloneRemoteBranchTips)) {
                 BOOL resuscitate = YES;
-                for (GCHistoryCommit* child in parent.children) {
+                for (NSUInteger j = 0, childCount = parent.childCount; j < childCount; ++j) {
+                  GCHistoryCommit* child = [parent childAtIndex:j];
                   if (!COMMIT_SKIPPED(child)) {
                     resuscitate = NO;
                     break;
@@ -234,7 +238,8 @@
 
           // A commit can be skipped if all its children are skipped
           BOOL skip = YES;
-          for (GCHistoryCommit* child in parent.children) {
+          for (NSUInteger j = 0, childCount = parent.childCount; j < childCount; ++j) {
+            GCHistoryCommit* child = [parent childAtIndex:j];
             skip = COMMIT_SKIPPED(child);
             if (!skip) {
               break;
@@ -305,7 +310,8 @@
       if (!commit.leaf) {
         // If skipping commits, a tip is ready only if all its children are skipped
         if (skipped) {
-          for (GCHistoryCommit* child in commit.children) {
+          for (NSUInteger j = 0, childCount = commit.childCount; j < childCount; ++j) {
+            GCHistoryCommit* child = [commit childAtIndex:j];
             if (!COMMIT_SKIPPED(child)) {
               ready = NO;
               break;
@@ -345,7 +351,8 @@
 
           // Check if this commit is "ready" to be a node i.e. all its children have non-dummy nodes associated (but not on the current layer)
           BOOL ready = YES;
-          for (GCHistoryCommit* child in commit.children) {
+          for (NSUInteger j = 0, childCount = commit.childCount; j < childCount; ++j) {
+            GCHistoryCommit* child = [commit childAtIndex:j];
             if (skipped && COMMIT_SKIPPED(child)) {
               continue;
             }
@@ -389,12 +396,12 @@
         }
         // Otherwise process its parent commit(s)
         else {
-          NSUInteger index = 0;
-          for (GCHistoryCommit* parent in commit.parents) {
+          for (NSUInteger i = 0, count = commit.parentCount; i < count; ++i) {
+            GCHistoryCommit* parent = [commit parentAtIndex:i];
             XLOG_DEBUG_CHECK(!skipped || !COMMIT_SKIPPED(parent));
             GINode* node = MAP_COMMIT_TO_NODE(parent);  // Check if commit has already been processed
             GILine* parentLine = line;
-            if (index) {  // Start a new line if not the first parent
+            if (i) {  // Start a new line if not the first parent
               GILine* newLine = [[GILine alloc] initWithBranch:line.branch];
               [_lines addObject:newLine];
 
@@ -410,7 +417,6 @@
               [previousNode addParent:nodeBlock(parentLine, parent, commit)];
             }
             [layer addLine:parentLine];
-            ++index;
           }
 
           // Cache node if it has references
@@ -526,7 +532,7 @@
     XLOG_DEBUG_CHECK(node.layer);
     XLOG_DEBUG_CHECK(node.primaryLine);
     XLOG_DEBUG_CHECK(node.commit);
-    XLOG_DEBUG_CHECK((node.dummy && (node.parentCount == 1)) || (!node.dummy && (node.parentCount == node.commit.parents.count)));
+    XLOG_DEBUG_CHECK((node.dummy && (node.parentCount == 1)) || (!node.dummy && (node.parentCount == node.commit.parentCount)));
   }
 
   // Validate lines
@@ -542,7 +548,7 @@
       if (i2 == 0) {
         XLOG_DEBUG_CHECK(node.commit.hasReferences || node.commit.leaf || (node.primaryLine == line.childLine) || [_history.HEADCommit isEqualToCommit:node.commit]);
       } else if (i2 == count2 - 1) {
-        XLOG_DEBUG_CHECK(node.commit.root || (node.primaryLine == line.parentLine));
+        XLOG_DEBUG_CHECK(node.commit.root || node.commit.boundary || (node.primaryLine == line.parentLine));
       } else {
         XLOG_DEBUG_CHECK(node.primaryLine == line);
       }
@@ -621,7 +627,14 @@
         ++index;
         nextNode = nodes[index];
       } while (nextNode.dummy);
-      XLOG_DEBUG_CHECK([node.commit.parents containsObject:nextNode.commit]);
+      BOOL isParent = NO;
+      for (NSUInteger j = 0, parentCount = node.commit.parentCount; j < parentCount; ++j) {
+        if ([node.commit parentAtIndex:j] == nextNode.commit) {
+          isParent = YES;
+          break;
+        }
+      }
+      XLOG_DEBUG_CHECK(isParent);
     }
     XLOG_DEBUG_CHECK(![(GINode*)line.nodes.lastObject isDummy]);
   }
@@ -642,7 +655,8 @@
   for (GCHistoryCommit* commit in _history.allCommits) {
     GINode* node = MAP_COMMIT_TO_NODE(commit);
     if (node) {
-      for (GCHistoryCommit* childCommit in commit.children) {
+      for (NSUInteger j = 0, childCount = commit.childCount; j < childCount; ++j) {
+        GCHistoryCommit* childCommit = [commit childAtIndex:j];
         GINode* childNode = MAP_COMMIT_TO_NODE(childCommit);
         if (childNode) {
           XLOG_DEBUG_CHECK(childNode.layer.y < node.layer.y);
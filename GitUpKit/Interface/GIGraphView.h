@@ -21,6 +21,8 @@
 - (void)graphViewDidChangeSelection:(GIGraphView*)graphView;
 - (void)graphView:(GIGraphView*)graphView didDoubleClickOnNode:(GINode*)node;
 - (NSMenu*)graphView:(GIGraphView*)graphView willShowContextualMenuForNode:(GINode*)node;
+@optional
+- (void)graphViewDidScrollToEnd:(GIGraphView*)graphView;  // Called once per graph when its last layer is drawn e.g. to load older commits
 @end
 
 @interface GIGraphView : NSView <NSUserInterfaceValidations>
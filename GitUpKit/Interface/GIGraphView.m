@@ -90,6 +90,7 @@ static const void* _associatedObjectDataKey = &_associatedObjectDataKey;
 
 @implementation GIGraphView {
   NSDateFormatter* _dateFormatter;
+  BOOL _endReached;
 }
 
 #pragma mark Initialization
@@ -206,6 +207,7 @@ static const void* _associatedObjectDataKey = &_associatedObjectDataKey;
     _selectedNode = nil;
     [_graph autorelease];
     _graph = [graph retain];
+    _endReached = NO;
 
     [self _updateView];
 
@@ -570,8 +572,8 @@ static const void* _associatedObjectDataKey = &_associatedObjectDataKey;
 
 static void _DrawNode(GINode* node, CGContextRef context, CGFloat x, CGFloat y) {
   BOOL onBranchMainLine = node.primaryLine.branchMainLine;
-  NSUInteger childrenCount = node.commit.children.count;
-  NSUInteger parentCount = node.commit.parents.count;
+  NSUInteger childrenCount = node.commit.childCount;
+  NSUInteger parentCount = node.commit.parentCount;
   if ((childrenCount > 1) || (parentCount > 1)) {
     CGColorRef color = onBranchMainLine ? node.primaryLine.color.CGColor : [[NSColor darkGrayColor] CGColor];
     CGFloat diameter = onBranchMainLine ? kMainLineNodeLargeDiameter : kSubNodeDiameter;
@@ -1470,6 +1472,14 @@ static void _DrawSelectedNode(CGContextRef context, CGFloat x, CGFloat y, GINode
   CGFloat offset = _graph.size.height;
   NSMutableSet* lines = [[NSMutableSet alloc] init];
 
+  // Notify delegate asynchronously as it might replace the graph
+  if (layerCount && (endIndex >= layerCount - 1) && !_endReached && [_delegate respondsToSelector:@selector(graphViewDidScrollToEnd:)]) {
+    _endReached = YES;
+    dispatch_async(dispatch_get_main_queue(), ^{
+      [_delegate graphViewDidScrollToEnd:self];
+    });
+  }
+
   // Cache attributes
   static NSDictionary* tagAttributes = nil;
   if (tagAttributes == nil) {
@@ -54,5 +54,6 @@
 - (void)repositoryHistoryDidUpdate;  // Default implementation does nothing
 - (void)repositoryStashesDidUpdate;  // Default implementation does nothing
 - (void)repositoryStatusDidUpdate;  // Default implementation does nothing
+- (void)repositoryStatusDidUpdateWithChanges:(NSDictionary*)changes;  // Receives the user info of GCLiveRepositoryStatusDidUpdateNotification - Default implementation calls -repositoryStatusDidUpdate
 - (void)repositorySnapshotsDidUpdate;  // Default implementation does nothing
 @end
@@ -79,8 +79,8 @@
     if (OVERRIDES_METHOD(repositoryStashesDidUpdate)) {
       [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(repositoryStashesDidUpdate) name:GCLiveRepositoryStashesDidUpdateNotification object:_repository];
     }
-    if (OVERRIDES_METHOD(repositoryStatusDidUpdate)) {
-      [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(repositoryStatusDidUpdate) name:GCLiveRepositoryStatusDidUpdateNotification object:_repository];
+    if (OVERRIDES_METHOD(repositoryStatusDidUpdate) || OVERRIDES_METHOD(repositoryStatusDidUpdateWithChanges:)) {
+      [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(_repositoryStatusDidUpdate:) name:GCLiveRepositoryStatusDidUpdateNotification object:_repository];
     }
     if (OVERRIDES_METHOD(repositorySnapshotsDidUpdate)) {
       [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(repositorySnapshotsDidUpdate) name:GCLiveRepositorySnapshotsDidUpdateNotification object:_repository];
@@ -109,7 +109,7 @@
   if (OVERRIDES_METHOD(repositoryStashesDidUpdate)) {
     [[NSNotificationCenter defaultCenter] removeObserver:self name:GCLiveRepositoryStashesDidUpdateNotification object:self.repository];
   }
-  if (OVERRIDES_METHOD(repositoryStatusDidUpdate)) {
+  if (OVERRIDES_METHOD(repositoryStatusDidUpdate) || OVERRIDES_METHOD(repositoryStatusDidUpdateWithChanges:)) {
     [[NSNotificationCenter defaultCenter] removeObserver:self name:GCLiveRepositoryStatusDidUpdateNotification object:self.repository];
   }
   if (OVERRIDES_METHOD(repositorySnapshotsDidUpdate)) {
@@ -313,10 +313,18 @@ static NSView* _PreferredFirstResponder(NSView* containerView) {
   ;
 }
 
+- (void)_repositoryStatusDidUpdate:(NSNotification*)notification {
+  [self repositoryStatusDidUpdateWithChanges:notification.userInfo];
+}
+
 - (void)repositoryStatusDidUpdate {
   ;
 }
 
+- (void)repositoryStatusDidUpdateWithChanges:(NSDictionary*)changes {
+  [self repositoryStatusDidUpdate];
+}
+
 - (void)repositorySnapshotsDidUpdate {
   ;
 }
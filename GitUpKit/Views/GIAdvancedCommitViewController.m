@@ -112,11 +112,11 @@
   self.repository.statusMode = kGCLiveRepositoryStatusMode_Disabled;
 }
 
-- (void)repositoryStatusDidUpdate {
-  [super repositoryStatusDidUpdate];
+- (void)repositoryStatusDidUpdateWithChanges:(NSDictionary*)changes {
+  [super repositoryStatusDidUpdateWithChanges:changes];
 
   if (self.viewVisible) {
-    [self _reloadContents];
+    [self _reloadContentsWithChanges:changes];
   }
 }
 
@@ -125,6 +125,10 @@
 }
 
 - (void)_reloadContents {
+  [self _reloadContentsWithChanges:nil];
+}
+
+- (void)_reloadContentsWithChanges:(NSDictionary*)changes {
   CGFloat offset;
   GCDiffDelta* topDelta = [_diffContentsViewController topVisibleDelta:&offset];
   NSArray* selectedWorkdirDeltas = _workdirFilesViewController.selectedDeltas;
@@ -134,17 +138,29 @@
 
   _disableFeedback = YES;
 
+  GCDiffChangeSet* workdirChanges = changes[GCLiveRepositoryStatusWorkingDirectoryChangesKey];
+  GCDiffChangeSet* indexChanges = changes[GCLiveRepositoryStatusIndexChangesKey];
+  if ([changes[GCLiveRepositoryStatusConflictsChangedKey] boolValue]) {
+    workdirChanges = nil;
+    indexChanges = nil;
+  }
+  if (workdirChanges.fromDiff != _workdirStatus) {  // Changes only apply to the deltas currently displayed
+    workdirChanges = nil;
+  }
+  if (indexChanges.fromDiff != _indexStatus) {
+    indexChanges = nil;
+  }
   _workdirStatus = self.repository.workingDirectoryStatus;
   _indexStatus = self.repository.indexStatus;
   _indexConflicts = self.repository.indexConflicts;
 
-  [_workdirFilesViewController setDeltas:_workdirStatus.deltas usingConflicts:_indexConflicts];
+  [_workdirFilesViewController setDeltas:_workdirStatus.deltas usingConflicts:_indexConflicts changes:workdirChanges];
   _workdirFilesViewController.selectedDeltas = selectedWorkdirDeltas;
   if (_workdirStatus.deltas.count && selectedWorkdirDeltas.count && !_workdirFilesViewController.selectedDeltas.count && (selectedWorkdirRow != NSNotFound)) {
     _workdirFilesViewController.selectedDelta = _workdirStatus.deltas[MIN(selectedWorkdirRow, _workdirStatus.deltas.count - 1)];  // If we can't preserve the selected deltas, attempt to preserve the first selected row
   }
 
-  [_indexFilesViewController setDeltas:_indexStatus.deltas usingConflicts:_indexConflicts];
+  [_indexFilesViewController setDeltas:_indexStatus.deltas usingConflicts:_indexConflicts changes:indexChanges];
   _indexFilesViewController.selectedDeltas = selectedIndexDeltas;
   if (_indexStatus.deltas.count && selectedIndexDeltas.count && !_indexFilesViewController.selectedDeltas.count && (selectedIndexRow != NSNotFound)) {
     _indexFilesViewController.selectedDelta = _indexStatus.deltas[MIN(selectedIndexRow, _indexStatus.deltas.count - 1)];  // If we can't preserve the selected deltas, attempt to preserve the first selected row
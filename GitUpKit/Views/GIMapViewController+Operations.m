@@ -683,17 +683,17 @@ static inline GIAlertType _AlertTypeForDangerousRemoteOperations() {
     GCHistoryCommit* fromCommit = [self.repository.history historyCommitForCommit:baseCommit];
     XLOG_DEBUG_CHECK(fromCommit);
     if ([fromCommit isEqualToCommit:commit]) {  // We are trying to rebase onto an ancestor so use branch point instead of common ancestor to rebase from
-      GCHistoryCommit* parentCommit = branch.tipCommit.parents.firstObject;
+      GCHistoryCommit* parentCommit = branch.tipCommit.parentCount ? [branch.tipCommit parentAtIndex:0] : nil;
       while (parentCommit) {
         if ([parentCommit isEqualToCommit:commit]) {
           [self.windowController showOverlayWithStyle:kGIOverlayStyle_Warning format:NSLocalizedString(@"The \"%@\" branch cannot be rebased onto one of its commits", nil), branch.name];
           return;
         }
-        if (parentCommit.children.count > 1) {
+        if (parentCommit.childCount > 1) {
           fromCommit = parentCommit;
           break;
         }
-        parentCommit = parentCommit.parents.firstObject;
+        parentCommit = parentCommit.parentCount ? [parentCommit parentAtIndex:0] : nil;
       }
     } else {
       XLOG_DEBUG_CHECK(![fromCommit isEqualToCommit:branch.tipCommit]);
@@ -280,6 +280,12 @@
   }
 }
 
+- (void)graphViewDidScrollToEnd:(GIGraphView*)graphView {
+  if (!_previewHistory && !self.repository.history.complete) {
+    [self.repository extendHistory];  // Map is reloaded through the history update notification
+  }
+}
+
 - (NSMenu*)graphView:(GIGraphView*)graphView willShowContextualMenuForNode:(GINode*)node {
   NSMenuItem* item;
   NSMenu* submenu;
@@ -821,11 +827,10 @@
       break;
 
     case NSOrderedSame: {  // Selected and HEAD commits have the exact same date
-      NSError* error;
-      GCCommitRelation relation = [self.repository findRelationOfCommit:selectedCommit relativeToCommit:headCommit error:&error];
+      GCCommitRelation relation = [self.repository.history findRelationOfCommit:selectedCommit relativeToCommit:headCommit];
       switch (relation) {
         case kGCCommitRelation_Unknown:
-          [self presentError:error];
+          XLOG_DEBUG_UNREACHABLE();
           break;
 
         case kGCCommitRelation_Identical:  // Selected and HEAD commits are the same
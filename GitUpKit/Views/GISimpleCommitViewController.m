@@ -88,22 +88,30 @@
   self.repository.statusMode = kGCLiveRepositoryStatusMode_Disabled;
 }
 
-- (void)repositoryStatusDidUpdate {
-  [super repositoryStatusDidUpdate];
+- (void)repositoryStatusDidUpdateWithChanges:(NSDictionary*)changes {
+  [super repositoryStatusDidUpdateWithChanges:changes];
 
   if (self.viewVisible) {
-    [self _reloadContents];
+    [self _reloadContentsWithChanges:changes];
   }
 }
 
 - (void)_reloadContents {
+  [self _reloadContentsWithChanges:nil];
+}
+
+- (void)_reloadContentsWithChanges:(NSDictionary*)changes {
   CGFloat offset;
   GCDiffDelta* topDelta = [_diffContentsViewController topVisibleDelta:&offset];
 
+  GCDiffChangeSet* unifiedChanges = changes[GCLiveRepositoryStatusUnifiedChangesKey];
+  if ((unifiedChanges.fromDiff != _unifiedStatus) || [changes[GCLiveRepositoryStatusConflictsChangedKey] boolValue]) {  // Changes only apply to the deltas currently displayed
+    unifiedChanges = nil;
+  }
   _unifiedStatus = self.repository.unifiedStatus;
   _indexConflicts = self.repository.indexConflicts;
-  [_diffContentsViewController setDeltas:_unifiedStatus.deltas usingConflicts:_indexConflicts];
-  [_diffFilesViewController setDeltas:_unifiedStatus.deltas usingConflicts:_indexConflicts];
+  [_diffContentsViewController setDeltas:_unifiedStatus.deltas usingConflicts:_indexConflicts changes:unifiedChanges];
+  [_diffFilesViewController setDeltas:_unifiedStatus.deltas usingConflicts:_indexConflicts changes:unifiedChanges];
 
   [_diffContentsViewController setTopVisibleDelta:topDelta offset:offset];
 